@@ -14,6 +14,7 @@
 
 #import "BITHockeyHelper.h"
 #import "BITHockeyAppClient.h"
+#import "BITEventBufferDump.h"
 
 #import <sys/sysctl.h>
 #import <objc/runtime.h>
@@ -39,6 +40,9 @@ static BITCrashManagerCallbacks bitCrashCallbacks = {
 
 // proxy implementation for PLCrashReporter to keep our interface stable while this can change
 static void plcr_post_crash_callback (siginfo_t * __unused info, ucontext_t * __unused uap, void *context) {
+  // Save the telemetry items that have not been persisted yet, they are the ones leading up to the crash
+  bit_eventBufferDumpWrite();
+  
   if (bitCrashCallbacks.handleSignal != NULL)
     bitCrashCallbacks.handleSignal(context);
 }
@@ -130,7 +134,7 @@ __attribute__((noreturn)) static void uncaught_cxx_exception_handler(const BITCr
     _askUserDetails = YES;
     
     _plcrExceptionHandler = nil;
-    _crashCallBacks = nil;
+    _crashCallBacks = &plCrashCallbacks;
     _crashIdenticalCurrentVersion = YES;
     
     _timeintervalCrashInLastSessionOccured = -1;
@@ -796,10 +800,8 @@ __attribute__((noreturn)) static void uncaught_cxx_exception_handler(const BITCr
       // get the current top level error handler
       NSUncaughtExceptionHandler *initialHandler = NSGetUncaughtExceptionHandler();
       
-      // set any user defined callbacks, hopefully the users knows what they do
-      if (self.crashCallBacks) {
-        [self.plCrashReporter setCrashCallbacks:self.crashCallBacks];
-      }
+      // set our proxy callbacks, which also call any user defined callbacks, hopefully the users knows what they do
+      [self.plCrashReporter setCrashCallbacks:self.crashCallBacks];
       
       // Enable the Crash Reporter
       BOOL crashReporterEnabled = [self.plCrashReporter enableCrashReporterAndReturnError:&error];
@@ -27,6 +27,143 @@ typedef NS_ENUM(NSUInteger, BITLogLevel) {
   BITLogLevelVerbose = 4
 };
 
+/**
+ *  Determines what happens to stored telemetry data once the storage budget of the metrics module is used up.
+ */
+typedef NS_ENUM(NSUInteger, BITTelemetryEvictionPolicy) {
+  /**
+   *  Nothing is evicted, new events are dropped until stored data has been sent
+   */
+  BITTelemetryEvictionPolicyNone = 0,
+  /**
+   *  The oldest stored batches are evicted to make room for new ones. Batches with session events are only evicted to
+   *  make room for other batches with session events, like under every policy that evicts
+   */
+  BITTelemetryEvictionPolicyOldestFirst = 1,
+  /**
+   *  Batches without session events are evicted before batches with session events, oldest first
+   */
+  BITTelemetryEvictionPolicyLowestPriorityFirst = 2,
+  /**
+   *  The oldest stored batches are evicted and, while the storage is more than half full, only every fourth session
+   *  event is kept
+   */
+  BITTelemetryEvictionPolicySampleSessionState = 3
+};
+
+/**
+ *  Determines what happens to telemetry events that are tracked faster than the metrics module can process them.
+ */
+typedef NS_ENUM(NSUInteger, BITTelemetryOverflowPolicy) {
+  /**
+   *  The oldest events waiting to be processed are dropped to make room for new ones
+   */
+  BITTelemetryOverflowPolicyDropOldest = 0,
+  /**
+   *  New events are dropped until there is room again
+   */
+  BITTelemetryOverflowPolicyDropNewest = 1,
+  /**
+   *  The tracking call blocks until there is room again. Don't use this if events are tracked on the main thread
+   */
+  BITTelemetryOverflowPolicyBlock = 2
+};
+
+/**
+ *  Determines how batches of telemetry events are stored until they are sent.
+ */
+typedef NS_ENUM(NSUInteger, BITTelemetryBatchFormat) {
+  /**
+   *  Batches are stored as compressed JSON, the way they are sent
+   */
+  BITTelemetryBatchFormatJSON = 0,
+  /**
+   *  Batches are stored in a compact binary format that is only rendered to JSON when they are sent. Events of a batch
+   *  that hasn't been stored yet are lost if the app crashes
+   */
+  BITTelemetryBatchFormatBinary = 1
+};
+
+/**
+ *  The counters of the telemetry pipeline, see BITTelemetryPipelineSnapshot.
+ */
+typedef NS_ENUM(NSUInteger, BITTelemetryCounter) {
+  /**
+   *  Events, session state and other items handed to the metrics manager
+   */
+  BITTelemetryCounterItemsTracked = 0,
+  /**
+   *  Events that were sampled out or rolled up into an aggregate instead of being enqueued
+   */
+  BITTelemetryCounterEventsSampledOrAggregated = 1,
+  /**
+   *  Items enqueued in the channel
+   */
+  BITTelemetryCounterItemsEnqueued = 2,
+  /**
+   *  Items dropped because they were tracked faster than they could be processed
+   */
+  BITTelemetryCounterItemsDroppedOnOverflow = 3,
+  /**
+   *  Items dropped because the channel was blocked by a full storage
+   */
+  BITTelemetryCounterItemsDroppedWhileBlocked = 4,
+  /**
+   *  Batches the channel has completed and handed to the storage
+   */
+  BITTelemetryCounterBatchesFlushed = 5,
+  /**
+   *  Batches that have been compressed before they were stored
+   */
+  BITTelemetryCounterBatchesCompressed = 6,
+  /**
+   *  Batches written to disk
+   */
+  BITTelemetryCounterBatchesPersisted = 7,
+  /**
+   *  Bytes of batches written to disk
+   */
+  BITTelemetryCounterBytesPersisted = 8,
+  /**
+   *  Requests sent to the server
+   */
+  BITTelemetryCounterRequestsSent = 9,
+  /**
+   *  Bytes of the bodies of requests sent to the server
+   */
+  BITTelemetryCounterBytesSent = 10,
+  /**
+   *  Batches that will be sent again because their request failed
+   */
+  BITTelemetryCounterBatchesRetried = 11,
+  /**
+   *  Batches deleted after the server has accepted them
+   */
+  BITTelemetryCounterBatchesDeleted = 12
+};
+
+/**
+ *  The stages of the telemetry pipeline whose durations are recorded, see BITTelemetryPipelineSnapshot.
+ */
+typedef NS_ENUM(NSUInteger, BITTelemetryStage) {
+  /**
+   *  Serializing an item and appending it to the current batch
+   */
+  BITTelemetryStageSerialization = 0,
+  /**
+   *  Compressing a completed batch
+   */
+  BITTelemetryStageCompression = 1,
+  /**
+   *  Writing a batch to disk
+   */
+  BITTelemetryStagePersistence = 2,
+  /**
+   *  Sending a request until its response has arrived
+   */
+  BITTelemetryStageRequest = 3
+};
+
 typedef NSString *(^BITLogMessageProvider)(void);
 typedef void (^BITLogHandler)(BITLogMessageProvider messageProvider, BITLogLevel logLevel, const char *file, const char *function, uint line);
 
@@ -19,6 +19,8 @@
 #import "BITFeedbackWindowController.h"
 
 #import "BITMetricsManager.h"
+#import "BITBatchingPolicy.h"
+#import "BITTelemetryPipelineSnapshot.h"
 
 // Notification message which HockeyManager is listening to, to retry requesting updated from the server
 #define BITHockeyNetworkDidBecomeReachableNotification @"BITHockeyNetworkDidBecomeReachable"
@@ -12,6 +12,14 @@
     return dict;
 }
 
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *)writer {
+    [super serializeMembersToJSONWriter:writer];
+    if (self.baseType != nil) {
+        bit_jsonWriterKey(writer, "baseType");
+        bit_jsonWriterNSString(writer, self.baseType);
+    }
+}
+
 #pragma mark - NSCoding
 
 - (instancetype)initWithCoder:(NSCoder *)coder {
@@ -0,0 +1,132 @@
+#import <Foundation/Foundation.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Decides when the telemetry items collected in memory are written to disk as a batch. Every batch is stored in a
+ *  file of its own and sent in a request of its own.
+ *
+ *  Times are seconds on a monotonic clock, e.g. `-[NSProcessInfo systemUptime]`. A policy is only called by one thread
+ *  at a time, but not always by the same one.
+ */
+@protocol BITBatchingPolicy <NSObject>
+
+/**
+ *  Called after an item has been added to the current batch.
+ *
+ *  @param itemCount the number of items in the batch, including the new one
+ *  @param length the uncompressed length of the batch in bytes, including the new item
+ *  @param time the time the item has been added
+ *
+ *  @return YES if the batch should be persisted right away
+ */
+- (BOOL)shouldPersistBatchWithItemCount:(NSUInteger)itemCount length:(NSUInteger)length addedAt:(NSTimeInterval)time;
+
+/**
+ *  Called when the first item has been added to a new batch.
+ *
+ *  @param time the time the batch has been started
+ *
+ *  @return the number of seconds after which the batch is persisted, even if it is not complete
+ */
+- (NSTimeInterval)flushIntervalForBatchStartedAt:(NSTimeInterval)time;
+
+@optional
+
+/**
+ *  Called after a batch has been compressed to be persisted.
+ *
+ *  @param itemCount the number of items in the batch
+ *  @param length the uncompressed length of the batch in bytes
+ *  @param compressedLength the length of the batch as it is stored and uploaded
+ */
+- (void)didPersistBatchWithItemCount:(NSUInteger)itemCount length:(NSUInteger)length compressedLength:(NSUInteger)compressedLength;
+
+@end
+
+/**
+ *  Persists a batch once it contains a fixed number of items or a fixed interval has passed since its first item was
+ *  added. This is the default policy.
+ */
+@interface BITFixedBatchingPolicy : NSObject <BITBatchingPolicy>
+
+/**
+ *  Initializes a policy.
+ *
+ *  @param maxBatchSize the number of items a batch is persisted at
+ *  @param batchInterval the number of seconds after which an incomplete batch is persisted
+ *
+ *  @return the policy
+ */
+- (instancetype)initWithMaxBatchSize:(NSUInteger)maxBatchSize batchInterval:(NSTimeInterval)batchInterval NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Initializes a policy with a batch size of 50 items and an interval of 15 seconds.
+ */
+- (instancetype)init;
+
+/**
+ *  The number of items a batch is persisted at.
+ */
+@property (nonatomic, assign, readonly) NSUInteger maxBatchSize;
+
+/**
+ *  The number of seconds after which an incomplete batch is persisted.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval batchInterval;
+
+@end
+
+/**
+ *  Sizes batches by bytes instead of items and adapts the flush interval to the rate items arrive at.
+ *
+ *  A batch is persisted once its compressed length is expected to reach `targetCompressedLength`. The compression
+ *  ratio is learned from the batches that have been persisted. The flush interval is the time it takes to fill a batch
+ *  at the observed arrival rate, limited to `minimumFlushInterval` and `maximumFlushInterval`. Apps that track few
+ *  events write fewer, fuller files, apps that track many events don't write lots of small ones.
+ */
+@interface BITAdaptiveBatchingPolicy : NSObject <BITBatchingPolicy>
+
+/**
+ *  The compressed length a batch should have, in bytes.
+ *
+ *  Default: 32 KB
+ */
+@property (nonatomic, assign) NSUInteger targetCompressedLength;
+
+/**
+ *  The uncompressed length at which a batch is persisted regardless of the expected compressed length, in bytes. Keeps
+ *  batches well below the size of the in-memory buffer.
+ *
+ *  Default: 256 KB
+ */
+@property (nonatomic, assign) NSUInteger maximumLength;
+
+/**
+ *  The shortest flush interval in seconds, used while items arrive fast.
+ *
+ *  Default: 15
+ */
+@property (nonatomic, assign) NSTimeInterval minimumFlushInterval;
+
+/**
+ *  The longest flush interval in seconds, used while items arrive slowly.
+ *
+ *  Default: 300
+ */
+@property (nonatomic, assign) NSTimeInterval maximumFlushInterval;
+
+/**
+ *  The current estimate of the time between two items, in seconds.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval averageArrivalInterval;
+
+/**
+ *  The current estimate of the compression ratio, uncompressed length divided by compressed length.
+ */
+@property (nonatomic, assign, readonly) double averageCompressionRatio;
+
+@end
+
+NS_ASSUME_NONNULL_END
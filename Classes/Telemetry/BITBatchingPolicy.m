@@ -0,0 +1,119 @@
+#import "BITBatchingPolicy.h"
+
+static NSUInteger const BITDefaultMaxBatchSize = 50;
+static NSTimeInterval const BITDefaultBatchInterval = 15;
+
+static NSUInteger const BITDefaultTargetCompressedLength = 32 * 1024;
+static NSUInteger const BITDefaultMaximumLength = 256 * 1024;
+static NSTimeInterval const BITDefaultMinimumFlushInterval = 15;
+static NSTimeInterval const BITDefaultMaximumFlushInterval = 300;
+
+// Estimates used until the first items have been observed. Envelopes compress well, but the ratio is underestimated
+// on purpose, so the first batches rather end up too small than too large.
+static NSTimeInterval const BITInitialArrivalInterval = 1;
+static double const BITInitialCompressionRatio = 4;
+
+// Weights of a new sample in the moving averages. Arrival intervals are noisy, so they change the estimate slowly.
+static double const BITArrivalIntervalWeight = 0.125;
+static double const BITItemLengthWeight = 0.125;
+static double const BITCompressionRatioWeight = 0.25;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@implementation BITFixedBatchingPolicy
+
+- (instancetype)initWithMaxBatchSize:(NSUInteger)maxBatchSize batchInterval:(NSTimeInterval)batchInterval {
+  if ((self = [super init])) {
+    _maxBatchSize = maxBatchSize > 0 ? maxBatchSize : BITDefaultMaxBatchSize;
+    _batchInterval = batchInterval > 0 ? batchInterval : BITDefaultBatchInterval;
+  }
+  return self;
+}
+
+- (instancetype)init {
+  return [self initWithMaxBatchSize:BITDefaultMaxBatchSize batchInterval:BITDefaultBatchInterval];
+}
+
+- (BOOL)shouldPersistBatchWithItemCount:(NSUInteger)itemCount length:(NSUInteger) __unused length addedAt:(NSTimeInterval) __unused time {
+  return itemCount >= self.maxBatchSize;
+}
+
+- (NSTimeInterval)flushIntervalForBatchStartedAt:(NSTimeInterval) __unused time {
+  return self.batchInterval;
+}
+
+@end
+
+@interface BITAdaptiveBatchingPolicy ()
+
+@property (nonatomic, assign) NSTimeInterval averageArrivalInterval;
+@property (nonatomic, assign) double averageCompressionRatio;
+@property (nonatomic, assign) double averageItemLength;
+@property (nonatomic, assign) NSTimeInterval lastArrivalTime;
+@property (nonatomic, assign) NSUInteger lastBatchLength;
+@property (nonatomic, assign) BOOL hasArrival;
+
+@end
+
+@implementation BITAdaptiveBatchingPolicy
+
+- (instancetype)init {
+  if ((self = [super init])) {
+    _targetCompressedLength = BITDefaultTargetCompressedLength;
+    _maximumLength = BITDefaultMaximumLength;
+    _minimumFlushInterval = BITDefaultMinimumFlushInterval;
+    _maximumFlushInterval = BITDefaultMaximumFlushInterval;
+    _averageArrivalInterval = BITInitialArrivalInterval;
+    _averageCompressionRatio = BITInitialCompressionRatio;
+  }
+  return self;
+}
+
+- (BOOL)shouldPersistBatchWithItemCount:(NSUInteger)itemCount length:(NSUInteger)length addedAt:(NSTimeInterval)time {
+  if (self.hasArrival) {
+
+    // Gaps longer than the longest flush interval make no difference for the interval, so they are capped. Otherwise a
+    // single night without events would take hours of events to be forgotten.
+    NSTimeInterval interval = MIN(MAX(time - self.lastArrivalTime, 0), self.maximumFlushInterval);
+    self.averageArrivalInterval += BITArrivalIntervalWeight * (interval - self.averageArrivalInterval);
+  }
+  self.hasArrival = YES;
+  self.lastArrivalTime = time;
+
+  // The length of the new item is the difference to the length of the batch before it was added.
+  NSUInteger itemLength = itemCount > 1 && length > self.lastBatchLength ? length - self.lastBatchLength : length;
+  self.lastBatchLength = length;
+  if (self.averageItemLength > 0) {
+    self.averageItemLength += BITItemLengthWeight * ((double)itemLength - self.averageItemLength);
+  } else {
+    self.averageItemLength = (double)itemLength;
+  }
+
+  return length >= self.maximumLength || (double)length >= [self targetLength];
+}
+
+- (NSTimeInterval)flushIntervalForBatchStartedAt:(NSTimeInterval) __unused time {
+  double itemsPerBatch = [self targetLength] / MAX(self.averageItemLength, 1.0);
+  NSTimeInterval interval = itemsPerBatch * self.averageArrivalInterval;
+  return MIN(MAX(interval, self.minimumFlushInterval), MAX(self.maximumFlushInterval, self.minimumFlushInterval));
+}
+
+- (void)didPersistBatchWithItemCount:(NSUInteger) __unused itemCount length:(NSUInteger)length compressedLength:(NSUInteger)compressedLength {
+  self.lastBatchLength = 0;
+  if (length == 0 || compressedLength == 0) {
+    return;
+  }
+  double ratio = (double)length / (double)compressedLength;
+  self.averageCompressionRatio += BITCompressionRatioWeight * (ratio - self.averageCompressionRatio);
+}
+
+/**
+ *  The uncompressed length a batch is expected to reach the target compressed length at.
+ */
+- (double)targetLength {
+  return MIN((double)self.targetCompressedLength * self.averageCompressionRatio, (double)self.maximumLength);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
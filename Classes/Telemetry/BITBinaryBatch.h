@@ -0,0 +1,139 @@
+#import <Foundation/Foundation.h>
+#import "BITEventRecord.h"
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A compact binary format for persisted telemetry batches, which is rendered to x-json-stream only when the batch is
+ *  sent. Tracked events are stored as their fields instead of their JSON, so the cost of rendering them is only paid
+ *  for batches that are actually sent, and the strings repeated in every event, names, keys, the iKey and the tags,
+ *  are stored once per batch.
+ *
+ *  A batch is laid out as follows, integers marked varint are unsigned LEB128:
+ *
+ *      batch   := "BITB" version:u8 record* table trailer
+ *      record  := kind:u8 length:varint payload[length]
+ *      table   := count:varint (length:varint bytes[length])*
+ *      trailer := tableOffset:u32le itemCount:u32le checksum:u32le "BITE"
+ *
+ *  Records of kind 0 hold a serialized item. Records of kind 1 hold an event:
+ *
+ *      event   := time:varint sampleRate:f64le iKey:ref tags:ref name:ref
+ *                 propertyCount:varint (key:ref value:ref)* measurementCount:varint (key:ref value:f64le)*
+ *
+ *  The time is in milliseconds since 1970, zigzag encoded, a sample rate of 0 means the event hasn't been sampled. A
+ *  ref is a varint, 0 for no string, 2 * (index + 1) for a string of the table and 2 * length + 1 for a string of that
+ *  many bytes that follows inline. Strings of the table are JSON fragments: names, keys and the iKey as quoted and
+ *  escaped strings and the tags as an object, so rendering only copies them. Inline strings are plain UTF-8.
+ *
+ *  The checksum is the CRC-32 of everything before it. The table and the trailer follow the records, so a batch is
+ *  written in a single pass and a reader that maps the file finds everything without reading it twice.
+ */
+typedef struct BITBinaryBatchWriter BITBinaryBatchWriter;
+
+/**
+ *  Creates a writer with an empty batch.
+ *
+ *  @param capacity the initial number of bytes reserved for the batch, it grows as needed
+ *
+ *  @return the writer or NULL if memory could not be allocated
+ */
+BITBinaryBatchWriter *_Nullable bit_binaryBatchWriterCreate(size_t capacity);
+
+/**
+ *  Frees the writer.
+ *
+ *  @param writer the writer, may be NULL
+ */
+void bit_binaryBatchWriterDestroy(BITBinaryBatchWriter *_Nullable writer);
+
+/**
+ *  Discards the current batch and starts a new one, keeping the memory.
+ *
+ *  @param writer the writer
+ */
+void bit_binaryBatchWriterReset(BITBinaryBatchWriter *writer);
+
+/**
+ *  Appends an item that has already been serialized.
+ *
+ *  @param writer the writer
+ *  @param bytes the JSON of the item
+ *  @param length the number of bytes
+ *
+ *  @return false if memory could not be allocated, the batch is unchanged then
+ */
+bool bit_binaryBatchWriterAppendJSON(BITBinaryBatchWriter *writer, const char *bytes, size_t length);
+
+/**
+ *  Appends an event.
+ *
+ *  @param writer the writer
+ *  @param record the event, which must not hold an object
+ *  @param appIdentifier the iKey of the event, may be NULL
+ *  @param tags the serialized tags object of the event, NULL for no tags
+ *  @param tagsLength the number of bytes of the tags
+ *
+ *  @return false if memory could not be allocated, the batch is unchanged then
+ */
+bool bit_binaryBatchWriterAppendEventRecord(BITBinaryBatchWriter *writer, const BITEventRecord *record, CFStringRef _Nullable appIdentifier, const char *_Nullable tags, size_t tagsLength);
+
+/**
+ *  Returns the number of items in the current batch.
+ *
+ *  @param writer the writer
+ *
+ *  @return the number of items
+ */
+uint32_t bit_binaryBatchWriterItemCount(const BITBinaryBatchWriter *writer);
+
+/**
+ *  Returns the number of bytes the current batch takes once it is finished.
+ *
+ *  @param writer the writer
+ *
+ *  @return the length of the batch
+ */
+size_t bit_binaryBatchWriterLength(const BITBinaryBatchWriter *writer);
+
+/**
+ *  Finishes the current batch and starts a new one.
+ *
+ *  @param writer the writer
+ *
+ *  @return the batch or nil if it is empty or memory could not be allocated
+ */
+NSData *_Nullable bit_binaryBatchWriterFinish(BITBinaryBatchWriter *writer);
+
+/**
+ *  Returns whether data starts like a binary batch.
+ *
+ *  @param bytes the data, may be NULL if length is 0
+ *  @param length the number of bytes
+ *
+ *  @return true if the data is a binary batch
+ */
+bool bit_isBinaryBatch(const void *_Nullable bytes, size_t length);
+
+/**
+ *  Reads the number of items of a binary batch from its trailer.
+ *
+ *  @param batch the batch
+ *  @param itemCount set to the number of items
+ *
+ *  @return false if the data is not a binary batch or damaged
+ */
+bool bit_binaryBatchItemCount(NSData *batch, uint64_t *itemCount);
+
+/**
+ *  Renders a binary batch to x-json-stream, one item per line, in the same way the channel serializes items into JSON
+ *  batches. Use a mapped NSData to read the batch straight from its file.
+ *
+ *  @param batch the batch
+ *
+ *  @return the rendered batch or nil if the batch is damaged
+ */
+NSData *_Nullable bit_renderBinaryBatch(NSData *batch);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,612 @@
+#import "BITBinaryBatch.h"
+#import <math.h>
+#import <stdlib.h>
+#import <string.h>
+#import <zlib.h>
+
+static char const BITBinaryBatchMagic[4] = {'B', 'I', 'T', 'B'};
+static char const BITBinaryBatchTrailerMagic[4] = {'B', 'I', 'T', 'E'};
+static uint8_t const BITBinaryBatchVersion = 1;
+static size_t const BITBinaryBatchHeaderLength = 5;
+static size_t const BITBinaryBatchTrailerLength = 16;
+
+// The length of a record is written in front of it once it is known, room for the longest varint of a 32-bit length
+// is left and the payload moved back afterwards.
+static size_t const BITMaxRecordLengthVarintLength = 5;
+
+typedef NS_ENUM(uint8_t, BITBinaryBatchRecordKind) {
+  BITBinaryBatchRecordKindJSON = 0,
+  BITBinaryBatchRecordKindEvent = 1
+};
+
+typedef struct {
+  uint8_t *bytes;
+  size_t length;
+  size_t capacity;
+  bool failed;
+} BITByteBuffer;
+
+typedef struct {
+  uint32_t generation;
+  uint32_t index;
+} BITBinaryBatchTableSlot;
+
+struct BITBinaryBatchWriter {
+  BITByteBuffer records;
+  BITByteBuffer table;
+  uint32_t tableCount;
+  uint32_t itemCount;
+
+  // The table index of every interned string by its identifier, only valid if it has been set for the current
+  // generation. The generation changes with every batch, so the slots never have to be cleared.
+  BITBinaryBatchTableSlot *slots;
+  size_t slotCount;
+  uint32_t generation;
+
+  // Most events have the iKey and the tags of the event before, so those are compared with the last ones instead of
+  // being looked up.
+  CFStringRef _Nullable appIdentifier;
+  uint64_t appIdentifierRef;
+  uint64_t tagsRef;
+  size_t tagsOffset;
+  size_t tagsLength;
+
+  BITJSONWriter *scratch;
+};
+
+#pragma mark - Encoding
+
+static bool bit_byteBufferReserve(BITByteBuffer *buffer, size_t additionalLength) {
+  if (buffer->failed) {
+    return false;
+  }
+  if (buffer->capacity - buffer->length >= additionalLength) {
+    return true;
+  }
+  size_t capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+  while (capacity - buffer->length < additionalLength) {
+    if (capacity > SIZE_MAX / 2) {
+      buffer->failed = true;
+      return false;
+    }
+    capacity *= 2;
+  }
+  uint8_t *bytes = realloc(buffer->bytes, capacity);
+  if (!bytes) {
+    buffer->failed = true;
+    return false;
+  }
+  buffer->bytes = bytes;
+  buffer->capacity = capacity;
+  return true;
+}
+
+static void bit_byteBufferAppend(BITByteBuffer *buffer, const void *bytes, size_t length) {
+  if (length > 0 && bit_byteBufferReserve(buffer, length)) {
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+  }
+}
+
+static size_t bit_encodeVarint(uint64_t value, uint8_t *bytes) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    bytes[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (uint8_t)value;
+  return length;
+}
+
+static void bit_byteBufferAppendVarint(BITByteBuffer *buffer, uint64_t value) {
+  uint8_t bytes[10];
+  bit_byteBufferAppend(buffer, bytes, bit_encodeVarint(value, bytes));
+}
+
+static void bit_byteBufferAppendUInt32(BITByteBuffer *buffer, uint32_t value) {
+  uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  bit_byteBufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+static void bit_byteBufferAppendDouble(BITByteBuffer *buffer, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint8_t bytes[8];
+  for (size_t i = 0; i < sizeof(bytes); i++) {
+    bytes[i] = (uint8_t)(bits >> (8 * i));
+  }
+  bit_byteBufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+#pragma mark - Writer
+
+BITBinaryBatchWriter *bit_binaryBatchWriterCreate(size_t capacity) {
+  BITBinaryBatchWriter *writer = calloc(1, sizeof(BITBinaryBatchWriter));
+  if (!writer) {
+    return NULL;
+  }
+  writer->scratch = bit_jsonWriterCreate(64);
+  if (!writer->scratch || !bit_byteBufferReserve(&writer->records, capacity > 0 ? capacity : 1)) {
+    bit_binaryBatchWriterDestroy(writer);
+    return NULL;
+  }
+  bit_binaryBatchWriterReset(writer);
+  return writer;
+}
+
+void bit_binaryBatchWriterDestroy(BITBinaryBatchWriter *writer) {
+  if (!writer) {
+    return;
+  }
+  if (writer->appIdentifier) {
+    CFRelease(writer->appIdentifier);
+  }
+  bit_jsonWriterDestroy(writer->scratch);
+  free(writer->records.bytes);
+  free(writer->table.bytes);
+  free(writer->slots);
+  free(writer);
+}
+
+// Forgets which strings are in the table, e.g. because the table has been cleared or cut back.
+static void bit_binaryBatchWriterForgetTable(BITBinaryBatchWriter *writer) {
+  writer->generation++;
+  if (writer->generation == 0) {
+    memset(writer->slots, 0, writer->slotCount * sizeof(BITBinaryBatchTableSlot));
+    writer->generation = 1;
+  }
+  if (writer->appIdentifier) {
+    CFRelease(writer->appIdentifier);
+    writer->appIdentifier = NULL;
+  }
+  writer->appIdentifierRef = 0;
+  writer->tagsRef = 0;
+}
+
+void bit_binaryBatchWriterReset(BITBinaryBatchWriter *writer) {
+  writer->records.length = 0;
+  writer->records.failed = false;
+  writer->table.length = 0;
+  writer->table.failed = false;
+  writer->tableCount = 0;
+  writer->itemCount = 0;
+  bit_binaryBatchWriterForgetTable(writer);
+  bit_byteBufferAppend(&writer->records, BITBinaryBatchMagic, sizeof(BITBinaryBatchMagic));
+  bit_byteBufferAppend(&writer->records, &BITBinaryBatchVersion, 1);
+}
+
+static uint64_t bit_binaryBatchWriterAddTableString(BITBinaryBatchWriter *writer, const char *bytes, size_t length) {
+  bit_byteBufferAppendVarint(&writer->table, length);
+  bit_byteBufferAppend(&writer->table, bytes, length);
+  return 2 * ((uint64_t)writer->tableCount++ + 1);
+}
+
+static uint64_t bit_binaryBatchWriterEntryRef(BITBinaryBatchWriter *writer, const BITStringTableEntry *entry) {
+  if (entry->identifier >= writer->slotCount) {
+    size_t slotCount = writer->slotCount > 0 ? writer->slotCount : 256;
+    while (slotCount <= entry->identifier) {
+      slotCount *= 2;
+    }
+    BITBinaryBatchTableSlot *slots = realloc(writer->slots, slotCount * sizeof(BITBinaryBatchTableSlot));
+    if (!slots) {
+
+      // Without a slot the string is still stored, just not shared with other events of the batch.
+      return bit_binaryBatchWriterAddTableString(writer, entry->json, entry->jsonLength);
+    }
+    memset(slots + writer->slotCount, 0, (slotCount - writer->slotCount) * sizeof(BITBinaryBatchTableSlot));
+    writer->slots = slots;
+    writer->slotCount = slotCount;
+  }
+  BITBinaryBatchTableSlot *slot = &writer->slots[entry->identifier];
+  if (slot->generation != writer->generation) {
+    slot->index = (uint32_t)(bit_binaryBatchWriterAddTableString(writer, entry->json, entry->jsonLength) / 2 - 1);
+    slot->generation = writer->generation;
+  }
+  return 2 * ((uint64_t)slot->index + 1);
+}
+
+static void bit_binaryBatchWriterAppendString(BITBinaryBatchWriter *writer, const BITEventRecord *record, BITEventRecordString string) {
+  if (string.entry) {
+    bit_byteBufferAppendVarint(&writer->records, bit_binaryBatchWriterEntryRef(writer, (const BITStringTableEntry *)string.entry));
+  } else {
+    bit_byteBufferAppendVarint(&writer->records, 2 * (uint64_t)string.length + 1);
+    bit_byteBufferAppend(&writer->records, bit_eventRecordStringBytes(record, string), string.length);
+  }
+}
+
+static uint64_t bit_binaryBatchWriterAppIdentifierRef(BITBinaryBatchWriter *writer, CFStringRef _Nullable appIdentifier) {
+  if (!appIdentifier) {
+    return 0;
+  }
+  if (writer->appIdentifier && CFEqual(writer->appIdentifier, appIdentifier)) {
+    return writer->appIdentifierRef;
+  }
+  BITJSONWriter *scratch = writer->scratch;
+  bit_jsonWriterReset(scratch);
+  bit_jsonWriterNSString(scratch, (__bridge NSString *)appIdentifier);
+  if (bit_jsonWriterHasFailed(scratch)) {
+    writer->table.failed = true;
+    return 0;
+  }
+  if (writer->appIdentifier) {
+    CFRelease(writer->appIdentifier);
+  }
+  writer->appIdentifier = CFStringCreateCopy(kCFAllocatorDefault, appIdentifier);
+  writer->appIdentifierRef = bit_binaryBatchWriterAddTableString(writer, bit_jsonWriterBytes(scratch), bit_jsonWriterLength(scratch));
+  return writer->appIdentifierRef;
+}
+
+static uint64_t bit_binaryBatchWriterTagsRef(BITBinaryBatchWriter *writer, const char *_Nullable tags, size_t tagsLength) {
+  if (!tags) {
+    return 0;
+  }
+  if (writer->tagsRef != 0 && writer->tagsLength == tagsLength &&
+      memcmp(writer->table.bytes + writer->tagsOffset, tags, tagsLength) == 0) {
+    return writer->tagsRef;
+  }
+  writer->tagsRef = bit_binaryBatchWriterAddTableString(writer, tags, tagsLength);
+  writer->tagsOffset = writer->table.length - tagsLength;
+  writer->tagsLength = tagsLength;
+  return writer->tagsRef;
+}
+
+static size_t bit_binaryBatchWriterBeginRecord(BITBinaryBatchWriter *writer, BITBinaryBatchRecordKind kind) {
+  size_t start = writer->records.length;
+  if (bit_byteBufferReserve(&writer->records, 1 + BITMaxRecordLengthVarintLength)) {
+    writer->records.bytes[start] = kind;
+    writer->records.length += 1 + BITMaxRecordLengthVarintLength;
+  }
+  return start;
+}
+
+// Moves the payload behind the actual length and counts the item, or restores the batch if anything failed.
+static bool bit_binaryBatchWriterEndRecord(BITBinaryBatchWriter *writer, size_t start, size_t tableLength, uint32_t tableCount) {
+  size_t payloadStart = start + 1 + BITMaxRecordLengthVarintLength;
+  size_t payloadLength = writer->records.length - payloadStart;
+  if (writer->records.failed || writer->table.failed || payloadLength > UINT32_MAX ||
+      writer->records.length + writer->table.length > UINT32_MAX - BITBinaryBatchTrailerLength - 10) {
+    writer->records.length = start;
+    writer->records.failed = false;
+    writer->table.length = tableLength;
+    writer->table.failed = false;
+    writer->tableCount = tableCount;
+
+    // Strings of the table may have been cut off, so none of them is assumed to be there anymore.
+    bit_binaryBatchWriterForgetTable(writer);
+    return false;
+  }
+  uint8_t length[10];
+  size_t lengthLength = bit_encodeVarint(payloadLength, length);
+  uint8_t *bytes = writer->records.bytes;
+  memmove(bytes + start + 1 + lengthLength, bytes + payloadStart, payloadLength);
+  memcpy(bytes + start + 1, length, lengthLength);
+  writer->records.length = start + 1 + lengthLength + payloadLength;
+  writer->itemCount++;
+  return true;
+}
+
+bool bit_binaryBatchWriterAppendJSON(BITBinaryBatchWriter *writer, const char *bytes, size_t length) {
+  size_t tableLength = writer->table.length;
+  uint32_t tableCount = writer->tableCount;
+  size_t start = bit_binaryBatchWriterBeginRecord(writer, BITBinaryBatchRecordKindJSON);
+  bit_byteBufferAppend(&writer->records, bytes, length);
+  return bit_binaryBatchWriterEndRecord(writer, start, tableLength, tableCount);
+}
+
+bool bit_binaryBatchWriterAppendEventRecord(BITBinaryBatchWriter *writer, const BITEventRecord *record, CFStringRef appIdentifier, const char *tags, size_t tagsLength) {
+  size_t tableLength = writer->table.length;
+  uint32_t tableCount = writer->tableCount;
+  size_t start = bit_binaryBatchWriterBeginRecord(writer, BITBinaryBatchRecordKindEvent);
+
+  // Zigzag encoding keeps the varint short for times before 1970 as well.
+  long long milliseconds = llround(record->timestamp * 1000);
+  uint64_t time = ((uint64_t)milliseconds << 1) ^ (uint64_t)(milliseconds >> 63);
+  bit_byteBufferAppendVarint(&writer->records, time);
+  bit_byteBufferAppendDouble(&writer->records, record->sampleRate);
+  bit_byteBufferAppendVarint(&writer->records, bit_binaryBatchWriterAppIdentifierRef(writer, appIdentifier));
+  bit_byteBufferAppendVarint(&writer->records, bit_binaryBatchWriterTagsRef(writer, tags, tagsLength));
+  bit_binaryBatchWriterAppendString(writer, record, record->name);
+  bit_byteBufferAppendVarint(&writer->records, record->propertyCount);
+  for (uint32_t i = 0; i < record->propertyCount; i++) {
+    bit_binaryBatchWriterAppendString(writer, record, record->properties[i].key);
+    bit_binaryBatchWriterAppendString(writer, record, record->properties[i].value);
+  }
+  bit_byteBufferAppendVarint(&writer->records, record->measurementCount);
+  for (uint32_t i = 0; i < record->measurementCount; i++) {
+    bit_binaryBatchWriterAppendString(writer, record, record->measurements[i].key);
+    bit_byteBufferAppendDouble(&writer->records, record->measurements[i].value);
+  }
+  return bit_binaryBatchWriterEndRecord(writer, start, tableLength, tableCount);
+}
+
+uint32_t bit_binaryBatchWriterItemCount(const BITBinaryBatchWriter *writer) {
+  return writer->itemCount;
+}
+
+size_t bit_binaryBatchWriterLength(const BITBinaryBatchWriter *writer) {
+  uint8_t count[10];
+  return writer->records.length + bit_encodeVarint(writer->tableCount, count) + writer->table.length + BITBinaryBatchTrailerLength;
+}
+
+NSData *bit_binaryBatchWriterFinish(BITBinaryBatchWriter *writer) {
+  NSMutableData *batch = nil;
+  if (writer->itemCount > 0) {
+    BITByteBuffer *records = &writer->records;
+    uint32_t tableOffset = (uint32_t)records->length;
+    bit_byteBufferAppendVarint(records, writer->tableCount);
+    bit_byteBufferAppend(records, writer->table.bytes, writer->table.length);
+    bit_byteBufferAppendUInt32(records, tableOffset);
+    bit_byteBufferAppendUInt32(records, writer->itemCount);
+    if (!records->failed) {
+      bit_byteBufferAppendUInt32(records, (uint32_t)crc32(crc32(0L, Z_NULL, 0), records->bytes, (uInt)records->length));
+    }
+    bit_byteBufferAppend(records, BITBinaryBatchTrailerMagic, sizeof(BITBinaryBatchTrailerMagic));
+    if (!records->failed) {
+      batch = [NSMutableData dataWithBytes:records->bytes length:records->length];
+    }
+  }
+  bit_binaryBatchWriterReset(writer);
+  return batch;
+}
+
+#pragma mark - Reader
+
+typedef struct {
+  const uint8_t *bytes;
+  size_t length;
+  size_t position;
+  bool failed;
+} BITBinaryReader;
+
+typedef struct {
+  const char *_Nullable bytes;
+  size_t length;
+
+  // Strings of the table are JSON fragments, inline strings are plain UTF-8.
+  bool isJSON;
+} BITBinaryBatchString;
+
+static uint32_t bit_readUInt32(const uint8_t *bytes) {
+  return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static const uint8_t *_Nullable bit_readBytes(BITBinaryReader *reader, size_t length) {
+  if (reader->failed || length > reader->length - reader->position) {
+    reader->failed = true;
+    return NULL;
+  }
+  const uint8_t *bytes = reader->bytes + reader->position;
+  reader->position += length;
+  return bytes;
+}
+
+static uint8_t bit_readByte(BITBinaryReader *reader) {
+  const uint8_t *byte = bit_readBytes(reader, 1);
+  return byte ? *byte : 0;
+}
+
+static uint64_t bit_readVarint(BITBinaryReader *reader) {
+  uint64_t value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = bit_readByte(reader);
+    if (reader->failed) {
+      return 0;
+    }
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  reader->failed = true;
+  return 0;
+}
+
+static double bit_readDouble(BITBinaryReader *reader) {
+  const uint8_t *bytes = bit_readBytes(reader, 8);
+  if (!bytes) {
+    return 0;
+  }
+  uint64_t bits = 0;
+  for (size_t i = 0; i < 8; i++) {
+    bits |= (uint64_t)bytes[i] << (8 * i);
+  }
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static BITBinaryBatchString bit_readString(BITBinaryReader *reader, const BITBinaryBatchString *table, size_t tableCount) {
+  BITBinaryBatchString string = {.bytes = NULL, .length = 0, .isJSON = false};
+  uint64_t ref = bit_readVarint(reader);
+  if (ref == 0 || reader->failed) {
+    return string;
+  }
+  if (ref & 1) {
+    uint64_t length = ref >> 1;
+    const uint8_t *bytes = length <= reader->length ? bit_readBytes(reader, (size_t)length) : NULL;
+    if (!bytes) {
+      reader->failed = true;
+      return string;
+    }
+    string.bytes = (const char *)bytes;
+    string.length = (size_t)length;
+    return string;
+  }
+  uint64_t index = ref / 2 - 1;
+  if (index >= tableCount) {
+    reader->failed = true;
+    return string;
+  }
+  return table[index];
+}
+
+static void bit_jsonWriterBinaryBatchString(BITJSONWriter *writer, BITBinaryBatchString string) {
+  if (string.isJSON) {
+    bit_jsonWriterRaw(writer, (const char *)string.bytes, string.length);
+  } else {
+    bit_jsonWriterString(writer, (const char *)string.bytes, string.length);
+  }
+}
+
+static void bit_jsonWriterBinaryBatchKey(BITJSONWriter *writer, BITBinaryBatchString key) {
+  if (key.isJSON) {
+    bit_jsonWriterRawKey(writer, (const char *)key.bytes, key.length);
+  } else {
+    bit_jsonWriterStringKey(writer, (const char *)key.bytes, key.length);
+  }
+}
+
+// Renders an event record the way the channel serializes event records into JSON batches.
+static bool bit_renderEvent(BITBinaryReader *reader, const BITBinaryBatchString *table, size_t tableCount, BITJSONWriter *writer) {
+  uint64_t time = bit_readVarint(reader);
+  long long milliseconds = (long long)(time >> 1) ^ -(long long)(time & 1);
+  double sampleRate = bit_readDouble(reader);
+  BITBinaryBatchString appIdentifier = bit_readString(reader, table, tableCount);
+  BITBinaryBatchString tags = bit_readString(reader, table, tableCount);
+  BITBinaryBatchString name = bit_readString(reader, table, tableCount);
+  if (reader->failed || !name.bytes || (tags.bytes && !tags.isJSON)) {
+    return false;
+  }
+
+  bit_eventRecordBeginJSONEnvelope(writer, (double)milliseconds / 1000, sampleRate);
+  if (appIdentifier.bytes) {
+    bit_jsonWriterKey(writer, "iKey");
+    bit_jsonWriterBinaryBatchString(writer, appIdentifier);
+  }
+  bit_eventRecordBeginJSONEventData(writer, tags.bytes, tags.length);
+  bit_jsonWriterKey(writer, "name");
+  bit_jsonWriterBinaryBatchString(writer, name);
+  bit_jsonWriterKey(writer, "properties");
+  bit_jsonWriterBeginObject(writer);
+  uint64_t propertyCount = bit_readVarint(reader);
+  for (uint64_t i = 0; i < propertyCount && !reader->failed; i++) {
+    BITBinaryBatchString key = bit_readString(reader, table, tableCount);
+    BITBinaryBatchString value = bit_readString(reader, table, tableCount);
+    if (!key.bytes || !value.bytes) {
+      reader->failed = true;
+      break;
+    }
+    bit_jsonWriterBinaryBatchKey(writer, key);
+    bit_jsonWriterBinaryBatchString(writer, value);
+  }
+  bit_jsonWriterEndObject(writer);
+  bit_jsonWriterKey(writer, "measurements");
+  bit_jsonWriterBeginObject(writer);
+  uint64_t measurementCount = bit_readVarint(reader);
+  for (uint64_t i = 0; i < measurementCount && !reader->failed; i++) {
+    BITBinaryBatchString key = bit_readString(reader, table, tableCount);
+    double value = bit_readDouble(reader);
+    if (!key.bytes) {
+      reader->failed = true;
+      break;
+    }
+    bit_jsonWriterBinaryBatchKey(writer, key);
+    bit_jsonWriterDouble(writer, value);
+  }
+  bit_jsonWriterEndObject(writer);
+  bit_eventRecordEndJSONEnvelope(writer);
+  return !reader->failed && reader->position == reader->length && !bit_jsonWriterHasFailed(writer);
+}
+
+bool bit_isBinaryBatch(const void *bytes, size_t length) {
+  return bytes && length >= BITBinaryBatchHeaderLength + BITBinaryBatchTrailerLength &&
+         memcmp(bytes, BITBinaryBatchMagic, sizeof(BITBinaryBatchMagic)) == 0;
+}
+
+// Checks the header and the trailer and returns the offset of the table.
+static bool bit_readBinaryBatchTrailer(NSData *batch, size_t *tableOffset, uint32_t *itemCount) {
+  const uint8_t *bytes = batch.bytes;
+  size_t length = batch.length;
+  if (!bit_isBinaryBatch(bytes, length) || bytes[sizeof(BITBinaryBatchMagic)] != BITBinaryBatchVersion ||
+      memcmp(bytes + length - sizeof(BITBinaryBatchTrailerMagic), BITBinaryBatchTrailerMagic, sizeof(BITBinaryBatchTrailerMagic)) != 0) {
+    return false;
+  }
+  const uint8_t *trailer = bytes + length - BITBinaryBatchTrailerLength;
+  *tableOffset = bit_readUInt32(trailer);
+  *itemCount = bit_readUInt32(trailer + 4);
+  return *tableOffset >= BITBinaryBatchHeaderLength && *tableOffset < length - BITBinaryBatchTrailerLength;
+}
+
+// Table strings are copied into the rendered batch as they are, so a damaged one would make it invalid JSON.
+static bool bit_verifyBinaryBatchChecksum(NSData *batch) {
+  size_t checkedLength = batch.length - BITBinaryBatchTrailerLength + 8;
+  uint32_t checksum = (uint32_t)crc32(crc32(0L, Z_NULL, 0), batch.bytes, (uInt)checkedLength);
+  return checksum == bit_readUInt32((const uint8_t *)batch.bytes + checkedLength);
+}
+
+bool bit_binaryBatchItemCount(NSData *batch, uint64_t *itemCount) {
+  size_t tableOffset;
+  uint32_t count;
+  if (!bit_readBinaryBatchTrailer(batch, &tableOffset, &count)) {
+    return false;
+  }
+  *itemCount = count;
+  return true;
+}
+
+NSData *bit_renderBinaryBatch(NSData *batch) {
+  size_t tableOffset;
+  uint32_t itemCount;
+  if (!bit_readBinaryBatchTrailer(batch, &tableOffset, &itemCount) || !bit_verifyBinaryBatchChecksum(batch)) {
+    return nil;
+  }
+  const uint8_t *bytes = batch.bytes;
+
+  // Every string of the table takes at least one byte, which bounds the count before anything is allocated for it.
+  BITBinaryReader tableReader = {.bytes = bytes, .length = batch.length - BITBinaryBatchTrailerLength, .position = tableOffset, .failed = false};
+  uint64_t tableCount = bit_readVarint(&tableReader);
+  if (tableReader.failed || tableCount > tableReader.length - tableReader.position) {
+    return nil;
+  }
+  BITBinaryBatchString *table = malloc((size_t)(tableCount > 0 ? tableCount : 1) * sizeof(BITBinaryBatchString));
+  if (!table) {
+    return nil;
+  }
+  for (uint64_t i = 0; i < tableCount; i++) {
+    uint64_t length = bit_readVarint(&tableReader);
+    const uint8_t *string = length <= tableReader.length ? bit_readBytes(&tableReader, (size_t)length) : NULL;
+    if (!string) {
+      tableReader.failed = true;
+      break;
+    }
+    table[i] = (BITBinaryBatchString){.bytes = (const char *)string, .length = (size_t)length, .isJSON = true};
+  }
+
+  // Rendered items are a few times larger than their records.
+  BITJSONWriter *writer = tableReader.failed || tableReader.position != tableReader.length ? NULL : bit_jsonWriterCreate(batch.length * 4);
+  BITBinaryReader reader = {.bytes = bytes, .length = tableOffset, .position = BITBinaryBatchHeaderLength, .failed = false};
+  uint32_t renderedCount = 0;
+  while (writer && reader.position < reader.length && !reader.failed) {
+    uint8_t kind = bit_readByte(&reader);
+    uint64_t length = bit_readVarint(&reader);
+    const uint8_t *payload = length <= reader.length ? bit_readBytes(&reader, (size_t)length) : NULL;
+    if (!payload) {
+      reader.failed = true;
+      break;
+    }
+    if (kind == BITBinaryBatchRecordKindJSON) {
+      bit_jsonWriterRaw(writer, (const char *)payload, (size_t)length);
+    } else if (kind == BITBinaryBatchRecordKindEvent) {
+      BITBinaryReader eventReader = {.bytes = payload, .length = (size_t)length, .position = 0, .failed = false};
+      if (!bit_renderEvent(&eventReader, table, (size_t)tableCount, writer)) {
+        reader.failed = true;
+        break;
+      }
+    } else {
+      reader.failed = true;
+      break;
+    }
+
+    // Top-level values aren't separated by the writer, the line break of every item is written as a raw value.
+    bit_jsonWriterRaw(writer, "\n", 1);
+    renderedCount++;
+  }
+
+  NSData *rendered = nil;
+  if (writer && !reader.failed && renderedCount == itemCount && !bit_jsonWriterHasFailed(writer)) {
+    rendered = [NSData dataWithBytes:bit_jsonWriterBytes(writer) length:bit_jsonWriterLength(writer)];
+  }
+  bit_jsonWriterDestroy(writer);
+  free(table);
+  return rendered;
+}
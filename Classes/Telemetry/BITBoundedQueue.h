@@ -0,0 +1,138 @@
+#import <stdbool.h>
+#import <stddef.h>
+#import <stdint.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A fixed-capacity, multi-producer queue of pointers with a single consumer that is woken on demand.
+ *
+ *  The slots are preallocated when the queue is created, every slot carries a sequence number that tells producers and
+ *  consumers whose turn it is. Pushing and popping an item is a compare-and-swap on the tail or head position, the queue
+ *  never allocates and never takes a lock unless a producer waits for free space.
+ *
+ *  All functions except bit_boundedQueueCreate and bit_boundedQueueDestroy are safe to call from multiple threads.
+ */
+typedef struct BITBoundedQueue BITBoundedQueue;
+
+/**
+ *  Called with items the queue gives up, i.e. items that are dropped and items still queued when it is destroyed.
+ *
+ *  @param item the item that is given up
+ */
+typedef void (*BITBoundedQueueReleaseItem)(void *item);
+
+/**
+ *  What happens to an item that is pushed while the queue is full.
+ */
+typedef enum {
+  /**
+   *  The pushed item is dropped
+   */
+  BITBoundedQueueOverflowDropNewest = 0,
+  /**
+   *  The oldest items are dropped until the pushed item fits
+   */
+  BITBoundedQueueOverflowDropOldest = 1,
+  /**
+   *  The caller waits until the consumer has made room
+   */
+  BITBoundedQueueOverflowWait = 2
+} BITBoundedQueueOverflow;
+
+/**
+ *  Creates a queue.
+ *
+ *  @param capacity the minimum number of items the queue can hold, will be rounded up to the next power of two
+ *  @param releaseItem called with items the queue gives up, may be NULL
+ *
+ *  @return the queue or NULL if it could not be allocated
+ */
+BITBoundedQueue *_Nullable bit_boundedQueueCreate(size_t capacity, BITBoundedQueueReleaseItem _Nullable releaseItem);
+
+/**
+ *  Releases all items that are still queued and frees the queue. It must not be used afterwards.
+ *
+ *  @param queue the queue to free
+ */
+void bit_boundedQueueDestroy(BITBoundedQueue *_Nullable queue);
+
+/**
+ *  Adds an item to the tail of the queue.
+ *
+ *  @param queue the queue
+ *  @param item the item to add
+ *  @param overflow what happens if the queue is full
+ *
+ *  @return true if the item has been added, false if it has been dropped and released
+ */
+bool bit_boundedQueuePush(BITBoundedQueue *queue, void *item, BITBoundedQueueOverflow overflow);
+
+/**
+ *  Takes the item at the head of the queue. Meant for the consumer, but safe to call from any thread.
+ *
+ *  @param queue the queue
+ *  @param item set to the item that has been taken, which is owned by the caller afterwards
+ *
+ *  @return true if an item has been taken, false if the queue is empty
+ */
+bool bit_boundedQueuePop(BITBoundedQueue *queue, void *_Nullable *_Nonnull item);
+
+/**
+ *  Marks the consumer as scheduled. Producers call this after pushing an item, so the consumer is woken only once per
+ *  burst of items instead of once per item.
+ *
+ *  @param queue the queue
+ *
+ *  @return true if the consumer was idle, in which case the caller has to run it
+ */
+bool bit_boundedQueueScheduleConsumer(BITBoundedQueue *queue);
+
+/**
+ *  Marks the consumer as idle. The consumer calls this once bit_boundedQueuePop returned false. Items might have been
+ *  pushed in the meantime without the consumer being scheduled again, so this checks for them before it gives up.
+ *
+ *  @param queue the queue
+ *
+ *  @return true if items are left and the consumer has been scheduled again, in which case it has to go on popping
+ */
+bool bit_boundedQueueConsumerDidFinish(BITBoundedQueue *queue);
+
+/**
+ *  Returns the number of queued items. The value may be outdated as soon as it has been read.
+ *
+ *  @param queue the queue
+ *
+ *  @return the number of items
+ */
+size_t bit_boundedQueueCount(const BITBoundedQueue *queue);
+
+/**
+ *  Returns the number of items the queue can hold.
+ *
+ *  @param queue the queue
+ *
+ *  @return the capacity
+ */
+size_t bit_boundedQueueCapacity(const BITBoundedQueue *queue);
+
+/**
+ *  Returns the number of items that have been dropped because the queue was full.
+ *
+ *  @param queue the queue
+ *
+ *  @return the number of dropped items
+ */
+uint64_t bit_boundedQueueDroppedCount(const BITBoundedQueue *queue);
+
+/**
+ *  Returns the largest number of items that have been queued at a time.
+ *
+ *  @param queue the queue
+ *
+ *  @return the high-water mark
+ */
+size_t bit_boundedQueuePeakCount(const BITBoundedQueue *queue);
+
+NS_ASSUME_NONNULL_END
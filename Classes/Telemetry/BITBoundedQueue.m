@@ -0,0 +1,237 @@
+#import "BITBoundedQueue.h"
+#import <pthread.h>
+#import <stdatomic.h>
+#import <stdlib.h>
+#import <sys/time.h>
+
+// Positions are incremented by different threads all the time, so they get a cache line of their own.
+#define BIT_CACHE_LINE_SIZE 64
+
+// A waiting producer checks for free space at least this often, in case it missed the consumer's signal.
+static long const BITBoundedQueueWaitIntervalNanoseconds = 1000000;
+
+typedef struct {
+  _Atomic(size_t) sequence;
+  void *item;
+} BITBoundedQueueSlot;
+
+struct BITBoundedQueue {
+  BITBoundedQueueSlot *slots;
+  size_t mask;
+  BITBoundedQueueReleaseItem releaseItem;
+  char padding0[BIT_CACHE_LINE_SIZE];
+  _Atomic(size_t) tail;
+  char padding1[BIT_CACHE_LINE_SIZE - sizeof(size_t)];
+  _Atomic(size_t) head;
+  char padding2[BIT_CACHE_LINE_SIZE - sizeof(size_t)];
+  _Atomic(bool) consumerScheduled;
+  _Atomic(uint64_t) droppedCount;
+  _Atomic(size_t) peakCount;
+  _Atomic(size_t) waiters;
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+};
+
+static size_t bit_nextPowerOfTwo(size_t value) {
+  size_t power = 1;
+  while (power < value) {
+    power <<= 1;
+  }
+  return power;
+}
+
+BITBoundedQueue *bit_boundedQueueCreate(size_t capacity, BITBoundedQueueReleaseItem releaseItem) {
+  if (capacity == 0) {
+    return NULL;
+  }
+  BITBoundedQueue *queue = calloc(1, sizeof(BITBoundedQueue));
+  if (!queue) {
+    return NULL;
+  }
+  capacity = bit_nextPowerOfTwo(capacity);
+  queue->slots = calloc(capacity, sizeof(BITBoundedQueueSlot));
+  if (!queue->slots) {
+    free(queue);
+    return NULL;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&queue->slots[i].sequence, i);
+  }
+  queue->mask = capacity - 1;
+  queue->releaseItem = releaseItem;
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->consumerScheduled, false);
+  atomic_init(&queue->droppedCount, 0);
+  atomic_init(&queue->peakCount, 0);
+  atomic_init(&queue->waiters, 0);
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->condition, NULL);
+  return queue;
+}
+
+void bit_boundedQueueDestroy(BITBoundedQueue *queue) {
+  if (!queue) {
+    return;
+  }
+  void *item;
+  while (bit_boundedQueuePop(queue, &item)) {
+    if (queue->releaseItem) {
+      queue->releaseItem(item);
+    }
+  }
+  pthread_cond_destroy(&queue->condition);
+  pthread_mutex_destroy(&queue->mutex);
+  free(queue->slots);
+  free(queue);
+}
+
+static void bit_boundedQueueDrop(BITBoundedQueue *queue, void *item) {
+  atomic_fetch_add_explicit(&queue->droppedCount, 1, memory_order_relaxed);
+  if (queue->releaseItem) {
+    queue->releaseItem(item);
+  }
+}
+
+static bool bit_boundedQueueTryPush(BITBoundedQueue *queue, void *item) {
+  size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  BITBoundedQueueSlot *slot;
+  for (;;) {
+    slot = &queue->slots[position & queue->mask];
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+    if (difference == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+
+      // The slot still holds the item pushed one lap ago, so the queue is full.
+      return false;
+    } else {
+      position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+  slot->item = item;
+  atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+  // The high-water mark is only statistics, so it doesn't need to be ordered with anything else.
+  size_t count = position + 1 - atomic_load_explicit(&queue->head, memory_order_relaxed);
+  size_t peak = atomic_load_explicit(&queue->peakCount, memory_order_relaxed);
+  while (count > peak && count <= queue->mask + 1 &&
+         !atomic_compare_exchange_weak_explicit(&queue->peakCount, &peak, count, memory_order_relaxed, memory_order_relaxed)) {
+  }
+  return true;
+}
+
+static bool bit_boundedQueueTryPop(BITBoundedQueue *queue, void **item) {
+  size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  BITBoundedQueueSlot *slot;
+  for (;;) {
+    slot = &queue->slots[position & queue->mask];
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+    if (difference == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+
+      // The slot hasn't been published yet, so the queue is empty as far as the consumer can tell.
+      return false;
+    } else {
+      position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    }
+  }
+  *item = slot->item;
+  atomic_store_explicit(&slot->sequence, position + queue->mask + 1, memory_order_release);
+  return true;
+}
+
+static void bit_boundedQueueWaitForFreeSpace(BITBoundedQueue *queue) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  long nanoseconds = (long)now.tv_usec * 1000 + BITBoundedQueueWaitIntervalNanoseconds;
+  struct timespec deadline = {
+    .tv_sec = now.tv_sec + nanoseconds / 1000000000,
+    .tv_nsec = nanoseconds % 1000000000
+  };
+  pthread_cond_timedwait(&queue->condition, &queue->mutex, &deadline);
+}
+
+bool bit_boundedQueuePush(BITBoundedQueue *queue, void *item, BITBoundedQueueOverflow overflow) {
+  if (bit_boundedQueueTryPush(queue, item)) {
+    return true;
+  }
+  switch (overflow) {
+    case BITBoundedQueueOverflowDropNewest:
+      bit_boundedQueueDrop(queue, item);
+      return false;
+    case BITBoundedQueueOverflowDropOldest:
+      do {
+        void *oldest;
+        if (bit_boundedQueueTryPop(queue, &oldest)) {
+          bit_boundedQueueDrop(queue, oldest);
+        }
+      } while (!bit_boundedQueueTryPush(queue, item));
+      return true;
+    case BITBoundedQueueOverflowWait:
+      pthread_mutex_lock(&queue->mutex);
+      atomic_fetch_add(&queue->waiters, 1);
+      while (!bit_boundedQueueTryPush(queue, item)) {
+        bit_boundedQueueWaitForFreeSpace(queue);
+      }
+      atomic_fetch_sub(&queue->waiters, 1);
+      pthread_mutex_unlock(&queue->mutex);
+      return true;
+  }
+  return false;
+}
+
+bool bit_boundedQueuePop(BITBoundedQueue *queue, void **item) {
+  if (!bit_boundedQueueTryPop(queue, item)) {
+    return false;
+  }
+  if (atomic_load(&queue->waiters) > 0) {
+    pthread_mutex_lock(&queue->mutex);
+    pthread_cond_signal(&queue->condition);
+    pthread_mutex_unlock(&queue->mutex);
+  }
+  return true;
+}
+
+bool bit_boundedQueueScheduleConsumer(BITBoundedQueue *queue) {
+
+  // This has to write even if the consumer is scheduled already: the consumer's exchange in
+  // bit_boundedQueueConsumerDidFinish then reads from it and is guaranteed to see the item pushed before.
+  return !atomic_exchange(&queue->consumerScheduled, true);
+}
+
+bool bit_boundedQueueConsumerDidFinish(BITBoundedQueue *queue) {
+  atomic_exchange(&queue->consumerScheduled, false);
+  if (bit_boundedQueueCount(queue) == 0) {
+    return false;
+  }
+
+  // Items have been pushed after the last pop. Their producers either saw the consumer as scheduled and rely on it to
+  // go on, or have scheduled it anew themselves, in which case this consumer can stop.
+  return bit_boundedQueueScheduleConsumer(queue);
+}
+
+size_t bit_boundedQueueCount(const BITBoundedQueue *queue) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  return tail > head ? tail - head : 0;
+}
+
+size_t bit_boundedQueueCapacity(const BITBoundedQueue *queue) {
+  return queue->mask + 1;
+}
+
+uint64_t bit_boundedQueueDroppedCount(const BITBoundedQueue *queue) {
+  return atomic_load_explicit(&queue->droppedCount, memory_order_relaxed);
+}
+
+size_t bit_boundedQueuePeakCount(const BITBoundedQueue *queue) {
+  return atomic_load_explicit(&queue->peakCount, memory_order_relaxed);
+}
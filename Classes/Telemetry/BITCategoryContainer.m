@@ -45,48 +45,20 @@
 //  3. This notice may not be removed or altered from any source distribution.
 //
 
-#import <zlib.h>
+//  Altered for HockeySDK: compression and decompression are implemented by
+//  BITCompression, which sizes the output up front instead of growing it by
+//  a fixed chunk per round and reuses the zlib state of the calling thread.
+//
 
-static const NSUInteger ChunkSize = 16384;
+#import <zlib.h>
+#import "BITCompression.h"
 
 @implementation NSData (BITGZIP)
 
 - (NSData *)bit_gzippedDataWithCompressionLevel:(float)level
 {
-  if ([self length])
-  {
-    z_stream stream;
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.opaque = Z_NULL;
-    stream.avail_in = (uint)[self length];
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wcast-qual"
-    stream.next_in = (z_const Bytef *)[self bytes];
-#pragma clang diagnostic pop
-    stream.total_out = 0;
-    stream.avail_out = 0;
-    
-    int compression = (level < 0.0f)? Z_DEFAULT_COMPRESSION: (int)(roundf(level * 9));
-    if (deflateInit2(&stream, compression, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) == Z_OK)
-    {
-      NSMutableData *data = [NSMutableData dataWithLength:ChunkSize];
-      while (stream.avail_out == 0)
-      {
-        if (stream.total_out >= [data length])
-        {
-          data.length += ChunkSize;
-        }
-        stream.next_out = (uint8_t *)[data mutableBytes] + stream.total_out;
-        stream.avail_out = (uInt)([data length] - stream.total_out);
-        deflate(&stream, Z_FINISH);
-      }
-      deflateEnd(&stream);
-      data.length = stream.total_out;
-      return data;
-    }
-  }
-  return nil;
+  int compression = (level < 0.0f)? Z_DEFAULT_COMPRESSION: (int)(roundf(level * 9));
+  return bit_gzipData(self, compression);
 }
 
 - (NSData *)bit_gzippedData
@@ -96,44 +68,13 @@ static const NSUInteger ChunkSize = 16384;
 
 - (NSData *)bit_gunzippedData
 {
-  if ([self length])
-  {
-    z_stream stream;
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.avail_in = (uint)[self length];
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wcast-qual"
-    stream.next_in = (z_const Bytef *)[self bytes];
-#pragma clang diagnostic pop
-    stream.total_out = 0;
-    stream.avail_out = 0;
-    
-    NSMutableData *data = [NSMutableData dataWithLength:(NSUInteger)([self length] * 1.5)];
-    if (inflateInit2(&stream, 47) == Z_OK)
-    {
-      int status = Z_OK;
-      while (status == Z_OK)
-      {
-        if (stream.total_out >= [data length])
-        {
-          data.length += [self length] / 2;
-        }
-        stream.next_out = (uint8_t *)[data mutableBytes] + stream.total_out;
-        stream.avail_out = (uInt)([data length] - stream.total_out);
-        status = inflate (&stream, Z_SYNC_FLUSH);
-      }
-      if (inflateEnd(&stream) == Z_OK)
-      {
-        if (status == Z_STREAM_END)
-        {
-          data.length = stream.total_out;
-          return data;
-        }
-      }
-    }
-  }
-  return nil;
+  return bit_gunzipData(self);
+}
+
+- (BOOL)bit_isGzippedData
+{
+  const uint8_t *bytes = (const uint8_t *)[self bytes];
+  return [self length] >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b;
 }
 
 @end
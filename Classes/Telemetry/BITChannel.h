@@ -1,5 +1,6 @@
 #import <Foundation/Foundation.h>
 #import "HockeySDKNullability.h"
+#import "BITRingBuffer.h"
 
 @class BITConfiguration;
 @class BITTelemetryData;
@@ -9,9 +10,10 @@
 NS_ASSUME_NONNULL_BEGIN
 
 /**
- * Buffer of telemtry events, will be written to disk. Make sure the buffer is used in a threadsafe way.
+ * Buffer of telemtry events, will be written to disk. Points to the buffer of the most recently created channel, so a
+ * crash handler can get hold of the events that have not been persisted, yet.
  */
-FOUNDATION_EXPORT char *_Nullable BITTelemetryEventBuffer;
+FOUNDATION_EXPORT BITRingBuffer *_Nullable BITTelemetryEventBuffer;
 
 /**
  *  Items get queued before they are persisted and sent out as a batch. This class managed the queue, and forwards the batch
@@ -7,44 +7,179 @@
 #import "BITEnvelope.h"
 #import "BITData.h"
 #import "BITDevice.h"
+#import "BITSessionStateData.h"
+#import "BITEventData.h"
 #import "BITPersistencePrivate.h"
+#import "BITPipelineStatistics.h"
 #import <stdatomic.h>
 
 static char *const BITDataItemsOperationsQueue = "net.hockeyapp.senderQueue";
-char *BITTelemetryEventBuffer;
+static void *BITDataItemsOperationsQueueKey = &BITDataItemsOperationsQueueKey;
+BITRingBuffer *BITTelemetryEventBuffer;
 
 NSString *const BITChannelBlockedNotification = @"BITChannelBlockedNotification";
 
-static NSInteger const BITDefaultMaxBatchSize  = 50;
-static NSInteger const BITDefaultBatchInterval = 15;
 static NSInteger const BITSchemaVersion = 2;
 
-static NSInteger const BITDebugMaxBatchSize = 5;
-static NSInteger const BITDebugBatchInterval = 3;
+static NSUInteger const BITDebugMaxBatchSize = 5;
+static NSTimeInterval const BITDebugBatchInterval = 3;
 
-typedef _Atomic(char*) atomic_charptr;
+// Large enough for several full batches, pages are only backed by memory once they have been touched.
+static size_t const BITDefaultEventBufferCapacity = 1024 * 1024;
+
+// Items tracked faster than they can be serialized are held back in a queue of this many items per lane.
+static size_t const BITDefaultItemQueueCapacity = 8192;
+
+// Records of items that have been serialized are kept for reuse until there are this many.
+static size_t const BITDefaultEventRecordPoolCapacity = 1024;
+
+// Initial size of the buffer items are serialized into, it grows to the size of the largest item.
+static size_t const BITDefaultJSONWriterCapacity = 4 * 1024;
+
+// Initial size of a binary batch, it grows up to the size of the event buffer.
+static size_t const BITDefaultBinaryBatchCapacity = 64 * 1024;
+
+static char const BITEventBufferLineSeparator = '\n';
+
+// Doubles represent all integers up to 2^53 exactly.
+static double const BITMaxExactInteger = 9007199254740992.0;
+
+// While the storage is under pressure and session state is sampled, only one in this many session state items is kept.
+static NSUInteger const BITSessionStateSampleInterval = 4;
 
 NS_ASSUME_NONNULL_BEGIN
 
-@implementation BITChannel
+#define BITChannelLaneCount 3
+
+typedef struct {
+  size_t capacity;
+  NSUInteger weight;
+  BOOL dropsItemsWhileBlocked;
+} BITChannelLaneConfiguration;
+
+// Session state is tracked twice per session and custom events come in bursts, so the session state lane gets a small
+// queue but the largest share of every round of draining.
+static BITChannelLaneConfiguration const BITChannelLaneConfigurations[BITChannelLaneCount] = {
+  [BITChannelLaneSessionState] = {.capacity = 256, .weight = 16, .dropsItemsWhileBlocked = NO},
+  [BITChannelLaneCritical] = {.capacity = 1024, .weight = 8, .dropsItemsWhileBlocked = YES},
+  [BITChannelLaneEvents] = {.capacity = BITDefaultItemQueueCapacity, .weight = 4, .dropsItemsWhileBlocked = YES}
+};
+
+typedef struct {
+  BITBoundedQueue *_Nullable queue;
+  _Atomic(uint64_t) deliveredCount;
+  _Atomic(uint64_t) blockedCount;
+} BITChannelLaneState;
+
+typedef struct {
+  BITCompressor *compressor;
+  bool failed;
+} BITCompressionBatchContext;
+
+static void bit_compressRecord(void *_Nullable context, const char *bytes, size_t length) {
+  BITCompressionBatchContext *batch = context;
+  if (!batch->failed) {
+    batch->failed = !bit_compressorWrite(batch->compressor, bytes, length);
+  }
+}
+
+// Queues only give up items they drop on overflow, the items left when the channel goes away are popped first.
+static void bit_releaseItemRecord(void *item) {
+  bit_pipelineCount(BITTelemetryCounterItemsDroppedOnOverflow, 1);
+  bit_eventRecordPoolRelease(item);
+}
+
+static BITBoundedQueueOverflow bit_boundedQueueOverflowForPolicy(BITTelemetryOverflowPolicy policy) {
+  switch (policy) {
+    case BITTelemetryOverflowPolicyDropNewest:
+      return BITBoundedQueueOverflowDropNewest;
+    case BITTelemetryOverflowPolicyBlock:
+      return BITBoundedQueueOverflowWait;
+    case BITTelemetryOverflowPolicyDropOldest:
+      return BITBoundedQueueOverflowDropOldest;
+  }
+  return BITBoundedQueueOverflowDropOldest;
+}
+
+// Interned strings are copied from their cached JSON representation, only strings stored in the record are escaped.
+static void bit_jsonWriterEventRecordString(BITJSONWriter *writer, const BITEventRecord *record, BITEventRecordString string) {
+  if (string.entry) {
+    bit_jsonWriterRaw(writer, string.entry->json, string.entry->jsonLength);
+  } else {
+    bit_jsonWriterString(writer, bit_eventRecordStringBytes(record, string), string.length);
+  }
+}
+
+static void bit_jsonWriterEventRecordKey(BITJSONWriter *writer, const BITEventRecord *record, BITEventRecordString key) {
+  if (key.entry) {
+    bit_jsonWriterRawKey(writer, key.entry->json, key.entry->jsonLength);
+  } else {
+    bit_jsonWriterStringKey(writer, bit_eventRecordStringBytes(record, key), key.length);
+  }
+}
+
+@implementation BITChannel {
+  BITChannelLaneState _lanes[BITChannelLaneCount];
+}
 
 @synthesize persistence = _persistence;
 @synthesize channelBlocked = _channelBlocked;
+@synthesize batchFormat = _batchFormat;
 
 #pragma mark - Initialisation
 
 - (instancetype)init {
   if ((self = [super init])) {
-    bit_resetEventBuffer(&BITTelemetryEventBuffer);
-    _dataItemCount = 0;
-    if (bit_isDebuggerAttached()) {
-      _maxBatchSize = BITDebugMaxBatchSize;
-      _batchInterval = BITDebugBatchInterval;
-    } else {
-      _maxBatchSize = BITDefaultMaxBatchSize;
-      _batchInterval = BITDefaultBatchInterval;
+    _eventBuffer = bit_ringBufferCreate(BITDefaultEventBufferCapacity);
+    if (!_eventBuffer) {
+      BITHockeyLogError(@"ERROR: Unable to allocate the telemetry event buffer.");
+      return nil;
+    }
+    _jsonWriter = bit_jsonWriterCreate(BITDefaultJSONWriterCapacity);
+    if (!_jsonWriter) {
+      BITHockeyLogError(@"ERROR: Unable to allocate the telemetry serialization buffer.");
+      bit_ringBufferDestroy(_eventBuffer);
+      _eventBuffer = NULL;
+      return nil;
+    }
+    _storageCodec = BITCompressionCodecGzip;
+    _compressor = bit_compressorCreate(_storageCodec);
+    if (!_compressor) {
+      BITHockeyLogError(@"ERROR: Unable to allocate the telemetry compression stream.");
+      bit_jsonWriterDestroy(_jsonWriter);
+      _jsonWriter = NULL;
+      bit_ringBufferDestroy(_eventBuffer);
+      _eventBuffer = NULL;
+      return nil;
     }
+    _eventRecordPool = bit_eventRecordPoolCreate(BITDefaultEventRecordPoolCapacity);
+    BOOL lanesCreated = YES;
+    for (size_t i = 0; i < BITChannelLaneCount; i++) {
+      _lanes[i].queue = bit_boundedQueueCreate(BITChannelLaneConfigurations[i].capacity, bit_releaseItemRecord);
+      atomic_init(&_lanes[i].deliveredCount, 0);
+      atomic_init(&_lanes[i].blockedCount, 0);
+      lanesCreated = lanesCreated && _lanes[i].queue != NULL;
+    }
+    if (!_eventRecordPool || !lanesCreated) {
+      BITHockeyLogError(@"ERROR: Unable to allocate the telemetry item queue.");
+      [self destroyItemQueues];
+      bit_eventRecordPoolDestroy(_eventRecordPool);
+      _eventRecordPool = NULL;
+      bit_compressorDestroy(_compressor);
+      _compressor = NULL;
+      bit_jsonWriterDestroy(_jsonWriter);
+      _jsonWriter = NULL;
+      bit_ringBufferDestroy(_eventBuffer);
+      _eventBuffer = NULL;
+      return nil;
+    }
+    BITTelemetryEventBuffer = _eventBuffer;
+    _dataItemCount = 0;
+    _overflowPolicy = BITTelemetryOverflowPolicyDropOldest;
+    _batchingPolicy = [self defaultBatchingPolicy];
+    _timerWheel = [BITTimerWheel sharedTimerWheel];
     dispatch_queue_t serialQueue = dispatch_queue_create(BITDataItemsOperationsQueue, DISPATCH_QUEUE_SERIAL);
+    dispatch_queue_set_specific(serialQueue, BITDataItemsOperationsQueueKey, (__bridge void *)self, NULL);
     _dataItemsOperations = serialQueue;
   }
   return self;
@@ -58,6 +193,97 @@ NS_ASSUME_NONNULL_BEGIN
   return self;
 }
 
+- (void)dealloc {
+  [_timerWheel cancelTimeout:_flushTimeout];
+  if (BITTelemetryEventBuffer == _eventBuffer) {
+    BITTelemetryEventBuffer = NULL;
+  }
+  bit_ringBufferDestroy(_eventBuffer);
+  bit_jsonWriterDestroy(_jsonWriter);
+  bit_compressorDestroy(_compressor);
+  bit_binaryBatchWriterDestroy(_binaryBatchWriter);
+
+  // Queued records are returned to the pool, so the pool goes last.
+  [self destroyItemQueues];
+  bit_eventRecordPoolDestroy(_eventRecordPool);
+}
+
+- (void)destroyItemQueues {
+  for (size_t i = 0; i < BITChannelLaneCount; i++) {
+
+    // Items that are still queued haven't overflowed, so they are released without being counted as dropped.
+    void *item;
+    while (_lanes[i].queue && bit_boundedQueuePop((BITBoundedQueue *)_lanes[i].queue, &item)) {
+      bit_eventRecordPoolRelease(item);
+    }
+    bit_boundedQueueDestroy(_lanes[i].queue);
+    _lanes[i].queue = NULL;
+  }
+}
+
+#pragma mark - Execution context
+
+- (BOOL)isOnDataItemsOperations {
+  return dispatch_get_specific(BITDataItemsOperationsQueueKey) == (__bridge void *)self;
+}
+
+- (void)performOnDataItemsOperations:(dispatch_block_t)block {
+  if ([self isOnDataItemsOperations]) {
+    block();
+  } else {
+    dispatch_sync(self.dataItemsOperations, block);
+  }
+}
+
+#pragma mark - Compression
+
+- (void)setStorageCodec:(BITCompressionCodec)storageCodec {
+  [self performOnDataItemsOperations:^{
+    if (storageCodec == self->_storageCodec) {
+      return;
+    }
+    BITCompressor *compressor = bit_compressorCreate(storageCodec);
+    if (!compressor) {
+      BITHockeyLogWarning(@"WARNING: Telemetry compression codec %u is not available, batches are still stored with codec %u.", storageCodec, self->_storageCodec);
+      return;
+    }
+    bit_compressorDestroy(self->_compressor);
+    self->_compressor = compressor;
+    self->_storageCodec = storageCodec;
+  }];
+}
+
+#pragma mark - Batch format
+
+- (BITTelemetryBatchFormat)batchFormat {
+  __block BITTelemetryBatchFormat batchFormat;
+  [self performOnDataItemsOperations:^{
+    batchFormat = self->_batchFormat;
+  }];
+  return batchFormat;
+}
+
+- (void)setBatchFormat:(BITTelemetryBatchFormat)batchFormat {
+  [self performOnDataItemsOperations:^{
+    if (batchFormat == self->_batchFormat) {
+      return;
+    }
+    if (batchFormat == BITTelemetryBatchFormatBinary && !self->_binaryBatchWriter) {
+      self->_binaryBatchWriter = bit_binaryBatchWriterCreate(BITDefaultBinaryBatchCapacity);
+      if (!self->_binaryBatchWriter) {
+        BITHockeyLogWarning(@"WARNING: Unable to allocate a binary telemetry batch, batches are still stored as JSON.");
+        return;
+      }
+    }
+
+    // The current batch is persisted in the format it has been written in.
+    if (self.dataItemCount > 0) {
+      [self persistDataItemQueue:self.eventBuffer];
+    }
+    self->_batchFormat = batchFormat;
+  }];
+}
+
 #pragma mark - Queue management
 
 - (BOOL)isQueueBusy {
@@ -71,45 +297,62 @@ NS_ASSUME_NONNULL_BEGIN
   return self.channelBlocked;
 }
 
-- (void)persistDataItemQueue:(char **)eventBuffer {
+- (void)persistDataItemQueue:(BITRingBuffer *)eventBuffer {
   [self invalidateTimer];
 
-  // Make sure string (which points to BITTelemetryEventBuffer) is not changed.
-  char *previousBuffer = NULL;
-  char *newEmptyString = NULL;
-  do {
-    newEmptyString = strdup("");
-    previousBuffer = *eventBuffer;
+  // Compress all committed items out of the buffer, this releases their space for new items right away. The batch is
+  // stored compressed, so it doesn't have to be compressed again every time the sender tries to send it.
+  NSData *bundle;
+  NSUInteger itemCount = self.dataItemCount;
+  NSUInteger length = self.batchLength;
+  if (_batchFormat == BITTelemetryBatchFormatBinary) {
 
-    // This swaps pointers and makes sure eventBuffer now has the balue of newEmptyString.
-    if (atomic_compare_exchange_strong((atomic_charptr *)eventBuffer, &previousBuffer, newEmptyString)) {
-      @synchronized(self) {
-        self.dataItemCount = 0;
-      }
-      break;
+    // Binary batches are stored as they are, so the sender can render them straight from the mapped file.
+    bundle = bit_binaryBatchWriterFinish((BITBinaryBatchWriter *)self.binaryBatchWriter);
+  } else {
+    uint64_t compressionStart = bit_pipelineTimestamp();
+    bundle = [self compressedBatchByConsumingEventBuffer:eventBuffer];
+    if (bundle) {
+      bit_pipelineRecordDuration(BITTelemetryStageCompression, compressionStart);
+      bit_pipelineCount(BITTelemetryCounterBatchesCompressed, 1);
     }
-  } while(true);
+  }
+  self.dataItemCount = 0;
+  self.batchLength = 0;
+  BITPersistencePriority priority = self.batchPriority;
+  self.batchPriority = BITPersistencePriorityDefault;
+  if (bundle && [self.batchingPolicy respondsToSelector:@selector(didPersistBatchWithItemCount:length:compressedLength:)]) {
+    [self.batchingPolicy didPersistBatchWithItemCount:itemCount length:length compressedLength:bundle.length];
+  }
 
-  // Nothing to persist, freeing memory and existing.
-  if (!previousBuffer || strlen(previousBuffer) == 0) {
-    free(previousBuffer);
+  // Nothing to persist.
+  if (!bundle) {
+    if (itemCount > 0) {
+      [self.persistence countDroppedEvents:itemCount];
+    }
     return;
   }
 
   // Persist the data
-  NSData *bundle = [NSData dataWithBytes:previousBuffer length:strlen(previousBuffer)];
-  [self.persistence persistBundle:bundle];
-  free(previousBuffer);
-
-  // Reset both, the async-signal-safe and item counter.
-  [self resetQueue];
+  bit_pipelineCount(BITTelemetryCounterBatchesFlushed, 1);
+  [self.persistence persistBundle:bundle priority:priority];
 }
 
-- (void)resetQueue {
-  @synchronized (self) {
-    bit_resetEventBuffer(&BITTelemetryEventBuffer);
-    self.dataItemCount = 0;
+- (nullable NSData *)compressedBatchByConsumingEventBuffer:(BITRingBuffer *)eventBuffer {
+  size_t usedBytes = bit_ringBufferUsedBytes(eventBuffer);
+  if (usedBytes == 0) {
+    return nil;
+  }
+
+  // The output is sized for the used bytes, it only has to grow if items are committed while the buffer is drained.
+  NSMutableData *output = [NSMutableData new];
+  BITCompressionBatchContext batch = {.compressor = self.compressor, .failed = !bit_compressorBegin(self.compressor, output, usedBytes)};
+  bit_ringBufferConsume(eventBuffer, bit_compressRecord, &batch);
+  if (batch.failed || !bit_compressorFinish(self.compressor)) {
+    BITHockeyLogError(@"ERROR: Unable to compress a batch of telemetry items, it was dropped.");
+    return nil;
   }
+  return output;
 }
 
 #pragma mark - Adding to queue
@@ -122,40 +365,267 @@ NS_ASSUME_NONNULL_BEGIN
     BITHockeyLogWarning(@"WARNING: TelemetryItem was nil.");
     return;
   }
-  
-  // First assigning self to weakSelf and then assigning this to strongSelf in the block is not very intuitive, this
-  // blog post explains it very well: https://dhoerl.wordpress.com/2013/04/23/i-finally-figured-out-weakself-and-strongself/
-  __weak typeof(self) weakSelf = self;
-  dispatch_async(self.dataItemsOperations, ^{
 
-    typeof(self) strongSelf = weakSelf;
-    if (strongSelf.isQueueBusy) {
+  BITEventRecord *record = bit_eventRecordPoolAcquire(self.eventRecordPool);
+  if (!record) {
+    BITHockeyLogError(@"ERROR: Unable to allocate a telemetry record. %@ was dropped.", item.debugDescription);
+    [self.persistence countDroppedEvents:1];
+    return;
+  }
+  record->object = (__bridge_retained CFTypeRef)item;
+  [self enqueueRecord:record lane:[self laneForTelemetryData:item]];
+}
 
-      // Case 1: Channel is in blocked state: Trigger sender, start timer to check after again after a while and abort operation.
-      BITHockeyLogDebug(@"INFO: The channel is saturated. %@ was dropped.", item.debugDescription);
-      if (![strongSelf timerIsRunning]) {
-        [strongSelf startTimer];
-      }
-      return;
+- (void)enqueueEventWithName:(NSString *)eventName
+                  properties:(nullable NSDictionary<NSString *, NSString *> *)properties
+                measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements
+                  sampleRate:(double)sampleRate {
+  BITEventRecord *record = bit_eventRecordPoolAcquire(self.eventRecordPool);
+  if (!record) {
+    BITHockeyLogError(@"ERROR: Unable to allocate a telemetry record. Event %@ was dropped.", eventName);
+    [self.persistence countDroppedEvents:1];
+    return;
+  }
+  record->timestamp = CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970;
+  record->sampleRate = sampleRate;
+  if (![self fillRecord:record withEventName:eventName properties:properties measurements:measurements]) {
+
+    // Events with values a record can't hold are tracked as objects, which serialize them the way they always have.
+    bit_eventRecordPoolRelease(record);
+    BITEventData *eventData = [BITEventData new];
+    eventData.name = eventName;
+    if (properties) {
+      eventData.properties = properties;
+    }
+    if (measurements) {
+      eventData.measurements = (NSDictionary *)measurements;
+    }
+    if (sampleRate > 0) {
+      eventData.sampleRate = @(sampleRate);
+    }
+    [self enqueueTelemetryItem:eventData];
+    return;
+  }
+  [self enqueueRecord:record lane:BITChannelLaneEvents];
+}
+
+- (BOOL)fillRecord:(BITEventRecord *)record
+     withEventName:(NSString *)eventName
+        properties:(nullable NSDictionary<NSString *, NSString *> *)properties
+      measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements {
+  if (!bit_eventRecordSetName(record, (__bridge CFStringRef)eventName)) {
+    return NO;
+  }
+  for (id key in properties) {
+    id value = properties[key];
+    if (![key isKindOfClass:[NSString class]] || ![value isKindOfClass:[NSString class]] ||
+        !bit_eventRecordAddProperty(record, (__bridge CFStringRef)key, (__bridge CFStringRef)value)) {
+      return NO;
+    }
+  }
+  for (id key in measurements) {
+    id value = measurements[key];
+    if (![key isKindOfClass:[NSString class]] || ![value isKindOfClass:[NSNumber class]] ||
+        CFGetTypeID((__bridge CFTypeRef)value) == CFBooleanGetTypeID()) {
+      return NO;
+    }
+
+    // Integers that don't survive the round trip through a double are left to the object's serialization.
+    NSNumber *number = value;
+    double doubleValue = number.doubleValue;
+    char type = number.objCType[0];
+    if (type != 'd' && type != 'f' && fabs(doubleValue) >= BITMaxExactInteger) {
+      return NO;
     }
+    if (!bit_eventRecordAddMeasurement(record, (__bridge CFStringRef)key, doubleValue)) {
+      return NO;
+    }
+  }
+  return YES;
+}
 
-    // Enqueue item.
-    @synchronized(self) {
-      NSDictionary *dict = [strongSelf dictionaryForTelemetryData:item];
-      [strongSelf appendDictionaryToEventBuffer:dict];
-      if (strongSelf.dataItemCount >= strongSelf.maxBatchSize) {
+- (void)enqueueRecord:(BITEventRecord *)record lane:(BITChannelLane)lane {
 
-        // Case 2: Max batch count has been reached, so write queue to disk and delete all items.
-        [strongSelf persistDataItemQueue:&BITTelemetryEventBuffer];
-      } else if (strongSelf.dataItemCount > 0) {
+  // Items are handed to the serial queue through a bounded queue, so bursts neither allocate a block per item nor
+  // grow without limit. The serial queue is only woken if it isn't draining the queue already.
+  BITBoundedQueueOverflow overflow = bit_boundedQueueOverflowForPolicy(self.overflowPolicy);
+  if (overflow == BITBoundedQueueOverflowWait && [self isOnDataItemsOperations]) {
 
-        // Case 3: It is the first item, let's start the timer.
-        if (![strongSelf timerIsRunning]) {
-          [strongSelf startTimer];
+    // Waiting for the queue that is supposed to make room would never end.
+    overflow = BITBoundedQueueOverflowDropNewest;
+  }
+  BITBoundedQueue *queue = [self itemQueueForLane:lane];
+  bit_pipelineCount(BITTelemetryCounterItemsEnqueued, 1);
+  if (!bit_boundedQueuePush(queue, record, overflow)) {
+    BITHockeyLogDebug(@"INFO: The telemetry item queue is full, an item was dropped.");
+  }
+  if (bit_boundedQueueScheduleConsumer(queue)) {
+
+    // First assigning self to weakSelf and then assigning this to strongSelf in the block is not very intuitive, this
+    // blog post explains it very well: https://dhoerl.wordpress.com/2013/04/23/i-finally-figured-out-weakself-and-strongself/
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.dataItemsOperations, ^{
+      typeof(self) strongSelf = weakSelf;
+      [strongSelf drainItemQueues];
+    });
+  }
+}
+
+- (void)drainItemQueues {
+  BOOL itemsPushedMeanwhile;
+  do {
+    NSUInteger processedCount;
+    do {
+      processedCount = 0;
+      for (size_t lane = 0; lane < BITChannelLaneCount; lane++) {
+        NSUInteger weight = BITChannelLaneConfigurations[lane].weight;
+        void *item;
+        for (NSUInteger i = 0; i < weight && bit_boundedQueuePop((BITBoundedQueue *)_lanes[lane].queue, &item); i++) {
+          BITEventRecord *record = item;
+          @autoreleasepool {
+            if (record->object) {
+              [self processTelemetryItem:(__bridge BITTelemetryData *)record->object];
+            } else {
+              [self processEventRecord:record];
+            }
+          }
+          bit_eventRecordPoolRelease(record);
+          processedCount++;
         }
       }
+    } while (processedCount > 0);
+
+    // Every lane is marked as drained, even the ones this drain hasn't been scheduled for, a drain that is scheduled
+    // for them meanwhile finds nothing left and returns right away.
+    itemsPushedMeanwhile = NO;
+    for (size_t lane = 0; lane < BITChannelLaneCount; lane++) {
+      if (bit_boundedQueueConsumerDidFinish((BITBoundedQueue *)_lanes[lane].queue)) {
+        itemsPushedMeanwhile = YES;
+      }
     }
-  });
+  } while (itemsPushedMeanwhile);
+}
+
+- (void)processTelemetryItem:(BITTelemetryData *)item {
+  BITChannelLane lane = [self laneForTelemetryData:item];
+  if ([self dropItemIfChannelIsBlockedInLane:lane]) {
+    return;
+  }
+
+  if (![self shouldKeepSampledItem:item]) {
+    BITHockeyLogDebug(@"INFO: The telemetry storage is under pressure. %@ was sampled out.", item.debugDescription);
+    [self.persistence countDroppedEvents:1];
+    return;
+  }
+
+  // Enqueue item.
+  uint64_t serializationStart = bit_pipelineTimestamp();
+  if ([self appendTelemetryDataToEventBuffer:item]) {
+    bit_pipelineRecordDuration(BITTelemetryStageSerialization, serializationStart);
+    atomic_fetch_add_explicit(&_lanes[lane].deliveredCount, 1, memory_order_relaxed);
+  }
+  [self persistBatchIfComplete];
+}
+
+- (void)processEventRecord:(const BITEventRecord *)record {
+  if ([self dropItemIfChannelIsBlockedInLane:BITChannelLaneEvents]) {
+    return;
+  }
+  uint64_t serializationStart = bit_pipelineTimestamp();
+  if ([self appendEventRecordToEventBuffer:record]) {
+    bit_pipelineRecordDuration(BITTelemetryStageSerialization, serializationStart);
+    atomic_fetch_add_explicit(&_lanes[BITChannelLaneEvents].deliveredCount, 1, memory_order_relaxed);
+  }
+  [self persistBatchIfComplete];
+}
+
+- (BOOL)dropItemIfChannelIsBlockedInLane:(BITChannelLane)lane {
+  if (!self.isQueueBusy) {
+    return NO;
+  }
+
+  // Case 1: Channel is in blocked state: Trigger sender, start timer to check after again after a while and abort operation.
+  if (![self timerIsRunning]) {
+    [self startTimer];
+  }
+
+  // The storage is mostly filled by items of other lanes, so session state is written anyway.
+  if (!BITChannelLaneConfigurations[lane].dropsItemsWhileBlocked) {
+    return NO;
+  }
+  BITHockeyLogDebug(@"INFO: The channel is saturated. A telemetry item was dropped.");
+  [self.persistence countDroppedEvents:1];
+  atomic_fetch_add_explicit(&_lanes[lane].blockedCount, 1, memory_order_relaxed);
+  bit_pipelineCount(BITTelemetryCounterItemsDroppedWhileBlocked, 1);
+  return YES;
+}
+
+- (void)persistBatchIfComplete {
+  if (self.dataItemCount > 0 &&
+      [self.batchingPolicy shouldPersistBatchWithItemCount:self.dataItemCount
+                                                    length:self.batchLength
+                                                   addedAt:[NSProcessInfo processInfo].systemUptime]) {
+
+    // Case 2: The batching policy considers the batch complete, so write queue to disk and delete all items.
+    [self persistDataItemQueue:self.eventBuffer];
+  } else if (self.dataItemCount > 0) {
+
+    // Case 3: It is the first item, let's start the timer.
+    if (![self timerIsRunning]) {
+      [self startTimer];
+    }
+  }
+}
+
+- (uint64_t)overflowedItemCount {
+  uint64_t count = 0;
+  for (size_t lane = 0; lane < BITChannelLaneCount; lane++) {
+    count += bit_boundedQueueDroppedCount((BITBoundedQueue *)_lanes[lane].queue);
+  }
+  return count;
+}
+
+#pragma mark - Lanes
+
+- (BITBoundedQueue *)itemQueueForLane:(BITChannelLane)lane {
+  return (BITBoundedQueue *)_lanes[lane < BITChannelLaneCount ? lane : BITChannelLaneEvents].queue;
+}
+
+- (BITChannelLaneStatistics)statisticsForLane:(BITChannelLane)lane {
+  BITChannelLaneStatistics statistics = {0, 0, 0};
+  if (lane < BITChannelLaneCount) {
+    statistics.deliveredCount = atomic_load_explicit(&_lanes[lane].deliveredCount, memory_order_relaxed);
+    statistics.overflowedCount = bit_boundedQueueDroppedCount((BITBoundedQueue *)_lanes[lane].queue);
+    statistics.blockedCount = atomic_load_explicit(&_lanes[lane].blockedCount, memory_order_relaxed);
+  }
+  return statistics;
+}
+
+- (BITChannelLane)laneForTelemetryData:(BITTelemetryData *)telemetryData {
+  if ([telemetryData isKindOfClass:[BITSessionStateData class]]) {
+    return BITChannelLaneSessionState;
+  }
+  if ([telemetryData isKindOfClass:[BITEventData class]]) {
+    return BITChannelLaneEvents;
+  }
+  return BITChannelLaneCritical;
+}
+
+- (BOOL)shouldKeepSampledItem:(BITTelemetryData *)item {
+  if (![item isKindOfClass:[BITSessionStateData class]] ||
+      self.persistence.evictionPolicy != BITTelemetryEvictionPolicySampleSessionState ||
+      ![self.persistence isStorageUnderPressure]) {
+    return YES;
+  }
+  NSUInteger index = self.sampledSessionStateItemCount++;
+  return index % BITSessionStateSampleInterval == 0;
+}
+
+- (BITPersistencePriority)priorityForTelemetryData:(BITTelemetryData *)telemetryData {
+  if ([telemetryData isKindOfClass:[BITSessionStateData class]]) {
+    return BITPersistencePriorityHigh;
+  }
+  return BITPersistencePriorityDefault;
 }
 
 #pragma mark - Envelope telemerty items
@@ -163,6 +633,7 @@ NS_ASSUME_NONNULL_BEGIN
 - (NSDictionary *)dictionaryForTelemetryData:(BITTelemetryData *) telemetryData {
   
   BITEnvelope *envelope = [self envelopeForTelemetryData:telemetryData];
+  envelope.tags = self.telemetryContext.contextDictionary;
   NSDictionary *dict = [envelope serializeToDictionary];
   return dict;
 }
@@ -177,144 +648,243 @@ NS_ASSUME_NONNULL_BEGIN
   BITEnvelope *envelope = [BITEnvelope new];
   envelope.time = bit_utcDateString([NSDate date]);
   envelope.iKey = self.telemetryContext.appIdentifier;
-  
-  envelope.tags = self.telemetryContext.contextDictionary;
+
+  // The context keeps its tags serialized, so they are only copied into the output instead of being merged into a new
+  // dictionary and serialized again for every item.
+  envelope.tagsFragment = self.telemetryContext.tagsFragment;
   envelope.data = data;
   envelope.name = telemetryData.envelopeTypeName;
+  if (telemetryData.sampleRate) {
+    envelope.sampleRate = telemetryData.sampleRate;
+  }
   
   return envelope;
 }
 
 #pragma mark - Serialization Helper
 
-- (NSString *)serializeDictionaryToJSONString:(NSDictionary *)dictionary {
+- (nullable NSData *)serializeDictionaryToJSONData:(NSDictionary *)dictionary {
   NSError *error;
   NSData *data = [NSJSONSerialization dataWithJSONObject:dictionary options:(NSJSONWritingOptions)0 error:&error];
   if (!data) {
     BITHockeyLogError(@"ERROR: JSONSerialization error: %@", error.localizedDescription);
-    return @"{}";
-  } else {
-    return (NSString *)[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
   }
+  return data;
 }
 
 #pragma mark JSON Stream
 
-- (void)appendDictionaryToEventBuffer:(NSDictionary *)dictionary {
-  if (dictionary) {
-    NSString *string = [self serializeDictionaryToJSONString:dictionary];
+- (BOOL)appendTelemetryDataToEventBuffer:(BITTelemetryData *)telemetryData {
 
-    // Since we can't persist every event right away, we write it to a simple C string.
-    // This can then be written to disk by a signal handler in case of a crash.
-    @synchronized (self) {
-      bit_appendStringToEventBuffer(string, &BITTelemetryEventBuffer);
-      self.dataItemCount += 1;
-    }
+  // The envelope is written straight into the reused serialization buffer, no dictionaries or strings are created.
+  BITJSONWriter *writer = self.jsonWriter;
+  bit_jsonWriterReset(writer);
+  [[self envelopeForTelemetryData:telemetryData] serializeToJSONWriter:writer];
+  if (bit_jsonWriterHasFailed(writer)) {
+    BITHockeyLogError(@"ERROR: Unable to serialize telemetry item %@.", telemetryData.debugDescription);
+    [self.persistence countDroppedEvents:1];
+    return NO;
+  }
+  if (![self appendLineToEventBuffer:bit_jsonWriterBytes(writer) length:bit_jsonWriterLength(writer)]) {
+    [self.persistence countDroppedEvents:1];
+    return NO;
   }
+  BITPersistencePriority priority = [self priorityForTelemetryData:telemetryData];
+  if (priority > self.batchPriority) {
+    self.batchPriority = priority;
+  }
+  return YES;
 }
 
-void bit_appendStringToEventBuffer(NSString *string, char **eventBuffer) {
-  if (eventBuffer == NULL) {
-    return;
+- (BOOL)appendEventRecordToEventBuffer:(const BITEventRecord *)record {
+  if (_batchFormat == BITTelemetryBatchFormatBinary) {
+    return [self appendEventRecordToBinaryBatch:record];
   }
-
-  if (!string) {
-    return;
+  BITJSONWriter *writer = self.jsonWriter;
+  bit_jsonWriterReset(writer);
+  [self serializeEventRecord:record toJSONWriter:writer];
+  if (bit_jsonWriterHasFailed(writer)) {
+    BITHockeyLogError(@"ERROR: Unable to serialize a telemetry event.");
+    [self.persistence countDroppedEvents:1];
+    return NO;
   }
-
-  if (*eventBuffer == NULL || strlen(*eventBuffer) == 0) {
-    bit_resetEventBuffer(eventBuffer);
+  if (![self appendLineToEventBuffer:bit_jsonWriterBytes(writer) length:bit_jsonWriterLength(writer)]) {
+    [self.persistence countDroppedEvents:1];
+    return NO;
   }
+  return YES;
+}
 
-  if (string.length == 0) {
-    return;
+- (BOOL)appendEventRecordToBinaryBatch:(const BITEventRecord *)record {
+  BITBinaryBatchWriter *writer = (BITBinaryBatchWriter *)self.binaryBatchWriter;
+  size_t previousLength = bit_binaryBatchWriterLength(writer);
+  NSData *tagsFragment = self.telemetryContext.tagsFragment;
+  CFStringRef appIdentifier = (__bridge CFStringRef)self.telemetryContext.appIdentifier;
+  if (!bit_binaryBatchWriterAppendEventRecord(writer, record, appIdentifier, tagsFragment.bytes, tagsFragment.length)) {
+    BITHockeyLogError(@"ERROR: Unable to write a telemetry event to the binary batch.");
+    [self.persistence countDroppedEvents:1];
+    return NO;
   }
+  [self didAppendToBinaryBatchFromLength:previousLength];
+  return YES;
+}
 
-  do {
-    char *newBuffer = NULL;
-    char *previousBuffer = *eventBuffer;
+- (void)didAppendToBinaryBatchFromLength:(size_t)previousLength {
+  size_t length = bit_binaryBatchWriterLength((BITBinaryBatchWriter *)self.binaryBatchWriter);
+  self.dataItemCount += 1;
+  self.batchLength += length - previousLength;
 
-    // Concatenate old string with new JSON string and add a comma.
-    asprintf(&newBuffer, "%s%.*s\n", previousBuffer, (int)MIN(string.length, (NSUInteger)INT_MAX), string.UTF8String);
+  // Binary batches are limited to the size of the event buffer, just like JSON batches.
+  if (length >= BITDefaultEventBufferCapacity) {
+    [self persistDataItemQueue:self.eventBuffer];
+  }
+}
 
-    // Compare newBuffer and previousBuffer. If they point to the same address, we are safe to use them.
-    if (atomic_compare_exchange_strong((atomic_charptr *)eventBuffer, &previousBuffer, newBuffer)) {
+- (void)serializeEventRecord:(const BITEventRecord *)record toJSONWriter:(BITJSONWriter *)writer {
+  bit_eventRecordBeginJSONEnvelope(writer, record->timestamp, record->sampleRate);
+  NSString *appIdentifier = self.telemetryContext.appIdentifier;
+  if (appIdentifier) {
+    bit_jsonWriterKey(writer, "iKey");
+    bit_jsonWriterNSString(writer, appIdentifier);
+  }
+  NSData *tagsFragment = self.telemetryContext.tagsFragment;
+  bit_eventRecordBeginJSONEventData(writer, tagsFragment.bytes, tagsFragment.length);
+  bit_jsonWriterKey(writer, "name");
+  bit_jsonWriterEventRecordString(writer, record, record->name);
+  bit_jsonWriterKey(writer, "properties");
+  bit_jsonWriterBeginObject(writer);
+  for (uint32_t i = 0; i < record->propertyCount; i++) {
+    BITEventRecordProperty property = record->properties[i];
+    bit_jsonWriterEventRecordKey(writer, record, property.key);
+    bit_jsonWriterEventRecordString(writer, record, property.value);
+  }
+  bit_jsonWriterEndObject(writer);
+  bit_jsonWriterKey(writer, "measurements");
+  bit_jsonWriterBeginObject(writer);
+  for (uint32_t i = 0; i < record->measurementCount; i++) {
+    BITEventRecordMeasurement measurement = record->measurements[i];
+    bit_jsonWriterEventRecordKey(writer, record, measurement.key);
+    bit_jsonWriterDouble(writer, measurement.value);
+  }
+  bit_jsonWriterEndObject(writer);
+  bit_eventRecordEndJSONEnvelope(writer);
+}
 
-      // Free the intermediate pointer.
-      free(previousBuffer);
+- (void)appendDictionaryToEventBuffer:(NSDictionary *)dictionary {
+  if (dictionary) {
+    NSData *data = [self serializeDictionaryToJSONData:dictionary];
+    if (data.length == 0) {
       return;
-    } else {
+    }
+    [self appendLineToEventBuffer:data.bytes length:data.length];
+  }
+}
 
-      // newBuffer has been changed by another thread.
-      free(newBuffer);
+- (BOOL)appendLineToEventBuffer:(const void *)bytes length:(size_t)length {
+
+  // Since we can't persist every event right away, we copy it into a preallocated buffer.
+  // This can then be written to disk by a signal handler in case of a crash.
+  struct iovec line[2] = {
+    {.iov_base = (void *)(uintptr_t)bytes, .iov_len = length},
+    {.iov_base = (void *)(uintptr_t)&BITEventBufferLineSeparator, .iov_len = 1}
+  };
+  if (_batchFormat == BITTelemetryBatchFormatBinary) {
+    BITBinaryBatchWriter *writer = (BITBinaryBatchWriter *)self.binaryBatchWriter;
+    size_t previousLength = bit_binaryBatchWriterLength(writer);
+    if (!bit_binaryBatchWriterAppendJSON(writer, bytes, length)) {
+      BITHockeyLogWarning(@"WARNING: Telemetry item of %lu bytes could not be written to the binary batch and was dropped.", (unsigned long)length);
+      return NO;
     }
-  } while (true);
+    [self didAppendToBinaryBatchFromLength:previousLength];
+    return YES;
+  }
+  if (!bit_ringBufferAppendv(self.eventBuffer, line, 2)) {
+
+    // The buffer is full: Persist what we have so far and try again with an empty buffer.
+    [self persistDataItemQueue:self.eventBuffer];
+    if (!bit_ringBufferAppendv(self.eventBuffer, line, 2)) {
+      BITHockeyLogWarning(@"WARNING: Telemetry item of %lu bytes exceeds the event buffer and was dropped.", (unsigned long)length);
+      return NO;
+    }
+  }
+  self.dataItemCount += 1;
+  self.batchLength += length + 1;
+  return YES;
 }
 
-void bit_resetEventBuffer(char **eventBuffer) {
-  if (!eventBuffer) { return; }
+BOOL bit_appendStringToEventBuffer(NSString *string, BITRingBuffer *eventBuffer) {
+  if (eventBuffer == NULL) {
+    return NO;
+  }
 
-  char *newEmptyString = NULL;
-  char *prevString = NULL;
-  do {
-    prevString = *eventBuffer;
-    newEmptyString = strdup("");
+  if (!string || string.length == 0) {
+    return NO;
+  }
 
-    // Compare pointers to strings to make sure we are still threadsafe!
-    if (atomic_compare_exchange_strong((atomic_charptr *)eventBuffer, &prevString, newEmptyString)) {
-      free(prevString);
-      return;
-    }
-  } while(true);
+  const char *bytes = string.UTF8String;
+  if (!bytes) {
+    return NO;
+  }
+  struct iovec line[2] = {
+    {.iov_base = (void *)(uintptr_t)bytes, .iov_len = strlen(bytes)},
+    {.iov_base = (void *)(uintptr_t)&BITEventBufferLineSeparator, .iov_len = 1}
+  };
+  return bit_ringBufferAppendv(eventBuffer, line, 2) ? YES : NO;
+}
+
+void bit_resetEventBuffer(BITRingBuffer *eventBuffer) {
+  if (!eventBuffer) { return; }
+  bit_ringBufferDiscard(eventBuffer);
 }
 
 #pragma mark - Batching
 
-- (NSUInteger)maxBatchSize {
-  if(_maxBatchSize <= 0){
-    return BITDefaultMaxBatchSize;
+- (id<BITBatchingPolicy>)defaultBatchingPolicy {
+  if (bit_isDebuggerAttached()) {
+    return [[BITFixedBatchingPolicy alloc] initWithMaxBatchSize:BITDebugMaxBatchSize batchInterval:BITDebugBatchInterval];
   }
-  return _maxBatchSize;
+  return [BITFixedBatchingPolicy new];
+}
+
+- (void)setBatchingPolicy:(nullable id<BITBatchingPolicy>)batchingPolicy {
+  [self performOnDataItemsOperations:^{
+    self->_batchingPolicy = batchingPolicy ?: [self defaultBatchingPolicy];
+  }];
 }
 
 - (void)invalidateTimer {
-  @synchronized(self) {
-    if (self.timerSource != nil) {
-      dispatch_source_cancel((dispatch_source_t)self.timerSource);
-      self.timerSource = nil;
-    }
+  if (self.flushTimeout != 0) {
+    [self.timerWheel cancelTimeout:self.flushTimeout];
+    self.flushTimeout = 0;
   }
 }
 
 -(BOOL)timerIsRunning {
-  @synchronized(self) {
-    return self.timerSource != nil;
-  }
+  return self.flushTimeout != 0;
 }
 
 - (void)startTimer {
-  @synchronized(self) {
 
-    // Reset timer, if it is already running.
-    [self invalidateTimer];
+  // Reset timer, if it is already running.
+  [self invalidateTimer];
 
-    dispatch_source_t timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.dataItemsOperations);
-    dispatch_source_set_timer(timerSource, dispatch_walltime(NULL, NSEC_PER_SEC * self.batchInterval), 1ull * NSEC_PER_SEC, 1ull * NSEC_PER_SEC);
-    __weak typeof(self) weakSelf = self;
-    dispatch_source_set_event_handler(timerSource, ^{
-      typeof(self) strongSelf = weakSelf;
-      if (strongSelf) {
-        if (strongSelf.dataItemCount > 0) {
-          [strongSelf persistDataItemQueue:&BITTelemetryEventBuffer];
-        } else {
-          strongSelf.channelBlocked = NO;
-        }
-        [strongSelf invalidateTimer];
+  // The deadline is kept by the shared timer wheel, so starting a batch or rechecking a blocked channel doesn't create a
+  // timer source. A deadline that has been replaced meanwhile is ignored when it is reached.
+  NSTimeInterval interval = [self.batchingPolicy flushIntervalForBatchStartedAt:[NSProcessInfo processInfo].systemUptime];
+  __block BITTimeoutIdentifier flushTimeout;
+  __weak typeof(self) weakSelf = self;
+  flushTimeout = [self.timerWheel scheduleAfterDelay:interval queue:self.dataItemsOperations block:^{
+    typeof(self) strongSelf = weakSelf;
+    if (strongSelf && strongSelf.flushTimeout == flushTimeout) {
+      strongSelf.flushTimeout = 0;
+      if (strongSelf.dataItemCount > 0) {
+        [strongSelf persistDataItemQueue:strongSelf.eventBuffer];
+      } else {
+        strongSelf.channelBlocked = NO;
       }
-    });
-    dispatch_resume(timerSource);
-    self.timerSource = timerSource;
-  }
+    }
+  }];
+  self.flushTimeout = flushTimeout;
 }
 
 /**
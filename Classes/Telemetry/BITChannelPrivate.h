@@ -3,12 +3,68 @@
 @class BITTelemetryData;
 @class BITTelemetryContext;
 @class BITPersistence;
+@class BITEnvelope;
 
 #import "BITChannel.h"
+#import "BITJSONWriter.h"
+#import "BITPersistencePrivate.h"
+#import "BITCompression.h"
+#import "BITBatchingPolicy.h"
+#import "BITBoundedQueue.h"
+#import "BITEventRecord.h"
+#import "BITBinaryBatch.h"
+#import "BITTimerWheel.h"
+#import "HockeySDKEnums.h"
 
 #import "HockeySDKNullability.h"
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+ *  The lanes items are enqueued in. Every lane has a queue and a budget of its own, so a burst of items in one lane
+ *  can't crowd out the items of another one, and lanes with a higher weight are drained first.
+ */
+typedef NS_ENUM(NSUInteger, BITChannelLane) {
+  /**
+   *  Session start and end, which users and sessions are derived from. Items in this lane are never dropped because
+   *  the channel is blocked
+   */
+  BITChannelLaneSessionState = 0,
+  /**
+   *  Telemetry items other than events and session state, e.g. items tracked around a crash with trackDataItem:
+   */
+  BITChannelLaneCritical = 1,
+  /**
+   *  Custom events
+   */
+  BITChannelLaneEvents = 2
+};
+
+/**
+ *  What happened to the items of a lane since the channel was created.
+ */
+typedef struct {
+  /**
+   *  Items that have been written to a batch.
+   */
+  uint64_t deliveredCount;
+
+  /**
+   *  Items that have been dropped because the queue of the lane was full.
+   */
+  uint64_t overflowedCount;
+
+  /**
+   *  Items that have been dropped because the channel was blocked.
+   */
+  uint64_t blockedCount;
+} BITChannelLaneStatistics;
+
+/**
+ *  The batch, the event buffer, the timer and the blocked state of a channel are owned by its dataItemsOperations
+ *  queue and are only touched there, so processing an item takes no locks. Producers hand items over through the
+ *  lock-free queues of the lanes, configuration changes are applied on dataItemsOperations synchronously. Methods of
+ *  the batch may be called directly from a single thread as long as nothing is enqueued meanwhile (testing).
+ */
 @interface BITChannel ()
 
 /**
@@ -27,32 +83,74 @@ FOUNDATION_EXPORT NSString *const BITChannelBlockedNotification;
  */
 @property (nonatomic, strong) BITPersistence *persistence;
 
-/*
- * Threshold for sending data to the server. Default batch size for debugging is 150, for release
- * configuration, the batch size is 5.
- *
- * Default: 50
+/**
+ *  Decides when the items in the event buffer are persisted as a batch. Setting nil restores the default, a
+ *  BITFixedBatchingPolicy with a batch size of 50 items and an interval of 15 seconds, or 5 items and 3 seconds while a
+ *  debugger is attached. The policy is replaced on dataItemsOperations.
+ */
+@property (nonatomic, strong, null_resettable) id<BITBatchingPolicy> batchingPolicy;
+
+/**
+ *  The timer wheel the flush deadline of the current batch is kept by, the shared wheel unless replaced (testing).
+ */
+@property (nonatomic, strong) BITTimerWheel *timerWheel;
+
+/**
+ *  The timeout which is used to flush the queue after a cretain time, or to recheck a blocked channel, 0 if none is
+ *  scheduled. Only touched on dataItemsOperations.
+ */
+@property (nonatomic, assign) BITTimeoutIdentifier flushTimeout;
+
+/**
+ *  The serial queue that owns the batch and the timer, items are processed and batches are persisted on it.
+ */
+@property (nonatomic, strong) dispatch_queue_t dataItemsOperations;
+
+/**
+ *  The records enqueued items are carried in, custom events are stored in them without creating any objects.
+ */
+@property (nonatomic, assign, readonly) BITEventRecordPool *eventRecordPool;
+
+/**
+ *  Determines what happens to items that are enqueued while the queue of their lane is full. Callers are never blocked
+ *  on dataItemsOperations itself, items enqueued there are dropped instead.
  *
- * @warning: We advice to not set the batch size below 5 events.
+ *  Default: BITTelemetryOverflowPolicyDropOldest
+ */
+@property (atomic, assign) BITTelemetryOverflowPolicy overflowPolicy;
+
+/**
+ *  The number of items that have been dropped because the queue of their lane was full.
  */
-@property (nonatomic) NSUInteger maxBatchSize;
+@property (nonatomic, assign, readonly) uint64_t overflowedItemCount;
 
-/*
- * Interval for sending data to the server in seconds.
+/**
+ *  Returns the bounded queue the records of items enqueued in a lane wait in until they are processed on
+ *  dataItemsOperations.
+ *
+ *  @param lane the lane.
  *
- * Default: 15
+ *  @return the queue of the lane.
  */
-@property (nonatomic, assign) NSInteger batchInterval;
+- (BITBoundedQueue *)itemQueueForLane:(BITChannelLane)lane;
 
 /**
- *  A timer source which is used to flush the queue after a cretain time.
+ *  Returns what happened to the items of a lane so far.
+ *
+ *  @param lane the lane.
+ *
+ *  @return the statistics of the lane.
  */
-@property (nonatomic, strong, nullable) dispatch_source_t timerSource;
+- (BITChannelLaneStatistics)statisticsForLane:(BITChannelLane)lane;
 
 /**
- *  A queue which makes array operations thread safe.
+ *  Returns the lane a telemetry item is enqueued in.
+ *
+ *  @param telemetryData the telemetry item.
+ *
+ *  @return the lane of the item.
  */
-@property (nonatomic, strong) dispatch_queue_t dataItemsOperations;
+- (BITChannelLane)laneForTelemetryData:(BITTelemetryData *)telemetryData;
 
 /**
  *  An integer value that keeps tracks of the number of data items added to the JSON Stream string.
@@ -60,14 +158,171 @@ FOUNDATION_EXPORT NSString *const BITChannelBlockedNotification;
 @property (nonatomic, assign) NSUInteger dataItemCount;
 
 /**
- *  Indicates that channel is currently in a blocked state.
+ *  The number of bytes of the data items added to the event buffer since the last batch was persisted.
+ */
+@property (nonatomic, assign) NSUInteger batchLength;
+
+/**
+ *  Indicates that channel is currently in a blocked state, only touched on dataItemsOperations.
+ */
+@property (nonatomic, assign) BOOL channelBlocked;
+
+/**
+ *  The highest priority of the items in the event buffer, it is passed on to the persistence with the batch.
+ */
+@property (nonatomic, assign) BITPersistencePriority batchPriority;
+
+/**
+ *  The number of session state items that have been enqueued while they are sampled, see
+ *  BITTelemetryEvictionPolicySampleSessionState.
+ */
+@property (nonatomic, assign) NSUInteger sampledSessionStateItemCount;
+
+/**
+ *  The preallocated buffer the serialized items are appended to before they get persisted as a batch.
+ */
+@property (nonatomic, assign, readonly) BITRingBuffer *eventBuffer;
+
+/**
+ *  The reused buffer telemetry items are serialized into before they are copied to the event buffer.
+ */
+@property (nonatomic, assign, readonly) BITJSONWriter *jsonWriter;
+
+/**
+ *  The reused compressor batches are compressed with while they are taken out of the event buffer.
+ */
+@property (nonatomic, assign, readonly) BITCompressor *compressor;
+
+/**
+ *  The codec batches are stored with. Defaults to gzip, which is what they are uploaded as, other codecs store
+ *  batches smaller but have them recompressed before they are sent. Setting a codec that is not available on the
+ *  running system keeps the current one. The codec is replaced on dataItemsOperations.
+ */
+@property (nonatomic, assign) BITCompressionCodec storageCodec;
+
+/**
+ *  The format batches are stored in. Binary batches are written by binaryBatchWriter instead of the event buffer and
+ *  stored uncompressed, so the sender can map them and render them while it reads them. Changing the format persists
+ *  the current batch on dataItemsOperations.
+ *
+ *  Default: BITTelemetryBatchFormatJSON
+ */
+@property (nonatomic, assign) BITTelemetryBatchFormat batchFormat;
+
+/**
+ *  The writer of the current binary batch, NULL until the binary format is used.
+ */
+@property (nonatomic, assign, readonly, nullable) BITBinaryBatchWriter *binaryBatchWriter;
+
+/**
+ *  Manually trigger the BITChannel to persist all items currently in its data item queue, must be called on
+ *  dataItemsOperations.
+ */
+- (void)persistDataItemQueue:(BITRingBuffer *)eventBuffer;
+
+/**
+ *  Takes all items out of the event buffer and compresses them with the storage codec, record by record, so the
+ *  uncompressed batch is never copied.
+ *
+ *  @param eventBuffer the buffer to drain.
+ *
+ *  @return the compressed batch or nil if the buffer was empty or compression failed.
+ */
+- (nullable NSData *)compressedBatchByConsumingEventBuffer:(BITRingBuffer *)eventBuffer;
+
+/**
+ *  Enqueues a custom event as an event record, so neither a BITEventData nor an envelope is created for it. Events
+ *  with properties or measurements a record can't hold, e.g. non-string property values or boolean measurements, are
+ *  enqueued as BITEventData instead.
+ *
+ *  @param eventName the name of the event.
+ *  @param properties the properties of the event.
+ *  @param measurements the measurements of the event.
+ *  @param sampleRate the percentage the event has been sampled with, 0 if it hasn't been sampled.
+ */
+- (void)enqueueEventWithName:(NSString *)eventName
+                  properties:(nullable NSDictionary<NSString *, NSString *> *)properties
+                measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements
+                  sampleRate:(double)sampleRate;
+
+/**
+ *  Takes all items out of the queues of the lanes and processes them, must be called on dataItemsOperations. Lanes are
+ *  drained in rounds, every round takes as many items from a lane as its weight, so items of a lane with a higher
+ *  weight don't wait for a burst in another lane to be processed.
+ */
+- (void)drainItemQueues;
+
+/**
+ *  Appends a telemetry item to the event buffer unless the channel is blocked and the item's lane drops items while it
+ *  is blocked, and persists the batch once the batching policy considers it complete, must be called on
+ *  dataItemsOperations.
+ *
+ *  @param item the telemetry item.
+ */
+- (void)processTelemetryItem:(BITTelemetryData *)item;
+
+/**
+ *  Appends an event record to the event buffer unless the channel is blocked and persists the batch once the batching
+ *  policy considers it complete, must be called on dataItemsOperations.
+ *
+ *  @param record the event record.
+ */
+- (void)processEventRecord:(const BITEventRecord *)record;
+
+/**
+ *  Returns the priority of the batch a telemetry item is persisted with. Session state items have a high priority as
+ *  users and sessions are derived from them.
+ *
+ *  @param telemetryData the telemetry item.
+ *
+ *  @return the priority of the item.
+ */
+- (BITPersistencePriority)priorityForTelemetryData:(BITTelemetryData *)telemetryData;
+
+/**
+ *  Wraps the given telemetry data in an envelope with the current context.
+ *
+ *  @param telemetryData the telemetry item to wrap.
+ *
+ *  @return the envelope for the telemetry item.
+ */
+- (BITEnvelope *)envelopeForTelemetryData:(BITTelemetryData *)telemetryData;
+
+/**
+ *  Wraps the given telemetry data in an envelope and serializes it to a dictionary (testing).
+ *
+ *  @param telemetryData the telemetry item to serialize.
+ *
+ *  @return the serialized envelope.
  */
-@property BOOL channelBlocked;
+- (NSDictionary *)dictionaryForTelemetryData:(BITTelemetryData *)telemetryData;
 
 /**
- *  Manually trigger the BITChannel to persist all items currently in its data item queue.
+ *  Wraps the given telemetry data in an envelope and appends it to the event buffer as a single JSON line.
+ *
+ *  @param telemetryData the telemetry item to serialize.
+ *
+ *  @return YES if the item has been appended.
  */
-- (void)persistDataItemQueue:(char *_Nullable*_Nullable)eventBuffer;
+- (BOOL)appendTelemetryDataToEventBuffer:(BITTelemetryData *)telemetryData;
+
+/**
+ *  Serializes an event record the way an envelope with a BITEventData is serialized and appends it to the event
+ *  buffer as a single JSON line.
+ *
+ *  @param record the event record to serialize.
+ *
+ *  @return YES if the record has been appended.
+ */
+- (BOOL)appendEventRecordToEventBuffer:(const BITEventRecord *)record;
+
+/**
+ *  Writes the envelope of an event record, with the current context, to the given writer.
+ *
+ *  @param record the event record to serialize.
+ *  @param writer the writer the envelope is written to.
+ */
+- (void)serializeEventRecord:(const BITEventRecord *)record toJSONWriter:(BITJSONWriter *)writer;
 
 /**
  *  Adds the specified dictionary to the JSON Stream string.
@@ -77,18 +332,21 @@ FOUNDATION_EXPORT NSString *const BITChannelBlockedNotification;
 - (void)appendDictionaryToEventBuffer:(NSDictionary *)dictionary;
 
 /**
- *  A C function that serializes a given dictionary to JSON and appends it to a char string
+ *  A C function that appends the given string as a new line to the event buffer.
  *
- *  @param string The C string which the dictionary's JSON representation will be appended to.
+ *  @param string The JSON string which will be appended to the buffer.
+ *  @param eventBuffer The buffer the string will be appended to.
+ *
+ *  @return YES if the string has been appended, NO if the buffer is full.
  */
-void bit_appendStringToEventBuffer(NSString *string, char *__nonnull*__nonnull eventBuffer);
+BOOL bit_appendStringToEventBuffer(NSString *string, BITRingBuffer *eventBuffer);
 
 /**
- *  Reset the event buffer so we can start appending JSON dictionaries.
+ *  Reset the event buffer, all items that have not been persisted are dropped.
  *
- *  @param eventBuffer The string that will be reset.
+ *  @param eventBuffer The buffer that will be reset.
  */
-void bit_resetEventBuffer(char *__nonnull*__nonnull eventBuffer);
+void bit_resetEventBuffer(BITRingBuffer *_Nullable eventBuffer);
 
 /**
  *  A method which indicates whether the telemetry pipeline is busy and no new data should be enqueued.
@@ -99,6 +357,20 @@ void bit_resetEventBuffer(char *__nonnull*__nonnull eventBuffer);
  */
 - (BOOL)isQueueBusy;
 
+/**
+ *  Returns whether the caller runs on the channel's own dataItemsOperations queue.
+ *
+ *  @return YES if called on dataItemsOperations.
+ */
+- (BOOL)isOnDataItemsOperations;
+
+/**
+ *  Runs a block on dataItemsOperations and waits for it, or runs it right away if called there already.
+ *
+ *  @param block the block to run.
+ */
+- (void)performOnDataItemsOperations:(dispatch_block_t)block;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -0,0 +1,223 @@
+#import <Foundation/Foundation.h>
+#import <stdbool.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  The codecs telemetry batches can be stored with. Every codec produces a self-describing stream, so stored data can be
+ *  decompressed without knowing which codec has been used to compress it.
+ */
+typedef NS_ENUM(uint8_t, BITCompressionCodec) {
+
+  /**
+   *  A gzip member, which is what the server expects. Data stored with this codec can be uploaded as it is.
+   */
+  BITCompressionCodecGzip = 0,
+
+  /**
+   *  A zlib stream compressed with a preset dictionary of the strings every envelope contains, which improves the
+   *  ratio of small batches considerably. Has to be recompressed with gzip before it's uploaded.
+   */
+  BITCompressionCodecDeflateDictionary = 1,
+
+  /**
+   *  An LZFSE stream created by libcompression, which is a lot faster than zlib at a similar ratio. Only available on
+   *  OS X 10.11 and later. Has to be recompressed with gzip before it's uploaded.
+   */
+  BITCompressionCodecLZFSE = 2
+};
+
+/**
+ *  A reusable streaming compressor. The input is passed in chunks and compressed into an NSMutableData, the state is
+ *  reset between streams instead of being allocated again.
+ *
+ *  A compressor is not thread-safe, callers have to serialize access.
+ */
+typedef struct BITCompressor BITCompressor;
+
+/**
+ *  Returns whether a codec can be used on the running system.
+ *
+ *  @param codec the codec
+ *
+ *  @return true if compressors for the codec can be created
+ */
+bool bit_compressionCodecIsAvailable(BITCompressionCodec codec);
+
+/**
+ *  Creates a compressor.
+ *
+ *  @param codec the codec to compress with
+ *
+ *  @return the compressor or NULL if the codec is not available or the state could not be allocated
+ */
+BITCompressor *_Nullable bit_compressorCreate(BITCompressionCodec codec);
+
+/**
+ *  Frees a compressor.
+ *
+ *  @param compressor the compressor to free
+ */
+void bit_compressorDestroy(BITCompressor *_Nullable compressor);
+
+/**
+ *  Returns the codec of a compressor.
+ *
+ *  @param compressor the compressor
+ *
+ *  @return the codec the compressor has been created with
+ */
+BITCompressionCodec bit_compressorCodec(const BITCompressor *compressor);
+
+/**
+ *  Starts a new stream. The output is replaced and sized for the expected input length, so a stream usually doesn't
+ *  have to grow it.
+ *
+ *  @param compressor the compressor
+ *  @param output the data the compressed stream is written to, must stay alive until bit_compressorFinish returns
+ *  @param expectedLength the expected number of input bytes
+ *
+ *  @return false if the compressor could not be reset
+ */
+bool bit_compressorBegin(BITCompressor *compressor, NSMutableData *output, size_t expectedLength);
+
+/**
+ *  Compresses a chunk of input.
+ *
+ *  @param compressor the compressor
+ *  @param bytes the input
+ *  @param length the number of input bytes
+ *
+ *  @return false if compression failed, the stream has to be started again
+ */
+bool bit_compressorWrite(BITCompressor *compressor, const void *bytes, size_t length);
+
+/**
+ *  Ends the stream and truncates the output to the compressed length.
+ *
+ *  @param compressor the compressor
+ *
+ *  @return false if compression failed
+ */
+bool bit_compressorFinish(BITCompressor *compressor);
+
+/**
+ *  Compresses data with a codec in one go.
+ *
+ *  @param data the data to compress
+ *  @param codec the codec
+ *
+ *  @return the compressed data or nil if the codec is not available or compression failed
+ */
+NSData *_Nullable bit_compressData(NSData *data, BITCompressionCodec codec);
+
+/**
+ *  Supplies the next chunk of input to a stream.
+ *
+ *  @param context the context passed to the stream function
+ *  @param buffer the buffer to copy the input to
+ *  @param capacity the size of the buffer
+ *
+ *  @return the number of bytes copied, 0 at the end of the input or -1 if the input could not be read
+ */
+typedef long (*BITCompressionInputCallback)(void *_Nullable context, void *buffer, size_t capacity);
+
+/**
+ *  Receives the next chunk of output of a stream.
+ *
+ *  @param context the context passed to the stream function
+ *  @param bytes the output, only valid during the call
+ *  @param length the number of output bytes
+ *
+ *  @return false to abort the stream
+ */
+typedef bool (*BITCompressionOutputCallback)(void *_Nullable context, const void *bytes, size_t length);
+
+/**
+ *  Gzips input of any length in chunks, so neither the input nor the output has to be held in memory at once. The
+ *  zlib state is reused by all calls on the same thread.
+ *
+ *  @param level the zlib compression level or Z_DEFAULT_COMPRESSION
+ *  @param input supplies the input
+ *  @param output receives the gzip member
+ *  @param context passed to the callbacks
+ *
+ *  @return false if reading, compressing or writing failed
+ */
+bool bit_gzipStream(int level, BITCompressionInputCallback input, BITCompressionOutputCallback output, void *_Nullable context);
+
+/**
+ *  Inflates a gzip member or zlib stream, including those of BITCompressionCodecDeflateDictionary, in chunks. The zlib
+ *  state is reused by all calls on the same thread.
+ *
+ *  @param input supplies the compressed input
+ *  @param output receives the inflated data
+ *  @param context passed to the callbacks
+ *
+ *  @return false if reading, inflating or writing failed or the input ended before the stream did
+ */
+bool bit_gunzipStream(BITCompressionInputCallback input, BITCompressionOutputCallback output, void *_Nullable context);
+
+/**
+ *  Gzips data in memory. The output is sized with deflateBound up front, so it's never grown or copied.
+ *
+ *  @param data the data to compress
+ *  @param level the zlib compression level or Z_DEFAULT_COMPRESSION
+ *
+ *  @return the gzip member or nil if the data is empty or compression failed
+ */
+NSData *_Nullable bit_gzipData(NSData *data, int level);
+
+/**
+ *  Inflates a gzip member or zlib stream in memory. The output is sized with the length stored in the gzip trailer and
+ *  grows geometrically if that's not enough.
+ *
+ *  @param data the compressed data
+ *
+ *  @return the inflated data or nil if the data is empty or damaged
+ */
+NSData *_Nullable bit_gunzipData(NSData *data);
+
+/**
+ *  Determines the codec data has been compressed with.
+ *
+ *  @param data the data
+ *  @param codec set to the codec if the data is compressed, may be NULL
+ *
+ *  @return false if the data is not compressed with a known codec
+ */
+bool bit_compressionCodecOfData(NSData *data, BITCompressionCodec *_Nullable codec);
+
+/**
+ *  Decompresses data compressed with any of the codecs and renders binary batches, see bit_renderBinaryBatch. Data
+ *  that is neither is returned as it is.
+ *
+ *  @param data the data
+ *
+ *  @return the decompressed data or nil if the data is damaged or its codec is not available
+ */
+NSData *_Nullable bit_decompressData(NSData *data);
+
+/**
+ *  Returns stored data in the format it is uploaded in, which is gzip. Gzipped data is returned as it is, everything
+ *  else is decompressed and gzipped.
+ *
+ *  @param data the stored data
+ *
+ *  @return the gzipped data or nil if the data could not be decompressed
+ */
+NSData *_Nullable bit_gzippedDataForUpload(NSData *data);
+
+/**
+ *  Checks whether a file holds gzipped data that can be uploaded as it is, without reading more than its header and its
+ *  trailer.
+ *
+ *  @param path the path of the file
+ *  @param uncompressedLength set to the uncompressed length the trailer declares, may be NULL
+ *
+ *  @return false if the file can't be read or is not gzipped
+ */
+bool bit_gzipFileInfo(const char *path, size_t *_Nullable uncompressedLength);
+
+NS_ASSUME_NONNULL_END
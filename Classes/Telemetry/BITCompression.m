@@ -0,0 +1,625 @@
+#import "BITCompression.h"
+#import "BITGZIP.h"
+#import "BITBinaryBatch.h"
+#import <compression.h>
+#import <dlfcn.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#import <zlib.h>
+
+// Window bits for zlib to write a gzip header and trailer instead of a zlib one.
+static int const BITGzipWindowBits = 15 + 16;
+
+// Window bits for a zlib header, which is what carries the id of the preset dictionary.
+static int const BITZlibWindowBits = 15;
+
+// Window bits for inflate to detect a gzip or zlib header by itself.
+static int const BITInflateWindowBits = 15 + 32;
+
+// Outputs grow by half their size, but at least by this much.
+static size_t const BITMinimumOutputGrowth = 16 * 1024;
+
+// Size of the input and output chunks of the streaming API.
+#define BITStreamChunkSize (32 * 1024)
+
+// Deflate can't compress better than this.
+static size_t const BITMaximumDeflateRatio = 1032;
+
+// Size of a gzip header without optional fields and its trailer.
+static size_t const BITGzipMinimumLength = 18;
+
+/**
+ *  The preset dictionary of BITCompressionCodecDeflateDictionary, built from the strings every envelope contains.
+ *  Deflate encodes references to the end of the dictionary more cheaply, so the most common strings come last.
+ *
+ *  Changing the dictionary makes batches stored with it unreadable. The Adler-32 checksum of the dictionary is part of
+ *  every stream, so a mismatch is detected instead of producing garbage.
+ */
+static const char BITTelemetryDictionary[] =
+  "\"ai.device.roleInstance\":\"\",\"ai.device.screenResolution\":\"\",\"ai.device.network\":\"\","
+  "\"ai.user.storeRegion\":\"\",\"ai.internal.agentVersion\":\"\",\"ai.user.accountId\":\"\","
+  "{\"state\":1},\"baseType\":\"SessionStateData\"},\"name\":\"Microsoft.ApplicationInsights.SessionState\","
+  "\"properties\":{\"\":\"\"},\"measurements\":{\"\":0.5},"
+  "\"ai.application.ver\":\"1.0 (1)\",\"ai.device.type\":\"Pc\",\"ai.device.language\":\"en\","
+  "\"ai.device.locale\":\"en_US\",\"ai.device.model\":\"x86_64\",\"ai.device.oemName\":\"Apple\","
+  "\"ai.device.os\":\"OS X\",\"ai.device.osVersion\":\"10.12.1 (16B2555)\",\"ai.internal.sdkVersion\":\"osx:4.\","
+  "\"ai.device.id\":\"\",\"ai.user.id\":\"\",\"ai.session.isFirst\":\"false\",\"ai.session.isNew\":\"true\","
+  "\"ai.session.id\":\"\"},\"data\":{\"baseType\":\"EventData\",\"baseData\":{\"ver\":2,\"name\":\"\"}}}\n"
+  "{\"ver\":1,\"name\":\"Microsoft.ApplicationInsights.Event\",\"time\":\"2017-01-01T00:00:00.000Z\","
+  "\"sampleRate\":100,\"iKey\":\"00000000-0000-0000-0000-000000000000\",\"tags\":{";
+
+#pragma mark - libcompression
+
+// libcompression only exists on OS X 10.11 and later, it is looked up at runtime so the SDK still loads on 10.9.
+typedef compression_status (*bit_compression_stream_init_t)(compression_stream *stream, compression_stream_operation operation, compression_algorithm algorithm);
+typedef compression_status (*bit_compression_stream_process_t)(compression_stream *stream, int flags);
+typedef compression_status (*bit_compression_stream_destroy_t)(compression_stream *stream);
+
+static bit_compression_stream_init_t bit_compression_stream_init;
+static bit_compression_stream_process_t bit_compression_stream_process;
+static bit_compression_stream_destroy_t bit_compression_stream_destroy;
+
+static bool bit_loadCompressionLibrary(void) {
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    void *library = dlopen("/usr/lib/libcompression.dylib", RTLD_LAZY | RTLD_LOCAL);
+    if (!library) {
+      return;
+    }
+    bit_compression_stream_init = (bit_compression_stream_init_t)dlsym(library, "compression_stream_init");
+    bit_compression_stream_process = (bit_compression_stream_process_t)dlsym(library, "compression_stream_process");
+    bit_compression_stream_destroy = (bit_compression_stream_destroy_t)dlsym(library, "compression_stream_destroy");
+  });
+  return bit_compression_stream_init && bit_compression_stream_process && bit_compression_stream_destroy;
+}
+
+#pragma mark - Output
+
+typedef struct {
+  void *data;
+  size_t length;
+} BITCompressionOutput;
+
+/**
+ *  Makes sure there's space left in the output and returns the position to continue writing at.
+ */
+static uint8_t *bit_reserveOutput(BITCompressionOutput *output, size_t *available) {
+  NSMutableData *data = (__bridge NSMutableData *)output->data;
+  if (data.length <= output->length) {
+    data.length = output->length + MAX(output->length / 2, BITMinimumOutputGrowth);
+  }
+  *available = data.length - output->length;
+  return (uint8_t *)data.mutableBytes + output->length;
+}
+
+#pragma mark - Per-thread streams
+
+/**
+ *  The zlib streams of a thread. Setting up a deflate stream allocates about 256 KB, so the streams are reset and
+ *  reused by every call on the same thread instead.
+ */
+typedef struct {
+  z_stream deflateStream;
+  z_stream inflateStream;
+  int deflateLevel;
+  bool deflateInitialized;
+  bool inflateInitialized;
+  bool inUse;
+  uint8_t input[BITStreamChunkSize];
+  uint8_t output[BITStreamChunkSize];
+} BITZlibThreadState;
+
+static pthread_key_t BITZlibThreadStateKey;
+
+static void bit_zlibThreadStateDestroy(void *value) {
+  BITZlibThreadState *state = value;
+  if (state->deflateInitialized) {
+    deflateEnd(&state->deflateStream);
+  }
+  if (state->inflateInitialized) {
+    inflateEnd(&state->inflateStream);
+  }
+  free(state);
+}
+
+/**
+ *  Returns the streams of the calling thread. If they are already in use further up the stack, e.g. because an output
+ *  callback compresses data itself, a temporary state is returned that has to be destroyed after use.
+ */
+static BITZlibThreadState *bit_zlibThreadStateAcquire(bool *temporary) {
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    pthread_key_create(&BITZlibThreadStateKey, bit_zlibThreadStateDestroy);
+  });
+  BITZlibThreadState *state = pthread_getspecific(BITZlibThreadStateKey);
+  *temporary = state && state->inUse;
+  if (!state || *temporary) {
+    state = calloc(1, sizeof(BITZlibThreadState));
+    if (!state) {
+      return NULL;
+    }
+    if (!*temporary && pthread_setspecific(BITZlibThreadStateKey, state) != 0) {
+      *temporary = true;
+    }
+  }
+  state->inUse = true;
+  return state;
+}
+
+static void bit_zlibThreadStateRelease(BITZlibThreadState *state, bool temporary) {
+  if (temporary) {
+    bit_zlibThreadStateDestroy(state);
+  } else {
+    state->inUse = false;
+  }
+}
+
+static z_stream *bit_zlibThreadStateDeflateStream(BITZlibThreadState *state, int level) {
+
+  // deflateParams would have to flush, a stream for another level is set up again instead.
+  if (state->deflateInitialized && state->deflateLevel != level) {
+    deflateEnd(&state->deflateStream);
+    state->deflateInitialized = false;
+  }
+  if (state->deflateInitialized) {
+
+    // A reset keeps the input of a stream that was abandoned.
+    state->deflateStream.next_in = Z_NULL;
+    state->deflateStream.avail_in = 0;
+    return deflateReset(&state->deflateStream) == Z_OK ? &state->deflateStream : NULL;
+  }
+  memset(&state->deflateStream, 0, sizeof(z_stream));
+  if (deflateInit2(&state->deflateStream, level, Z_DEFLATED, BITGzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return NULL;
+  }
+  state->deflateInitialized = true;
+  state->deflateLevel = level;
+  return &state->deflateStream;
+}
+
+static z_stream *bit_zlibThreadStateInflateStream(BITZlibThreadState *state) {
+  if (state->inflateInitialized) {
+    state->inflateStream.next_in = Z_NULL;
+    state->inflateStream.avail_in = 0;
+    return inflateReset(&state->inflateStream) == Z_OK ? &state->inflateStream : NULL;
+  }
+  memset(&state->inflateStream, 0, sizeof(z_stream));
+  if (inflateInit2(&state->inflateStream, BITInflateWindowBits) != Z_OK) {
+    return NULL;
+  }
+  state->inflateInitialized = true;
+  return &state->inflateStream;
+}
+
+/**
+ *  Calls inflate and supplies the preset dictionary if the stream asks for it.
+ */
+static int bit_inflate(z_stream *stream) {
+  int status = inflate(stream, Z_NO_FLUSH);
+  if (status == Z_NEED_DICT) {
+    const Bytef *dictionary = (const Bytef *)BITTelemetryDictionary;
+    uInt dictionaryLength = sizeof(BITTelemetryDictionary) - 1;
+    if (stream->adler != adler32(adler32(0, NULL, 0), dictionary, dictionaryLength)) {
+      return Z_DATA_ERROR;
+    }
+    status = inflateSetDictionary(stream, dictionary, dictionaryLength);
+  }
+  return status;
+}
+
+bool bit_gzipStream(int level, BITCompressionInputCallback input, BITCompressionOutputCallback output, void *context) {
+  bool temporary;
+  BITZlibThreadState *state = bit_zlibThreadStateAcquire(&temporary);
+  if (!state) {
+    return false;
+  }
+  z_stream *stream = bit_zlibThreadStateDeflateStream(state, level);
+  bool success = stream != NULL;
+  bool endOfInput = false;
+  int status = Z_OK;
+  while (success && status != Z_STREAM_END) {
+    if (stream->avail_in == 0 && !endOfInput) {
+      long length = input(context, state->input, BITStreamChunkSize);
+      if (length < 0) {
+        success = false;
+        break;
+      }
+      endOfInput = length == 0;
+      stream->next_in = state->input;
+      stream->avail_in = (uInt)length;
+    }
+    stream->next_out = state->output;
+    stream->avail_out = BITStreamChunkSize;
+    status = deflate(stream, endOfInput ? Z_FINISH : Z_NO_FLUSH);
+    size_t length = BITStreamChunkSize - stream->avail_out;
+    success = status != Z_STREAM_ERROR && (length == 0 || output(context, state->output, length));
+  }
+  bit_zlibThreadStateRelease(state, temporary);
+  return success;
+}
+
+bool bit_gunzipStream(BITCompressionInputCallback input, BITCompressionOutputCallback output, void *context) {
+  bool temporary;
+  BITZlibThreadState *state = bit_zlibThreadStateAcquire(&temporary);
+  if (!state) {
+    return false;
+  }
+  z_stream *stream = bit_zlibThreadStateInflateStream(state);
+  bool success = stream != NULL;
+  int status = Z_OK;
+  while (success && status != Z_STREAM_END) {
+    if (stream->avail_in == 0) {
+
+      // The input must not end before the stream does.
+      long length = input(context, state->input, BITStreamChunkSize);
+      if (length <= 0) {
+        success = false;
+        break;
+      }
+      stream->next_in = state->input;
+      stream->avail_in = (uInt)length;
+    }
+    stream->next_out = state->output;
+    stream->avail_out = BITStreamChunkSize;
+    status = bit_inflate(stream);
+    size_t length = BITStreamChunkSize - stream->avail_out;
+    success = (status == Z_OK || status == Z_STREAM_END || status == Z_BUF_ERROR) &&
+              (length == 0 || output(context, state->output, length));
+  }
+  bit_zlibThreadStateRelease(state, temporary);
+  return success;
+}
+
+NSData *bit_gzipData(NSData *data, int level) {
+  if (data.length == 0 || data.length > UINT_MAX) {
+    return nil;
+  }
+  bool temporary;
+  BITZlibThreadState *state = bit_zlibThreadStateAcquire(&temporary);
+  if (!state) {
+    return nil;
+  }
+  NSMutableData *result = nil;
+  z_stream *stream = bit_zlibThreadStateDeflateStream(state, level);
+  if (stream) {
+
+    // deflate finishes in one call if the output is as large as the bound, so nothing is ever copied.
+    result = [NSMutableData dataWithLength:deflateBound(stream, (uLong)data.length)];
+    stream->next_in = (Bytef *)(uintptr_t)data.bytes;
+    stream->avail_in = (uInt)data.length;
+    stream->next_out = result.mutableBytes;
+    stream->avail_out = (uInt)result.length;
+    if (deflate(stream, Z_FINISH) == Z_STREAM_END) {
+      result.length = stream->total_out;
+    } else {
+      result = nil;
+    }
+  }
+  bit_zlibThreadStateRelease(state, temporary);
+  return result;
+}
+
+/**
+ *  Returns how large the output of inflating data probably is. The trailer of a gzip member contains its uncompressed
+ *  length modulo 2^32, which is exact for everything this SDK compresses. Lengths deflate can't reach are ignored, so
+ *  a damaged trailer doesn't cause a huge allocation.
+ */
+static size_t bit_expectedInflatedLength(NSData *data) {
+  const uint8_t *bytes = data.bytes;
+  if (data.length >= BITGzipMinimumLength && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+    const uint8_t *trailer = bytes + data.length - 4;
+    size_t length = (size_t)trailer[0] | (size_t)trailer[1] << 8 | (size_t)trailer[2] << 16 | (size_t)trailer[3] << 24;
+    if (length >= data.length && length / BITMaximumDeflateRatio <= data.length) {
+      return length;
+    }
+  }
+  return data.length * 4;
+}
+
+NSData *bit_gunzipData(NSData *data) {
+  if (data.length == 0 || data.length > UINT_MAX) {
+    return nil;
+  }
+  bool temporary;
+  BITZlibThreadState *state = bit_zlibThreadStateAcquire(&temporary);
+  if (!state) {
+    return nil;
+  }
+  NSMutableData *result = nil;
+  z_stream *stream = bit_zlibThreadStateInflateStream(state);
+  if (stream) {
+    result = [NSMutableData dataWithLength:bit_expectedInflatedLength(data)];
+    BITCompressionOutput output = {.data = (__bridge void *)result, .length = 0};
+    stream->next_in = (Bytef *)(uintptr_t)data.bytes;
+    stream->avail_in = (uInt)data.length;
+    int status;
+    do {
+      size_t available;
+      stream->next_out = bit_reserveOutput(&output, &available);
+      stream->avail_out = (uInt)MIN(available, UINT_MAX);
+      uInt availableBefore = stream->avail_out;
+      status = bit_inflate(stream);
+      output.length += availableBefore - stream->avail_out;
+    } while (status == Z_OK);
+    if (status == Z_STREAM_END) {
+      result.length = output.length;
+    } else {
+      result = nil;
+    }
+  }
+  bit_zlibThreadStateRelease(state, temporary);
+  return result;
+}
+
+#pragma mark - Compressor
+
+struct BITCompressor {
+  BITCompressionCodec codec;
+  BITCompressionOutput output;
+  z_stream zlibStream;
+  compression_stream lzfseStream;
+  bool lzfseStreamInitialized;
+};
+
+bool bit_compressionCodecIsAvailable(BITCompressionCodec codec) {
+  switch (codec) {
+    case BITCompressionCodecGzip:
+    case BITCompressionCodecDeflateDictionary:
+      return true;
+    case BITCompressionCodecLZFSE:
+      return bit_loadCompressionLibrary();
+  }
+  return false;
+}
+
+BITCompressor *bit_compressorCreate(BITCompressionCodec codec) {
+  if (!bit_compressionCodecIsAvailable(codec)) {
+    return NULL;
+  }
+  BITCompressor *compressor = calloc(1, sizeof(BITCompressor));
+  if (!compressor) {
+    return NULL;
+  }
+  compressor->codec = codec;
+  if (codec == BITCompressionCodecGzip || codec == BITCompressionCodecDeflateDictionary) {
+    int windowBits = codec == BITCompressionCodecGzip ? BITGzipWindowBits : BITZlibWindowBits;
+    if (deflateInit2(&compressor->zlibStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      free(compressor);
+      return NULL;
+    }
+  }
+  return compressor;
+}
+
+static void bit_compressorDestroyLZFSEStream(BITCompressor *compressor) {
+  if (compressor->lzfseStreamInitialized) {
+    bit_compression_stream_destroy(&compressor->lzfseStream);
+    compressor->lzfseStreamInitialized = false;
+  }
+}
+
+void bit_compressorDestroy(BITCompressor *compressor) {
+  if (!compressor) {
+    return;
+  }
+  if (compressor->codec == BITCompressionCodecLZFSE) {
+    bit_compressorDestroyLZFSEStream(compressor);
+  } else {
+    deflateEnd(&compressor->zlibStream);
+  }
+  free(compressor);
+}
+
+BITCompressionCodec bit_compressorCodec(const BITCompressor *compressor) {
+  return compressor->codec;
+}
+
+bool bit_compressorBegin(BITCompressor *compressor, NSMutableData *output, size_t expectedLength) {
+  size_t capacity = 0;
+  switch (compressor->codec) {
+    case BITCompressionCodecGzip:
+    case BITCompressionCodecDeflateDictionary:
+      if (deflateReset(&compressor->zlibStream) != Z_OK) {
+        return false;
+      }
+
+      // The dictionary has to be set again after every reset.
+      if (compressor->codec == BITCompressionCodecDeflateDictionary &&
+          deflateSetDictionary(&compressor->zlibStream, (const Bytef *)BITTelemetryDictionary, sizeof(BITTelemetryDictionary) - 1) != Z_OK) {
+        return false;
+      }
+      capacity = deflateBound(&compressor->zlibStream, (uLong)expectedLength);
+      break;
+    case BITCompressionCodecLZFSE:
+      bit_compressorDestroyLZFSEStream(compressor);
+      if (bit_compression_stream_init(&compressor->lzfseStream, COMPRESSION_STREAM_ENCODE, COMPRESSION_LZFSE) != COMPRESSION_STATUS_OK) {
+        return false;
+      }
+      compressor->lzfseStreamInitialized = true;
+
+      // There's no bound for LZFSE, telemetry compresses far better than this anyway.
+      capacity = expectedLength / 2 + 1024;
+      break;
+  }
+  output.length = capacity;
+  compressor->output.data = (__bridge void *)output;
+  compressor->output.length = 0;
+  return true;
+}
+
+static bool bit_compressorProcessZlib(BITCompressor *compressor, const void *bytes, size_t length, bool finish) {
+  z_stream *stream = &compressor->zlibStream;
+  int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+  stream->next_in = (Bytef *)(uintptr_t)bytes;
+  stream->avail_in = (uInt)length;
+  int status;
+  do {
+    size_t available;
+    stream->next_out = bit_reserveOutput(&compressor->output, &available);
+    stream->avail_out = (uInt)MIN(available, UINT_MAX);
+    uInt availableBefore = stream->avail_out;
+    status = deflate(stream, flush);
+    compressor->output.length += availableBefore - stream->avail_out;
+    if (status == Z_STREAM_ERROR) {
+      return false;
+    }
+  } while (stream->avail_out == 0 || (finish && status != Z_STREAM_END));
+  return true;
+}
+
+static bool bit_compressorProcessLZFSE(BITCompressor *compressor, const void *bytes, size_t length, bool finish) {
+  compression_stream *stream = &compressor->lzfseStream;
+  stream->src_ptr = bytes;
+  stream->src_size = length;
+  compression_status status;
+  do {
+    size_t available;
+    stream->dst_ptr = bit_reserveOutput(&compressor->output, &available);
+    stream->dst_size = available;
+    status = bit_compression_stream_process(stream, finish ? COMPRESSION_STREAM_FINALIZE : 0);
+    compressor->output.length += available - stream->dst_size;
+    if (status == COMPRESSION_STATUS_ERROR) {
+      return false;
+    }
+  } while (stream->dst_size == 0 || stream->src_size > 0 || (finish && status != COMPRESSION_STATUS_END));
+  return true;
+}
+
+bool bit_compressorWrite(BITCompressor *compressor, const void *bytes, size_t length) {
+  if (!compressor->output.data || length > UINT_MAX) {
+    return false;
+  }
+  if (compressor->codec == BITCompressionCodecLZFSE) {
+    return bit_compressorProcessLZFSE(compressor, bytes, length, false);
+  }
+  return bit_compressorProcessZlib(compressor, bytes, length, false);
+}
+
+bool bit_compressorFinish(BITCompressor *compressor) {
+  if (!compressor->output.data) {
+    return false;
+  }
+  bool success;
+  if (compressor->codec == BITCompressionCodecLZFSE) {
+    success = bit_compressorProcessLZFSE(compressor, NULL, 0, true);
+    bit_compressorDestroyLZFSEStream(compressor);
+  } else {
+    success = bit_compressorProcessZlib(compressor, NULL, 0, true);
+  }
+  NSMutableData *output = (__bridge NSMutableData *)compressor->output.data;
+  output.length = success ? compressor->output.length : 0;
+  compressor->output.data = NULL;
+  return success;
+}
+
+NSData *bit_compressData(NSData *data, BITCompressionCodec codec) {
+  if (codec == BITCompressionCodecGzip) {
+    return bit_gzipData(data, Z_DEFAULT_COMPRESSION);
+  }
+  BITCompressor *compressor = bit_compressorCreate(codec);
+  if (!compressor) {
+    return nil;
+  }
+  NSMutableData *output = [NSMutableData new];
+  bool success = bit_compressorBegin(compressor, output, data.length) &&
+                 bit_compressorWrite(compressor, data.bytes, data.length) &&
+                 bit_compressorFinish(compressor);
+  bit_compressorDestroy(compressor);
+  return success ? output : nil;
+}
+
+#pragma mark - Decompression
+
+bool bit_compressionCodecOfData(NSData *data, BITCompressionCodec *codec) {
+  if (data.length < 4) {
+    return false;
+  }
+  const uint8_t *bytes = data.bytes;
+  BITCompressionCodec detectedCodec;
+  if (bytes[0] == 0x1f && bytes[1] == 0x8b) {
+    detectedCodec = BITCompressionCodecGzip;
+  } else if ((bytes[0] & 0x0f) == Z_DEFLATED && ((bytes[0] << 8) | bytes[1]) % 31 == 0 && (bytes[1] & 0x20)) {
+
+    // A zlib header with the preset dictionary flag set. JSON lines start with '{', so this can't be uncompressed data.
+    detectedCodec = BITCompressionCodecDeflateDictionary;
+  } else if (bytes[0] == 'b' && bytes[1] == 'v' && bytes[2] == 'x') {
+
+    // Every LZFSE block starts with one of the "bvx" magics.
+    detectedCodec = BITCompressionCodecLZFSE;
+  } else {
+    return false;
+  }
+  if (codec) {
+    *codec = detectedCodec;
+  }
+  return true;
+}
+
+static NSData *bit_decodeLZFSEData(NSData *data) {
+  compression_stream stream;
+  if (!bit_loadCompressionLibrary() || bit_compression_stream_init(&stream, COMPRESSION_STREAM_DECODE, COMPRESSION_LZFSE) != COMPRESSION_STATUS_OK) {
+    return nil;
+  }
+  NSMutableData *result = [NSMutableData dataWithLength:data.length * 4];
+  BITCompressionOutput output = {.data = (__bridge void *)result, .length = 0};
+  stream.src_ptr = data.bytes;
+  stream.src_size = data.length;
+  compression_status status;
+  do {
+    size_t available;
+    stream.dst_ptr = bit_reserveOutput(&output, &available);
+    stream.dst_size = available;
+    status = bit_compression_stream_process(&stream, COMPRESSION_STREAM_FINALIZE);
+    output.length += available - stream.dst_size;
+  } while (status == COMPRESSION_STATUS_OK);
+  bit_compression_stream_destroy(&stream);
+  if (status != COMPRESSION_STATUS_END) {
+    return nil;
+  }
+  result.length = output.length;
+  return result;
+}
+
+NSData *bit_decompressData(NSData *data) {
+  if (bit_isBinaryBatch(data.bytes, data.length)) {
+    return bit_renderBinaryBatch(data);
+  }
+  BITCompressionCodec codec;
+  if (!bit_compressionCodecOfData(data, &codec)) {
+    return data;
+  }
+  if (codec == BITCompressionCodecLZFSE) {
+    return bit_decodeLZFSEData(data);
+  }
+  return bit_gunzipData(data);
+}
+
+NSData *bit_gzippedDataForUpload(NSData *data) {
+  BITCompressionCodec codec;
+  if (bit_compressionCodecOfData(data, &codec) && codec == BITCompressionCodecGzip) {
+    return data;
+  }
+  NSData *uncompressedData = bit_decompressData(data);
+  return uncompressedData ? bit_gzipData((NSData *)uncompressedData, Z_DEFAULT_COMPRESSION) : nil;
+}
+
+bool bit_gzipFileInfo(const char *path, size_t *uncompressedLength) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat status;
+  uint8_t header[3];
+  uint8_t trailer[4];
+  bool isGzip = fstat(fd, &status) == 0 && status.st_size >= (off_t)BITGzipMinimumLength &&
+                pread(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                header[0] == 0x1f && header[1] == 0x8b && header[2] == Z_DEFLATED &&
+                pread(fd, trailer, sizeof(trailer), status.st_size - (off_t)sizeof(trailer)) == (ssize_t)sizeof(trailer);
+  close(fd);
+  if (isGzip && uncompressedLength) {
+    *uncompressedLength = (size_t)trailer[0] | (size_t)trailer[1] << 8 | (size_t)trailer[2] << 16 | (size_t)trailer[3] << 24;
+  }
+  return isGzip;
+}
@@ -15,6 +15,19 @@
     return dict;
 }
 
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *)writer {
+    [super serializeMembersToJSONWriter:writer];
+    if (self.baseData != nil) {
+        BITJSONWriterCheckpoint checkpoint = bit_jsonWriterCheckpoint(writer);
+        bit_jsonWriterKey(writer, "baseData");
+        [self.baseData serializeToJSONWriter:writer];
+        if (bit_jsonWriterHasFailed(writer)) {
+            bit_jsonWriterRestore(writer, checkpoint);
+            NSLog(@"[HockeyApp] Some of the telemetry data was not NSJSONSerialization compatible and could not be serialized!");
+        }
+    }
+}
+
 #pragma mark - NSCoding
 
 - (instancetype)initWithCoder:(NSCoder *)coder {
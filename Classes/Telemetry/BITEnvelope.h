@@ -17,6 +17,12 @@
 @property (nonatomic, copy) NSString *appVer;
 @property (nonatomic, copy) NSString *userId;
 @property (nonatomic, strong) NSDictionary *tags;
+
+/**
+ *  Tags that have already been serialized to a JSON object. If set, they are written instead of tags by
+ *  serializeToJSONWriter:, serializeToDictionary always uses tags.
+ */
+@property (nonatomic, strong) NSData *tagsFragment;
 @property (nonatomic, strong) BITBase *data;
 
 
@@ -69,6 +69,79 @@
   return dict;
 }
 
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *)writer {
+  [super serializeMembersToJSONWriter:writer];
+  if(self.version != nil) {
+    bit_jsonWriterKey(writer, "ver");
+    bit_jsonWriterObject(writer, self.version);
+  }
+  if(self.name != nil) {
+    bit_jsonWriterKey(writer, "name");
+    bit_jsonWriterNSString(writer, self.name);
+  }
+  if(self.time != nil) {
+    bit_jsonWriterKey(writer, "time");
+    bit_jsonWriterNSString(writer, self.time);
+  }
+  if(self.sampleRate != nil) {
+    bit_jsonWriterKey(writer, "sampleRate");
+    bit_jsonWriterObject(writer, self.sampleRate);
+  }
+  if(self.seq != nil) {
+    bit_jsonWriterKey(writer, "seq");
+    bit_jsonWriterNSString(writer, self.seq);
+  }
+  if(self.iKey != nil) {
+    bit_jsonWriterKey(writer, "iKey");
+    bit_jsonWriterNSString(writer, self.iKey);
+  }
+  if(self.flags != nil) {
+    bit_jsonWriterKey(writer, "flags");
+    bit_jsonWriterObject(writer, self.flags);
+  }
+  if(self.deviceId != nil) {
+    bit_jsonWriterKey(writer, "deviceId");
+    bit_jsonWriterNSString(writer, self.deviceId);
+  }
+  if(self.os != nil) {
+    bit_jsonWriterKey(writer, "os");
+    bit_jsonWriterNSString(writer, self.os);
+  }
+  if(self.osVer != nil) {
+    bit_jsonWriterKey(writer, "osVer");
+    bit_jsonWriterNSString(writer, self.osVer);
+  }
+  if(self.appId != nil) {
+    bit_jsonWriterKey(writer, "appId");
+    bit_jsonWriterNSString(writer, self.appId);
+  }
+  if(self.appVer != nil) {
+    bit_jsonWriterKey(writer, "appVer");
+    bit_jsonWriterNSString(writer, self.appVer);
+  }
+  if(self.userId != nil) {
+    bit_jsonWriterKey(writer, "userId");
+    bit_jsonWriterNSString(writer, self.userId);
+  }
+  if(self.tagsFragment != nil) {
+    bit_jsonWriterKey(writer, "tags");
+    bit_jsonWriterRaw(writer, self.tagsFragment.bytes, self.tagsFragment.length);
+  } else if(self.tags != nil) {
+    bit_jsonWriterKey(writer, "tags");
+    bit_jsonWriterObject(writer, self.tags);
+  }
+
+  if (self.data != nil) {
+    BITJSONWriterCheckpoint checkpoint = bit_jsonWriterCheckpoint(writer);
+    bit_jsonWriterKey(writer, "data");
+    [self.data serializeToJSONWriter:writer];
+    if (bit_jsonWriterHasFailed(writer)) {
+      bit_jsonWriterRestore(writer, checkpoint);
+      NSLog(@"[HockeyApp] Some of the telemetry data was not NSJSONSerialization compatible and could not be serialized!");
+    }
+  }
+}
+
 #pragma mark - NSCoding
 
 - (instancetype)initWithCoder:(NSCoder *)coder {
@@ -0,0 +1,138 @@
+#import <Foundation/Foundation.h>
+#import "HockeySDKNullability.h"
+
+@class BITEventData;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Called with every event that should be tracked, may be called on any thread.
+ */
+typedef void (^BITEventAggregatorHandler)(BITEventData *eventData);
+
+/**
+ *  Samples and rolls up tracked events before they are handed to the channel.
+ *
+ *  Sampled events are kept with the sampling percentage of their name. Every kept event stands for 100 / percentage
+ *  events, which is stamped into the `sampleRate` of its envelope, so counts stay correct.
+ *
+ *  Events with aggregation enabled are not tracked one by one. All events with the same name and properties are
+ *  collected in a single aggregate until the interval has passed, which is then tracked as one event:
+ *
+ *  - the envelope's `sampleRate` is 100 divided by the number of events the aggregate stands for, its measurement
+ *    `aggregate.count` is that number
+ *  - every measurement holds the sum of its values divided by the number of events, events without the measurement
+ *    count as 0, so extrapolating with the sample rate yields the sum
+ *  - `<measurement>.count` holds the number of events with the measurement, `<measurement>.sum`,
+ *    `<measurement>.min` and `<measurement>.max` hold the summary of its values
+ *  - `<measurement>.le.<bound>` holds the number of values less than or equal to each bucket boundary that aren't less
+ *    than or equal to the previous one, `<measurement>.gt.<bound>` the number of values above the last boundary
+ *
+ *  Counts, sums and buckets are weighted with the events the sampled events stand for.
+ */
+@interface BITEventAggregator : NSObject
+
+/**
+ *  Initializes an aggregator.
+ *
+ *  @param handler called with every event that should be tracked, right away for events that are not aggregated and
+ *                 with aggregates once their interval has passed
+ *
+ *  @return the aggregator
+ */
+- (instancetype)initWithHandler:(BITEventAggregatorHandler)handler NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ *  The number of seconds events are collected in an aggregate before it is tracked.
+ *
+ *  Default: 60
+ */
+@property (atomic, assign) NSTimeInterval interval;
+
+/**
+ *  The upper bounds of the histogram buckets of every measurement, in ascending order. No histogram is added if empty.
+ *
+ *  Default: 1, 10, 100, 1000 and 10000
+ */
+@property (atomic, copy) NSArray<NSNumber *> *histogramBucketBoundaries;
+
+/**
+ *  The max number of aggregates collected at a time. All aggregates are tracked early once it is exceeded, which limits
+ *  the memory taken by events with many different properties.
+ *
+ *  Default: 1000
+ */
+@property (atomic, assign) NSUInteger maxAggregateCount;
+
+/**
+ *  Sets the percentage of events with the given name that are kept.
+ *
+ *  @param percentage between 0 and 100, 100 keeps every event
+ *  @param eventName the name of the events
+ */
+- (void)setSamplingPercentage:(double)percentage forEventWithName:(NSString *)eventName;
+
+/**
+ *  Returns the percentage of events with the given name that are kept, 100 unless set otherwise.
+ *
+ *  @param eventName the name of the events
+ *
+ *  @return the percentage
+ */
+- (double)samplingPercentageForEventWithName:(NSString *)eventName;
+
+/**
+ *  Enables or disables aggregation for events with the given name. Aggregates collected so far are tracked when
+ *  aggregation is disabled.
+ *
+ *  @param enabled whether the events should be aggregated
+ *  @param eventName the name of the events
+ */
+- (void)setAggregationEnabled:(BOOL)enabled forEventWithName:(NSString *)eventName;
+
+/**
+ *  Returns whether events with the given name are aggregated.
+ *
+ *  @param eventName the name of the events
+ *
+ *  @return YES if the events are aggregated
+ */
+- (BOOL)isAggregationEnabledForEventWithName:(NSString *)eventName;
+
+/**
+ *  Samples an event and either hands it to the handler or adds it to its aggregate.
+ *
+ *  @param eventName the name of the event
+ *  @param properties the properties of the event
+ *  @param measurements the measurements of the event
+ */
+- (void)addEventWithName:(NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements;
+
+/**
+ *  Samples an event and adds it to its aggregate if it is aggregated. Unlike addEventWithName:properties:measurements:
+ *  this leaves tracking events that are not aggregated to the caller, so no BITEventData has to be created for them.
+ *
+ *  @param eventName the name of the event
+ *  @param properties the properties of the event
+ *  @param measurements the measurements of the event
+ *  @param samplingPercentage set to the percentage the event has been sampled with, 100 if it isn't sampled
+ *
+ *  @return YES if the caller has to track the event, NO if it has been sampled out or added to an aggregate
+ */
+- (BOOL)shouldTrackEventWithName:(NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements samplingPercentage:(double *)samplingPercentage;
+
+/**
+ *  Hands all aggregates to the handler, regardless of their interval.
+ */
+- (void)flush;
+
+/**
+ *  The number of aggregates currently collected.
+ */
+@property (atomic, assign, readonly) NSUInteger aggregateCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
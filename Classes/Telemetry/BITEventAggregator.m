@@ -0,0 +1,288 @@
+#import "BITEventAggregator.h"
+#import "BITEventData.h"
+
+static NSTimeInterval const BITDefaultAggregationInterval = 60;
+static NSUInteger const BITDefaultMaxAggregateCount = 1000;
+static double const BITFullSamplingPercentage = 100;
+
+// Sampling decisions are made in steps of a millionth of a percent.
+static uint32_t const BITSamplingResolution = 100000000;
+
+static NSString *const kBITAggregateCountKey = @"aggregate.count";
+
+// Separators that can't be part of an event name or property, so different tuples never get the same key.
+static NSString *const kBITAggregateKeySeparator = @"\x1f";
+static NSString *const kBITAggregateValueSeparator = @"\x1e";
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  The summary of the values of a single measurement in an aggregate.
+ */
+@interface BITMeasurementSummary : NSObject
+
+@property (nonatomic, assign) double count;
+@property (nonatomic, assign) double sum;
+@property (nonatomic, assign) double min;
+@property (nonatomic, assign) double max;
+
+/**
+ *  One weighted count per bucket, the last bucket counts the values above the last boundary.
+ */
+@property (nonatomic, strong) NSMutableData *buckets;
+
+@end
+
+@implementation BITMeasurementSummary
+@end
+
+/**
+ *  All events with the same name and properties collected during an interval.
+ */
+@interface BITEventAggregate : NSObject
+
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, copy) NSDictionary<NSString *, NSString *> *properties;
+@property (nonatomic, copy) NSArray<NSNumber *> *bucketBoundaries;
+@property (nonatomic, assign) double count;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, BITMeasurementSummary *> *measurements;
+
+@end
+
+@implementation BITEventAggregate
+
+- (void)addMeasurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements weight:(double)weight {
+  self.count += weight;
+  [measurements enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *number, BOOL * __unused stop) {
+    if (![number isKindOfClass:[NSNumber class]] || isnan(number.doubleValue)) {
+      return;
+    }
+    double value = number.doubleValue;
+    BITMeasurementSummary *summary = self.measurements[key];
+    if (!summary) {
+      summary = [BITMeasurementSummary new];
+      summary.min = value;
+      summary.max = value;
+      summary.buckets = [NSMutableData dataWithLength:(self.bucketBoundaries.count + 1) * sizeof(double)];
+      self.measurements[key] = summary;
+    }
+    summary.count += weight;
+    summary.sum += value * weight;
+    summary.min = MIN(summary.min, value);
+    summary.max = MAX(summary.max, value);
+
+    NSUInteger bucket = 0;
+    while (bucket < self.bucketBoundaries.count && value > self.bucketBoundaries[bucket].doubleValue) {
+      bucket++;
+    }
+    ((double *)summary.buckets.mutableBytes)[bucket] += weight;
+  }];
+}
+
+- (BITEventData *)eventData {
+  NSMutableDictionary<NSString *, NSNumber *> *measurements = [NSMutableDictionary new];
+  measurements[kBITAggregateCountKey] = @(self.count);
+  [self.measurements enumerateKeysAndObjectsUsingBlock:^(NSString *key, BITMeasurementSummary *summary, BOOL * __unused stop) {
+
+    // Divided by all events of the aggregate, also the ones without the measurement, so it extrapolates to the sum.
+    measurements[key] = @(summary.sum / self.count);
+    measurements[[key stringByAppendingString:@".count"]] = @(summary.count);
+    measurements[[key stringByAppendingString:@".sum"]] = @(summary.sum);
+    measurements[[key stringByAppendingString:@".min"]] = @(summary.min);
+    measurements[[key stringByAppendingString:@".max"]] = @(summary.max);
+    const double *buckets = summary.buckets.bytes;
+    for (NSUInteger i = 0; i < self.bucketBoundaries.count; i++) {
+      measurements[[NSString stringWithFormat:@"%@.le.%@", key, self.bucketBoundaries[i]]] = @(buckets[i]);
+    }
+    if (self.bucketBoundaries.count > 0) {
+      measurements[[NSString stringWithFormat:@"%@.gt.%@", key, self.bucketBoundaries.lastObject]] = @(buckets[self.bucketBoundaries.count]);
+    }
+  }];
+
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = self.name;
+  eventData.properties = self.properties;
+  eventData.measurements = measurements;
+  eventData.sampleRate = @(BITFullSamplingPercentage / self.count);
+  return eventData;
+}
+
+@end
+
+@interface BITEventAggregator ()
+
+@property (nonatomic, copy) BITEventAggregatorHandler handler;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *samplingPercentages;
+@property (nonatomic, strong) NSMutableSet<NSString *> *aggregatedEventNames;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, BITEventAggregate *> *aggregates;
+@property (nonatomic, strong) dispatch_queue_t timerQueue;
+@property (nonatomic, strong, nullable) dispatch_source_t timerSource;
+@property (atomic, assign) NSUInteger aggregateCount;
+
+@end
+
+@implementation BITEventAggregator
+
+- (instancetype)initWithHandler:(BITEventAggregatorHandler)handler {
+  if ((self = [super init])) {
+    _handler = [handler copy];
+    _interval = BITDefaultAggregationInterval;
+    _histogramBucketBoundaries = @[@1, @10, @100, @1000, @10000];
+    _maxAggregateCount = BITDefaultMaxAggregateCount;
+    _samplingPercentages = [NSMutableDictionary new];
+    _aggregatedEventNames = [NSMutableSet new];
+    _aggregates = [NSMutableDictionary new];
+    _timerQueue = dispatch_queue_create("net.hockeyapp.eventAggregatorQueue", DISPATCH_QUEUE_SERIAL);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (_timerSource) {
+    dispatch_source_cancel((dispatch_source_t)_timerSource);
+  }
+}
+
+#pragma mark - Configuration
+
+- (void)setSamplingPercentage:(double)percentage forEventWithName:(NSString *)eventName {
+  @synchronized(self) {
+    self.samplingPercentages[eventName] = @(MAX(MIN(percentage, BITFullSamplingPercentage), 0));
+  }
+}
+
+- (double)samplingPercentageForEventWithName:(NSString *)eventName {
+  @synchronized(self) {
+    NSNumber *percentage = self.samplingPercentages[eventName];
+    return percentage ? percentage.doubleValue : BITFullSamplingPercentage;
+  }
+}
+
+- (void)setAggregationEnabled:(BOOL)enabled forEventWithName:(NSString *)eventName {
+  @synchronized(self) {
+    if (enabled) {
+      [self.aggregatedEventNames addObject:eventName];
+    } else {
+      [self.aggregatedEventNames removeObject:eventName];
+    }
+  }
+  if (!enabled) {
+    [self flush];
+  }
+}
+
+- (BOOL)isAggregationEnabledForEventWithName:(NSString *)eventName {
+  @synchronized(self) {
+    return [self.aggregatedEventNames containsObject:eventName];
+  }
+}
+
+#pragma mark - Adding events
+
+- (void)addEventWithName:(NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements {
+  double samplingPercentage;
+  if (![self shouldTrackEventWithName:eventName properties:properties measurements:measurements samplingPercentage:&samplingPercentage]) {
+    return;
+  }
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = eventName;
+  if (properties) {
+    eventData.properties = properties;
+  }
+  if (measurements) {
+    eventData.measurements = (NSDictionary *)measurements;
+  }
+  if (samplingPercentage < BITFullSamplingPercentage) {
+    eventData.sampleRate = @(samplingPercentage);
+  }
+  self.handler(eventData);
+}
+
+- (BOOL)shouldTrackEventWithName:(NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements samplingPercentage:(double *)samplingPercentage {
+  double percentage = [self samplingPercentageForEventWithName:eventName];
+  *samplingPercentage = percentage;
+  if (percentage < BITFullSamplingPercentage &&
+      (double)arc4random_uniform(BITSamplingResolution) >= percentage / BITFullSamplingPercentage * BITSamplingResolution) {
+    return NO;
+  }
+
+  if (![self isAggregationEnabledForEventWithName:eventName]) {
+    return YES;
+  }
+
+  BOOL full;
+  @synchronized(self) {
+    NSString *key = [self aggregateKeyForEventWithName:eventName properties:properties];
+    BITEventAggregate *aggregate = self.aggregates[key];
+    if (!aggregate) {
+      aggregate = [BITEventAggregate new];
+      aggregate.name = eventName;
+      aggregate.properties = properties ?: @{};
+      aggregate.bucketBoundaries = self.histogramBucketBoundaries;
+      aggregate.measurements = [NSMutableDictionary new];
+      self.aggregates[key] = aggregate;
+      self.aggregateCount = self.aggregates.count;
+    }
+    [aggregate addMeasurements:measurements weight:BITFullSamplingPercentage / percentage];
+    full = self.aggregates.count > self.maxAggregateCount;
+    if (!full && !self.timerSource) {
+      [self startTimer];
+    }
+  }
+  if (full) {
+    [self flush];
+  }
+  return NO;
+}
+
+- (NSString *)aggregateKeyForEventWithName:(NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties {
+  NSMutableString *key = [eventName mutableCopy];
+  for (NSString *propertyName in [properties.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+    [key appendFormat:@"%@%@%@%@", kBITAggregateKeySeparator, propertyName, kBITAggregateValueSeparator, properties[propertyName]];
+  }
+  return key;
+}
+
+#pragma mark - Flushing
+
+- (void)flush {
+  NSArray<BITEventAggregate *> *aggregates;
+  @synchronized(self) {
+    aggregates = self.aggregates.allValues;
+    [self.aggregates removeAllObjects];
+    self.aggregateCount = 0;
+    [self invalidateTimer];
+  }
+
+  // The handler is called without holding the lock, it may track events itself.
+  for (BITEventAggregate *aggregate in aggregates) {
+    self.handler([aggregate eventData]);
+  }
+}
+
+- (void)invalidateTimer {
+  @synchronized(self) {
+    if (self.timerSource != nil) {
+      dispatch_source_cancel((dispatch_source_t)self.timerSource);
+      self.timerSource = nil;
+    }
+  }
+}
+
+- (void)startTimer {
+  @synchronized(self) {
+    dispatch_source_t timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.timerQueue);
+    dispatch_source_set_timer(timerSource, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(NSEC_PER_SEC * self.interval)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(timerSource, ^{
+      typeof(self) strongSelf = weakSelf;
+      [strongSelf flush];
+    });
+    dispatch_resume(timerSource);
+    self.timerSource = timerSource;
+  }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
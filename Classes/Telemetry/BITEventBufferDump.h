@@ -0,0 +1,38 @@
+#import <stdbool.h>
+#import <sys/types.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Writes the telemetry items of BITTelemetryEventBuffer that have not been persisted to a file if the app crashes.
+ *
+ *  The file is opened and truncated when the SDK starts and its descriptor is kept open, so all that is left to do
+ *  after a crash is a series of write(2) calls, which is async-signal-safe. The items are written as the JSON lines they
+ *  are buffered as, BITPersistence turns them into a regular bundle on the next launch.
+ */
+
+/**
+ *  Opens the dump file for this launch. A file left behind by an earlier launch has to be recovered before, it is
+ *  truncated. A dump file that has been opened before is closed.
+ *
+ *  @param path the path of the dump file
+ *
+ *  @return false if the file could not be opened
+ */
+bool bit_eventBufferDumpOpen(const char *path);
+
+/**
+ *  Closes the dump file, nothing is written after a crash anymore.
+ */
+void bit_eventBufferDumpClose(void);
+
+/**
+ *  Appends the committed items of BITTelemetryEventBuffer to the dump file. Async-signal-safe, it neither allocates
+ *  memory nor takes locks, so it can be called from a crash handler.
+ *
+ *  @return the number of bytes written, 0 if there is no dump file or no event buffer, -1 on error
+ */
+ssize_t bit_eventBufferDumpWrite(void);
+
+NS_ASSUME_NONNULL_END
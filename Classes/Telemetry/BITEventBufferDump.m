@@ -0,0 +1,36 @@
+#import "BITEventBufferDump.h"
+#import "BITChannel.h"
+#import <fcntl.h>
+#import <stdatomic.h>
+#import <unistd.h>
+
+// A lock-free atomic int, loading it is async-signal-safe.
+static _Atomic(int) BITEventBufferDumpFileDescriptor = -1;
+
+bool bit_eventBufferDumpOpen(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  int previous = atomic_exchange_explicit(&BITEventBufferDumpFileDescriptor, fd, memory_order_acq_rel);
+  if (previous >= 0) {
+    close(previous);
+  }
+  return true;
+}
+
+void bit_eventBufferDumpClose(void) {
+  int previous = atomic_exchange_explicit(&BITEventBufferDumpFileDescriptor, -1, memory_order_acq_rel);
+  if (previous >= 0) {
+    close(previous);
+  }
+}
+
+ssize_t bit_eventBufferDumpWrite(void) {
+  int fd = atomic_load_explicit(&BITEventBufferDumpFileDescriptor, memory_order_acquire);
+  BITRingBuffer *eventBuffer = BITTelemetryEventBuffer;
+  if (fd < 0 || !eventBuffer) {
+    return 0;
+  }
+  return bit_ringBufferWriteToFileDescriptor(eventBuffer, fd);
+}
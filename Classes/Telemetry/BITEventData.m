@@ -36,6 +36,22 @@
   return dict;
 }
 
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *)writer {
+  [super serializeMembersToJSONWriter:writer];
+  if (self.name != nil) {
+    bit_jsonWriterKey(writer, "name");
+    bit_jsonWriterNSString(writer, self.name);
+  }
+  if (self.properties != nil) {
+    bit_jsonWriterKey(writer, "properties");
+    bit_jsonWriterObject(writer, (NSDictionary *)self.properties);
+  }
+  if (self.measurements) {
+    bit_jsonWriterKey(writer, "measurements");
+    bit_jsonWriterObject(writer, self.measurements);
+  }
+}
+
 #pragma mark - NSCoding
 
 - (instancetype)initWithCoder:(NSCoder *)coder {
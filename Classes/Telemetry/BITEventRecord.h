@@ -0,0 +1,229 @@
+#import <CoreFoundation/CoreFoundation.h>
+#import <stdbool.h>
+#import <stddef.h>
+#import <stdint.h>
+#import "BITStringTable.h"
+#import "BITJSONWriter.h"
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A pool of event records shared by all threads that track events.
+ *
+ *  Records are taken out of the pool when an event is tracked and put back once it has been serialized, along with the
+ *  memory they have grown to, so a steady stream of events stops allocating once every record in flight has seen an
+ *  event of the largest size. Event names and property keys are interned in the string table of the pool and shared by
+ *  all records.
+ *
+ *  All functions except bit_eventRecordPoolCreate and bit_eventRecordPoolDestroy are safe to call from multiple threads.
+ */
+typedef struct BITEventRecordPool BITEventRecordPool;
+
+/**
+ *  A string of an event record. It either has an entry in the string table of the pool, if the string has been
+ *  interned, or its UTF-8 bytes are stored in the record itself, use bit_eventRecordStringBytes to get them.
+ */
+typedef struct {
+  const BITStringTableEntry *_Nullable entry;
+  uint32_t offset;
+  uint32_t length;
+} BITEventRecordString;
+
+typedef struct {
+  BITEventRecordString key;
+  BITEventRecordString value;
+} BITEventRecordProperty;
+
+typedef struct {
+  BITEventRecordString key;
+  double value;
+} BITEventRecordMeasurement;
+
+/**
+ *  A tracked event, or any other telemetry item, on its way from the tracking call to the event buffer.
+ *
+ *  Custom events are stored as plain C data. Other telemetry items are kept as the Objective-C object they have been
+ *  tracked as, which is retained by the record.
+ */
+typedef struct {
+
+  /**
+   *  The pool the record is returned to.
+   */
+  BITEventRecordPool *pool;
+
+  /**
+   *  A retained BITTelemetryData that is tracked instead of an event, NULL for events.
+   */
+  CFTypeRef _Nullable object;
+
+  BITEventRecordString name;
+
+  /**
+   *  The time the event was tracked at, in seconds since 1970.
+   */
+  double timestamp;
+
+  /**
+   *  The percentage the event has been sampled with, 0 if it hasn't been sampled.
+   */
+  double sampleRate;
+
+  BITEventRecordProperty *_Nullable properties;
+  uint32_t propertyCount;
+  uint32_t propertyCapacity;
+
+  BITEventRecordMeasurement *_Nullable measurements;
+  uint32_t measurementCount;
+  uint32_t measurementCapacity;
+
+  /**
+   *  The UTF-8 bytes of the strings that have not been interned.
+   */
+  char *_Nullable bytes;
+  size_t byteCount;
+  size_t byteCapacity;
+} BITEventRecord;
+
+/**
+ *  Creates a pool.
+ *
+ *  @param capacity the number of unused records the pool keeps, records returned to a full pool are freed
+ *
+ *  @return the pool or NULL if it could not be allocated
+ */
+BITEventRecordPool *_Nullable bit_eventRecordPoolCreate(size_t capacity);
+
+/**
+ *  Frees the pool, its unused records and its interned strings. All records taken out of it must have been returned.
+ *
+ *  @param pool the pool to free
+ */
+void bit_eventRecordPoolDestroy(BITEventRecordPool *_Nullable pool);
+
+/**
+ *  Takes an empty record out of the pool, a new record is allocated if the pool is empty.
+ *
+ *  @param pool the pool
+ *
+ *  @return the record or NULL if it could not be allocated
+ */
+BITEventRecord *_Nullable bit_eventRecordPoolAcquire(BITEventRecordPool *pool);
+
+/**
+ *  Releases the object of a record, empties it and returns it to its pool.
+ *
+ *  @param record the record, which must not be used afterwards
+ */
+void bit_eventRecordPoolRelease(BITEventRecord *record);
+
+/**
+ *  Returns the number of records that have been allocated by the pool so far.
+ *
+ *  @param pool the pool
+ *
+ *  @return the number of allocated records
+ */
+size_t bit_eventRecordPoolAllocatedCount(const BITEventRecordPool *pool);
+
+/**
+ *  Returns the number of strings that have been interned.
+ *
+ *  @param pool the pool
+ *
+ *  @return the number of interned strings
+ */
+size_t bit_eventRecordPoolInternedCount(const BITEventRecordPool *pool);
+
+/**
+ *  Returns the table names and keys are interned in.
+ *
+ *  @param pool the pool
+ *
+ *  @return the string table of the pool
+ */
+BITStringTable *bit_eventRecordPoolStringTable(const BITEventRecordPool *pool);
+
+/**
+ *  Sets the name of the event, which is interned.
+ *
+ *  @param record the record
+ *  @param name the name of the event
+ *
+ *  @return false if memory could not be allocated
+ */
+bool bit_eventRecordSetName(BITEventRecord *record, CFStringRef name);
+
+/**
+ *  Adds a property to the event, its key is interned.
+ *
+ *  @param record the record
+ *  @param key the key of the property
+ *  @param value the value of the property
+ *
+ *  @return false if memory could not be allocated
+ */
+bool bit_eventRecordAddProperty(BITEventRecord *record, CFStringRef key, CFStringRef value);
+
+/**
+ *  Adds a measurement to the event, its key is interned.
+ *
+ *  @param record the record
+ *  @param key the key of the measurement
+ *  @param value the value of the measurement
+ *
+ *  @return false if memory could not be allocated
+ */
+bool bit_eventRecordAddMeasurement(BITEventRecord *record, CFStringRef key, double value);
+
+/**
+ *  Returns the UTF-8 bytes of a string of a record, which are not NUL-terminated. Only valid until the record is
+ *  modified or released.
+ *
+ *  @param record the record the string belongs to
+ *  @param string the string
+ *
+ *  @return the bytes of the string
+ */
+const char *bit_eventRecordStringBytes(const BITEventRecord *record, BITEventRecordString string);
+
+/**
+ *  Formats the timestamp of a record the way envelopes are stamped, e.g. 2017-10-12T09:41:00.000Z.
+ *
+ *  @param record the record
+ *  @param buffer the buffer the NUL-terminated date is written to
+ *  @param size the size of the buffer, 25 bytes are needed
+ *
+ *  @return the length of the date or 0 if the buffer was too small
+ */
+size_t bit_eventRecordFormatTimestamp(const BITEventRecord *record, char *buffer, size_t size);
+
+/**
+ *  Begins the envelope of an event, writing its members up to the sample rate in the order BITEnvelope writes them.
+ *  The writer may write the optional iKey next, followed by bit_eventRecordBeginJSONEventData.
+ *
+ *  @param writer the writer
+ *  @param timestamp the time the event was tracked at, in seconds since 1970
+ *  @param sampleRate the percentage the event has been sampled with, 0 if it hasn't been sampled
+ */
+void bit_eventRecordBeginJSONEnvelope(BITJSONWriter *writer, double timestamp, double sampleRate);
+
+/**
+ *  Writes the tags of an event envelope and begins its base data. The writer writes the name, properties and
+ *  measurements of the event next, followed by bit_eventRecordEndJSONEnvelope.
+ *
+ *  @param writer the writer
+ *  @param tags the serialized tags object, NULL for no tags
+ *  @param tagsLength the number of bytes of the tags
+ */
+void bit_eventRecordBeginJSONEventData(BITJSONWriter *writer, const char *_Nullable tags, size_t tagsLength);
+
+/**
+ *  Ends the envelope of an event.
+ *
+ *  @param writer the writer
+ */
+void bit_eventRecordEndJSONEnvelope(BITJSONWriter *writer);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,268 @@
+#import "BITEventRecord.h"
+#import "BITBoundedQueue.h"
+#import <math.h>
+#import <stdatomic.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <time.h>
+
+// Names and keys are interned until there are this many of them, further strings are stored in the records instead, so
+// an app that uses unique event names can't grow the table without limit.
+static size_t const BITEventRecordMaxInternedStrings = 4096;
+
+// Event records are serialized without a BITEventData, so they are stamped with its types here.
+static char const BITEventEnvelopeTypeName[] = "Microsoft.ApplicationInsights.Event";
+static char const BITEventDataTypeName[] = "EventData";
+static long long const BITEnvelopeVersion = 1;
+static long long const BITEventDataVersion = 2;
+
+struct BITEventRecordPool {
+  BITBoundedQueue *freeRecords;
+  BITStringTable *strings;
+  _Atomic(size_t) allocatedCount;
+};
+
+static void bit_eventRecordFree(void *item) {
+  BITEventRecord *record = item;
+  free(record->properties);
+  free(record->measurements);
+  free(record->bytes);
+  free(record);
+}
+
+BITEventRecordPool *bit_eventRecordPoolCreate(size_t capacity) {
+  BITEventRecordPool *pool = calloc(1, sizeof(BITEventRecordPool));
+  if (!pool) {
+    return NULL;
+  }
+  pool->freeRecords = bit_boundedQueueCreate(capacity, bit_eventRecordFree);
+  pool->strings = bit_stringTableCreate(BITEventRecordMaxInternedStrings);
+  if (!pool->freeRecords || !pool->strings) {
+    bit_boundedQueueDestroy(pool->freeRecords);
+    bit_stringTableDestroy(pool->strings);
+    free(pool);
+    return NULL;
+  }
+  atomic_init(&pool->allocatedCount, 0);
+  return pool;
+}
+
+void bit_eventRecordPoolDestroy(BITEventRecordPool *pool) {
+  if (!pool) {
+    return;
+  }
+  bit_boundedQueueDestroy(pool->freeRecords);
+  bit_stringTableDestroy(pool->strings);
+  free(pool);
+}
+
+BITEventRecord *bit_eventRecordPoolAcquire(BITEventRecordPool *pool) {
+  void *item;
+  if (bit_boundedQueuePop(pool->freeRecords, &item)) {
+    return item;
+  }
+  BITEventRecord *record = calloc(1, sizeof(BITEventRecord));
+  if (!record) {
+    return NULL;
+  }
+  record->pool = pool;
+  atomic_fetch_add_explicit(&pool->allocatedCount, 1, memory_order_relaxed);
+  return record;
+}
+
+void bit_eventRecordPoolRelease(BITEventRecord *record) {
+  if (record->object) {
+    CFRelease(record->object);
+    record->object = NULL;
+  }
+  record->name = (BITEventRecordString){0};
+  record->timestamp = 0;
+  record->sampleRate = 0;
+  record->propertyCount = 0;
+  record->measurementCount = 0;
+  record->byteCount = 0;
+
+  // The record keeps the memory it has grown to, the pool frees it if enough records are unused already.
+  bit_boundedQueuePush(record->pool->freeRecords, record, BITBoundedQueueOverflowDropNewest);
+}
+
+size_t bit_eventRecordPoolAllocatedCount(const BITEventRecordPool *pool) {
+  return atomic_load_explicit(&pool->allocatedCount, memory_order_relaxed);
+}
+
+size_t bit_eventRecordPoolInternedCount(const BITEventRecordPool *pool) {
+  return bit_stringTableCount(pool->strings);
+}
+
+BITStringTable *bit_eventRecordPoolStringTable(const BITEventRecordPool *pool) {
+  return pool->strings;
+}
+
+#pragma mark - Strings
+
+static bool bit_eventRecordReserveBytes(BITEventRecord *record, size_t length) {
+  if (record->byteCount + length <= record->byteCapacity) {
+    return true;
+  }
+  size_t capacity = record->byteCapacity > 0 ? record->byteCapacity : 256;
+  while (capacity < record->byteCount + length) {
+    capacity *= 2;
+  }
+  char *bytes = realloc(record->bytes, capacity);
+  if (!bytes) {
+    return false;
+  }
+  record->bytes = bytes;
+  record->byteCapacity = capacity;
+  return true;
+}
+
+static bool bit_eventRecordCopyString(BITEventRecord *record, CFStringRef string, BITEventRecordString *result) {
+  CFIndex length = CFStringGetLength(string);
+  CFIndex maxLength = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+  if (maxLength == kCFNotFound || !bit_eventRecordReserveBytes(record, (size_t)maxLength)) {
+    return false;
+  }
+  // Unpaired surrogates can't be encoded, they are replaced like BITJSONWriter does instead of ending the string.
+  CFIndex usedLength = 0;
+  CFIndex converted = CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, '?', false,
+                                       (UInt8 *)record->bytes + record->byteCount, maxLength, &usedLength);
+  if (converted != length) {
+    return false;
+  }
+  *result = (BITEventRecordString){.entry = NULL, .offset = (uint32_t)record->byteCount, .length = (uint32_t)usedLength};
+  record->byteCount += (size_t)usedLength;
+  return true;
+}
+
+static bool bit_eventRecordInternString(BITEventRecord *record, CFStringRef string, BITEventRecordString *result) {
+  const BITStringTableEntry *entry = bit_stringTableIntern(record->pool->strings, string);
+  if (!entry) {
+    return bit_eventRecordCopyString(record, string, result);
+  }
+  *result = (BITEventRecordString){.entry = entry, .offset = 0, .length = entry->length};
+  return true;
+}
+
+const char *bit_eventRecordStringBytes(const BITEventRecord *record, BITEventRecordString string) {
+  if (string.entry) {
+    return string.entry->bytes;
+  }
+  return record->bytes ? record->bytes + string.offset : "";
+}
+
+#pragma mark - Members
+
+bool bit_eventRecordSetName(BITEventRecord *record, CFStringRef name) {
+  return bit_eventRecordInternString(record, name, &record->name);
+}
+
+bool bit_eventRecordAddProperty(BITEventRecord *record, CFStringRef key, CFStringRef value) {
+  if (record->propertyCount == record->propertyCapacity) {
+    uint32_t capacity = record->propertyCapacity > 0 ? record->propertyCapacity * 2 : 8;
+    BITEventRecordProperty *properties = realloc(record->properties, capacity * sizeof(BITEventRecordProperty));
+    if (!properties) {
+      return false;
+    }
+    record->properties = properties;
+    record->propertyCapacity = capacity;
+  }
+  BITEventRecordProperty *property = &record->properties[record->propertyCount];
+  if (!bit_eventRecordInternString(record, key, &property->key) ||
+      !bit_eventRecordCopyString(record, value, &property->value)) {
+    return false;
+  }
+  record->propertyCount++;
+  return true;
+}
+
+bool bit_eventRecordAddMeasurement(BITEventRecord *record, CFStringRef key, double value) {
+  if (record->measurementCount == record->measurementCapacity) {
+    uint32_t capacity = record->measurementCapacity > 0 ? record->measurementCapacity * 2 : 8;
+    BITEventRecordMeasurement *measurements = realloc(record->measurements, capacity * sizeof(BITEventRecordMeasurement));
+    if (!measurements) {
+      return false;
+    }
+    record->measurements = measurements;
+    record->measurementCapacity = capacity;
+  }
+  BITEventRecordMeasurement *measurement = &record->measurements[record->measurementCount];
+  if (!bit_eventRecordInternString(record, key, &measurement->key)) {
+    return false;
+  }
+  measurement->value = value;
+  record->measurementCount++;
+  return true;
+}
+
+static size_t bit_formatTimestamp(double timestamp, char *buffer, size_t size) {
+
+  // Rounded to whole milliseconds first, the fraction of a timestamp is rarely exact.
+  long long totalMilliseconds = llround(timestamp * 1000);
+  time_t time = (time_t)(totalMilliseconds / 1000);
+  int milliseconds = (int)(totalMilliseconds % 1000);
+  if (milliseconds < 0) {
+    time -= 1;
+    milliseconds += 1000;
+  }
+  struct tm components;
+  if (!gmtime_r(&time, &components)) {
+    return 0;
+  }
+  int length = snprintf(buffer, size, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                        components.tm_year + 1900, components.tm_mon + 1, components.tm_mday,
+                        components.tm_hour, components.tm_min, components.tm_sec, milliseconds);
+  if (length < 0 || (size_t)length >= size) {
+    return 0;
+  }
+  return (size_t)length;
+}
+
+size_t bit_eventRecordFormatTimestamp(const BITEventRecord *record, char *buffer, size_t size) {
+  return bit_formatTimestamp(record->timestamp, buffer, size);
+}
+
+#pragma mark - JSON
+
+void bit_eventRecordBeginJSONEnvelope(BITJSONWriter *writer, double timestamp, double sampleRate) {
+
+  // Members are written in the order an envelope with a BITEventData writes them, see BITEnvelope and BITEventData.
+  bit_jsonWriterBeginObject(writer);
+  bit_jsonWriterKey(writer, "ver");
+  bit_jsonWriterInteger(writer, BITEnvelopeVersion);
+  bit_jsonWriterKey(writer, "name");
+  bit_jsonWriterString(writer, BITEventEnvelopeTypeName, sizeof(BITEventEnvelopeTypeName) - 1);
+  char time[32];
+  size_t timeLength = bit_formatTimestamp(timestamp, time, sizeof(time));
+  if (timeLength > 0) {
+    bit_jsonWriterKey(writer, "time");
+    bit_jsonWriterString(writer, time, timeLength);
+  }
+  bit_jsonWriterKey(writer, "sampleRate");
+  bit_jsonWriterDouble(writer, sampleRate > 0 ? sampleRate : 100.0);
+}
+
+void bit_eventRecordBeginJSONEventData(BITJSONWriter *writer, const char *tags, size_t tagsLength) {
+  bit_jsonWriterKey(writer, "tags");
+  if (tags) {
+    bit_jsonWriterRaw(writer, tags, tagsLength);
+  } else {
+    bit_jsonWriterBeginObject(writer);
+    bit_jsonWriterEndObject(writer);
+  }
+  bit_jsonWriterKey(writer, "data");
+  bit_jsonWriterBeginObject(writer);
+  bit_jsonWriterKey(writer, "baseType");
+  bit_jsonWriterString(writer, BITEventDataTypeName, sizeof(BITEventDataTypeName) - 1);
+  bit_jsonWriterKey(writer, "baseData");
+  bit_jsonWriterBeginObject(writer);
+  bit_jsonWriterKey(writer, "ver");
+  bit_jsonWriterInteger(writer, BITEventDataVersion);
+}
+
+void bit_eventRecordEndJSONEnvelope(BITJSONWriter *writer) {
+  bit_jsonWriterEndObject(writer);
+  bit_jsonWriterEndObject(writer);
+  bit_jsonWriterEndObject(writer);
+}
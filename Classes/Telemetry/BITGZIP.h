@@ -38,5 +38,6 @@
 - (NSData *)bit_gzippedDataWithCompressionLevel:(float)level;
 - (NSData *)bit_gzippedData;
 - (NSData *)bit_gunzippedData;
+- (BOOL)bit_isGzippedData;
 
 @end
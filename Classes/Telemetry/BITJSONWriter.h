@@ -0,0 +1,194 @@
+#import <Foundation/Foundation.h>
+#import <stdbool.h>
+#import <stddef.h>
+#import <stdint.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A streaming JSON writer that renders values straight into a growable byte buffer.
+ *
+ *  Separators are inserted automatically and strings are escaped in a single pass while they are copied, so no
+ *  intermediate dictionaries or strings are needed to produce a JSON document. The buffer is kept across calls to
+ *  bit_jsonWriterReset, so a writer that is reused for every item stops allocating once it has grown to the size of the
+ *  largest item.
+ *
+ *  Errors are sticky: once a value could not be written (e.g. a non-finite number or an unsupported object type),
+ *  all further calls are ignored until the writer is reset or restored to an earlier checkpoint.
+ */
+typedef struct BITJSONWriter BITJSONWriter;
+
+/**
+ *  A position in the output of a writer that can be restored to drop everything written afterwards.
+ */
+typedef struct {
+  size_t length;
+  uint64_t separators;
+  unsigned int depth;
+  bool afterKey;
+  bool failed;
+} BITJSONWriterCheckpoint;
+
+/**
+ *  Creates a new writer.
+ *
+ *  @param capacity the initial capacity of the output buffer in bytes
+ *
+ *  @return a new writer or NULL if the buffer could not be allocated
+ */
+BITJSONWriter *_Nullable bit_jsonWriterCreate(size_t capacity);
+
+/**
+ *  Frees the writer and its output buffer.
+ *
+ *  @param writer the writer to destroy
+ */
+void bit_jsonWriterDestroy(BITJSONWriter *_Nullable writer);
+
+/**
+ *  Discards the output and the error state, but keeps the allocated buffer for the next document.
+ *
+ *  @param writer the writer to reset
+ */
+void bit_jsonWriterReset(BITJSONWriter *writer);
+
+/**
+ *  The bytes that have been written so far. Only valid until the next call that modifies the writer.
+ *
+ *  @param writer the writer
+ *
+ *  @return the UTF-8 encoded output, not NUL terminated
+ */
+const char *bit_jsonWriterBytes(const BITJSONWriter *writer);
+
+/**
+ *  The number of bytes that have been written so far.
+ *
+ *  @param writer the writer
+ *
+ *  @return the length of the output in bytes
+ */
+size_t bit_jsonWriterLength(const BITJSONWriter *writer);
+
+/**
+ *  Whether a value could not be written since the last reset.
+ *
+ *  @param writer the writer
+ *
+ *  @return true if the output is incomplete
+ */
+bool bit_jsonWriterHasFailed(const BITJSONWriter *writer);
+
+/**
+ *  Marks the current position of the writer.
+ *
+ *  @param writer the writer
+ *
+ *  @return a checkpoint that can be passed to bit_jsonWriterRestore
+ */
+BITJSONWriterCheckpoint bit_jsonWriterCheckpoint(const BITJSONWriter *writer);
+
+/**
+ *  Drops everything that has been written after the given checkpoint, including errors that occurred in between.
+ *
+ *  @param writer the writer
+ *  @param checkpoint a checkpoint previously taken from the same writer
+ */
+void bit_jsonWriterRestore(BITJSONWriter *writer, BITJSONWriterCheckpoint checkpoint);
+
+void bit_jsonWriterBeginObject(BITJSONWriter *writer);
+void bit_jsonWriterEndObject(BITJSONWriter *writer);
+void bit_jsonWriterBeginArray(BITJSONWriter *writer);
+void bit_jsonWriterEndArray(BITJSONWriter *writer);
+
+/**
+ *  Writes the key of the next member of the current object.
+ *
+ *  @param writer the writer
+ *  @param key a NUL terminated, UTF-8 encoded key
+ */
+void bit_jsonWriterKey(BITJSONWriter *writer, const char *key);
+
+/**
+ *  Writes the key of the next member of the current object.
+ *
+ *  @param writer the writer
+ *  @param bytes UTF-8 encoded bytes of the key
+ *  @param length the number of bytes
+ */
+void bit_jsonWriterStringKey(BITJSONWriter *writer, const char *bytes, size_t length);
+
+/**
+ *  Writes a string value.
+ *
+ *  @param writer the writer
+ *  @param bytes UTF-8 encoded bytes of the string
+ *  @param length the number of bytes
+ */
+void bit_jsonWriterString(BITJSONWriter *writer, const char *bytes, size_t length);
+
+void bit_jsonWriterInteger(BITJSONWriter *writer, long long value);
+void bit_jsonWriterUnsignedInteger(BITJSONWriter *writer, unsigned long long value);
+
+/**
+ *  Writes a number with the shortest representation that reads back as the same value. Fails for NaN and infinity,
+ *  which can't be represented in JSON.
+ *
+ *  @param writer the writer
+ *  @param value the number to write
+ */
+void bit_jsonWriterDouble(BITJSONWriter *writer, double value);
+
+void bit_jsonWriterBool(BITJSONWriter *writer, bool value);
+void bit_jsonWriterNull(BITJSONWriter *writer);
+
+/**
+ *  Writes a value that already is valid, serialized JSON, e.g. a cached fragment.
+ *
+ *  @param writer the writer
+ *  @param bytes the serialized value
+ *  @param length the number of bytes
+ */
+void bit_jsonWriterRaw(BITJSONWriter *writer, const char *bytes, size_t length);
+
+/**
+ *  Writes the key of the next member of the current object from a string that already is quoted and escaped, e.g. an
+ *  interned one.
+ *
+ *  @param writer the writer
+ *  @param bytes the serialized string
+ *  @param length the number of bytes
+ */
+void bit_jsonWriterRawKey(BITJSONWriter *writer, const char *bytes, size_t length);
+
+#pragma mark - Foundation
+
+/**
+ *  Writes the given string without creating a UTF-8 copy of it first.
+ *
+ *  @param writer the writer
+ *  @param string the string to write
+ */
+void bit_jsonWriterNSString(BITJSONWriter *writer, NSString *string);
+
+/**
+ *  Writes the given string as key of the next member of the current object.
+ *
+ *  @param writer the writer
+ *  @param key the key to write
+ */
+void bit_jsonWriterNSStringKey(BITJSONWriter *writer, NSString *key);
+
+/**
+ *  Writes a Foundation object graph, supporting the same types as NSJSONSerialization: NSDictionary with NSString keys,
+ *  NSArray, NSString, NSNumber and NSNull.
+ *
+ *  @param writer the writer
+ *  @param object the object to write
+ *
+ *  @return NO if the object graph contains unsupported values, in which case the writer is in the failed state
+ */
+BOOL bit_jsonWriterObject(BITJSONWriter *writer, id object);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,388 @@
+#import "BITJSONWriter.h"
+#import <math.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+
+// Nesting deeper than this is treated as an error, telemetry payloads are only a few levels deep.
+static unsigned int const BITJSONWriterMaxDepth = 64;
+
+struct BITJSONWriter {
+  char *bytes;
+  size_t length;
+  size_t capacity;
+
+  // One bit per nesting level, set once the container at that level has its first element.
+  uint64_t separators;
+  unsigned int depth;
+  bool afterKey;
+  bool failed;
+};
+
+// Replacement character for every byte that needs to be escaped, 'u' means \u00XX.
+static char const BITJSONEscapes[256] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+static char const BITJSONHexDigits[] = "0123456789abcdef";
+
+#pragma mark - Buffer
+
+static bool bit_jsonWriterReserve(BITJSONWriter *writer, size_t additionalLength) {
+  if (writer->failed) {
+    return false;
+  }
+  if (writer->capacity - writer->length >= additionalLength) {
+    return true;
+  }
+  size_t capacity = writer->capacity > 0 ? writer->capacity : 256;
+  while (capacity - writer->length < additionalLength) {
+    capacity *= 2;
+  }
+  char *bytes = realloc(writer->bytes, capacity);
+  if (!bytes) {
+    writer->failed = true;
+    return false;
+  }
+  writer->bytes = bytes;
+  writer->capacity = capacity;
+  return true;
+}
+
+static void bit_jsonWriterAppend(BITJSONWriter *writer, const char *bytes, size_t length) {
+  if (bit_jsonWriterReserve(writer, length)) {
+    memcpy(writer->bytes + writer->length, bytes, length);
+    writer->length += length;
+  }
+}
+
+static void bit_jsonWriterAppendByte(BITJSONWriter *writer, char byte) {
+  if (bit_jsonWriterReserve(writer, 1)) {
+    writer->bytes[writer->length++] = byte;
+  }
+}
+
+// Called in front of every value and key, writes the comma if the current container already has an element.
+static void bit_jsonWriterBeginValue(BITJSONWriter *writer) {
+  if (writer->afterKey) {
+    writer->afterKey = false;
+    return;
+  }
+  if (writer->depth == 0) {
+    return;
+  }
+  uint64_t bit = 1ull << (writer->depth - 1);
+  if (writer->separators & bit) {
+    bit_jsonWriterAppendByte(writer, ',');
+  } else {
+    writer->separators |= bit;
+  }
+}
+
+// Escapes bytes into the output, runs of bytes that don't need escaping are copied at once.
+static void bit_jsonWriterAppendEscaped(BITJSONWriter *writer, const char *bytes, size_t length) {
+  const unsigned char *input = (const unsigned char *)bytes;
+  size_t start = 0;
+  for (size_t i = 0; i < length; i++) {
+    char escape = BITJSONEscapes[input[i]];
+    if (escape == 0) {
+      continue;
+    }
+    bit_jsonWriterAppend(writer, bytes + start, i - start);
+    if (escape == 'u') {
+      char sequence[6] = {'\\', 'u', '0', '0', BITJSONHexDigits[input[i] >> 4], BITJSONHexDigits[input[i] & 0xf]};
+      bit_jsonWriterAppend(writer, sequence, sizeof(sequence));
+    } else {
+      char sequence[2] = {'\\', escape};
+      bit_jsonWriterAppend(writer, sequence, sizeof(sequence));
+    }
+    start = i + 1;
+  }
+  bit_jsonWriterAppend(writer, bytes + start, length - start);
+}
+
+#pragma mark - Writer
+
+BITJSONWriter *bit_jsonWriterCreate(size_t capacity) {
+  BITJSONWriter *writer = calloc(1, sizeof(BITJSONWriter));
+  if (!writer) {
+    return NULL;
+  }
+  if (capacity > 0) {
+    writer->bytes = malloc(capacity);
+    if (!writer->bytes) {
+      free(writer);
+      return NULL;
+    }
+    writer->capacity = capacity;
+  }
+  return writer;
+}
+
+void bit_jsonWriterDestroy(BITJSONWriter *writer) {
+  if (!writer) {
+    return;
+  }
+  free(writer->bytes);
+  free(writer);
+}
+
+void bit_jsonWriterReset(BITJSONWriter *writer) {
+  writer->length = 0;
+  writer->separators = 0;
+  writer->depth = 0;
+  writer->afterKey = false;
+  writer->failed = false;
+}
+
+const char *bit_jsonWriterBytes(const BITJSONWriter *writer) {
+  return writer->bytes ? writer->bytes : "";
+}
+
+size_t bit_jsonWriterLength(const BITJSONWriter *writer) {
+  return writer->length;
+}
+
+bool bit_jsonWriterHasFailed(const BITJSONWriter *writer) {
+  return writer->failed;
+}
+
+BITJSONWriterCheckpoint bit_jsonWriterCheckpoint(const BITJSONWriter *writer) {
+  BITJSONWriterCheckpoint checkpoint = {
+    .length = writer->length,
+    .separators = writer->separators,
+    .depth = writer->depth,
+    .afterKey = writer->afterKey,
+    .failed = writer->failed
+  };
+  return checkpoint;
+}
+
+void bit_jsonWriterRestore(BITJSONWriter *writer, BITJSONWriterCheckpoint checkpoint) {
+  writer->length = checkpoint.length;
+  writer->separators = checkpoint.separators;
+  writer->depth = checkpoint.depth;
+  writer->afterKey = checkpoint.afterKey;
+  writer->failed = checkpoint.failed;
+}
+
+static void bit_jsonWriterBeginContainer(BITJSONWriter *writer, char opening) {
+  bit_jsonWriterBeginValue(writer);
+  if (writer->depth >= BITJSONWriterMaxDepth) {
+    writer->failed = true;
+    return;
+  }
+  bit_jsonWriterAppendByte(writer, opening);
+  writer->depth++;
+  writer->separators &= ~(1ull << (writer->depth - 1));
+}
+
+static void bit_jsonWriterEndContainer(BITJSONWriter *writer, char closing) {
+  if (writer->depth == 0) {
+    writer->failed = true;
+    return;
+  }
+  writer->depth--;
+  bit_jsonWriterAppendByte(writer, closing);
+}
+
+void bit_jsonWriterBeginObject(BITJSONWriter *writer) {
+  bit_jsonWriterBeginContainer(writer, '{');
+}
+
+void bit_jsonWriterEndObject(BITJSONWriter *writer) {
+  bit_jsonWriterEndContainer(writer, '}');
+}
+
+void bit_jsonWriterBeginArray(BITJSONWriter *writer) {
+  bit_jsonWriterBeginContainer(writer, '[');
+}
+
+void bit_jsonWriterEndArray(BITJSONWriter *writer) {
+  bit_jsonWriterEndContainer(writer, ']');
+}
+
+void bit_jsonWriterKey(BITJSONWriter *writer, const char *key) {
+  bit_jsonWriterStringKey(writer, key, strlen(key));
+}
+
+void bit_jsonWriterStringKey(BITJSONWriter *writer, const char *bytes, size_t length) {
+  bit_jsonWriterString(writer, bytes, length);
+  bit_jsonWriterAppendByte(writer, ':');
+  writer->afterKey = true;
+}
+
+void bit_jsonWriterString(BITJSONWriter *writer, const char *bytes, size_t length) {
+  bit_jsonWriterBeginValue(writer);
+  bit_jsonWriterAppendByte(writer, '"');
+  bit_jsonWriterAppendEscaped(writer, bytes, length);
+  bit_jsonWriterAppendByte(writer, '"');
+}
+
+void bit_jsonWriterInteger(BITJSONWriter *writer, long long value) {
+  char number[24];
+  int length = snprintf(number, sizeof(number), "%lld", value);
+  bit_jsonWriterRaw(writer, number, (size_t)length);
+}
+
+void bit_jsonWriterUnsignedInteger(BITJSONWriter *writer, unsigned long long value) {
+  char number[24];
+  int length = snprintf(number, sizeof(number), "%llu", value);
+  bit_jsonWriterRaw(writer, number, (size_t)length);
+}
+
+void bit_jsonWriterDouble(BITJSONWriter *writer, double value) {
+  if (!isfinite(value)) {
+    writer->failed = true;
+    return;
+  }
+
+  // Integral values are by far the most common, they don't need a round trip through strtod.
+  if (value == floor(value) && fabs(value) < 9007199254740992.0) {
+    bit_jsonWriterInteger(writer, (long long)value);
+    return;
+  }
+  char number[32];
+  int length = 0;
+  for (int precision = 15; precision <= 17; precision++) {
+    length = snprintf(number, sizeof(number), "%.*g", precision, value);
+    if (strtod(number, NULL) == value) {
+      break;
+    }
+  }
+  bit_jsonWriterRaw(writer, number, (size_t)length);
+}
+
+void bit_jsonWriterBool(BITJSONWriter *writer, bool value) {
+  if (value) {
+    bit_jsonWriterRaw(writer, "true", 4);
+  } else {
+    bit_jsonWriterRaw(writer, "false", 5);
+  }
+}
+
+void bit_jsonWriterNull(BITJSONWriter *writer) {
+  bit_jsonWriterRaw(writer, "null", 4);
+}
+
+void bit_jsonWriterRaw(BITJSONWriter *writer, const char *bytes, size_t length) {
+  bit_jsonWriterBeginValue(writer);
+  bit_jsonWriterAppend(writer, bytes, length);
+}
+
+void bit_jsonWriterRawKey(BITJSONWriter *writer, const char *bytes, size_t length) {
+  bit_jsonWriterRaw(writer, bytes, length);
+  bit_jsonWriterAppendByte(writer, ':');
+  writer->afterKey = true;
+}
+
+#pragma mark - Foundation
+
+static void bit_jsonWriterAppendNSString(BITJSONWriter *writer, NSString *string) {
+  CFStringRef cfString = (__bridge CFStringRef)string;
+
+  // Most strings are stored as ASCII internally and can be escaped in place. They may contain U+0000, so their length
+  // is taken from the string rather than from the terminating zero, an ASCII string has a byte per character.
+  const char *bytes = CFStringGetCStringPtr(cfString, kCFStringEncodingASCII);
+  if (bytes) {
+    bit_jsonWriterAppendEscaped(writer, bytes, (size_t)CFStringGetLength(cfString));
+    return;
+  }
+
+  // Everything else is transcoded in chunks on the stack.
+  char chunk[512];
+  CFIndex length = CFStringGetLength(cfString);
+  CFIndex location = 0;
+  while (location < length && !writer->failed) {
+    CFIndex remaining = length - location;
+    CFIndex characterCount = remaining < 128 ? remaining : 128;
+
+    // Never split a surrogate pair between two chunks.
+    if (characterCount < remaining && CFStringIsSurrogateHighCharacter(CFStringGetCharacterAtIndex(cfString, location + characterCount - 1))) {
+      characterCount--;
+    }
+    CFIndex usedLength = 0;
+    CFIndex converted = CFStringGetBytes(cfString, CFRangeMake(location, characterCount), kCFStringEncodingUTF8, '?', false, (UInt8 *)chunk, (CFIndex)sizeof(chunk), &usedLength);
+    if (converted <= 0) {
+      writer->failed = true;
+      return;
+    }
+    bit_jsonWriterAppendEscaped(writer, chunk, (size_t)usedLength);
+    location += converted;
+  }
+}
+
+void bit_jsonWriterNSString(BITJSONWriter *writer, NSString *string) {
+  bit_jsonWriterBeginValue(writer);
+  bit_jsonWriterAppendByte(writer, '"');
+  bit_jsonWriterAppendNSString(writer, string);
+  bit_jsonWriterAppendByte(writer, '"');
+}
+
+void bit_jsonWriterNSStringKey(BITJSONWriter *writer, NSString *key) {
+  bit_jsonWriterNSString(writer, key);
+  bit_jsonWriterAppendByte(writer, ':');
+  writer->afterKey = true;
+}
+
+static void bit_jsonWriterNSNumber(BITJSONWriter *writer, NSNumber *number) {
+  if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+    bit_jsonWriterBool(writer, number.boolValue);
+    return;
+  }
+  switch (number.objCType[0]) {
+    case 'f':
+    case 'd':
+      bit_jsonWriterDouble(writer, number.doubleValue);
+      break;
+    case 'Q':
+      bit_jsonWriterUnsignedInteger(writer, number.unsignedLongLongValue);
+      break;
+    default:
+      bit_jsonWriterInteger(writer, number.longLongValue);
+      break;
+  }
+}
+
+BOOL bit_jsonWriterObject(BITJSONWriter *writer, id object) {
+  if (writer->failed) {
+    return NO;
+  }
+  if ([object isKindOfClass:[NSString class]]) {
+    bit_jsonWriterNSString(writer, (NSString *)object);
+  } else if ([object isKindOfClass:[NSNumber class]]) {
+    bit_jsonWriterNSNumber(writer, (NSNumber *)object);
+  } else if ([object isKindOfClass:[NSDictionary class]]) {
+    NSDictionary *dictionary = (NSDictionary *)object;
+    bit_jsonWriterBeginObject(writer);
+    for (id key in dictionary) {
+      if (![key isKindOfClass:[NSString class]]) {
+        writer->failed = true;
+        return NO;
+      }
+      bit_jsonWriterNSStringKey(writer, (NSString *)key);
+      if (!bit_jsonWriterObject(writer, (id)[dictionary objectForKey:key])) {
+        return NO;
+      }
+    }
+    bit_jsonWriterEndObject(writer);
+  } else if ([object isKindOfClass:[NSArray class]]) {
+    bit_jsonWriterBeginArray(writer);
+    for (id element in (NSArray *)object) {
+      if (!bit_jsonWriterObject(writer, element)) {
+        return NO;
+      }
+    }
+    bit_jsonWriterEndArray(writer);
+  } else if ([object isKindOfClass:[NSNull class]]) {
+    bit_jsonWriterNull(writer);
+  } else {
+    writer->failed = true;
+  }
+  return writer->failed ? NO : YES;
+}
@@ -1,6 +1,9 @@
 #import <Foundation/Foundation.h>
 #import "BITHockeyBaseManager.h"
 #import "HockeySDKNullability.h"
+#import "HockeySDKEnums.h"
+#import "BITBatchingPolicy.h"
+#import "BITTelemetryPipelineSnapshot.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -29,6 +32,122 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, assign) BOOL disabled;
 
+/**
+ *  The number of bytes of telemetry data that is stored on disk until it is sent. Once the limit is reached, stored
+ *  data is evicted according to `telemetryEvictionPolicy`.
+ *
+ *  Default: 2 MB
+ */
+@property (nonatomic, assign) NSUInteger telemetryStorageLimit;
+
+/**
+ *  Determines what happens to stored telemetry data once `telemetryStorageLimit` is reached. With
+ *  BITTelemetryEvictionPolicyNone, new events are dropped as soon as the limit is reached. With the other policies,
+ *  they are only dropped while nothing can be evicted, e.g. because all stored data is being sent.
+ *
+ *  Default: BITTelemetryEvictionPolicyOldestFirst
+ */
+@property (nonatomic, assign) BITTelemetryEvictionPolicy telemetryEvictionPolicy;
+
+/**
+ *  Decides when tracked events are written to disk as a batch, which is then sent in a request of its own. Use a
+ *  BITAdaptiveBatchingPolicy to size batches by bytes and adapt to the rate events are tracked at. Setting nil restores
+ *  the default.
+ *
+ *  Default: a BITFixedBatchingPolicy with a batch size of 50 events and an interval of 15 seconds
+ */
+@property (nonatomic, strong, null_resettable) id<BITBatchingPolicy> telemetryBatchingPolicy;
+
+/**
+ *  The number of bytes of telemetry data currently stored on disk.
+ */
+@property (nonatomic, assign, readonly) uint64_t telemetryBytesStored;
+
+/**
+ *  The number of bytes of stored telemetry data that have been evicted since the app was launched.
+ */
+@property (nonatomic, assign, readonly) uint64_t telemetryBytesEvicted;
+
+/**
+ *  The number of events that have been dropped or evicted since the app was launched.
+ */
+@property (nonatomic, assign, readonly) uint64_t telemetryEventsDropped;
+
+/**
+ *  Determines what happens to events that are tracked faster than they can be processed. Tracked events wait in a
+ *  queue of limited size until they are written to the event buffer, this decides what happens once it is full.
+ *
+ *  Default: BITTelemetryOverflowPolicyDropOldest
+ */
+@property (nonatomic, assign) BITTelemetryOverflowPolicy telemetryOverflowPolicy;
+
+/**
+ *  The number of events that have been dropped since the app was launched because they were tracked faster than they
+ *  could be processed. They are included in `telemetryEventsDropped`.
+ */
+@property (nonatomic, assign, readonly) uint64_t telemetryEventsDroppedOnOverflow;
+
+/**
+ *  The format batches of events are stored in. Binary batches store tracked events as their fields and the strings
+ *  they share only once per batch, so events are written faster and batches that are never sent are never rendered to
+ *  JSON. Binary batches are not compressed, which makes them larger on disk than compressed JSON.
+ *
+ *  With JSON batches, events that haven't been stored yet are written to disk when the app crashes and sent on the
+ *  next launch. Binary batches skip the buffer this is written from, so with them the events of the current batch are
+ *  lost if the app crashes. Changing the format stores the current batch.
+ *
+ *  Default: BITTelemetryBatchFormatJSON
+ */
+@property (nonatomic, assign) BITTelemetryBatchFormat telemetryBatchFormat;
+
+/**
+ *  The counters and stage durations of the telemetry pipeline, from tracking an event until its batch has been sent.
+ *  Use them to see how much the metrics module costs your app and where events get lost.
+ *
+ *  @return a snapshot of the current counters and durations
+ */
+- (BITTelemetryPipelineSnapshot *)telemetryPipelineSnapshot;
+
+/**
+ *  The number of seconds after which the `dictionaryRepresentation` of the current `telemetryPipelineSnapshot` is
+ *  tracked as the measurements of an event named `HockeySDK.TelemetryPipeline`. 0 disables the event.
+ *
+ *  Default: 0
+ */
+@property (nonatomic, assign) NSTimeInterval telemetryPipelineReportInterval;
+
+/**
+ *  The number of seconds events with aggregation enabled are rolled up for, see
+ *  `setAggregationEnabled:forEventWithName:`.
+ *
+ *  Default: 60
+ */
+@property (nonatomic, assign) NSTimeInterval eventAggregationInterval;
+
+/**
+ *  Sends only a percentage of the events with the given name, picked at random. Every event that is sent stands for
+ *  100 / samplingPercentage events, the `sampleRate` it is sent with tells the server how many, so event counts stay
+ *  correct.
+ *
+ *  @param samplingPercentage the percentage of events to send, between 0 and 100
+ *  @param eventName the name of the events
+ */
+- (void)setSamplingPercentage:(double)samplingPercentage forEventWithName:(nonnull NSString *)eventName;
+
+/**
+ *  Rolls up events with the given name instead of sending each of them. All events with the same name and properties
+ *  tracked during `eventAggregationInterval` are sent as a single event: its `sampleRate` makes it count as the number
+ *  of events it stands for, which is also stored in its measurement `aggregate.count`. Every measurement holds the mean
+ *  of its values, `<measurement>.sum`, `.min` and `.max` summarize them and `<measurement>.le.<bound>` and
+ *  `.gt.<bound>` count them in histogram buckets with the bounds 1, 10, 100, 1000 and 10000.
+ *
+ *  Use this for events that are tracked many times a second, e.g. in response to UI events.
+ *
+ *  @param enabled whether events with the given name are aggregated
+ *  @param eventName the name of the events
+ */
+- (void)setAggregationEnabled:(BOOL)enabled forEventWithName:(nonnull NSString *)eventName;
+
 /**
  *  This method allows to track an event that happened in your app.
  *  Remember to choose meaningful event names to have the best experience when diagnosing your app
@@ -5,17 +5,20 @@
 #import "BITHockeyHelper.h"
 #import "HockeySDKPrivate.h"
 #import "BITChannel.h"
+#import "BITChannelPrivate.h"
 #import "BITEventData.h"
 #import "BITSession.h"
 #import "BITSessionState.h"
 #import "BITSessionStateData.h"
 #import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
 #import "BITHockeyBaseManagerPrivate.h"
 #import "BITSender.h"
+#import "BITEventAggregator.h"
+#import "BITPipelineStatistics.h"
 
 NSString *const kBITApplicationWasLaunched = @"BITApplicationWasLaunched";
-
-static char *const kBITMetricsEventQueue = "net.hockeyapp.telemetryEventQueue";
+NSString *const kBITTelemetryPipelineEventName = @"HockeySDK.TelemetryPipeline";
 
 static NSString *const kBITSessionFileType = @"plist";
 static NSString *const kBITApplicationDidEnterBackgroundTime = @"BITApplicationDidEnterBackgroundTime";
@@ -45,13 +48,22 @@ static NSString *const BITMetricsURLPathString = @"v2/track";
 - (instancetype)init {
   if ((self = [super init])) {
     _disabled = NO;
-    _metricsEventQueue = dispatch_queue_create(kBITMetricsEventQueue, DISPATCH_QUEUE_CONCURRENT);
     _appBackgroundTimeBeforeSessionExpires = 20;
     _serverURL = [NSString stringWithFormat:@"%@%@", BITMetricsBaseURLString, BITMetricsURLPathString];
+    _timerWheel = [BITTimerWheel sharedTimerWheel];
+    __weak typeof(self) weakSelf = self;
+    _eventAggregator = [[BITEventAggregator alloc] initWithHandler:^(BITEventData *eventData) {
+      typeof(self) strongSelf = weakSelf;
+      [strongSelf trackDataItem:eventData];
+    }];
   }
   return self;
 }
 
+- (void)dealloc {
+  [_timerWheel cancelTimeout:_pipelineReportTimeout];
+}
+
 - (instancetype)initWithChannel:(BITChannel *)channel telemetryContext:(BITTelemetryContext *)telemetryContext persistence:(BITPersistence *)persistence userDefaults:(NSUserDefaults *)userDefaults {
   if ((self = [self init])) {
     _channel = channel;
@@ -63,6 +75,7 @@ static NSString *const BITMetricsURLPathString = @"v2/track";
 }
 
 - (void)startManager {
+  [self.persistence recoverEventBufferDump];
   self.sender = [[BITSender alloc] initWithPersistence:self.persistence serverURL:(NSURL *)[NSURL URLWithString:self.serverURL]];
   [self.sender sendSavedDataAsync];
   self.firstSessionCreation = [[NSDate date] timeIntervalSince1970];
@@ -82,6 +95,120 @@ static NSString *const BITMetricsURLPathString = @"v2/track";
   }
 }
 
+- (NSUInteger)telemetryStorageLimit {
+  return self.persistence.maxBytes;
+}
+
+- (void)setTelemetryStorageLimit:(NSUInteger)telemetryStorageLimit {
+  self.persistence.maxBytes = telemetryStorageLimit;
+}
+
+- (BITTelemetryEvictionPolicy)telemetryEvictionPolicy {
+  return self.persistence.evictionPolicy;
+}
+
+- (void)setTelemetryEvictionPolicy:(BITTelemetryEvictionPolicy)telemetryEvictionPolicy {
+  self.persistence.evictionPolicy = telemetryEvictionPolicy;
+}
+
+- (id<BITBatchingPolicy>)telemetryBatchingPolicy {
+  return self.channel.batchingPolicy;
+}
+
+- (void)setTelemetryBatchingPolicy:(nullable id<BITBatchingPolicy>)telemetryBatchingPolicy {
+  self.channel.batchingPolicy = telemetryBatchingPolicy;
+}
+
+- (uint64_t)telemetryBytesStored {
+  return self.persistence.bytesStored;
+}
+
+- (uint64_t)telemetryBytesEvicted {
+  return self.persistence.bytesEvicted;
+}
+
+- (uint64_t)telemetryEventsDropped {
+  return self.persistence.eventsDropped + self.channel.overflowedItemCount;
+}
+
+- (uint64_t)telemetryEventsDroppedOnOverflow {
+  return self.channel.overflowedItemCount;
+}
+
+- (BITTelemetryOverflowPolicy)telemetryOverflowPolicy {
+  return self.channel.overflowPolicy;
+}
+
+- (void)setTelemetryOverflowPolicy:(BITTelemetryOverflowPolicy)telemetryOverflowPolicy {
+  self.channel.overflowPolicy = telemetryOverflowPolicy;
+}
+
+- (BITTelemetryBatchFormat)telemetryBatchFormat {
+  return self.channel.batchFormat;
+}
+
+- (void)setTelemetryBatchFormat:(BITTelemetryBatchFormat)telemetryBatchFormat {
+  self.channel.batchFormat = telemetryBatchFormat;
+}
+
+- (NSTimeInterval)eventAggregationInterval {
+  return self.eventAggregator.interval;
+}
+
+- (void)setEventAggregationInterval:(NSTimeInterval)eventAggregationInterval {
+  self.eventAggregator.interval = eventAggregationInterval;
+}
+
+- (void)setSamplingPercentage:(double)samplingPercentage forEventWithName:(NSString *)eventName {
+  [self.eventAggregator setSamplingPercentage:samplingPercentage forEventWithName:eventName];
+}
+
+- (void)setAggregationEnabled:(BOOL)enabled forEventWithName:(NSString *)eventName {
+  [self.eventAggregator setAggregationEnabled:enabled forEventWithName:eventName];
+}
+
+#pragma mark - Pipeline statistics
+
+- (BITTelemetryPipelineSnapshot *)telemetryPipelineSnapshot {
+  return [BITTelemetryPipelineSnapshot new];
+}
+
+- (void)setTelemetryPipelineReportInterval:(NSTimeInterval)telemetryPipelineReportInterval {
+  @synchronized(self) {
+    _telemetryPipelineReportInterval = MAX(telemetryPipelineReportInterval, 0);
+    [self schedulePipelineReport];
+  }
+}
+
+- (void)schedulePipelineReport {
+  [self.timerWheel cancelTimeout:self.pipelineReportTimeout];
+  self.pipelineReportTimeout = 0;
+  if (self.telemetryPipelineReportInterval <= 0) {
+    return;
+  }
+  __weak typeof(self) weakSelf = self;
+  self.pipelineReportTimeout = [self.timerWheel scheduleAfterDelay:self.telemetryPipelineReportInterval
+                                                             queue:dispatch_get_global_queue(QOS_CLASS_UTILITY, 0)
+                                                             block:^{
+                                                               typeof(self) strongSelf = weakSelf;
+                                                               [strongSelf reportTelemetryPipeline];
+                                                             }];
+}
+
+- (void)reportTelemetryPipeline {
+  @synchronized(self) {
+    if (!self.disabled) {
+
+      // The report is enqueued directly, it is neither sampled nor counted as a tracked item itself.
+      [self.channel enqueueEventWithName:kBITTelemetryPipelineEventName
+                              properties:nil
+                            measurements:self.telemetryPipelineSnapshot.dictionaryRepresentation
+                              sampleRate:0];
+    }
+    [self schedulePipelineReport];
+  }
+}
+
 #pragma mark - Sessions
 
 - (void)registerObservers {
@@ -96,6 +223,9 @@ static NSString *const BITMetricsURLPathString = @"v2/track";
                                                  usingBlock:^(NSNotification * __unused note) {
                                                    typeof(self) strongSelf = weakSelf;
                                                    [strongSelf updateDidEnterBackgroundTime];
+
+                                                   // The app may not come back, so aggregates are not held back any longer.
+                                                   [strongSelf.eventAggregator flush];
                                                  }];
   }
   if(nil == self.appWillEnterForegroundObserver) {
@@ -177,6 +307,7 @@ static NSString *const BITMetricsURLPathString = @"v2/track";
     return;
   }
   
+  bit_pipelineCount(BITTelemetryCounterItemsTracked, 1);
   BITSessionStateData *sessionStateData = [BITSessionStateData new];
   sessionStateData.state = state;
   [self.channel enqueueTelemetryItem:sessionStateData];
@@ -185,19 +316,7 @@ static NSString *const BITMetricsURLPathString = @"v2/track";
 #pragma mark Events
 
 - (void)trackEventWithName:(NSString *)eventName {
-  if (!eventName) { return; }
-  if (self.disabled) {
-    BITHockeyLogDebug(@"INFO: BITMetricsManager is disabled, therefore this tracking call was ignored.");
-    return;
-  }
-  
-  __weak typeof(self) weakSelf = self;
-  dispatch_async(self.metricsEventQueue, ^{
-    typeof(self) strongSelf = weakSelf;
-    BITEventData *eventData = [BITEventData new];
-    [eventData setName:eventName];
-    [strongSelf trackDataItem:eventData];
-  });
+  [self trackEventWithName:eventName properties:nil measurements:nil];
 }
 
 - (void)trackEventWithName:(nonnull NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements {
@@ -207,15 +326,18 @@ static NSString *const BITMetricsURLPathString = @"v2/track";
     return;
   }
   
-  __weak typeof(self) weakSelf = self;
-  dispatch_async(self.metricsEventQueue, ^{
-    typeof(self) strongSelf = weakSelf;
-    BITEventData *eventData = [BITEventData new];
-    [eventData setName:eventName];
-    [eventData setProperties:properties];
-    [eventData setMeasurements:measurements];
-    [strongSelf trackDataItem:eventData];
-  });
+  // Events are handed to the channel's bounded queue right away instead of hopping through another queue first. Events
+  // that are not aggregated are stored in an event record, no objects are created for them on the way.
+  bit_pipelineCount(BITTelemetryCounterItemsTracked, 1);
+  double samplingPercentage;
+  if ([self.eventAggregator shouldTrackEventWithName:eventName properties:properties measurements:measurements samplingPercentage:&samplingPercentage]) {
+    [self.channel enqueueEventWithName:eventName
+                            properties:properties
+                          measurements:measurements
+                            sampleRate:samplingPercentage < 100 ? samplingPercentage : 0];
+  } else {
+    bit_pipelineCount(BITTelemetryCounterEventsSampledOrAggregated, 1);
+  }
 }
 
 
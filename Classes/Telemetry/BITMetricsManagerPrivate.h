@@ -1,16 +1,19 @@
 #import "BITMetricsManager.h"
 #import "BITSessionState.h"
+#import "BITTimerWheel.h"
 
 @class BITChannel;
 @class BITTelemetryContext;
 @class BITSession;
 @class BITPersistence;
 @class BITSender;
+@class BITEventAggregator;
 
 #import "HockeySDKNullability.h"
 NS_ASSUME_NONNULL_BEGIN
 
 FOUNDATION_EXPORT NSString *const kBITApplicationWasLaunched;
+FOUNDATION_EXPORT NSString *const kBITTelemetryPipelineEventName;
 
 @interface BITMetricsManager()
 
@@ -44,14 +47,29 @@ FOUNDATION_EXPORT NSString *const kBITApplicationWasLaunched;
 @property (nonatomic, strong, readonly) BITTelemetryContext *telemetryContext;
 
 /**
- *  A concurrent queue which creates and processes telemetry items.
+ *  Sender instance to send out telemetry data.
  */
-@property (nonatomic, strong, readonly) dispatch_queue_t metricsEventQueue;
+@property (nonatomic, strong) BITSender *sender;
 
 /**
- *  Sender instance to send out telemetry data.
+ *  Samples and aggregates tracked events before they are enqueued in the channel.
  */
-@property (nonatomic, strong) BITSender *sender;
+@property (nonatomic, strong, readonly) BITEventAggregator *eventAggregator;
+
+/**
+ *  The timer wheel the pipeline report is scheduled on.
+ */
+@property (nonatomic, strong) BITTimerWheel *timerWheel;
+
+/**
+ *  The deadline of the next pipeline report, 0 if none is scheduled.
+ */
+@property (nonatomic, assign) BITTimeoutIdentifier pipelineReportTimeout;
+
+/**
+ *  Tracks the current pipeline snapshot as an event and schedules the next report.
+ */
+- (void)reportTelemetryPipeline;
 
 ///-----------------------------------------------------------------------------
 /// @name Session Management
@@ -3,24 +3,66 @@
 #import "BITPersistencePrivate.h"
 #import "HockeySDKPrivate.h"
 #import "BITHockeyHelper.h"
+#import "BITCompression.h"
+#import "BITBinaryBatch.h"
+#import "BITEventBufferDump.h"
+#import "BITPipelineStatistics.h"
+#import <sys/xattr.h>
 
 NSString *const BITPersistenceSuccessNotification = @"BITHockeyPersistenceSuccessNotification";
 
 static NSString *const kBITTelemetry = @"Telemetry";
 static NSString *const kBITMetaData = @"MetaData";
 static NSString *const kBITFileBaseString = @"hockey-app-bundle-";
+static NSString *const kBITLogRecordBaseString = @"hockey-app-bundle-record-";
+static NSString *const kBITHighPriorityFileSuffix = @"-high";
 static NSString *const kBITFileBaseStringMeta = @"metadata";
 static NSString *const kBITHockeyDirectory = @"com.microsoft.HockeyApp";
 static NSString *const kBITTelemetryDirectory = @"Telemetry";
 static NSString *const kBITMetaDataDirectory = @"MetaData";
+static NSString *const kBITTelemetryLogDirectory = @"TelemetryLog";
+static NSString *const kBITEventBufferDumpFileName = @"EventBuffer.dump";
 
 static char const *kBITPersistenceQueueString = "com.microsoft.HockeyApp.persistenceQueue";
 static NSUInteger const BITDefaultFileCount = 50;
+static NSUInteger const BITDefaultMaxBytes = 2 * 1024 * 1024;
+static size_t const BITDefaultLogSegmentSize = 1024 * 1024;
+static char const *kBITSendAttemptsAttribute = "net.hockeyapp.sendAttempts";
+
+/**
+ *  The extended attribute a bundle file stores its failed send attempts in.
+ */
+typedef struct {
+  uint32_t attempts;
+  uint32_t reserved;
+  double retryTime; // seconds since 1970
+} BITSendAttemptsAttribute;
+
+// Every telemetry item is serialized to a line of its own, binary batches tell their count in their trailer.
+static uint64_t bit_itemCountOfBundle(NSData *_Nullable bundle) {
+  uint64_t binaryCount;
+  if (bundle && bit_binaryBatchItemCount((NSData *)bundle, &binaryCount)) {
+    return binaryCount;
+  }
+  bundle = bundle ? bit_decompressData((NSData *)bundle) : nil;
+  uint64_t count = 0;
+  const char *bytes = bundle.bytes;
+  const char *end = bytes + bundle.length;
+  while (bytes && bytes < end && (bytes = memchr(bytes, '\n', (size_t)(end - bytes)))) {
+    count++;
+    bytes++;
+  }
+  return count;
+}
 
 @interface BITPersistence ()
 
 @property (nonatomic, copy) NSString *appHockeySDKDirectoryPath;
 @property(nonatomic) BOOL directorySetupComplete;
+@property (atomic, assign) uint64_t bytesStored;
+@property (atomic, assign) uint64_t bytesEvicted;
+@property (atomic, assign) BOOL evictionFailed;
+@property (atomic, assign) uint64_t eventsDropped;
 
 @end
 
@@ -29,44 +71,93 @@ static NSUInteger const BITDefaultFileCount = 50;
 #pragma mark - Public
 
 - (instancetype)init {
+  return [self initWithStorageFormat:BITPersistenceStorageFormatFiles];
+}
+
+- (instancetype)initWithStorageFormat:(BITPersistenceStorageFormat)storageFormat {
   self = [super init];
   if (self) {
+    _storageFormat = storageFormat;
     _persistenceQueue = dispatch_queue_create(kBITPersistenceQueueString, DISPATCH_QUEUE_SERIAL); //TODO several queues?
-    _requestedBundlePaths = [NSMutableArray new];
+    _requestedBundlePaths = [NSMutableSet new];
+    _persistedBundlePaths = [NSMutableOrderedSet new];
+    _persistedBundleSizes = [NSMutableDictionary new];
+    _failedSendAttempts = [NSMutableDictionary new];
+    _retryDates = [NSMutableDictionary new];
     _maxFileCount = BITDefaultFileCount;
+    _maxBytes = BITDefaultMaxBytes;
+    _evictionPolicy = BITTelemetryEvictionPolicyOldestFirst;
     
     // Evantually, there will be old files on disk, the flag will be updated before the first event gets created
     _directorySetupComplete = NO; //will be set to true in createDirectoryStructureIfNeeded
     
     [self createDirectoryStructureIfNeeded];
+    if (storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+      [self openSegmentedLog];
+    } else {
+      [self loadPersistedBundlePaths];
+    }
   }
   return self;
 }
 
+- (void)dealloc {
+  bit_segmentedLogClose(_segmentedLog);
+}
+
 /**
  * Saves the Bundle using NSKeyedArchiver and NSData's writeToFile:atomically
  * Sends out a BITHockeyPersistenceSuccessNotification in case of success
  */
 - (void)persistBundle:(NSData *)bundle {
+  [self persistBundle:bundle priority:BITPersistencePriorityDefault];
+}
+
+- (void)persistBundle:(NSData *)bundle priority:(BITPersistencePriority)priority {
   //TODO send out a fail notification?
+  __weak typeof(self) weakSelf = self;
+  dispatch_async(self.persistenceQueue, ^{
+    typeof(self) strongSelf = weakSelf;
+    [strongSelf storeBundle:bundle priority:priority];
+  });
+}
+
+/**
+ * Writes a bundle to the segmented log or to a file of its own. Must be called on the persistenceQueue.
+ */
+- (void)storeBundle:(NSData *)bundle priority:(BITPersistencePriority)priority {
+  if (self.storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+    [self appendBundleToSegmentedLog:bundle];
+    return;
+  }
   NSString *fileURL = [self fileURLForType:BITPersistenceTypeTelemetry];
-  
-  if (bundle) {
-    __weak typeof(self) weakSelf = self;
-    dispatch_async(self.persistenceQueue, ^{
-      typeof(self) strongSelf = weakSelf;
-      BOOL success = [bundle writeToFile:fileURL atomically:YES];
-      if (success) {
-        BITHockeyLogDebug(@"Wrote bundle to %@", fileURL);
-        [strongSelf sendBundleSavedNotification];
-      }
-      else {
-        BITHockeyLogError(@"Error writing bundle to %@", fileURL);
-      }
-    });
+  if (priority == BITPersistencePriorityHigh) {
+    fileURL = [fileURL stringByAppendingString:kBITHighPriorityFileSuffix];
   }
-  else {
+  if (!bundle) {
     BITHockeyLogDebug(@"WARNING: Unable to write %@ as provided bundle was null", fileURL);
+    return;
+  }
+  if (![self makeRoomForBundleOfLength:bundle.length priority:priority]) {
+    BITHockeyLogWarning(@"WARNING: The telemetry storage is full, a bundle of %lu bytes was dropped.", (unsigned long)bundle.length);
+    self.eventsDropped += bit_itemCountOfBundle(bundle);
+    return;
+  }
+  uint64_t writeStart = bit_pipelineTimestamp();
+  BOOL success = [bundle writeToFile:fileURL atomically:YES];
+  if (success) {
+    bit_pipelineRecordDuration(BITTelemetryStagePersistence, writeStart);
+    bit_pipelineCount(BITTelemetryCounterBatchesPersisted, 1);
+    bit_pipelineCount(BITTelemetryCounterBytesPersisted, bundle.length);
+    BITHockeyLogDebug(@"Wrote bundle to %@", fileURL);
+    [self.persistedBundlePaths addObject:fileURL];
+    self.persistedBundleSizes[fileURL] = @(bundle.length);
+    self.persistedBundleCount = self.persistedBundlePaths.count;
+    self.bytesStored += bundle.length;
+    [self sendBundleSavedNotification];
+  }
+  else {
+    BITHockeyLogError(@"Error writing bundle to %@", fileURL);
   }
 }
 
@@ -79,8 +170,25 @@ static NSUInteger const BITDefaultFileCount = 50;
 }
 
 - (BOOL)isFreeSpaceAvailable {
-  NSArray *files = [self persistedFilesForType:BITPersistenceTypeTelemetry];
-  return files.count < self.maxFileCount;
+  BOOL withinLimits = [self storedBundleCount] < self.maxFileCount && self.bytesStored < self.maxBytes;
+
+  // Old bundles are evicted when a new one gets persisted, so the storage is only full once that has failed.
+  if (self.evictionPolicy != BITTelemetryEvictionPolicyNone) {
+    return withinLimits || !self.evictionFailed;
+  }
+  return withinLimits;
+}
+
+- (BOOL)isStorageUnderPressure {
+  return [self storedBundleCount] * 2 > self.maxFileCount || self.bytesStored * 2 > self.maxBytes;
+}
+
+- (void)countDroppedEvents:(NSUInteger)count {
+  __weak typeof(self) weakSelf = self;
+  dispatch_async(self.persistenceQueue, ^{
+    typeof(self) strongSelf = weakSelf;
+    strongSelf.eventsDropped += count;
+  });
 }
 
 - (NSString *)requestNextFilePath {
@@ -89,7 +197,11 @@ static NSUInteger const BITDefaultFileCount = 50;
   dispatch_sync(self.persistenceQueue, ^() {
     typeof(self) strongSelf = weakSelf;
     
-    path = [strongSelf nextURLOfType:BITPersistenceTypeTelemetry];
+    if (strongSelf.storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+      path = [strongSelf acquireNextLogRecordPath];
+    } else {
+      path = [strongSelf nextPersistedBundlePath];
+    }
     
     if (path) {
       [self.requestedBundlePaths addObject:path];
@@ -98,6 +210,49 @@ static NSUInteger const BITDefaultFileCount = 50;
   return path;
 }
 
+- (NSUInteger)failedSendAttemptsForFilePath:(NSString *)filePath {
+  __block NSUInteger attempts = 0;
+  dispatch_sync(self.persistenceQueue, ^{
+    attempts = self.failedSendAttempts[filePath].unsignedIntegerValue;
+  });
+  return attempts;
+}
+
+- (NSUInteger)recordFailedSendAttemptForFilePath:(NSString *)filePath retryDate:(NSDate *)retryDate {
+  __block NSUInteger attempts = 0;
+  dispatch_sync(self.persistenceQueue, ^{
+    attempts = self.failedSendAttempts[filePath].unsignedIntegerValue + 1;
+    self.failedSendAttempts[filePath] = @(attempts);
+    self.retryDates[filePath] = retryDate;
+    if (self.storageFormat == BITPersistenceStorageFormatFiles) {
+      BITSendAttemptsAttribute attribute = {(uint32_t)MIN(attempts, UINT32_MAX), 0, retryDate.timeIntervalSince1970};
+      if (setxattr(filePath.fileSystemRepresentation, kBITSendAttemptsAttribute, &attribute, sizeof(attribute), 0, 0) != 0) {
+        BITHockeyLogDebug(@"INFO: Unable to store the send attempts of %@", filePath);
+      }
+    }
+  });
+  return attempts;
+}
+
+- (NSDate *)nextRetryDate {
+  __block NSDate *nextRetryDate = nil;
+  dispatch_sync(self.persistenceQueue, ^{
+    NSDate *now = [NSDate date];
+    for (NSDate *retryDate in self.retryDates.objectEnumerator) {
+      if ([retryDate compare:now] == NSOrderedDescending && (!nextRetryDate || [retryDate compare:nextRetryDate] == NSOrderedAscending)) {
+        nextRetryDate = retryDate;
+      }
+    }
+  });
+  return nextRetryDate;
+}
+
+- (void)dropFileAtPath:(NSString *)filePath {
+  NSData *bundle = [self dataAtFilePath:filePath];
+  [self countDroppedEvents:(NSUInteger)bit_itemCountOfBundle(bundle)];
+  [self deleteFileAtPath:filePath];
+}
+
 - (NSDictionary *)metaData {
   NSString *filePath = [self fileURLForType:BITPersistenceTypeMetaData];
   NSObject *bundle = [self bundleAtFilePath:filePath withFileBaseString:kBITFileBaseStringMeta];
@@ -118,12 +273,40 @@ static NSUInteger const BITDefaultFileCount = 50;
 
 - (NSData *)dataAtFilePath:(NSString *)path {
   NSData *data = nil;
+  if (self.storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+    return [self dataOfLogRecordAtPath:path];
+  }
   if (path && [path rangeOfString:kBITFileBaseString].location != NSNotFound) {
-    data = [NSData dataWithContentsOfFile:path];
+
+    // Binary batches are rendered straight from the mapped file, everything else is only read once anyway.
+    data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+    if (!data && ![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+
+      // The file has been removed behind our back, make sure it isn't handed out again.
+      __weak typeof(self) weakSelf = self;
+      dispatch_async(self.persistenceQueue, ^{
+        typeof(self) strongSelf = weakSelf;
+        [strongSelf removePersistedBundlePath:path];
+      });
+    }
   }
   return data;
 }
 
+- (NSURL *)uploadableFileURLForFilePath:(NSString *)filePath uncompressedLength:(NSUInteger *)uncompressedLength {
+  if (self.storageFormat != BITPersistenceStorageFormatFiles || [filePath rangeOfString:kBITFileBaseString].location == NSNotFound) {
+    return nil;
+  }
+  size_t length = 0;
+  if (!bit_gzipFileInfo(filePath.fileSystemRepresentation, &length)) {
+    return nil;
+  }
+  if (uncompressedLength) {
+    *uncompressedLength = length;
+  }
+  return [NSURL fileURLWithPath:filePath];
+}
+
 /**
  * Deletes a file at the given path.
  *
@@ -133,14 +316,18 @@ static NSUInteger const BITDefaultFileCount = 50;
   __weak typeof(self) weakSelf = self;
   dispatch_sync(self.persistenceQueue, ^() {
     typeof(self) strongSelf = weakSelf;
-    if ([path rangeOfString:kBITFileBaseString].location != NSNotFound) {
+    if (strongSelf.storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+      [strongSelf removeLogRecordAtPath:path];
+    } else if ([path rangeOfString:kBITFileBaseString].location != NSNotFound) {
       NSError *error = nil;
-      if (![[NSFileManager defaultManager] removeItemAtPath:path error:&error]) {
-        BITHockeyLogError(@"Error deleting file at path %@", path);
-      }
-      else {
+      if ([[NSFileManager defaultManager] removeItemAtPath:path error:&error]) {
         BITHockeyLogDebug(@"INFO: Successfully deleted file at path %@", path);
-        [strongSelf.requestedBundlePaths removeObject:path];
+        [strongSelf removePersistedBundlePath:path];
+      } else if ([error.domain isEqualToString:NSCocoaErrorDomain] && error.code == NSFileNoSuchFileError) {
+        BITHockeyLogDebug(@"INFO: File at path %@ has already been deleted", path);
+        [strongSelf removePersistedBundlePath:path];
+      } else {
+        BITHockeyLogError(@"Error deleting file at path %@", path);
       }
     } else {
       BITHockeyLogDebug(@"INFO: Empty path, nothing to delete");
@@ -154,10 +341,364 @@ static NSUInteger const BITDefaultFileCount = 50;
   dispatch_async(self.persistenceQueue, ^() {
     typeof(self) strongSelf = weakSelf;
     
+    if (strongSelf.storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+      BITSegmentedLogRecordID recordID;
+      if ([strongSelf getLogRecordID:&recordID fromPath:filePath]) {
+        bit_segmentedLogRelease(strongSelf.segmentedLog, recordID);
+      }
+    }
     [strongSelf.requestedBundlePaths removeObject:filePath];
   });
 }
 
+#pragma mark - Bundle index
+
+- (void)loadPersistedBundlePaths {
+
+  // The directory is only read once. Afterwards, the index is kept up to date by persisting, deleting and giving back bundles.
+  dispatch_sync(self.persistenceQueue, ^{
+    NSArray<NSURL *> *fileURLs = [self persistedFilesForType:BITPersistenceTypeTelemetry];
+    NSMutableArray<NSURL *> *bundleURLs = [NSMutableArray arrayWithCapacity:fileURLs.count];
+    for (NSURL *fileURL in fileURLs) {
+      if ([fileURL.lastPathComponent hasPrefix:kBITFileBaseString]) {
+        [bundleURLs addObject:fileURL];
+      }
+    }
+
+    // File names are random, so the creation date determines which bundle has been persisted first.
+    [bundleURLs sortUsingComparator:^NSComparisonResult(NSURL *url1, NSURL *url2) {
+      NSDate *date1 = nil;
+      NSDate *date2 = nil;
+      [url1 getResourceValue:&date1 forKey:NSURLCreationDateKey error:nil];
+      [url2 getResourceValue:&date2 forKey:NSURLCreationDateKey error:nil];
+      NSComparisonResult result = (date1 && date2) ? [date1 compare:date2] : NSOrderedSame;
+      return result != NSOrderedSame ? result : [url1.path compare:url2.path];
+    }];
+
+    [self.persistedBundlePaths removeAllObjects];
+    [self.persistedBundleSizes removeAllObjects];
+    [self.failedSendAttempts removeAllObjects];
+    [self.retryDates removeAllObjects];
+    uint64_t bytesStored = 0;
+    for (NSURL *bundleURL in bundleURLs) {
+      NSString *path = (NSString *)bundleURL.path;
+      NSNumber *size = nil;
+      [bundleURL getResourceValue:&size forKey:NSURLFileSizeKey error:nil];
+      [self.persistedBundlePaths addObject:path];
+      self.persistedBundleSizes[path] = size ?: @0;
+      bytesStored += size.unsignedLongLongValue;
+      [self loadSendAttemptsOfBundleAtPath:path];
+    }
+    self.persistedBundleCount = self.persistedBundlePaths.count;
+    self.bytesStored = bytesStored;
+  });
+}
+
+- (void)loadSendAttemptsOfBundleAtPath:(NSString *)path {
+  BITSendAttemptsAttribute attribute;
+  if (getxattr(path.fileSystemRepresentation, kBITSendAttemptsAttribute, &attribute, sizeof(attribute), 0, 0) == sizeof(attribute) &&
+      attribute.attempts > 0) {
+    self.failedSendAttempts[path] = @(attribute.attempts);
+    self.retryDates[path] = [NSDate dateWithTimeIntervalSince1970:attribute.retryTime];
+  }
+}
+
+- (nullable NSString *)nextPersistedBundlePath {
+
+  // Only requested and deferred bundles are skipped, deferred ones are rare as the sender backs off as a whole.
+  NSDate *now = [NSDate date];
+  for (NSString *path in self.persistedBundlePaths) {
+    if (![self.requestedBundlePaths containsObject:path] && ![self isBundleDeferredAtPath:path now:now]) {
+      return path;
+    }
+  }
+  return nil;
+}
+
+- (BOOL)isBundleDeferredAtPath:(NSString *)path now:(NSDate *)now {
+  NSDate *retryDate = self.retryDates[path];
+  return retryDate && [retryDate compare:now] == NSOrderedDescending;
+}
+
+- (void)forgetSendAttemptsOfBundleAtPath:(NSString *)path {
+  [self.failedSendAttempts removeObjectForKey:path];
+  [self.retryDates removeObjectForKey:path];
+}
+
+- (void)removePersistedBundlePath:(NSString *)path {
+  [self.persistedBundlePaths removeObject:path];
+  [self.requestedBundlePaths removeObject:path];
+  [self forgetSendAttemptsOfBundleAtPath:path];
+  self.persistedBundleCount = self.persistedBundlePaths.count;
+  NSNumber *size = self.persistedBundleSizes[path];
+  if (size) {
+    self.bytesStored -= size.unsignedLongLongValue;
+    [self.persistedBundleSizes removeObjectForKey:path];
+  }
+}
+
+#pragma mark - Eviction
+
+- (NSUInteger)storedBundleCount {
+  if (self.storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+    return self.segmentedLogRecordCount;
+  }
+  return self.persistedBundleCount;
+}
+
+/**
+ * Evicts bundles until maxFileCount and maxBytes leave room for a new bundle. Bundles that are currently sent are
+ * never evicted. Sets evictionFailed if nothing is left to evict. Must be called on the persistenceQueue.
+ *
+ * @returns NO if not enough bundles could be evicted and the new bundle should be dropped.
+ */
+- (BOOL)makeRoomForBundleOfLength:(NSUInteger)length priority:(BITPersistencePriority)priority {
+  if (self.evictionPolicy == BITTelemetryEvictionPolicyNone) {
+    return YES;
+  }
+  if (length > self.maxBytes) {
+    return NO;
+  }
+  while ([self storedBundleCount] >= self.maxFileCount || self.bytesStored + length > self.maxBytes) {
+    BOOL evicted = NO;
+    if (self.storageFormat == BITPersistenceStorageFormatSegmentedLog) {
+      evicted = [self evictOldestLogRecord];
+    } else {
+      NSString *path = [self evictionCandidateForPriority:priority];
+      if (path) {
+        [self evictBundleAtPath:path];
+        evicted = YES;
+      }
+    }
+    if (!evicted) {
+      self.evictionFailed = YES;
+      return NO;
+    }
+  }
+  self.evictionFailed = NO;
+  return YES;
+}
+
+- (nullable NSString *)evictionCandidateForPriority:(BITPersistencePriority)priority {
+  BOOL byPriority = self.evictionPolicy == BITTelemetryEvictionPolicyLowestPriorityFirst;
+  NSString *highPriorityCandidate = nil;
+  for (NSString *path in self.persistedBundlePaths) {
+    if ([self.requestedBundlePaths containsObject:path]) {
+      continue;
+    }
+    if (![path hasSuffix:kBITHighPriorityFileSuffix]) {
+      return path;
+    }
+
+    // Without priorities, a high priority bundle makes room by evicting the oldest bundle, whatever its priority.
+    if (!byPriority && priority == BITPersistencePriorityHigh) {
+      return path;
+    }
+    if (!highPriorityCandidate) {
+      highPriorityCandidate = path;
+    }
+  }
+
+  // High priority bundles only make room for other high priority bundles, under every policy that evicts.
+  return priority == BITPersistencePriorityHigh ? highPriorityCandidate : nil;
+}
+
+- (void)evictBundleAtPath:(NSString *)path {
+  NSData *bundle = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+  uint64_t size = self.persistedBundleSizes[path].unsignedLongLongValue;
+  NSError *error = nil;
+  if (![[NSFileManager defaultManager] removeItemAtPath:path error:&error]) {
+    BITHockeyLogError(@"ERROR: Unable to evict bundle at path %@: %@", path, error.localizedDescription);
+  }
+
+  // The bundle is removed from the index in any case, otherwise it would be picked again right away.
+  [self removePersistedBundlePath:path];
+  self.bytesEvicted += size;
+  self.eventsDropped += bit_itemCountOfBundle(bundle);
+  BITHockeyLogDebug(@"INFO: Evicted bundle of %llu bytes at path %@", size, path);
+}
+
+- (BOOL)evictOldestLogRecord {
+  BITSegmentedLog *log = self.segmentedLog;
+  BITSegmentedLogRecordID recordID;
+  if (!log || !bit_segmentedLogAcquireNext(log, &recordID)) {
+    return NO;
+  }
+  long long length = bit_segmentedLogRecordLength(log, recordID);
+  NSMutableData *record = [NSMutableData dataWithLength:(NSUInteger)MAX(length, 0)];
+  BOOL readable = bit_segmentedLogRead(log, recordID, record.mutableBytes);
+  uint64_t usedBytes = bit_segmentedLogUsedBytes(log);
+  bit_segmentedLogRemove(log, recordID);
+  [self forgetSendAttemptsOfBundleAtPath:[self pathOfLogRecord:recordID]];
+  self.segmentedLogRecordCount = bit_segmentedLogRecordCount(log);
+  self.bytesStored = bit_segmentedLogUsedBytes(log);
+  self.bytesEvicted += usedBytes - self.bytesStored;
+  self.eventsDropped += readable ? bit_itemCountOfBundle(record) : 0;
+  BITHockeyLogDebug(@"INFO: Evicted telemetry log record %llu", (unsigned long long)recordID);
+  return YES;
+}
+
+#pragma mark - Crash recovery
+
+- (NSString *)eventBufferDumpPath {
+  return [self.appHockeySDKDirectoryPath stringByAppendingPathComponent:kBITEventBufferDumpFileName];
+}
+
+- (void)recoverEventBufferDump {
+  NSString *dumpPath = [self eventBufferDumpPath];
+
+  // Reading and compressing the dump happens on the persistenceQueue like every other write, not on the caller's thread.
+  __weak typeof(self) weakSelf = self;
+  dispatch_async(self.persistenceQueue, ^{
+    typeof(self) strongSelf = weakSelf;
+    NSData *dump = [NSData dataWithContentsOfFile:dumpPath];
+
+    // Every item ends with a line break, the crash handler may have been interrupted in the middle of the last one.
+    const char *bytes = dump.bytes;
+    NSUInteger length = dump.length;
+    while (length > 0 && bytes[length - 1] != '\n') {
+      length--;
+    }
+    if (length < dump.length) {
+      BITHockeyLogWarning(@"WARNING: Dropping %lu bytes of an incomplete telemetry item written during a crash", (unsigned long)(dump.length - length));
+    }
+    if (length > 0) {
+      NSData *bundle = bit_compressData([dump subdataWithRange:NSMakeRange(0, length)], BITCompressionCodecGzip);
+      if (bundle) {
+        BITHockeyLogDebug(@"INFO: Recovered %lu bytes of telemetry items written during a crash", (unsigned long)length);
+        [strongSelf storeBundle:(NSData *)bundle priority:BITPersistencePriorityDefault];
+      }
+    }
+
+    // Opening the file truncates it, so the items are only recovered once.
+    if (!bit_eventBufferDumpOpen(dumpPath.fileSystemRepresentation)) {
+      BITHockeyLogError(@"ERROR: Unable to open %@, telemetry items will be lost in case of a crash", dumpPath);
+    }
+  });
+}
+
+#pragma mark - Segmented log
+
+- (void)openSegmentedLog {
+  NSString *logPath = [self.appHockeySDKDirectoryPath stringByAppendingPathComponent:kBITTelemetryLogDirectory];
+  NSError *error = nil;
+  if (!logPath || ![[NSFileManager defaultManager] createDirectoryAtPath:logPath withIntermediateDirectories:YES attributes:nil error:&error]) {
+    BITHockeyLogError(@"ERROR: Unable to create the telemetry log directory: %@", error.localizedDescription);
+    return;
+  }
+
+  // Opening the log recovers it, which reads all segments once. Everything afterwards is served from its index.
+  dispatch_sync(self.persistenceQueue, ^{
+    self.segmentedLog = bit_segmentedLogOpen(logPath.fileSystemRepresentation, BITDefaultLogSegmentSize);
+    if (!self.segmentedLog) {
+      BITHockeyLogError(@"ERROR: Unable to open the telemetry log at %@", logPath);
+      return;
+    }
+    self.segmentedLogRecordCount = bit_segmentedLogRecordCount(self.segmentedLog);
+    self.bytesStored = bit_segmentedLogUsedBytes(self.segmentedLog);
+  });
+}
+
+// Must be called on the persistenceQueue.
+- (void)appendBundleToSegmentedLog:(NSData *)bundle {
+  if (bundle.length == 0) {
+    BITHockeyLogDebug(@"WARNING: Unable to append to the telemetry log as provided bundle was empty");
+    return;
+  }
+  BITSegmentedLog *log = self.segmentedLog;
+  if (![self makeRoomForBundleOfLength:bundle.length priority:BITPersistencePriorityDefault]) {
+    BITHockeyLogWarning(@"WARNING: The telemetry storage is full, a bundle of %lu bytes was dropped.", (unsigned long)bundle.length);
+    self.eventsDropped += bit_itemCountOfBundle(bundle);
+    return;
+  }
+  uint64_t writeStart = bit_pipelineTimestamp();
+  if (log && bit_segmentedLogAppend(log, bundle.bytes, bundle.length, NULL)) {
+    bit_pipelineRecordDuration(BITTelemetryStagePersistence, writeStart);
+    bit_pipelineCount(BITTelemetryCounterBatchesPersisted, 1);
+    bit_pipelineCount(BITTelemetryCounterBytesPersisted, bundle.length);
+    self.segmentedLogRecordCount = bit_segmentedLogRecordCount(log);
+    self.bytesStored = bit_segmentedLogUsedBytes(log);
+    [self sendBundleSavedNotification];
+  } else {
+    BITHockeyLogError(@"Error appending bundle of %lu bytes to the telemetry log", (unsigned long)bundle.length);
+  }
+}
+
+- (NSString *)acquireNextLogRecordPath {
+  BITSegmentedLogRecordID recordID;
+  NSString *path = nil;
+  NSMutableArray<NSNumber *> *deferredRecordIDs = [NSMutableArray new];
+  NSDate *now = [NSDate date];
+  while (self.segmentedLog && bit_segmentedLogAcquireNext(self.segmentedLog, &recordID)) {
+    NSString *recordPath = [self pathOfLogRecord:recordID];
+    if (![self isBundleDeferredAtPath:recordPath now:now]) {
+      path = recordPath;
+      break;
+    }
+    [deferredRecordIDs addObject:@(recordID)];
+  }
+
+  // Deferred records are only acquired to skip them.
+  for (NSNumber *deferredRecordID in deferredRecordIDs) {
+    bit_segmentedLogRelease(self.segmentedLog, deferredRecordID.unsignedLongLongValue);
+  }
+  return path;
+}
+
+- (NSString *)pathOfLogRecord:(BITSegmentedLogRecordID)recordID {
+  NSString *fileName = [NSString stringWithFormat:@"%@%llu", kBITLogRecordBaseString, (unsigned long long)recordID];
+  return [[self.appHockeySDKDirectoryPath stringByAppendingPathComponent:kBITTelemetryLogDirectory] stringByAppendingPathComponent:fileName];
+}
+
+- (BOOL)getLogRecordID:(BITSegmentedLogRecordID *)recordID fromPath:(NSString *)path {
+  NSString *fileName = path.lastPathComponent;
+  if (![fileName hasPrefix:kBITLogRecordBaseString]) {
+    return NO;
+  }
+  *recordID = strtoull([fileName substringFromIndex:kBITLogRecordBaseString.length].UTF8String, NULL, 10);
+  return YES;
+}
+
+- (nullable NSData *)dataOfLogRecordAtPath:(NSString *)path {
+  BITSegmentedLogRecordID recordID;
+  if (![self getLogRecordID:&recordID fromPath:path]) {
+    return nil;
+  }
+  __block NSData *data = nil;
+  dispatch_sync(self.persistenceQueue, ^{
+    BITSegmentedLog *log = self.segmentedLog;
+    long long length = log ? bit_segmentedLogRecordLength(log, recordID) : -1;
+    if (length <= 0) {
+      return;
+    }
+    NSMutableData *buffer = [NSMutableData dataWithLength:(NSUInteger)length];
+    if (bit_segmentedLogRead(log, recordID, buffer.mutableBytes)) {
+      data = buffer;
+    } else {
+
+      // A damaged record would never be sent successfully, so drop it instead of retrying it forever.
+      BITHockeyLogError(@"ERROR: Telemetry log record %llu is corrupted and will be removed", (unsigned long long)recordID);
+      bit_segmentedLogRemove(log, recordID);
+      self.segmentedLogRecordCount = bit_segmentedLogRecordCount(log);
+      self.bytesStored = bit_segmentedLogUsedBytes(log);
+    }
+  });
+  return data;
+}
+
+- (void)removeLogRecordAtPath:(NSString *)path {
+  BITSegmentedLogRecordID recordID;
+  if ([self getLogRecordID:&recordID fromPath:path] && self.segmentedLog && bit_segmentedLogRemove(self.segmentedLog, recordID)) {
+    BITHockeyLogDebug(@"INFO: Successfully removed telemetry log record %llu", (unsigned long long)recordID);
+    self.segmentedLogRecordCount = bit_segmentedLogRecordCount(self.segmentedLog);
+    self.bytesStored = bit_segmentedLogUsedBytes(self.segmentedLog);
+  } else {
+    BITHockeyLogDebug(@"INFO: No telemetry log record for path %@", path);
+  }
+  [self.requestedBundlePaths removeObject:path];
+  [self forgetSendAttemptsOfBundleAtPath:path];
+}
+
 #pragma mark - Private
 
 - (NSString *)fileURLForType:(BITPersistenceType)type {
@@ -236,27 +777,11 @@ static NSUInteger const BITDefaultFileCount = 50;
   }
 }
 
-/**
- * @returns the URL to the next file depending on the specified type. If there's no file, return nil.
- */
-- (NSString *)nextURLOfType:(BITPersistenceType)type {
-  NSArray<NSURL *> *fileNames = [self persistedFilesForType:type];
-  if (fileNames && fileNames.count > 0) {
-    for (NSURL *filename in fileNames) {
-      NSString *absolutePath = filename.path;
-      if (![self.requestedBundlePaths containsObject:absolutePath]) {
-        return absolutePath;
-      }
-    }
-  }
-  return nil;
-}
-
 - (NSArray *)persistedFilesForType: (BITPersistenceType)type {
   NSString *directoryPath = [self folderPathForType:type];
   NSError *error = nil;
   NSArray<NSURL *> *fileNames = [[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:directoryPath]
-                                                              includingPropertiesForKeys:@[NSURLNameKey]
+                                                              includingPropertiesForKeys:@[NSURLNameKey, NSURLCreationDateKey, NSURLFileSizeKey]
                                                                                  options:NSDirectoryEnumerationSkipsHiddenFiles
                                                                                    error:&error];
   return fileNames;
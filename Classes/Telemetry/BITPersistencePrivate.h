@@ -1,6 +1,7 @@
 #import "HockeySDK.h"
 #import "BITPersistence.h"
 #import "HockeySDKNullability.h"
+#import "BITSegmentedLog.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -14,6 +15,32 @@ typedef NS_ENUM(NSInteger, BITPersistenceType) {
   BITPersistenceTypeMetaData = 1
 };
 
+/**
+ * The BITPersistenceStorageFormat determines how telemetry bundles are stored on disk.
+ */
+typedef NS_ENUM(NSInteger, BITPersistenceStorageFormat) {
+
+  /**
+   *  Every bundle is written to a file of its own.
+   */
+  BITPersistenceStorageFormatFiles = 0,
+
+  /**
+   *  Bundles are appended as records to a segmented log, see BITSegmentedLog. The paths handed out by
+   *  requestNextFilePath identify records instead of files.
+   */
+  BITPersistenceStorageFormatSegmentedLog = 1
+};
+
+/**
+ * The BITPersistencePriority of a telemetry bundle determines the order in which bundles get evicted by
+ * BITTelemetryEvictionPolicyLowestPriorityFirst.
+ */
+typedef NS_ENUM(NSInteger, BITPersistencePriority) {
+  BITPersistencePriorityDefault = 0,
+  BITPersistencePriorityHigh = 1
+};
+
 /**
  * Notification that will be send on the main thread to notifiy observers of a successfully saved bundle.
  * This is typically used to trigger sending to the server.
@@ -24,6 +51,31 @@ FOUNDATION_EXPORT NSString *const BITPersistenceSuccessNotification;
 /// @name Save/delete bundle of data
 ///-----------------------------------------------------------------------------
 
+/**
+ *  Creates a persistence that stores telemetry bundles in the given format. init uses BITPersistenceStorageFormatFiles.
+ *
+ *  @param storageFormat the format used for telemetry bundles
+ *
+ *  @return the persistence
+ */
+- (instancetype)initWithStorageFormat:(BITPersistenceStorageFormat)storageFormat;
+
+/**
+ *  The format used for telemetry bundles.
+ */
+@property (nonatomic, assign, readonly) BITPersistenceStorageFormat storageFormat;
+
+/**
+ *  The log telemetry bundles are stored in if the storage format is BITPersistenceStorageFormatSegmentedLog. Must only
+ *  be accessed on the persistenceQueue.
+ */
+@property (nonatomic, assign, nullable) BITSegmentedLog *segmentedLog;
+
+/**
+ *  The number of records in the segmented log, mirrored so it can be read without waiting for the persistenceQueue.
+ */
+@property (atomic, assign) NSUInteger segmentedLogRecordCount;
+
 /**
  *  A queue which makes file system operations thread safe.
  */
@@ -35,12 +87,78 @@ FOUNDATION_EXPORT NSString *const BITPersistenceSuccessNotification;
 @property (nonatomic, assign) NSUInteger maxFileCount;
 
 /**
- *  An array with all file paths, that have been requested by the sender. If the sender
+ *  Determines how many bytes of telemetry bundles can be on disk at a time.
+ *
+ *  Default: 2 MB
+ */
+@property (nonatomic, assign) NSUInteger maxBytes;
+
+/**
+ *  Determines how room is made for new bundles once maxFileCount or maxBytes is reached. Bundles in the segmented log
+ *  have no priority, all policies except BITTelemetryEvictionPolicyNone evict its oldest records.
+ *
+ *  Default: BITTelemetryEvictionPolicyOldestFirst
+ */
+@property (atomic, assign) BITTelemetryEvictionPolicy evictionPolicy;
+
+/**
+ *  The number of bytes of telemetry bundles currently on disk.
+ */
+@property (atomic, assign, readonly) uint64_t bytesStored;
+
+/**
+ *  The number of bytes of telemetry bundles that have been evicted to make room for new ones.
+ */
+@property (atomic, assign, readonly) uint64_t bytesEvicted;
+
+/**
+ *  Whether the last bundle had to be dropped because no stored bundle could be evicted to make room for it, e.g.
+ *  because all of them are being sent. It's cleared once a bundle fits again.
+ */
+@property (atomic, assign, readonly) BOOL evictionFailed;
+
+/**
+ *  The number of telemetry items that have been dropped, either by the channel or because the bundle containing them
+ *  has been evicted or could not be stored.
+ */
+@property (atomic, assign, readonly) uint64_t eventsDropped;
+
+/**
+ *  The size of every bundle in persistedBundlePaths. Must only be accessed on the persistenceQueue.
+ */
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *persistedBundleSizes;
+
+/**
+ *  A set with all file paths, that have been requested by the sender. If the sender
  *  triggers a delete, the appropriate path should also be removed here. We keep to
  *  track of requested bundles to make sure that bundles don't get sent twice at the same
  *  time by differend http operations.
  */
-@property (nonatomic, strong) NSMutableArray *requestedBundlePaths;
+@property (nonatomic, strong) NSMutableSet<NSString *> *requestedBundlePaths;
+
+/**
+ *  The paths of all telemetry bundles on disk, oldest first. The directory is only read when the persistence is
+ *  created, afterwards the index is updated whenever a bundle is persisted or deleted. Must only be accessed on the
+ *  persistenceQueue.
+ */
+@property (nonatomic, strong) NSMutableOrderedSet<NSString *> *persistedBundlePaths;
+
+/**
+ *  The number of bundles in persistedBundlePaths, mirrored so it can be read without waiting for the persistenceQueue.
+ */
+@property (atomic, assign) NSUInteger persistedBundleCount;
+
+/**
+ *  The number of failed send attempts of every bundle that has failed at least once. Must only be accessed on the
+ *  persistenceQueue.
+ */
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *failedSendAttempts;
+
+/**
+ *  The date before which a bundle is not handed out by requestNextFilePath, for every bundle that has been deferred.
+ *  Must only be accessed on the persistenceQueue.
+ */
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSDate *> *retryDates;
 
 /**
  *  Saves the bundle to disk.
@@ -49,6 +167,21 @@ FOUNDATION_EXPORT NSString *const BITPersistenceSuccessNotification;
  */
 - (void)persistBundle:(NSData *)bundle;
 
+/**
+ *  Saves the bundle to disk, evicting other bundles according to the evictionPolicy if necessary.
+ *
+ *  @param bundle            the bundle, which should be saved to disk
+ *  @param priority          the priority of the bundle, determines the eviction order
+ */
+- (void)persistBundle:(NSData *)bundle priority:(BITPersistencePriority)priority;
+
+/**
+ *  Adds telemetry items that have been dropped before they were persisted to eventsDropped.
+ *
+ *  @param count the number of dropped items
+ */
+- (void)countDroppedEvents:(NSUInteger)count;
+
 /**
  *  Saves the given dictionary to the session Ids file.
  *
@@ -66,10 +199,18 @@ FOUNDATION_EXPORT NSString *const BITPersistenceSuccessNotification;
 /**
  *  Determines whether the persistence layer is able to write more files to disk.
  *
- *  @return YES if the maxFileCount has not been reached, yet (otherwise NO).
+ *  @return YES if the maxFileCount and maxBytes have not been reached, yet, or if old bundles get evicted to make
+ *          room for new ones and that hasn't failed for the last bundle (otherwise NO).
  */
 - (BOOL)isFreeSpaceAvailable;
 
+/**
+ *  Determines whether more than half of maxFileCount or maxBytes is used.
+ *
+ *  @return YES if the storage is more than half full.
+ */
+- (BOOL)isStorageUnderPressure;
+
 ///-----------------------------------------------------------------------------
 /// @name Get a bundle of saved data
 ///-----------------------------------------------------------------------------
@@ -89,6 +230,41 @@ FOUNDATION_EXPORT NSString *const BITPersistenceSuccessNotification;
  */
 - (void)giveBackRequestedFilePath:(NSString *)filePath;
 
+/**
+ *  Returns the number of times sending a bundle has failed.
+ *
+ *  @param filePath the path of the bundle
+ *
+ *  @return the number of failed attempts, 0 if sending the bundle has never failed
+ */
+- (NSUInteger)failedSendAttemptsForFilePath:(NSString *)filePath;
+
+/**
+ *  Counts a failed attempt to send a bundle and defers it, requestNextFilePath skips it until the retry date has
+ *  passed. Bundle files store both in an extended attribute, so they survive a relaunch. Records of the segmented log
+ *  only keep them in memory. The path stays requested, call giveBackRequestedFilePath: afterwards.
+ *
+ *  @param filePath the path of the bundle
+ *  @param retryDate the date before which the bundle should not be sent again
+ *
+ *  @return the number of failed attempts including this one
+ */
+- (NSUInteger)recordFailedSendAttemptForFilePath:(NSString *)filePath retryDate:(NSDate *)retryDate;
+
+/**
+ *  Returns the earliest retry date of the deferred bundles.
+ *
+ *  @return the date or nil if no bundle is deferred
+ */
+- (nullable NSDate *)nextRetryDate;
+
+/**
+ *  Deletes a bundle that will never be sent and adds its items to eventsDropped.
+ *
+ *  @param filePath the path of the bundle
+ */
+- (void)dropFileAtPath:(NSString *)filePath;
+
 /**
  *  Return the json data for a given path
  *
@@ -98,6 +274,17 @@ FOUNDATION_EXPORT NSString *const BITPersistenceSuccessNotification;
  */
 - (nullable NSData *)dataAtFilePath:(NSString *)filePath;
 
+/**
+ *  Returns the file of a bundle if it can be uploaded without reading it into memory, which is the case for bundles
+ *  stored as files in gzip format.
+ *
+ *  @param filePath the path of the bundle
+ *  @param uncompressedLength set to the uncompressed length of the bundle, may be NULL
+ *
+ *  @return the URL of the file or nil if the bundle is stored in a segmented log or with another codec
+ */
+- (nullable NSURL *)uploadableFileURLForFilePath:(NSString *)filePath uncompressedLength:(nullable NSUInteger *)uncompressedLength;
+
 /**
  *  Returns the content of the session Ids file.
  *
@@ -132,6 +319,22 @@ FOUNDATION_EXPORT NSString *const BITPersistenceSuccessNotification;
 
 - (NSString *)appHockeySDKDirectoryPath;
 
+/**
+ *  The path of the file the event buffer is written to if the app crashes, see BITEventBufferDump.h.
+ */
+- (NSString *)eventBufferDumpPath;
+
+///-----------------------------------------------------------------------------
+/// @name Crash recovery
+///-----------------------------------------------------------------------------
+
+/**
+ *  Persists the items that were written to the dump file when the app crashed during the last launch as a regular
+ *  bundle and opens the dump file for this launch. Items cut off in the middle by the crash are dropped. Runs
+ *  asynchronously on the persistenceQueue.
+ */
+- (void)recoverEventBufferDump;
+
 @end
 
 NS_ASSUME_NONNULL_END
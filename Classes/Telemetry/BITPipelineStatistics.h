@@ -0,0 +1,87 @@
+#import <Foundation/Foundation.h>
+#import "HockeySDKEnums.h"
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+#define BITTelemetryCounterCount 13
+#define BITTelemetryStageCount 4
+
+// Bucket 0 holds durations of 0 ns, bucket i durations from 2^(i - 1) up to 2^i ns, the last one everything longer.
+#define BITPipelineHistogramBucketCount 40
+
+/**
+ *  The durations recorded for a stage of the pipeline.
+ */
+typedef struct {
+  uint64_t count;
+  uint64_t totalNanoseconds;
+  uint64_t buckets[BITPipelineHistogramBucketCount];
+} BITPipelineHistogram;
+
+/**
+ *  The counters and histograms of the pipeline at a point in time.
+ */
+typedef struct {
+  uint64_t counters[BITTelemetryCounterCount];
+  BITPipelineHistogram histograms[BITTelemetryStageCount];
+} BITPipelineStatistics;
+
+/**
+ *  The process wide counters and histograms of the telemetry pipeline, which are updated by the metrics manager, the
+ *  channel, the persistence and the sender.
+ *
+ *  Every thread updates a shard of its own cache line with relaxed atomic additions, so counting takes neither a lock
+ *  nor a contended cache line. Threads beyond the number of shards share them. Reading the statistics sums up the
+ *  shards, it sees every update that happened before it but not necessarily in order.
+ */
+
+/**
+ *  Adds to a counter.
+ *
+ *  @param counter the counter
+ *  @param value the value to add
+ */
+void bit_pipelineCount(BITTelemetryCounter counter, uint64_t value);
+
+/**
+ *  Returns a timestamp to measure the duration of a stage from.
+ *
+ *  @return the timestamp in mach absolute time units
+ */
+uint64_t bit_pipelineTimestamp(void);
+
+/**
+ *  Records the duration of a stage that started at the given timestamp and ends now.
+ *
+ *  @param stage the stage
+ *  @param startTimestamp the timestamp returned by bit_pipelineTimestamp when the stage started
+ */
+void bit_pipelineRecordDuration(BITTelemetryStage stage, uint64_t startTimestamp);
+
+/**
+ *  Records a duration of a stage.
+ *
+ *  @param stage the stage
+ *  @param nanoseconds the duration
+ */
+void bit_pipelineRecordNanoseconds(BITTelemetryStage stage, uint64_t nanoseconds);
+
+/**
+ *  Reads the current counters and histograms.
+ *
+ *  @param statistics set to the current statistics
+ */
+void bit_pipelineStatisticsRead(BITPipelineStatistics *statistics);
+
+/**
+ *  Estimates a percentile of the durations of a histogram.
+ *
+ *  @param histogram the histogram
+ *  @param percentile the percentile between 0 and 100
+ *
+ *  @return the upper bound of the bucket the percentile falls into in nanoseconds, 0 if the histogram is empty
+ */
+uint64_t bit_pipelineHistogramPercentile(const BITPipelineHistogram *histogram, double percentile);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,112 @@
+#import "BITPipelineStatistics.h"
+#import <mach/mach_time.h>
+#import <stdatomic.h>
+
+// Every thread updates a shard of its own, which starts on a cache line of its own.
+#define BIT_CACHE_LINE_SIZE 64
+#define BITPipelineShardCount 16
+
+typedef struct {
+  _Atomic(uint64_t) count;
+  _Atomic(uint64_t) totalNanoseconds;
+  _Atomic(uint64_t) buckets[BITPipelineHistogramBucketCount];
+} BITPipelineHistogramShard;
+
+typedef struct {
+  _Alignas(BIT_CACHE_LINE_SIZE) _Atomic(uint64_t) counters[BITTelemetryCounterCount];
+  BITPipelineHistogramShard histograms[BITTelemetryStageCount];
+} BITPipelineShard;
+
+static BITPipelineShard bit_pipelineShards[BITPipelineShardCount];
+
+static _Atomic(unsigned int) bit_nextPipelineShard;
+
+// The shard of the current thread plus one, 0 until the thread updates its first counter.
+static _Thread_local unsigned int bit_currentPipelineShard;
+
+static BITPipelineShard *bit_pipelineShard(void) {
+  unsigned int shard = bit_currentPipelineShard;
+  if (shard == 0) {
+    shard = atomic_fetch_add_explicit(&bit_nextPipelineShard, 1, memory_order_relaxed) % BITPipelineShardCount + 1;
+    bit_currentPipelineShard = shard;
+  }
+  return &bit_pipelineShards[shard - 1];
+}
+
+static unsigned int bit_pipelineHistogramBucket(uint64_t nanoseconds) {
+  if (nanoseconds == 0) {
+    return 0;
+  }
+  unsigned int bucket = 64 - (unsigned int)__builtin_clzll(nanoseconds);
+  return bucket < BITPipelineHistogramBucketCount ? bucket : BITPipelineHistogramBucketCount - 1;
+}
+
+void bit_pipelineCount(BITTelemetryCounter counter, uint64_t value) {
+  if (counter >= BITTelemetryCounterCount) {
+    return;
+  }
+  atomic_fetch_add_explicit(&bit_pipelineShard()->counters[counter], value, memory_order_relaxed);
+}
+
+uint64_t bit_pipelineTimestamp(void) {
+  return mach_absolute_time();
+}
+
+void bit_pipelineRecordDuration(BITTelemetryStage stage, uint64_t startTimestamp) {
+  static mach_timebase_info_data_t timebase;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info(&timebase);
+  });
+  uint64_t elapsed = mach_absolute_time() - startTimestamp;
+  bit_pipelineRecordNanoseconds(stage, timebase.numer == timebase.denom ? elapsed : elapsed * timebase.numer / timebase.denom);
+}
+
+void bit_pipelineRecordNanoseconds(BITTelemetryStage stage, uint64_t nanoseconds) {
+  if (stage >= BITTelemetryStageCount) {
+    return;
+  }
+  BITPipelineHistogramShard *histogram = &bit_pipelineShard()->histograms[stage];
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->totalNanoseconds, nanoseconds, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->buckets[bit_pipelineHistogramBucket(nanoseconds)], 1, memory_order_relaxed);
+}
+
+void bit_pipelineStatisticsRead(BITPipelineStatistics *statistics) {
+  memset(statistics, 0, sizeof(BITPipelineStatistics));
+  for (size_t i = 0; i < BITPipelineShardCount; i++) {
+    BITPipelineShard *shard = &bit_pipelineShards[i];
+    for (size_t counter = 0; counter < BITTelemetryCounterCount; counter++) {
+      statistics->counters[counter] += atomic_load_explicit(&shard->counters[counter], memory_order_relaxed);
+    }
+    for (size_t stage = 0; stage < BITTelemetryStageCount; stage++) {
+      BITPipelineHistogramShard *histogram = &shard->histograms[stage];
+      statistics->histograms[stage].count += atomic_load_explicit(&histogram->count, memory_order_relaxed);
+      statistics->histograms[stage].totalNanoseconds += atomic_load_explicit(&histogram->totalNanoseconds, memory_order_relaxed);
+      for (size_t bucket = 0; bucket < BITPipelineHistogramBucketCount; bucket++) {
+        statistics->histograms[stage].buckets[bucket] += atomic_load_explicit(&histogram->buckets[bucket], memory_order_relaxed);
+      }
+    }
+  }
+}
+
+uint64_t bit_pipelineHistogramPercentile(const BITPipelineHistogram *histogram, double percentile) {
+
+  // The count is read separately from the buckets, so the buckets are summed up instead.
+  uint64_t count = 0;
+  for (size_t bucket = 0; bucket < BITPipelineHistogramBucketCount; bucket++) {
+    count += histogram->buckets[bucket];
+  }
+  if (count == 0) {
+    return 0;
+  }
+  double rank = MAX(MIN(percentile, 100), 0) / 100 * (double)count;
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < BITPipelineHistogramBucketCount; bucket++) {
+    seen += histogram->buckets[bucket];
+    if (seen > 0 && (double)seen >= rank) {
+      return bucket == 0 ? 0 : 1ull << bucket;
+    }
+  }
+  return 1ull << (BITPipelineHistogramBucketCount - 1);
+}
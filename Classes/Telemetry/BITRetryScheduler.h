@@ -0,0 +1,121 @@
+#import <Foundation/Foundation.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  The state of the circuit breaker of a BITRetryScheduler.
+ */
+typedef NS_ENUM(NSInteger, BITCircuitState) {
+
+  /**
+   *  Requests are sent, failures only delay the next one.
+   */
+  BITCircuitStateClosed = 0,
+
+  /**
+   *  Too many requests have failed in a row, no requests are sent until the backoff delay has passed.
+   */
+  BITCircuitStateOpen = 1,
+
+  /**
+   *  The backoff delay of an open circuit has passed and a single probe request is in flight. Its outcome closes or
+   *  opens the circuit again.
+   */
+  BITCircuitStateHalfOpen = 2
+};
+
+/**
+ *  Decides when the sender may start a request, so clients back off while the server is throttling or down instead of
+ *  retrying on every persisted batch.
+ *
+ *  Every failed request delays the next one by an exponential backoff with jitter, or by the server's Retry-After
+ *  interval if that is longer. After `failureThreshold` failures in a row the circuit opens: once the delay has passed,
+ *  only a single request probes the server, and the others wait for its outcome.
+ *
+ *  Times are seconds on a monotonic clock, e.g. `-[NSProcessInfo systemUptime]`. All methods are thread-safe.
+ */
+@interface BITRetryScheduler : NSObject
+
+/**
+ *  The delay after the first failure in seconds, it doubles with every further failure.
+ *
+ *  Default: 5
+ */
+@property (nonatomic, assign) NSTimeInterval baseDelay;
+
+/**
+ *  The longest backoff delay in seconds.
+ *
+ *  Default: 600
+ */
+@property (nonatomic, assign) NSTimeInterval maximumDelay;
+
+/**
+ *  The longest Retry-After interval that is honored in seconds, so a bogus header can't stop sending for good.
+ *
+ *  Default: 3600
+ */
+@property (nonatomic, assign) NSTimeInterval maximumRetryAfter;
+
+/**
+ *  The number of failures in a row that opens the circuit.
+ *
+ *  Default: 5
+ */
+@property (nonatomic, assign) NSUInteger failureThreshold;
+
+/**
+ *  The state of the circuit breaker.
+ */
+@property (atomic, assign, readonly) BITCircuitState state;
+
+/**
+ *  The number of requests that have failed since the last successful one.
+ */
+@property (atomic, assign, readonly) NSUInteger consecutiveFailures;
+
+/**
+ *  Returns a backoff delay with jitter. The delay is a random value between half and all of
+ *  `MIN(maximumDelay, baseDelay * 2^(attempt - 1))`, so clients that failed at the same time don't retry at the same
+ *  time.
+ *
+ *  @param attempt the number of failed attempts, starting at 1
+ *
+ *  @return the delay in seconds, 0 if attempt is 0
+ */
+- (NSTimeInterval)delayForAttempt:(NSUInteger)attempt;
+
+/**
+ *  Asks whether a request may be started. If it may, the request is counted as started, which reserves the probe of a
+ *  circuit that has become half-open.
+ *
+ *  @param time the current time
+ *
+ *  @return 0 if the request may be started, otherwise the number of seconds after which to ask again
+ */
+- (NSTimeInterval)acquireRequestAt:(NSTimeInterval)time;
+
+/**
+ *  Releases a request that has been acquired but not sent, e.g. because there was nothing to send.
+ */
+- (void)cancelRequest;
+
+/**
+ *  Records that the server has accepted a request, which closes the circuit.
+ */
+- (void)recordSuccess;
+
+/**
+ *  Records a failed request.
+ *
+ *  @param time the current time
+ *  @param retryAfter the Retry-After interval of the response in seconds, 0 if there was none
+ *
+ *  @return the number of seconds until the next request may be started
+ */
+- (NSTimeInterval)recordFailureAt:(NSTimeInterval)time retryAfter:(NSTimeInterval)retryAfter;
+
+@end
+
+NS_ASSUME_NONNULL_END
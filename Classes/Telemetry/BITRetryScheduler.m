@@ -0,0 +1,92 @@
+#import "BITRetryScheduler.h"
+
+static NSTimeInterval const BITDefaultBaseDelay = 5;
+static NSTimeInterval const BITDefaultMaximumDelay = 10 * 60;
+static NSTimeInterval const BITDefaultMaximumRetryAfter = 60 * 60;
+static NSUInteger const BITDefaultFailureThreshold = 5;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface BITRetryScheduler ()
+
+@property (atomic, assign) BITCircuitState state;
+@property (atomic, assign) NSUInteger consecutiveFailures;
+@property (nonatomic, assign) NSTimeInterval nextRequestTime;
+@property (nonatomic, assign) BOOL probeInFlight;
+
+@end
+
+@implementation BITRetryScheduler
+
+- (instancetype)init {
+  if ((self = [super init])) {
+    _baseDelay = BITDefaultBaseDelay;
+    _maximumDelay = BITDefaultMaximumDelay;
+    _maximumRetryAfter = BITDefaultMaximumRetryAfter;
+    _failureThreshold = BITDefaultFailureThreshold;
+    _state = BITCircuitStateClosed;
+  }
+  return self;
+}
+
+- (NSTimeInterval)delayForAttempt:(NSUInteger)attempt {
+  if (attempt == 0) {
+    return 0;
+  }
+
+  // The exponent is limited before the multiplication, so many failures can't overflow into infinity.
+  NSTimeInterval delay = MIN(self.baseDelay * exp2((double)MIN(attempt - 1, (NSUInteger)32)), self.maximumDelay);
+  double jitter = (double)arc4random_uniform(UINT32_MAX) / (double)UINT32_MAX;
+  return delay / 2 + delay / 2 * jitter;
+}
+
+- (NSTimeInterval)acquireRequestAt:(NSTimeInterval)time {
+  @synchronized(self) {
+    if (time < self.nextRequestTime) {
+      return self.nextRequestTime - time;
+    }
+    if (self.state == BITCircuitStateClosed) {
+      return 0;
+    }
+    if (self.probeInFlight) {
+
+      // The outcome of the probe triggers the next request, this is only a fallback in case it never arrives.
+      return MAX(self.baseDelay, 1);
+    }
+    self.state = BITCircuitStateHalfOpen;
+    self.probeInFlight = YES;
+    return 0;
+  }
+}
+
+- (void)cancelRequest {
+  @synchronized(self) {
+    self.probeInFlight = NO;
+  }
+}
+
+- (void)recordSuccess {
+  @synchronized(self) {
+    self.state = BITCircuitStateClosed;
+    self.consecutiveFailures = 0;
+    self.nextRequestTime = 0;
+    self.probeInFlight = NO;
+  }
+}
+
+- (NSTimeInterval)recordFailureAt:(NSTimeInterval)time retryAfter:(NSTimeInterval)retryAfter {
+  @synchronized(self) {
+    self.consecutiveFailures += 1;
+    NSTimeInterval delay = MAX([self delayForAttempt:self.consecutiveFailures], MIN(MAX(retryAfter, 0), self.maximumRetryAfter));
+    self.nextRequestTime = MAX(self.nextRequestTime, time + delay);
+    if (self.state == BITCircuitStateHalfOpen || self.consecutiveFailures >= self.failureThreshold) {
+      self.state = BITCircuitStateOpen;
+    }
+    self.probeInFlight = NO;
+    return self.nextRequestTime - time;
+  }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,116 @@
+#import <stdbool.h>
+#import <stddef.h>
+#import <stdint.h>
+#import <sys/uio.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A fixed-capacity, multi-producer, single-consumer byte ring buffer for serialized telemetry items.
+ *
+ *  The buffer (including its bookkeeping) lives in a single anonymous memory mapping that is created once and never
+ *  resized. Producers reserve space with a compare-and-swap on the head offset, copy their bytes and publish the record
+ *  by setting a committed flag, so appending an item costs O(item) and never allocates. The consumer reads committed
+ *  records in order and releases the space afterwards.
+ *
+ *  All functions except bit_ringBufferCreate and bit_ringBufferDestroy are async-signal-safe, which allows a crash
+ *  handler to write pending records to disk with bit_ringBufferWriteToFileDescriptor.
+ */
+typedef struct BITRingBuffer BITRingBuffer;
+
+/**
+ *  Callback used to hand out records while reading the buffer.
+ *
+ *  @param context the context that was passed to the read function
+ *  @param bytes the bytes of a single record, only valid for the duration of the callback
+ *  @param length the number of bytes of the record
+ */
+typedef void (*BITRingBufferReader)(void *_Nullable context, const char *bytes, size_t length);
+
+/**
+ *  Creates a new ring buffer.
+ *
+ *  @param capacity the minimum number of bytes the buffer can hold, will be rounded up to the next power of two
+ *
+ *  @return a new ring buffer or NULL if the memory could not be mapped
+ */
+BITRingBuffer *_Nullable bit_ringBufferCreate(size_t capacity);
+
+/**
+ *  Unmaps the memory of the given ring buffer. The buffer must not be used afterwards.
+ *
+ *  @param ringBuffer the buffer to destroy
+ */
+void bit_ringBufferDestroy(BITRingBuffer *_Nullable ringBuffer);
+
+/**
+ *  Appends a single record, gathered from the given vector, to the buffer. Safe to call from multiple threads.
+ *
+ *  @param ringBuffer the buffer to append to
+ *  @param iov the bytes of the record
+ *  @param iovcnt the number of elements in iov
+ *
+ *  @return true if the record has been appended, false if there was not enough free space
+ */
+bool bit_ringBufferAppendv(BITRingBuffer *ringBuffer, const struct iovec *iov, int iovcnt);
+
+/**
+ *  Appends a single record to the buffer. Safe to call from multiple threads.
+ *
+ *  @param ringBuffer the buffer to append to
+ *  @param bytes the bytes of the record
+ *  @param length the number of bytes
+ *
+ *  @return true if the record has been appended, false if there was not enough free space
+ */
+bool bit_ringBufferAppend(BITRingBuffer *ringBuffer, const void *bytes, size_t length);
+
+/**
+ *  Reads all committed records in order and releases their space. Must only be called from a single consumer.
+ *
+ *  @param ringBuffer the buffer to read from
+ *  @param reader called once per record
+ *  @param context passed to the reader
+ *
+ *  @return the number of records that have been read
+ */
+size_t bit_ringBufferConsume(BITRingBuffer *ringBuffer, BITRingBufferReader reader, void *_Nullable context);
+
+/**
+ *  Drops all committed records without reading them. Must only be called from a single consumer.
+ *
+ *  @param ringBuffer the buffer to clear
+ */
+void bit_ringBufferDiscard(BITRingBuffer *ringBuffer);
+
+/**
+ *  Writes all committed records to the given file descriptor, using write(2) only. The buffer is not modified, so this
+ *  can be called from a signal handler while other threads are suspended in the middle of an append.
+ *
+ *  @param ringBuffer the buffer to write
+ *  @param fd an open file descriptor
+ *
+ *  @return the number of bytes written or -1 on error
+ */
+ssize_t bit_ringBufferWriteToFileDescriptor(const BITRingBuffer *_Nullable ringBuffer, int fd);
+
+/**
+ *  Returns the number of bytes that are currently reserved by records, including bookkeeping overhead.
+ *
+ *  @param ringBuffer the buffer
+ *
+ *  @return the number of used bytes
+ */
+size_t bit_ringBufferUsedBytes(const BITRingBuffer *ringBuffer);
+
+/**
+ *  Returns the capacity of the buffer in bytes.
+ *
+ *  @param ringBuffer the buffer
+ *
+ *  @return the capacity in bytes
+ */
+size_t bit_ringBufferCapacity(const BITRingBuffer *ringBuffer);
+
+NS_ASSUME_NONNULL_END
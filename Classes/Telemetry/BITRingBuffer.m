@@ -0,0 +1,203 @@
+#import "BITRingBuffer.h"
+#import <errno.h>
+#import <stdatomic.h>
+#import <string.h>
+#import <sys/mman.h>
+#import <unistd.h>
+
+// Every record starts with a 32 bit header word and is padded to a multiple of 4 bytes, so header words are always
+// naturally aligned and can be accessed atomically.
+static uint32_t const BITRingBufferCommittedFlag = 1u << 31;
+static uint32_t const BITRingBufferPaddingFlag = 1u << 30;
+static uint32_t const BITRingBufferLengthMask = BITRingBufferPaddingFlag - 1;
+static size_t const BITRingBufferHeaderSize = sizeof(uint32_t);
+
+struct BITRingBuffer {
+
+  // Monotonic byte offsets, the position in the data area is offset & (capacity - 1).
+  _Atomic(uint64_t) head;
+  _Atomic(uint64_t) tail;
+  size_t capacity;
+  size_t mappedLength;
+  char *bytes;
+};
+
+static size_t bit_ringBufferRecordSize(size_t length) {
+  return (BITRingBufferHeaderSize + length + 3) & ~(size_t)3;
+}
+
+static _Atomic(uint32_t) *bit_ringBufferHeaderAt(const BITRingBuffer *ringBuffer, uint64_t offset) {
+  return (_Atomic(uint32_t) *)(void *)(ringBuffer->bytes + (offset & (ringBuffer->capacity - 1)));
+}
+
+BITRingBuffer *bit_ringBufferCreate(size_t capacity) {
+  size_t roundedCapacity = 4096;
+  while (roundedCapacity < capacity) {
+    if (roundedCapacity > BITRingBufferLengthMask) {
+      return NULL;
+    }
+    roundedCapacity <<= 1;
+  }
+
+  // The bookkeeping struct gets its own page in front of the data area, so everything is mapped at once.
+  size_t pageSize = (size_t)getpagesize();
+  size_t mappedLength = pageSize + roundedCapacity;
+  void *memory = mmap(NULL, mappedLength, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+  if (memory == MAP_FAILED) {
+    return NULL;
+  }
+
+  // Anonymous mappings are zero filled, so all header words start out as "not committed".
+  BITRingBuffer *ringBuffer = (BITRingBuffer *)memory;
+  atomic_init(&ringBuffer->head, 0);
+  atomic_init(&ringBuffer->tail, 0);
+  ringBuffer->capacity = roundedCapacity;
+  ringBuffer->mappedLength = mappedLength;
+  ringBuffer->bytes = (char *)memory + pageSize;
+  return ringBuffer;
+}
+
+void bit_ringBufferDestroy(BITRingBuffer *ringBuffer) {
+  if (!ringBuffer) {
+    return;
+  }
+  munmap(ringBuffer, ringBuffer->mappedLength);
+}
+
+bool bit_ringBufferAppendv(BITRingBuffer *ringBuffer, const struct iovec *iov, int iovcnt) {
+  size_t length = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    length += iov[i].iov_len;
+  }
+  if (length == 0 || length > BITRingBufferLengthMask) {
+    return false;
+  }
+
+  size_t capacity = ringBuffer->capacity;
+  size_t recordSize = bit_ringBufferRecordSize(length);
+  if (recordSize > capacity) {
+    return false;
+  }
+
+  // Reserve space. If the record does not fit in front of the wrap around point, the remainder gets reserved as well
+  // and is turned into a padding record, so the payload is always contiguous.
+  uint64_t head = atomic_load_explicit(&ringBuffer->head, memory_order_relaxed);
+  size_t padding;
+  do {
+    uint64_t tail = atomic_load_explicit(&ringBuffer->tail, memory_order_acquire);
+    size_t position = (size_t)(head & (capacity - 1));
+    padding = (capacity - position < recordSize) ? capacity - position : 0;
+    if (head + padding + recordSize - tail > capacity) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(&ringBuffer->head, &head, head + padding + recordSize,
+                                                  memory_order_relaxed, memory_order_relaxed));
+
+  if (padding > 0) {
+    atomic_store_explicit(bit_ringBufferHeaderAt(ringBuffer, head), (uint32_t)padding | BITRingBufferPaddingFlag | BITRingBufferCommittedFlag, memory_order_release);
+    head += padding;
+  }
+
+  // Publish the length right away, so a crash handler can skip this record if we never get to commit it.
+  _Atomic(uint32_t) *header = bit_ringBufferHeaderAt(ringBuffer, head);
+  atomic_store_explicit(header, (uint32_t)length, memory_order_relaxed);
+
+  char *destination = (char *)header + BITRingBufferHeaderSize;
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(destination, iov[i].iov_base, iov[i].iov_len);
+    destination += iov[i].iov_len;
+  }
+  atomic_store_explicit(header, (uint32_t)length | BITRingBufferCommittedFlag, memory_order_release);
+  return true;
+}
+
+bool bit_ringBufferAppend(BITRingBuffer *ringBuffer, const void *bytes, size_t length) {
+  struct iovec iov = {.iov_base = (void *)(uintptr_t)bytes, .iov_len = length};
+  return bit_ringBufferAppendv(ringBuffer, &iov, 1);
+}
+
+size_t bit_ringBufferConsume(BITRingBuffer *ringBuffer, BITRingBufferReader reader, void *context) {
+  size_t count = 0;
+  uint64_t tail = atomic_load_explicit(&ringBuffer->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&ringBuffer->head, memory_order_acquire);
+  while (tail < head) {
+    _Atomic(uint32_t) *header = bit_ringBufferHeaderAt(ringBuffer, tail);
+    uint32_t value = atomic_load_explicit(header, memory_order_acquire);
+    if (!(value & BITRingBufferCommittedFlag)) {
+
+      // A producer is still copying its bytes, everything behind it has to wait for the next call.
+      break;
+    }
+    size_t length = value & BITRingBufferLengthMask;
+    size_t recordSize = length;
+    if (!(value & BITRingBufferPaddingFlag)) {
+      if (reader) {
+        reader(context, (const char *)header + BITRingBufferHeaderSize, length);
+      }
+      recordSize = bit_ringBufferRecordSize(length);
+      count++;
+    }
+
+    // Clear the record before handing the space back. Headers of later records may land anywhere in this area, and
+    // readers rely on reserved but uncommitted headers being zero.
+    memset((void *)header, 0, recordSize);
+    tail += recordSize;
+    atomic_store_explicit(&ringBuffer->tail, tail, memory_order_release);
+  }
+  return count;
+}
+
+void bit_ringBufferDiscard(BITRingBuffer *ringBuffer) {
+  bit_ringBufferConsume(ringBuffer, NULL, NULL);
+}
+
+ssize_t bit_ringBufferWriteToFileDescriptor(const BITRingBuffer *ringBuffer, int fd) {
+  if (!ringBuffer || fd < 0) {
+    return -1;
+  }
+  ssize_t written = 0;
+  uint64_t tail = atomic_load_explicit(&ringBuffer->tail, memory_order_acquire);
+  uint64_t head = atomic_load_explicit(&ringBuffer->head, memory_order_acquire);
+  while (tail < head) {
+    _Atomic(uint32_t) *header = bit_ringBufferHeaderAt(ringBuffer, tail);
+    uint32_t value = atomic_load_explicit(header, memory_order_acquire);
+    size_t length = value & BITRingBufferLengthMask;
+    if (length == 0) {
+
+      // Space has been reserved but not even the length is known, so there's no way to skip it.
+      break;
+    }
+    if (value & BITRingBufferPaddingFlag) {
+      tail += length;
+      continue;
+    }
+    if (value & BITRingBufferCommittedFlag) {
+      const char *bytes = (const char *)header + BITRingBufferHeaderSize;
+      size_t remaining = length;
+      while (remaining > 0) {
+        ssize_t result = write(fd, bytes, remaining);
+        if (result < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          return -1;
+        }
+        bytes += result;
+        remaining -= (size_t)result;
+      }
+      written += (ssize_t)length;
+    }
+    tail += bit_ringBufferRecordSize(length);
+  }
+  return written;
+}
+
+size_t bit_ringBufferUsedBytes(const BITRingBuffer *ringBuffer) {
+  uint64_t tail = atomic_load_explicit(&ringBuffer->tail, memory_order_acquire);
+  uint64_t head = atomic_load_explicit(&ringBuffer->head, memory_order_acquire);
+  return (size_t)(head - tail);
+}
+
+size_t bit_ringBufferCapacity(const BITRingBuffer *ringBuffer) {
+  return ringBuffer->capacity;
+}
@@ -0,0 +1,126 @@
+#import <stdbool.h>
+#import <stddef.h>
+#import <stdint.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  An append-only log of telemetry batches, stored in a directory of segment files.
+ *
+ *  Every segment starts with a small header and contains length-prefixed records, each protected by a CRC32 of its
+ *  payload. Records are appended to the newest segment until it reaches the configured segment size, removing a
+ *  record only flips a state word in its header, and a segment file is deleted once all of its records are removed.
+ *
+ *  The log keeps an in-memory index of all records, so appending, looking up the next record to send and the number of
+ *  stored bytes are O(1) and never list the directory. The directory is only read when the log is opened: segments
+ *  are validated record by record and truncated after the last intact record, which drops whatever a crash left
+ *  behind in the middle of an append.
+ *
+ *  A log is not thread-safe, callers have to serialize access.
+ */
+typedef struct BITSegmentedLog BITSegmentedLog;
+
+/**
+ *  Identifies a record for the lifetime of an opened log. Identifiers are assigned in append order and are not stored
+ *  on disk, they are reassigned when a log is opened again.
+ */
+typedef uint64_t BITSegmentedLogRecordID;
+
+/**
+ *  Opens the log in the given directory and recovers it. The directory must exist.
+ *
+ *  @param directoryPath the directory the segment files are stored in
+ *  @param segmentSize the size at which a new segment is started, records larger than this get a segment of their own
+ *
+ *  @return the opened log or NULL if the directory or one of the segments could not be read or indexed
+ */
+BITSegmentedLog *_Nullable bit_segmentedLogOpen(const char *directoryPath, size_t segmentSize);
+
+/**
+ *  Closes all segment files and frees the index.
+ *
+ *  @param log the log to close
+ */
+void bit_segmentedLogClose(BITSegmentedLog *_Nullable log);
+
+/**
+ *  Appends a record to the newest segment.
+ *
+ *  @param log the log
+ *  @param bytes the payload of the record
+ *  @param length the number of bytes
+ *  @param recordID set to the identifier of the new record, may be NULL
+ *
+ *  @return true if the record has been written completely
+ */
+bool bit_segmentedLogAppend(BITSegmentedLog *log, const void *bytes, size_t length, BITSegmentedLogRecordID *_Nullable recordID);
+
+/**
+ *  Returns the oldest record that is neither removed nor in flight and marks it as in flight.
+ *
+ *  @param log the log
+ *  @param recordID set to the identifier of the record
+ *
+ *  @return false if there is no record available
+ */
+bool bit_segmentedLogAcquireNext(BITSegmentedLog *log, BITSegmentedLogRecordID *recordID);
+
+/**
+ *  Makes an in-flight record available to bit_segmentedLogAcquireNext again.
+ *
+ *  @param log the log
+ *  @param recordID the record to release
+ */
+void bit_segmentedLogRelease(BITSegmentedLog *log, BITSegmentedLogRecordID recordID);
+
+/**
+ *  Removes a record. The segment file is deleted once all of its records have been removed.
+ *
+ *  @param log the log
+ *  @param recordID the record to remove
+ *
+ *  @return false if the record doesn't exist
+ */
+bool bit_segmentedLogRemove(BITSegmentedLog *log, BITSegmentedLogRecordID recordID);
+
+/**
+ *  Returns the payload length of a record.
+ *
+ *  @param log the log
+ *  @param recordID the record
+ *
+ *  @return the length in bytes or -1 if the record doesn't exist
+ */
+long long bit_segmentedLogRecordLength(BITSegmentedLog *log, BITSegmentedLogRecordID recordID);
+
+/**
+ *  Reads the payload of a record and verifies its checksum.
+ *
+ *  @param log the log
+ *  @param recordID the record
+ *  @param buffer receives the payload, must be at least bit_segmentedLogRecordLength bytes large
+ *
+ *  @return false if the record doesn't exist, could not be read or is corrupted
+ */
+bool bit_segmentedLogRead(BITSegmentedLog *log, BITSegmentedLogRecordID recordID, void *buffer);
+
+/**
+ *  Returns the number of records that have not been removed.
+ *
+ *  @param log the log
+ *
+ *  @return the number of live records
+ */
+size_t bit_segmentedLogRecordCount(const BITSegmentedLog *log);
+
+/**
+ *  Returns the number of bytes on disk used by records that have not been removed, including record headers.
+ *
+ *  @param log the log
+ *
+ *  @return the number of live bytes
+ */
+uint64_t bit_segmentedLogUsedBytes(const BITSegmentedLog *log);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,548 @@
+#import "BITSegmentedLog.h"
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <sys/uio.h>
+#import <unistd.h>
+#import <zlib.h>
+
+// Segment files are named after their sequence number, so sorting them by name restores the append order.
+static char const *const BITSegmentFileFormat = "segment-%016llx.log";
+static size_t const BITSegmentFileNameLength = 28;
+
+static char const BITSegmentMagic[8] = {'B', 'I', 'T', 'S', 'L', 'O', 'G', '1'};
+static uint32_t const BITSegmentVersion = 1;
+static uint32_t const BITRecordMagic = 0x31524C42;
+
+// Written over the state word of a record once it has been removed. Any other value means the record is live, so a
+// torn write of the state can at worst cause a record to be sent twice, never to be lost.
+static uint32_t const BITRecordStateLive = 0;
+static uint32_t const BITRecordStateRemoved = 0x564D4552;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t sequence;
+  uint32_t reserved;
+  uint32_t checksum;
+} BITSegmentHeader;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t length;
+
+  // CRC32 of the length followed by the payload.
+  uint32_t checksum;
+  uint32_t state;
+} BITRecordHeader;
+
+typedef struct {
+  uint64_t sequence;
+  int fd;
+  uint64_t size;
+  size_t liveRecords;
+  char *path;
+} BITLogSegment;
+
+typedef enum {
+  BITLogEntryStatePending,
+  BITLogEntryStateInFlight,
+  BITLogEntryStateRemoved
+} BITLogEntryState;
+
+typedef struct {
+  BITLogSegment *segment;
+  uint64_t offset;
+  uint32_t length;
+  BITLogEntryState state;
+} BITLogEntry;
+
+struct BITSegmentedLog {
+  char *directoryPath;
+  size_t segmentSize;
+
+  // Ordered by sequence, the last segment is the one records are appended to.
+  BITLogSegment **segments;
+  size_t segmentCount;
+  size_t segmentCapacity;
+
+  // Ring of index entries, the entry of a record lives at (entryHead + recordID - firstID) & (entryCapacity - 1).
+  BITLogEntry *entries;
+  size_t entryCapacity;
+  size_t entryHead;
+  size_t entryCount;
+  BITSegmentedLogRecordID firstID;
+
+  // There is no pending record with a smaller identifier.
+  BITSegmentedLogRecordID cursor;
+
+  size_t liveRecords;
+  uint64_t liveBytes;
+};
+
+#pragma mark - Helper
+
+static uint32_t bit_recordChecksum(uint32_t length, const void *bytes) {
+  uLong checksum = crc32(0L, Z_NULL, 0);
+  checksum = crc32(checksum, (const Bytef *)&length, sizeof(length));
+  checksum = crc32(checksum, (const Bytef *)bytes, (uInt)length);
+  return (uint32_t)checksum;
+}
+
+static uint32_t bit_segmentHeaderChecksum(const BITSegmentHeader *header) {
+  return (uint32_t)crc32(crc32(0L, Z_NULL, 0), (const Bytef *)header, (uInt)offsetof(BITSegmentHeader, checksum));
+}
+
+static bool bit_writeFully(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t written = writev(fd, iov, iovcnt);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+      written -= (ssize_t)iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= (size_t)written;
+    }
+  }
+  return true;
+}
+
+static bool bit_readFully(int fd, void *buffer, size_t length, uint64_t offset) {
+  char *destination = buffer;
+  while (length > 0) {
+    ssize_t result = pread(fd, destination, length, (off_t)offset);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    destination += result;
+    length -= (size_t)result;
+    offset += (uint64_t)result;
+  }
+  return true;
+}
+
+static char *bit_segmentPath(const BITSegmentedLog *log, uint64_t sequence) {
+  char name[BITSegmentFileNameLength + 1];
+  snprintf(name, sizeof(name), BITSegmentFileFormat, (unsigned long long)sequence);
+  size_t length = strlen(log->directoryPath) + 1 + BITSegmentFileNameLength + 1;
+  char *path = malloc(length);
+  if (path) {
+    snprintf(path, length, "%s/%s", log->directoryPath, name);
+  }
+  return path;
+}
+
+#pragma mark - Segments
+
+static void bit_segmentFree(BITLogSegment *segment) {
+  if (segment->fd >= 0) {
+    close(segment->fd);
+  }
+  free(segment->path);
+  free(segment);
+}
+
+static bool bit_segmentsAppend(BITSegmentedLog *log, BITLogSegment *segment) {
+  if (log->segmentCount == log->segmentCapacity) {
+    size_t capacity = log->segmentCapacity > 0 ? log->segmentCapacity * 2 : 8;
+    BITLogSegment **segments = realloc(log->segments, capacity * sizeof(BITLogSegment *));
+    if (!segments) {
+      return false;
+    }
+    log->segments = segments;
+    log->segmentCapacity = capacity;
+  }
+  log->segments[log->segmentCount++] = segment;
+  return true;
+}
+
+static void bit_segmentDelete(BITSegmentedLog *log, BITLogSegment *segment) {
+  for (size_t i = 0; i < log->segmentCount; i++) {
+    if (log->segments[i] == segment) {
+      memmove(&log->segments[i], &log->segments[i + 1], (log->segmentCount - i - 1) * sizeof(BITLogSegment *));
+      log->segmentCount--;
+      break;
+    }
+  }
+  unlink(segment->path);
+  bit_segmentFree(segment);
+}
+
+static BITLogSegment *bit_activeSegment(const BITSegmentedLog *log) {
+  return log->segmentCount > 0 ? log->segments[log->segmentCount - 1] : NULL;
+}
+
+static BITLogSegment *bit_segmentCreate(BITSegmentedLog *log) {
+  BITLogSegment *previous = bit_activeSegment(log);
+  BITLogSegment *segment = calloc(1, sizeof(BITLogSegment));
+  if (!segment) {
+    return NULL;
+  }
+  segment->sequence = previous ? previous->sequence + 1 : 1;
+  segment->path = bit_segmentPath(log, segment->sequence);
+  segment->fd = segment->path ? open(segment->path, O_RDWR | O_CREAT | O_TRUNC, 0600) : -1;
+  if (segment->fd < 0) {
+    bit_segmentFree(segment);
+    return NULL;
+  }
+
+  BITSegmentHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BITSegmentMagic, sizeof(header.magic));
+  header.version = BITSegmentVersion;
+  header.headerSize = sizeof(BITSegmentHeader);
+  header.sequence = segment->sequence;
+  header.checksum = bit_segmentHeaderChecksum(&header);
+  struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+  if (!bit_writeFully(segment->fd, &iov, 1) || !bit_segmentsAppend(log, segment)) {
+    unlink(segment->path);
+    bit_segmentFree(segment);
+    return NULL;
+  }
+  segment->size = sizeof(BITSegmentHeader);
+
+  // The previous segment isn't written to anymore, so it can go away as soon as it's empty.
+  if (previous && previous->liveRecords == 0) {
+    bit_segmentDelete(log, previous);
+  }
+  return segment;
+}
+
+#pragma mark - Index
+
+static BITLogEntry *bit_entryForID(const BITSegmentedLog *log, BITSegmentedLogRecordID recordID) {
+  if (recordID < log->firstID || recordID - log->firstID >= log->entryCount) {
+    return NULL;
+  }
+  return &log->entries[(log->entryHead + (size_t)(recordID - log->firstID)) & (log->entryCapacity - 1)];
+}
+
+static bool bit_entriesAppend(BITSegmentedLog *log, BITLogSegment *segment, uint64_t offset, uint32_t length, BITSegmentedLogRecordID *recordID) {
+  if (log->entryCount == log->entryCapacity) {
+    size_t capacity = log->entryCapacity > 0 ? log->entryCapacity * 2 : 64;
+    BITLogEntry *entries = malloc(capacity * sizeof(BITLogEntry));
+    if (!entries) {
+      return false;
+    }
+    for (size_t i = 0; i < log->entryCount; i++) {
+      entries[i] = log->entries[(log->entryHead + i) & (log->entryCapacity - 1)];
+    }
+    free(log->entries);
+    log->entries = entries;
+    log->entryCapacity = capacity;
+    log->entryHead = 0;
+  }
+  BITLogEntry *entry = &log->entries[(log->entryHead + log->entryCount) & (log->entryCapacity - 1)];
+  entry->segment = segment;
+  entry->offset = offset;
+  entry->length = length;
+  entry->state = BITLogEntryStatePending;
+  if (recordID) {
+    *recordID = log->firstID + log->entryCount;
+  }
+  log->entryCount++;
+  segment->liveRecords++;
+  log->liveRecords++;
+  log->liveBytes += sizeof(BITRecordHeader) + length;
+  return true;
+}
+
+// Drops removed entries from the front, so the index only grows with the number of records that are still stored.
+static void bit_entriesTrim(BITSegmentedLog *log) {
+  while (log->entryCount > 0 && log->entries[log->entryHead].state == BITLogEntryStateRemoved) {
+    log->entryHead = (log->entryHead + 1) & (log->entryCapacity - 1);
+    log->entryCount--;
+    log->firstID++;
+  }
+  if (log->cursor < log->firstID) {
+    log->cursor = log->firstID;
+  }
+}
+
+#pragma mark - Recovery
+
+static int bit_compareSequences(const void *lhs, const void *rhs) {
+  uint64_t a = *(const uint64_t *)lhs;
+  uint64_t b = *(const uint64_t *)rhs;
+  return (a > b) - (a < b);
+}
+
+// Indexes all intact records of a segment and cuts off everything after the first damaged one. Only a bad header or
+// checksum counts as damage. If a record can't be read or indexed, recovery stops without touching the segment and
+// returns false, the records behind it may well be intact.
+static bool bit_segmentRecover(BITSegmentedLog *log, BITLogSegment *segment, uint64_t fileSize) {
+  uint64_t offset = sizeof(BITSegmentHeader);
+  void *payload = NULL;
+  size_t payloadCapacity = 0;
+  bool damaged = false;
+  while (offset + sizeof(BITRecordHeader) <= fileSize) {
+    BITRecordHeader header;
+    if (!bit_readFully(segment->fd, &header, sizeof(header), offset)) {
+      free(payload);
+      return false;
+    }
+    if (header.magic != BITRecordMagic || header.length > fileSize - offset - sizeof(header)) {
+      damaged = true;
+      break;
+    }
+    if (header.length > payloadCapacity) {
+      void *buffer = realloc(payload, header.length);
+      if (!buffer) {
+        free(payload);
+        return false;
+      }
+      payload = buffer;
+      payloadCapacity = header.length;
+    }
+    if (!bit_readFully(segment->fd, payload, header.length, offset + sizeof(header))) {
+      free(payload);
+      return false;
+    }
+    if (bit_recordChecksum(header.length, payload) != header.checksum) {
+      damaged = true;
+      break;
+    }
+    if (header.state != BITRecordStateRemoved && !bit_entriesAppend(log, segment, offset, header.length, NULL)) {
+      free(payload);
+      return false;
+    }
+    offset += sizeof(header) + header.length;
+  }
+  free(payload);
+
+  // Less than a record header at the end is the remainder of an interrupted append as well.
+  if ((damaged || offset < fileSize) && ftruncate(segment->fd, (off_t)offset) != 0) {
+    return false;
+  }
+  segment->size = offset;
+  return true;
+}
+
+static bool bit_segmentedLogRecover(BITSegmentedLog *log, DIR *directory) {
+  uint64_t *sequences = NULL;
+  size_t count = 0;
+  size_t capacity = 0;
+  struct dirent *item;
+  while ((item = readdir(directory)) != NULL) {
+    unsigned long long sequence = 0;
+    if (strlen(item->d_name) != BITSegmentFileNameLength || sscanf(item->d_name, BITSegmentFileFormat, &sequence) != 1) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity = capacity > 0 ? capacity * 2 : 16;
+      uint64_t *buffer = realloc(sequences, capacity * sizeof(uint64_t));
+      if (!buffer) {
+        free(sequences);
+        return false;
+      }
+      sequences = buffer;
+    }
+    sequences[count++] = sequence;
+  }
+  qsort(sequences, count, sizeof(uint64_t), bit_compareSequences);
+
+  for (size_t i = 0; i < count; i++) {
+    BITLogSegment *segment = calloc(1, sizeof(BITLogSegment));
+    if (!segment) {
+      free(sequences);
+      return false;
+    }
+    segment->sequence = sequences[i];
+    segment->path = bit_segmentPath(log, sequences[i]);
+    segment->fd = segment->path ? open(segment->path, O_RDWR) : -1;
+
+    BITSegmentHeader header;
+    struct stat attributes;
+    if (segment->fd < 0 || fstat(segment->fd, &attributes) != 0 ||
+        !bit_readFully(segment->fd, &header, sizeof(header), 0) ||
+        memcmp(header.magic, BITSegmentMagic, sizeof(header.magic)) != 0 ||
+        header.version != BITSegmentVersion || header.sequence != sequences[i] ||
+        header.checksum != bit_segmentHeaderChecksum(&header) || !bit_segmentsAppend(log, segment)) {
+
+      // A segment without a valid header has been interrupted while it was created and can't contain any records.
+      if (segment->path) {
+        unlink(segment->path);
+      }
+      bit_segmentFree(segment);
+      continue;
+    }
+    if (!bit_segmentRecover(log, segment, (uint64_t)attributes.st_size)) {
+      free(sequences);
+      return false;
+    }
+  }
+  free(sequences);
+
+  // Only the newest segment is kept around if it is empty, it's the one new records are appended to.
+  for (size_t i = 0; i + 1 < log->segmentCount;) {
+    if (log->segments[i]->liveRecords == 0) {
+      bit_segmentDelete(log, log->segments[i]);
+    } else {
+      i++;
+    }
+  }
+  return true;
+}
+
+#pragma mark - Log
+
+BITSegmentedLog *bit_segmentedLogOpen(const char *directoryPath, size_t segmentSize) {
+  DIR *directory = opendir(directoryPath);
+  if (!directory) {
+    return NULL;
+  }
+  BITSegmentedLog *log = calloc(1, sizeof(BITSegmentedLog));
+  if (!log || !(log->directoryPath = strdup(directoryPath))) {
+    free(log);
+    closedir(directory);
+    return NULL;
+  }
+  log->segmentSize = segmentSize;
+  log->firstID = 1;
+  log->cursor = 1;
+  bool recovered = bit_segmentedLogRecover(log, directory);
+  closedir(directory);
+  if (!recovered) {
+
+    // A log that is only partly indexed would append over records it doesn't know about.
+    bit_segmentedLogClose(log);
+    return NULL;
+  }
+  return log;
+}
+
+void bit_segmentedLogClose(BITSegmentedLog *log) {
+  if (!log) {
+    return;
+  }
+  for (size_t i = 0; i < log->segmentCount; i++) {
+    bit_segmentFree(log->segments[i]);
+  }
+  free(log->segments);
+  free(log->entries);
+  free(log->directoryPath);
+  free(log);
+}
+
+bool bit_segmentedLogAppend(BITSegmentedLog *log, const void *bytes, size_t length, BITSegmentedLogRecordID *recordID) {
+  if (length == 0 || length > UINT32_MAX - sizeof(BITRecordHeader)) {
+    return false;
+  }
+  uint64_t recordSize = sizeof(BITRecordHeader) + length;
+  BITLogSegment *segment = bit_activeSegment(log);
+  if (!segment || (segment->size + recordSize > log->segmentSize && segment->size > sizeof(BITSegmentHeader))) {
+    segment = bit_segmentCreate(log);
+    if (!segment) {
+      return false;
+    }
+  }
+
+  BITRecordHeader header = {
+    .magic = BITRecordMagic,
+    .length = (uint32_t)length,
+    .checksum = bit_recordChecksum((uint32_t)length, bytes),
+    .state = BITRecordStateLive
+  };
+  struct iovec iov[2] = {
+    {.iov_base = &header, .iov_len = sizeof(header)},
+    {.iov_base = (void *)(uintptr_t)bytes, .iov_len = length}
+  };
+  if (lseek(segment->fd, (off_t)segment->size, SEEK_SET) < 0 || !bit_writeFully(segment->fd, iov, 2) ||
+      !bit_entriesAppend(log, segment, segment->size, (uint32_t)length, recordID)) {
+
+    // Don't leave a partial record behind, it would hide every record appended after it from recovery.
+    ftruncate(segment->fd, (off_t)segment->size);
+    return false;
+  }
+  segment->size += recordSize;
+  return true;
+}
+
+bool bit_segmentedLogAcquireNext(BITSegmentedLog *log, BITSegmentedLogRecordID *recordID) {
+  for (BITSegmentedLogRecordID candidate = log->cursor; candidate < log->firstID + log->entryCount; candidate++) {
+    BITLogEntry *entry = bit_entryForID(log, candidate);
+    if (entry->state == BITLogEntryStatePending) {
+      entry->state = BITLogEntryStateInFlight;
+      log->cursor = candidate + 1;
+      *recordID = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+void bit_segmentedLogRelease(BITSegmentedLog *log, BITSegmentedLogRecordID recordID) {
+  BITLogEntry *entry = bit_entryForID(log, recordID);
+  if (!entry || entry->state != BITLogEntryStateInFlight) {
+    return;
+  }
+  entry->state = BITLogEntryStatePending;
+  if (recordID < log->cursor) {
+    log->cursor = recordID;
+  }
+}
+
+bool bit_segmentedLogRemove(BITSegmentedLog *log, BITSegmentedLogRecordID recordID) {
+  BITLogEntry *entry = bit_entryForID(log, recordID);
+  if (!entry || entry->state == BITLogEntryStateRemoved) {
+    return false;
+  }
+  BITLogSegment *segment = entry->segment;
+  uint32_t state = BITRecordStateRemoved;
+  pwrite(segment->fd, &state, sizeof(state), (off_t)(entry->offset + offsetof(BITRecordHeader, state)));
+
+  entry->state = BITLogEntryStateRemoved;
+  log->liveRecords--;
+  log->liveBytes -= sizeof(BITRecordHeader) + entry->length;
+  segment->liveRecords--;
+  if (segment->liveRecords == 0 && segment != bit_activeSegment(log)) {
+    bit_segmentDelete(log, segment);
+  }
+  bit_entriesTrim(log);
+  return true;
+}
+
+long long bit_segmentedLogRecordLength(BITSegmentedLog *log, BITSegmentedLogRecordID recordID) {
+  BITLogEntry *entry = bit_entryForID(log, recordID);
+  if (!entry || entry->state == BITLogEntryStateRemoved) {
+    return -1;
+  }
+  return entry->length;
+}
+
+bool bit_segmentedLogRead(BITSegmentedLog *log, BITSegmentedLogRecordID recordID, void *buffer) {
+  BITLogEntry *entry = bit_entryForID(log, recordID);
+  if (!entry || entry->state == BITLogEntryStateRemoved) {
+    return false;
+  }
+  BITRecordHeader header;
+  if (!bit_readFully(entry->segment->fd, &header, sizeof(header), entry->offset) ||
+      !bit_readFully(entry->segment->fd, buffer, entry->length, entry->offset + sizeof(header))) {
+    return false;
+  }
+  return header.length == entry->length && bit_recordChecksum(entry->length, buffer) == header.checksum;
+}
+
+size_t bit_segmentedLogRecordCount(const BITSegmentedLog *log) {
+  return log->liveRecords;
+}
+
+uint64_t bit_segmentedLogUsedBytes(const BITSegmentedLog *log) {
+  return log->liveBytes;
+}
@@ -3,6 +3,8 @@
 #import "HockeySDKNullability.h"
 
 @class BITPersistence;
+@class BITRetryScheduler;
+@class BITTimerWheel;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -24,11 +26,6 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (instancetype)initWithPersistence:(BITPersistence *)persistence serverURL:(NSURL *)serverURL;
 
-/**
- * We use this queue to keep track of the number of currently running requests
- */
-@property (nonatomic, strong) dispatch_queue_t requestsCountQueue;
-
 /**
  *  A queue which is used to handle completion blocks.
  */
@@ -50,9 +47,57 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, assign) NSUInteger maxRequestCount;
 
 /**
- *  The number of requests that are currently running.
+ *  The number of requests that are currently running. Every running request holds a token of a lock-free pool with
+ *  maxRequestCount tokens.
+ */
+@property (nonatomic, assign, readonly) NSUInteger runningRequestsCount;
+
+/**
+ *  The largest number of requests that have been running at a time.
+ */
+@property (nonatomic, assign, readonly) NSUInteger peakRunningRequestsCount;
+
+/**
+ *  The max number of persisted batches that are coalesced into a single request. Batches are sent one per request if
+ *  this is 1.
+ *
+ *  Default: 20
+ */
+@property (nonatomic, assign) NSUInteger maxBatchesPerRequest;
+
+/**
+ *  The max uncompressed length of a request with coalesced batches in bytes. A single batch is sent even if it is
+ *  longer.
+ *
+ *  Default: 1 MB
+ */
+@property (nonatomic, assign) NSUInteger maxRequestLength;
+
+/**
+ *  The number of times sending a batch may fail with a response of the server before it is dropped. Failures without a
+ *  response, e.g. while the device is offline, are not counted.
+ *
+ *  Default: 20
+ */
+@property (nonatomic, assign) NSUInteger maxSendAttempts;
+
+/**
+ *  Whether batches stored as gzip files are uploaded straight from their files. The upload task reads the file while
+ *  sending it, so memory usage doesn't grow with the size of a batch. Otherwise every batch is read into memory first.
+ *
+ *  Default: YES
  */
-@property (nonatomic, assign) NSUInteger runningRequestsCount;
+@property (nonatomic, assign) BOOL uploadsFromFile;
+
+/**
+ *  Decides when requests may be sent after others have failed.
+ */
+@property (nonatomic, strong, readonly) BITRetryScheduler *retryScheduler;
+
+/**
+ *  The timer wheel deferred sends are scheduled with, the shared wheel unless replaced (testing).
+ */
+@property (nonatomic, strong) BITTimerWheel *timerWheel;
 
 /**
  *  BaseURL to which relative paths are appended.
@@ -76,6 +121,46 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)sendData:(NSData *)data withFilePath:(NSString * )filePath;
 
+/**
+ *  Creates an upload task that sends a stored batch from its file without reading it into memory.
+ *
+ *  @param fileURL the URL of the file, which has to contain the batch in gzip format
+ *  @param filePath the path of the batch (needed to delete it after sending)
+ */
+- (void)sendFileAtURL:(NSURL *)fileURL withFilePath:(NSString *)filePath;
+
+/**
+ *  Sends several batches in one request. The batches are read and gzipped one at a time into a temporary file, which
+ *  is uploaded from disk, so neither the batches nor the request body are held in memory as a whole.
+ *
+ *  @param filePaths the paths of the batches in the order they are sent
+ *  @param itemCounts the number of items of each batch
+ */
+- (void)sendBatchesAtFilePaths:(NSArray<NSString *> *)filePaths itemCounts:(NSArray<NSNumber *> *)itemCounts;
+
+/**
+ *  Creates an upload task that sends a gzipped request body from a temporary file, which is removed once the response
+ *  has arrived.
+ *
+ *  @param bodyURL the URL of the file with the gzipped body
+ *  @param filePaths the paths of the batches in the body (needed to delete them after sending)
+ *  @param itemCounts the number of items of each batch
+ */
+- (void)sendRequestBodyAtURL:(NSURL *)bodyURL filePaths:(NSArray<NSString *> *)filePaths itemCounts:(NSArray<NSNumber *> *)itemCounts;
+
+/**
+ *  Takes one of the maxRequestCount request tokens. Every token has to be returned with releaseRequestToken once the
+ *  request has finished or has not been sent after all.
+ *
+ *  @return NO if maxRequestCount requests are already running
+ */
+- (BOOL)acquireRequestToken;
+
+/**
+ *  Returns a request token taken with acquireRequestToken.
+ */
+- (void)releaseRequestToken;
+
 /**
  *  Triggers sending the saved data on a background thread. Does nothing if nothing has been persisted, yet. This method should be called on app start.
  */
@@ -113,6 +198,20 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(NSData *)responseData filePath:(NSString *)filePath error:(NSError *)error;
 
+/**
+ *  Deletes the batches the server has acknowledged and defers the others. A batch is acknowledged unless the request
+ *  failed with a recoverable status code or one of its items has been rejected with one. Failed requests back off the
+ *  whole sender, see retryScheduler.
+ *
+ *  @param statusCode the status code of the response, 0 if there is no response
+ *  @param responseData the data of the response
+ *  @param retryAfter the Retry-After interval of the response in seconds, 0 if there is none
+ *  @param filePaths the paths of the batches which content has been sent to the server
+ *  @param itemCounts the number of items of each batch, nil if it's unknown which batch an item belongs to
+ *  @param error an error object sent from the server
+ */
+- (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(nullable NSData *)responseData retryAfter:(NSTimeInterval)retryAfter filePaths:(NSArray<NSString *> *)filePaths itemCounts:(nullable NSArray<NSNumber *> *)itemCounts error:(nullable NSError *)error;
+
 ///-----------------------------------------------------------------------------
 /// @name Helper
 ///-----------------------------------------------------------------------------
@@ -126,6 +225,14 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (NSURLRequest *)requestForData:(NSData *)data;
 
+/**
+ *  Returns a request for sending a gzipped file to the telemetry server. It has all headers but no body, the body is
+ *  read from the file by the upload task.
+ *
+ *  @return a request without a body
+ */
+- (NSURLRequest *)requestForFileUpload;
+
 /**
  *  Returns if data should be deleted based on a given status code.
  *
@@ -135,6 +242,24 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (BOOL)shouldDeleteDataWithStatusCode:(NSInteger)statusCode;
 
+/**
+ *  Returns the Retry-After interval of a response, given either in seconds or as an HTTP date.
+ *
+ *  @param response the response
+ *
+ *  @return the interval in seconds, 0 if the response has no valid Retry-After header
+ */
+- (NSTimeInterval)retryAfterIntervalOfResponse:(nullable NSHTTPURLResponse *)response;
+
+/**
+ *  Returns the indexes of the items the server has rejected with a recoverable status code.
+ *
+ *  @param responseData the data of a response, which lists rejected items as `errors` with an `index` and a `statusCode`
+ *
+ *  @return the indexes of the items that should be sent again, empty if there are none or the response can't be parsed
+ */
+- (NSIndexSet *)retryableItemIndexesInResponseData:(nullable NSData *)responseData;
+
 @end
 
 NS_ASSUME_NONNULL_END
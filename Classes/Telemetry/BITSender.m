@@ -2,32 +2,192 @@
 
 #import "BITPersistencePrivate.h"
 #import "BITChannelPrivate.h"
-#import "BITGZIP.h"
+#import "BITCompression.h"
+#import "BITRetryScheduler.h"
+#import "BITTimerWheel.h"
+#import "BITTokenPool.h"
 #import "HockeySDKPrivate.h"
 #import "BITHockeyHelper.h"
+#import "BITPipelineStatistics.h"
+#import <zlib.h>
+#import <fcntl.h>
+#import <unistd.h>
 
 static char const *kBITSenderTasksQueueString = "net.hockeyapp.sender.tasksQueue";
-static char const *kBITSenderRequestsCountQueueString = "net.hockeyapp.sender.requestsCount";
 static NSUInteger const BITDefaultRequestLimit = 10;
+static NSUInteger const BITDefaultMaxBatchesPerRequest = 20;
+static NSUInteger const BITDefaultMaxRequestLength = 1024 * 1024;
+static NSUInteger const BITDefaultMaxSendAttempts = 20;
+
+/**
+ *  Counts the items of an uncompressed batch, one per line.
+ */
+static NSUInteger bit_itemCountOfBatch(NSData *batch) {
+  const char *bytes = batch.bytes;
+  NSUInteger length = batch.length;
+  NSUInteger count = 0;
+  for (NSUInteger i = 0; i < length; i++) {
+    if (bytes[i] == '\n') {
+      count++;
+    }
+  }
+  return length > 0 && bytes[length - 1] != '\n' ? count + 1 : count;
+}
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Hands the batches of a coalesced request to bit_gzipStream one at a time and writes the gzipped body to a file, so
+ *  neither the batches nor the body are held in memory as a whole.
+ */
+@interface BITCoalescedRequestBody : NSObject
+
+- (nullable instancetype)initWithPersistence:(BITPersistence *)persistence filePaths:(NSArray<NSString *> *)filePaths bodyURL:(NSURL *)bodyURL;
+
+- (long)readIntoBuffer:(void *)buffer capacity:(size_t)capacity;
+- (BOOL)writeBytes:(const void *)bytes length:(size_t)length;
+
+/**
+ *  Closes the file of the body.
+ *
+ *  @return NO if the body could not be written completely
+ */
+- (BOOL)close;
+
+@end
+
+@interface BITCoalescedRequestBody ()
+
+@property (nonatomic, strong) BITPersistence *persistence;
+@property (nonatomic, copy) NSArray<NSString *> *filePaths;
+@property (nonatomic, assign) NSUInteger nextFileIndex;
+@property (nonatomic, strong, nullable) NSData *batch;
+@property (nonatomic, assign) NSUInteger batchOffset;
+@property (nonatomic, assign) BOOL needsLineBreak;
+@property (nonatomic, assign) int fileDescriptor;
+@property (nonatomic, assign) BOOL failed;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+@implementation BITCoalescedRequestBody
+
+- (instancetype)initWithPersistence:(BITPersistence *)persistence filePaths:(NSArray<NSString *> *)filePaths bodyURL:(NSURL *)bodyURL {
+  if ((self = [super init])) {
+    _persistence = persistence;
+    _filePaths = [filePaths copy];
+    _fileDescriptor = open(bodyURL.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (_fileDescriptor < 0) {
+      return nil;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self close];
+}
+
+- (long)readIntoBuffer:(void *)buffer capacity:(size_t)capacity {
+  while (self.batchOffset >= self.batch.length) {
+
+    // Batches are separated by line breaks, the last line of a batch may not end with one.
+    if (self.needsLineBreak) {
+      self.needsLineBreak = NO;
+      ((char *)buffer)[0] = '\n';
+      return 1;
+    }
+    if (self.nextFileIndex >= self.filePaths.count) {
+      return 0;
+    }
+
+    // Only the batch that is being compressed is held in memory.
+    @autoreleasepool {
+      NSData *data = [self.persistence dataAtFilePath:self.filePaths[self.nextFileIndex]];
+      self.batch = data.length > 0 ? bit_decompressData((NSData *)data) : nil;
+    }
+    self.nextFileIndex += 1;
+    self.batchOffset = 0;
+    if (self.batch.length == 0) {
+      return -1;
+    }
+    self.needsLineBreak = ((const char *)self.batch.bytes)[self.batch.length - 1] != '\n';
+  }
+  size_t length = MIN(capacity, self.batch.length - self.batchOffset);
+  memcpy(buffer, (const char *)self.batch.bytes + self.batchOffset, length);
+  self.batchOffset += length;
+  return (long)length;
+}
+
+- (BOOL)writeBytes:(const void *)bytes length:(size_t)length {
+  size_t written = 0;
+  while (written < length) {
+    ssize_t result = write(self.fileDescriptor, (const char *)bytes + written, length - written);
+    if (result < 0) {
+      self.failed = YES;
+      return NO;
+    }
+    written += (size_t)result;
+  }
+  return YES;
+}
+
+- (BOOL)close {
+  if (self.fileDescriptor >= 0) {
+    if (close(self.fileDescriptor) != 0) {
+      self.failed = YES;
+    }
+    self.fileDescriptor = -1;
+  }
+  return !self.failed;
+}
+
+@end
+
+static long bit_readCoalescedRequestBody(void *context, void *buffer, size_t capacity) {
+  return [(__bridge BITCoalescedRequestBody *)context readIntoBuffer:buffer capacity:capacity];
+}
+
+static bool bit_writeCoalescedRequestBody(void *context, const void *bytes, size_t length) {
+  return [(__bridge BITCoalescedRequestBody *)context writeBytes:bytes length:length];
+}
 
 @interface BITSender ()
 
 @property (nonatomic, strong) NSURLSession *session;
 
+/**
+ *  The tokens of the running requests.
+ */
+@property (nonatomic, assign) BITTokenPool *requestTokens;
+
+/**
+ *  The time the next deferred call of sendSavedData has been scheduled for, 0 if there is none.
+ */
+@property (nonatomic, assign) NSTimeInterval scheduledSendTime;
+
 @end
 
 @implementation BITSender
 
-@synthesize runningRequestsCount = _runningRequestsCount;
 @synthesize persistence = _persistence;
 
 #pragma mark - Initialize instance
 
 - (instancetype)initWithPersistence:(nonnull BITPersistence *)persistence serverURL:(nonnull NSURL *)serverURL {
   if ((self = [super init])) {
-    _requestsCountQueue = dispatch_queue_create(kBITSenderRequestsCountQueueString, DISPATCH_QUEUE_CONCURRENT);
     _senderTasksQueue = dispatch_queue_create(kBITSenderTasksQueueString, DISPATCH_QUEUE_CONCURRENT);
-    _maxRequestCount = BITDefaultRequestLimit;
+    _requestTokens = bit_tokenPoolCreate(BITDefaultRequestLimit);
+    if (!_requestTokens) {
+      return nil;
+    }
+    _maxBatchesPerRequest = BITDefaultMaxBatchesPerRequest;
+    _maxRequestLength = BITDefaultMaxRequestLength;
+    _maxSendAttempts = BITDefaultMaxSendAttempts;
+    _uploadsFromFile = YES;
+    _retryScheduler = [BITRetryScheduler new];
+    _timerWheel = [BITTimerWheel sharedTimerWheel];
     _serverURL = serverURL;
     _persistence = persistence;
     [self registerObservers];
@@ -35,6 +195,10 @@ static NSUInteger const BITDefaultRequestLimit = 10;
   return self;
 }
 
+- (void)dealloc {
+  bit_tokenPoolDestroy(_requestTokens);
+}
+
 #pragma mark - Handle persistence events
 
 - (void)registerObservers {
@@ -67,34 +231,167 @@ static NSUInteger const BITDefaultRequestLimit = 10;
 }
 
 - (void)sendSavedData {
-  @synchronized(self){
-    if(self.runningRequestsCount < self.maxRequestCount){
-      self.runningRequestsCount++;
-      BITHockeyLogDebug(@"INFO: Create new sender thread. Current count is %ld", (long) self.runningRequestsCount);
-    }else{
-      return;
+  if (![self acquireRequestToken]) {
+    return;
+  }
+  BITHockeyLogDebug(@"INFO: Create new sender thread. Current count is %ld", (long) self.runningRequestsCount);
+
+  // Every persisted batch triggers this method. While the server is throttling or down, the retry scheduler keeps those
+  // triggers from turning into requests.
+  NSTimeInterval delay = [self.retryScheduler acquireRequestAt:[NSProcessInfo processInfo].systemUptime];
+  if (delay > 0) {
+    [self releaseRequestToken];
+    BITHockeyLogDebug(@"INFO: Backing off for %.1f seconds. Current count is %ld", delay, (long) self.runningRequestsCount);
+    [self scheduleSendAfterDelay:delay];
+    return;
+  }
+
+  if (self.maxBatchesPerRequest <= 1) {
+    NSString *filePath = [self.persistence requestNextFilePath];
+    NSURL *fileURL = filePath ? [self uploadableFileURLForFilePath:(NSString *)filePath uncompressedLength:NULL] : nil;
+    if (fileURL) {
+      [self sendFileAtURL:(NSURL *)fileURL withFilePath:(NSString *)filePath];
+    } else {
+      NSData *data = [self.persistence dataAtFilePath:filePath];
+      [self sendData:data withFilePath:filePath];
     }
+  } else {
+    [self sendCoalescedSavedData];
+  }
+}
+
+/**
+ *  Requests batches until maxBatchesPerRequest or maxRequestLength is reached and sends them in a single request. The
+ *  server accepts any number of items per x-json-stream request, so fewer, larger requests drain a backlog in fewer
+ *  round trips.
+ */
+- (void)sendCoalescedSavedData {
+  NSMutableArray<NSString *> *filePaths = [NSMutableArray new];
+  NSMutableArray<NSNumber *> *itemCounts = [NSMutableArray new];
+  NSUInteger payloadLength = 0;
+  NSData *firstData = nil;
+  NSURL *firstFileURL = nil;
+
+  while (filePaths.count < self.maxBatchesPerRequest) {
+    // Only the batch that is being measured is held in memory, apart from the first one.
+    @autoreleasepool {
+      NSString *filePath = [self.persistence requestNextFilePath];
+      if (!filePath) {
+        break;
+      }
+
+      // The trailer of a gzip file tells how long the batch is, so batches that don't fit are neither read nor inflated.
+      NSUInteger uncompressedLength = 0;
+      NSURL *fileURL = [self uploadableFileURLForFilePath:(NSString *)filePath uncompressedLength:&uncompressedLength];
+      if (fileURL && filePaths.count == 0 && uncompressedLength >= self.maxRequestLength) {
+        [self sendFileAtURL:(NSURL *)fileURL withFilePath:(NSString *)filePath];
+        return;
+      }
+      if (fileURL && filePaths.count > 0 && payloadLength + uncompressedLength > self.maxRequestLength) {
+        [self.persistence giveBackRequestedFilePath:(NSString *)filePath];
+        break;
+      }
+      NSData *data = [self.persistence dataAtFilePath:filePath];
+      NSData *batch = data.length > 0 ? bit_decompressData((NSData *)data) : nil;
+      if (batch.length == 0) {
+        // There is nothing that could ever be sent, so the batch is dropped instead of being handed out again.
+        BITHockeyLogWarning(@"WARNING: Dropping empty or damaged telemetry batch at %@", filePath);
+        [self.persistence deleteFileAtPath:filePath];
+        continue;
+      }
+      if (filePaths.count > 0 && payloadLength + batch.length > self.maxRequestLength) {
+        [self.persistence giveBackRequestedFilePath:filePath];
+        break;
+      }
+      if (filePaths.count == 0) {
+        firstFileURL = fileURL;
+        firstData = fileURL ? nil : data;
+      }
+
+      // The batches are only measured and counted here, they are read again one at a time while the body is compressed.
+      payloadLength += batch.length + (((const char *)batch.bytes)[batch.length - 1] != '\n' ? 1 : 0);
+      [filePaths addObject:filePath];
+      [itemCounts addObject:@(bit_itemCountOfBatch((NSData *)batch))];
+    }
+  }
+
+  if (filePaths.count == 0) {
+    [self releaseRequestToken];
+    [self.retryScheduler cancelRequest];
+    BITHockeyLogDebug(@"INFO: Close sender thread due empty package. Current count is %ld", (long) self.runningRequestsCount);
+    [self scheduleSendOfDeferredData];
+  } else if (filePaths.count == 1 && firstFileURL) {
+    [self sendFileAtURL:(NSURL *)firstFileURL withFilePath:filePaths[0]];
+  } else if (filePaths.count == 1) {
+    // A single batch is sent the way it is stored, which usually saves compressing it again.
+    [self sendData:(NSData *)firstData withFilePath:filePaths[0]];
+  } else {
+    [self sendBatchesAtFilePaths:filePaths itemCounts:itemCounts];
   }
-  
-  NSString *filePath = [self.persistence requestNextFilePath];
-  NSData *data = [self.persistence dataAtFilePath:filePath];
-  [self sendData:data withFilePath:filePath];
-  
 }
 
 - (void)sendData:(nonnull NSData *)data withFilePath:(nonnull NSString *)filePath {
-  if (data && data.length > 0) {
-    NSData *gzippedData = [data bit_gzippedData];
-    NSURLRequest *request = [self requestForData:gzippedData];
+  // Batches are compressed when they are persisted. Only batches stored by older versions of the SDK or with another
+  // codec than gzip still need to be compressed here.
+  NSData *gzippedData = data.length > 0 ? bit_gzippedDataForUpload(data) : nil;
+  if (gzippedData) {
+    NSURLRequest *request = [self requestForData:(NSData *)gzippedData];
     
     [self sendRequest:request filePath:filePath];
   } else {
-    self.runningRequestsCount -= 1;
+    [self releaseRequestToken];
+    [self.retryScheduler cancelRequest];
     BITHockeyLogDebug(@"INFO: Close sender thread due empty package. Current count is %ld", (long) self.runningRequestsCount);
+    [self scheduleSendOfDeferredData];
     // TODO: Delete data and send next file
   }
 }
 
+- (void)sendFileAtURL:(nonnull NSURL *)fileURL withFilePath:(nonnull NSString *)filePath {
+  // The session reads the file while it sends it, so the batch is never held in memory as a whole. The file can't go
+  // away in the meantime, requested files are neither evicted nor handed out again until the response has arrived.
+  NSURLSessionUploadTask *task = [self.session uploadTaskWithRequest:[self requestForFileUpload]
+                                                            fromFile:fileURL
+                                                   completionHandler:[self completionHandlerForFilePaths:@[filePath] itemCounts:nil]];
+  NSNumber *fileSize = [[NSFileManager defaultManager] attributesOfItemAtPath:(NSString *)fileURL.path error:nil][NSFileSize];
+  bit_pipelineCount(BITTelemetryCounterRequestsSent, 1);
+  bit_pipelineCount(BITTelemetryCounterBytesSent, fileSize.unsignedLongLongValue);
+  [self resumeSessionDataTask:task];
+}
+
+- (void)sendBatchesAtFilePaths:(nonnull NSArray<NSString *> *)filePaths itemCounts:(nonnull NSArray<NSNumber *> *)itemCounts {
+  NSString *fileName = [NSString stringWithFormat:@"net.hockeyapp.telemetry.%@.gz", [NSUUID UUID].UUIDString];
+  NSURL *bodyURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+  BITCoalescedRequestBody *body = [[BITCoalescedRequestBody alloc] initWithPersistence:self.persistence filePaths:filePaths bodyURL:bodyURL];
+  BOOL compressed = body && bit_gzipStream(Z_DEFAULT_COMPRESSION, bit_readCoalescedRequestBody, bit_writeCoalescedRequestBody, (__bridge void *)body);
+  if ([body close] && compressed) {
+    BITHockeyLogDebug(@"INFO: Sending %lu batches in one request", (unsigned long)filePaths.count);
+    [self sendRequestBodyAtURL:bodyURL filePaths:filePaths itemCounts:itemCounts];
+  } else {
+    [[NSFileManager defaultManager] removeItemAtURL:bodyURL error:nil];
+    [self releaseRequestToken];
+    [self.retryScheduler cancelRequest];
+    BITHockeyLogError(@"ERROR: Compressing telemetry batches failed");
+    for (NSString *filePath in filePaths) {
+      [self.persistence giveBackRequestedFilePath:filePath];
+    }
+  }
+}
+
+- (void)sendRequestBodyAtURL:(nonnull NSURL *)bodyURL filePaths:(nonnull NSArray<NSString *> *)filePaths itemCounts:(nonnull NSArray<NSNumber *> *)itemCounts {
+  void (^completionHandler)(NSData *, NSURLResponse *, NSError *) = [self completionHandlerForFilePaths:filePaths itemCounts:itemCounts];
+  NSURLSessionUploadTask *task = [self.session uploadTaskWithRequest:[self requestForFileUpload]
+                                                            fromFile:bodyURL
+                                                   completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                                                     [[NSFileManager defaultManager] removeItemAtURL:bodyURL error:nil];
+                                                     completionHandler(data, response, error);
+                                                   }];
+  NSNumber *fileSize = [[NSFileManager defaultManager] attributesOfItemAtPath:(NSString *)bodyURL.path error:nil][NSFileSize];
+  bit_pipelineCount(BITTelemetryCounterRequestsSent, 1);
+  bit_pipelineCount(BITTelemetryCounterBytesSent, fileSize.unsignedLongLongValue);
+  [self resumeSessionDataTask:task];
+}
+
 - (void)sendRequest:(nonnull NSURLRequest *) request filePath:(nonnull NSString *) path {
   if (!path || !request) {return;}
   [self sendUsingURLSessionWithRequest:request filePath:path];
@@ -103,43 +400,185 @@ static NSUInteger const BITDefaultRequestLimit = 10;
 - (void)sendUsingURLSessionWithRequest:(nonnull NSURLRequest *)request filePath:(nonnull NSString *)filePath {
   NSURLSession *session = self.session;
   NSURLSessionDataTask *task = [session dataTaskWithRequest:request
-                                          completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
-                                            NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *) response;
-                                            NSInteger statusCode = httpResponse.statusCode;
-                                            [self handleResponseWithStatusCode:statusCode responseData:data filePath:filePath error:error];
-                                          }];
+                                          completionHandler:[self completionHandlerForFilePaths:@[filePath] itemCounts:nil]];
+  bit_pipelineCount(BITTelemetryCounterRequestsSent, 1);
+  bit_pipelineCount(BITTelemetryCounterBytesSent, request.HTTPBody.length);
   [self resumeSessionDataTask:task];
 }
 
+- (void (^)(NSData *, NSURLResponse *, NSError *))completionHandlerForFilePaths:(nonnull NSArray<NSString *> *)filePaths itemCounts:(nullable NSArray<NSNumber *> *)itemCounts {
+  uint64_t requestStart = bit_pipelineTimestamp();
+  return ^(NSData *data, NSURLResponse *response, NSError *error) {
+    bit_pipelineRecordDuration(BITTelemetryStageRequest, requestStart);
+    NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *) response;
+    [self handleResponseWithStatusCode:httpResponse.statusCode
+                          responseData:data
+                            retryAfter:[self retryAfterIntervalOfResponse:httpResponse]
+                             filePaths:filePaths
+                            itemCounts:itemCounts
+                                 error:error];
+  };
+}
+
 - (void)resumeSessionDataTask:(nonnull NSURLSessionDataTask *)sessionDataTask {
   [sessionDataTask resume];
 }
 
 - (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(nonnull NSData *)responseData filePath:(nonnull NSString *)filePath error:(nonnull NSError *)error {
-  self.runningRequestsCount -= 1;
+  [self handleResponseWithStatusCode:statusCode responseData:responseData retryAfter:0 filePaths:@[filePath] itemCounts:nil error:error];
+}
+
+- (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(nullable NSData *)responseData retryAfter:(NSTimeInterval)retryAfter filePaths:(nonnull NSArray<NSString *> *)filePaths itemCounts:(nullable NSArray<NSNumber *> *)itemCounts error:(nullable NSError *)error {
+  [self releaseRequestToken];
   BITHockeyLogDebug(@"INFO: Close sender thread due incoming response. Current count is %ld", (long) self.runningRequestsCount);
   
-  if (responseData && (responseData.length > 0) && [self shouldDeleteDataWithStatusCode:statusCode]) {
-    //we delete data that was either sent successfully or if we have a non-recoverable error
-    BITHockeyLogDebug(@"INFO: Sent data with status code: %ld", (long) statusCode);
-    BITHockeyLogDebug(@"INFO: Response data:\n%@", [NSJSONSerialization JSONObjectWithData:responseData options:0 error:nil]);
-    [self.persistence deleteFileAtPath:filePath];
-    [self sendSavedData];
-  } else {
+  if (!(responseData && (responseData.length > 0) && [self shouldDeleteDataWithStatusCode:statusCode])) {
     BITHockeyLogError(@"ERROR: Sending telemetry data failed");
     BITHockeyLogError(@"Error description: %@", error.localizedDescription);
-    [self.persistence giveBackRequestedFilePath:filePath];
+    NSTimeInterval delay = [self.retryScheduler recordFailureAt:[NSProcessInfo processInfo].systemUptime retryAfter:retryAfter];
+    bit_pipelineCount(BITTelemetryCounterBatchesRetried, filePaths.count);
+    for (NSString *filePath in filePaths) {
+
+      // Without a response, e.g. while offline, the batch can't be blamed, so it doesn't use up its attempts.
+      if (statusCode > 0) {
+        [self deferRequestedFilePath:filePath delay:delay];
+      } else {
+        [self.persistence giveBackRequestedFilePath:filePath];
+      }
+    }
+    [self scheduleSendAfterDelay:delay];
+    return;
   }
+  [self.retryScheduler recordSuccess];
+
+  //we delete data that was either sent successfully or if we have a non-recoverable error
+  BITHockeyLogDebug(@"INFO: Sent data with status code: %ld", (long) statusCode);
+  BITHockeyLogDebug(@"INFO: Response data:\n%@", [NSJSONSerialization JSONObjectWithData:(NSData *)responseData options:0 error:nil]);
+
+  // A partial success lists the rejected items by their index in the request. Batches with items that may be accepted
+  // later are kept, everything else has been acknowledged.
+  NSIndexSet *retryableItems = [self retryableItemIndexesInResponseData:responseData];
+  NSUInteger firstItem = 0;
+  BOOL deletedBatch = NO;
+  for (NSUInteger i = 0; i < filePaths.count; i++) {
+    NSUInteger itemCount = itemCounts ? itemCounts[i].unsignedIntegerValue : NSUIntegerMax - firstItem;
+    if (itemCount > 0 && [retryableItems intersectsIndexesInRange:NSMakeRange(firstItem, itemCount)]) {
+      BITHockeyLogWarning(@"WARNING: Items of a telemetry batch have been rejected, it will be sent again");
+      bit_pipelineCount(BITTelemetryCounterBatchesRetried, 1);
+      [self scheduleSendAfterDelay:[self deferRequestedFilePath:filePaths[i] delay:retryAfter]];
+    } else {
+      [self.persistence deleteFileAtPath:filePaths[i]];
+      bit_pipelineCount(BITTelemetryCounterBatchesDeleted, 1);
+      deletedBatch = YES;
+    }
+    firstItem += itemCount;
+  }
+  if (deletedBatch) {
+    [self sendSavedData];
+  }
+}
+
+#pragma mark - Retrying
+
+/**
+ *  Counts a failed attempt of a batch and gives it back, so it's sent again after its own backoff delay. Batches that
+ *  have used up their attempts are dropped.
+ *
+ *  @return the number of seconds until the batch is sent again
+ */
+- (NSTimeInterval)deferRequestedFilePath:(nonnull NSString *)filePath delay:(NSTimeInterval)delay {
+  NSUInteger attempts = [self.persistence failedSendAttemptsForFilePath:filePath] + 1;
+  if (attempts >= self.maxSendAttempts) {
+    BITHockeyLogWarning(@"WARNING: Sending a telemetry batch failed %lu times, it will be dropped", (unsigned long)attempts);
+    [self.persistence dropFileAtPath:filePath];
+    return 0;
+  }
+  NSTimeInterval retryDelay = MAX(delay, [self.retryScheduler delayForAttempt:attempts]);
+  [self.persistence recordFailedSendAttemptForFilePath:filePath retryDate:[NSDate dateWithTimeIntervalSinceNow:retryDelay]];
+  [self.persistence giveBackRequestedFilePath:filePath];
+  return retryDelay;
+}
+
+/**
+ *  Calls sendSavedData once the delay has passed, unless an earlier call has already been scheduled.
+ */
+- (void)scheduleSendAfterDelay:(NSTimeInterval)delay {
+  if (delay <= 0) {
+    return;
+  }
+  NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+  NSTimeInterval sendTime = now + delay;
+  @synchronized(self) {
+    if (self.scheduledSendTime > now && self.scheduledSendTime <= sendTime) {
+      return;
+    }
+    self.scheduledSendTime = sendTime;
+  }
+
+  // Backoff deadlines share the timer wheel with the flush deadlines of the channel, so they don't need a timer of
+  // their own.
+  __weak typeof(self) weakSelf = self;
+  [self.timerWheel scheduleAfterDelay:delay queue:self.senderTasksQueue block:^{
+    typeof(self) strongSelf = weakSelf;
+    @synchronized(strongSelf) {
+      if (strongSelf.scheduledSendTime == sendTime) {
+        strongSelf.scheduledSendTime = 0;
+      }
+    }
+    [strongSelf sendSavedData];
+  }];
+}
+
+/**
+ *  Makes sure deferred batches are sent once their retry date has passed, nothing else might trigger sending them.
+ */
+- (void)scheduleSendOfDeferredData {
+  NSDate *retryDate = [self.persistence nextRetryDate];
+  if (retryDate) {
+    [self scheduleSendAfterDelay:retryDate.timeIntervalSinceNow];
+  }
+}
+
+- (NSTimeInterval)retryAfterIntervalOfResponse:(nullable NSHTTPURLResponse *)response {
+  __block NSString *value = nil;
+  [response.allHeaderFields enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+    if ([key isKindOfClass:[NSString class]] && [key caseInsensitiveCompare:@"Retry-After"] == NSOrderedSame && [obj isKindOfClass:[NSString class]]) {
+      value = obj;
+      *stop = YES;
+    }
+  }];
+  value = [value stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+  if (value.length == 0) {
+    return 0;
+  }
+
+  NSScanner *scanner = [NSScanner scannerWithString:value];
+  NSInteger seconds = 0;
+  if ([scanner scanInteger:&seconds] && scanner.isAtEnd) {
+    return MAX((NSTimeInterval)seconds, 0);
+  }
+
+  NSDateFormatter *formatter = [NSDateFormatter new];
+  formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+  formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+  formatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss zzz";
+  NSDate *date = [formatter dateFromString:value];
+  return date ? MAX(date.timeIntervalSinceNow, 0) : 0;
 }
 
 #pragma mark - Helper
 
 - (NSURLRequest *)requestForData:(nonnull NSData *)data {
+  NSMutableURLRequest *request = [[self requestForFileUpload] mutableCopy];
+  request.HTTPBody = data;
+  return request;
+}
+
+- (NSURLRequest *)requestForFileUpload {
   
   NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:self.serverURL];
   request.HTTPMethod = @"POST";
   
-  request.HTTPBody = data;
   request.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
   
   NSDictionary<NSString *,NSString *> *headers = @{@"Charset" : @"UTF-8",
@@ -159,6 +598,34 @@ static NSUInteger const BITDefaultRequestLimit = 10;
   return ![recoverableStatusCodes containsObject:@(statusCode)];
 }
 
+- (nullable NSURL *)uploadableFileURLForFilePath:(nonnull NSString *)filePath uncompressedLength:(nullable NSUInteger *)uncompressedLength {
+  return self.uploadsFromFile ? [self.persistence uploadableFileURLForFilePath:filePath uncompressedLength:uncompressedLength] : nil;
+}
+
+- (NSIndexSet *)retryableItemIndexesInResponseData:(nullable NSData *)responseData {
+  NSMutableIndexSet *indexes = [NSMutableIndexSet new];
+  if (responseData.length == 0) {
+    return indexes;
+  }
+  id response = [NSJSONSerialization JSONObjectWithData:(NSData *)responseData options:0 error:nil];
+  NSArray *errors = [response isKindOfClass:[NSDictionary class]] ? response[@"errors"] : nil;
+  if (![errors isKindOfClass:[NSArray class]]) {
+    return indexes;
+  }
+  for (id itemError in errors) {
+    if (![itemError isKindOfClass:[NSDictionary class]]) {
+      continue;
+    }
+    id index = itemError[@"index"];
+    id itemStatusCode = itemError[@"statusCode"];
+    if ([index isKindOfClass:[NSNumber class]] && [itemStatusCode isKindOfClass:[NSNumber class]] &&
+        [index integerValue] >= 0 && ![self shouldDeleteDataWithStatusCode:[itemStatusCode integerValue]]) {
+      [indexes addIndex:[index unsignedIntegerValue]];
+    }
+  }
+  return indexes;
+}
+
 #pragma mark - Getter/Setter
 
 - (NSURLSession *)session {
@@ -178,17 +645,29 @@ static NSUInteger const BITDefaultRequestLimit = 10;
 }
 
 - (NSUInteger)runningRequestsCount {
-  __block NSUInteger count;
-  dispatch_sync(self.requestsCountQueue, ^{
-    count = self->_runningRequestsCount;
-  });
-  return count;
+  return bit_tokenPoolInUse(self.requestTokens);
 }
 
-- (void)setRunningRequestsCount:(NSUInteger)runningRequestsCount {
-  dispatch_sync(self.requestsCountQueue, ^{
-    self->_runningRequestsCount = runningRequestsCount;
-  });
+- (NSUInteger)peakRunningRequestsCount {
+  return bit_tokenPoolPeakInUse(self.requestTokens);
+}
+
+- (NSUInteger)maxRequestCount {
+  return bit_tokenPoolCapacity(self.requestTokens);
+}
+
+- (void)setMaxRequestCount:(NSUInteger)maxRequestCount {
+  bit_tokenPoolSetCapacity(self.requestTokens, maxRequestCount);
+}
+
+- (BOOL)acquireRequestToken {
+  return bit_tokenPoolAcquire(self.requestTokens);
+}
+
+- (void)releaseRequestToken {
+  if (!bit_tokenPoolRelease(self.requestTokens)) {
+    BITHockeyLogError(@"ERROR: A request token has been released without being acquired");
+  }
 }
 
 @end
@@ -24,6 +24,12 @@
   return dict;
 }
 
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *)writer {
+  [super serializeMembersToJSONWriter:writer];
+  bit_jsonWriterKey(writer, "state");
+  bit_jsonWriterInteger(writer, (int)self.state);
+}
+
 #pragma mark - NSCoding
 
 - (instancetype)initWithCoder:(NSCoder *)coder {
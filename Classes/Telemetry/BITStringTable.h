@@ -0,0 +1,121 @@
+#import <CoreFoundation/CoreFoundation.h>
+#import <stdbool.h>
+#import <stddef.h>
+#import <stdint.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A concurrent table that interns strings, e.g. event names and property keys, and caches their UTF-8 and JSON
+ *  representations, so a string that is serialized over and over is only converted and escaped once.
+ *
+ *  Looking up a string that has been interned takes no lock and writes no shared memory other than the hit counter of
+ *  the calling thread, so the table scales with the number of threads for the read-mostly load it is made for. Adding
+ *  a string takes a lock. Entries are never removed, instead the table takes a limited number of strings and rejects
+ *  further ones, so unique strings can't grow it without limit.
+ *
+ *  All functions except bit_stringTableCreate and bit_stringTableDestroy are safe to call from multiple threads.
+ */
+typedef struct BITStringTable BITStringTable;
+
+/**
+ *  The identifier of an interned string. Identifiers are assigned in the order strings are added, starting at 0.
+ */
+typedef uint32_t BITStringTableIdentifier;
+
+/**
+ *  An interned string, which stays valid and unchanged until the table is destroyed.
+ */
+typedef struct {
+  BITStringTableIdentifier identifier;
+
+  /**
+   *  The number of UTF-8 bytes of the string.
+   */
+  uint32_t length;
+
+  /**
+   *  The number of bytes of the JSON representation of the string.
+   */
+  uint32_t jsonLength;
+
+  /**
+   *  The NUL-terminated UTF-8 bytes of the string.
+   */
+  const char *bytes;
+
+  /**
+   *  The string as a quoted and escaped JSON string, which can be written with bit_jsonWriterRaw and
+   *  bit_jsonWriterRawKey.
+   */
+  const char *json;
+} BITStringTableEntry;
+
+/**
+ *  How well the table works. A lookup counts as hit if the string has been interned before, as insertion if it has been
+ *  added and as rejection if it couldn't be added because the table is full.
+ */
+typedef struct {
+  uint64_t hitCount;
+  uint64_t insertionCount;
+  uint64_t rejectionCount;
+  size_t count;
+} BITStringTableStatistics;
+
+/**
+ *  Creates a table.
+ *
+ *  @param maxCount the max number of strings the table takes
+ *
+ *  @return the table or NULL if memory could not be allocated
+ */
+BITStringTable *_Nullable bit_stringTableCreate(size_t maxCount);
+
+/**
+ *  Frees the table and all of its entries.
+ *
+ *  @param table the table, may be NULL
+ */
+void bit_stringTableDestroy(BITStringTable *_Nullable table);
+
+/**
+ *  Returns the entry of a string, adding it to the table if it hasn't been interned yet. Strings are compared by value,
+ *  mutable strings are copied when they are added.
+ *
+ *  @param table the table
+ *  @param string the string
+ *
+ *  @return the entry or NULL if the table is full or memory could not be allocated
+ */
+const BITStringTableEntry *_Nullable bit_stringTableIntern(BITStringTable *table, CFStringRef string);
+
+/**
+ *  Returns the entry of an identifier.
+ *
+ *  @param table the table
+ *  @param identifier the identifier of an interned string
+ *
+ *  @return the entry or NULL if no string has the identifier
+ */
+const BITStringTableEntry *_Nullable bit_stringTableEntry(const BITStringTable *table, BITStringTableIdentifier identifier);
+
+/**
+ *  Returns the number of strings in the table.
+ *
+ *  @param table the table
+ *
+ *  @return the number of strings
+ */
+size_t bit_stringTableCount(const BITStringTable *table);
+
+/**
+ *  Sums up the counters of all threads. Lookups that happen meanwhile may or may not be included.
+ *
+ *  @param table the table
+ *
+ *  @return the statistics of the table
+ */
+BITStringTableStatistics bit_stringTableStatistics(const BITStringTable *table);
+
+NS_ASSUME_NONNULL_END
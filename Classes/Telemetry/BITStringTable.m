@@ -0,0 +1,244 @@
+#import "BITStringTable.h"
+#import "BITJSONWriter.h"
+#import <pthread.h>
+#import <stdatomic.h>
+#import <stdlib.h>
+#import <string.h>
+
+// Every thread counts its lookups in a stripe of its own cache line, so reading the table doesn't make cores fight over
+// a shared counter. Threads beyond the number of stripes share them.
+#define BIT_CACHE_LINE_SIZE 64
+#define BITStringTableCounterStripeCount 16
+
+typedef struct {
+  _Atomic(uint64_t) hitCount;
+  _Atomic(uint64_t) insertionCount;
+  _Atomic(uint64_t) rejectionCount;
+  char padding[BIT_CACHE_LINE_SIZE - 3 * sizeof(uint64_t)];
+} BITStringTableCounters;
+
+typedef struct {
+  BITStringTableEntry entry;
+  CFStringRef string;
+  CFHashCode hash;
+} BITStringTableNode;
+
+struct BITStringTable {
+  BITStringTableCounters counters[BITStringTableCounterStripeCount];
+
+  // Open addressing with linear probing, there are at least twice as many slots as strings, so probe sequences stay
+  // short and always end at a free slot. A slot is written once, when a string is added to it.
+  _Atomic(BITStringTableNode *) *slots;
+  size_t mask;
+
+  // The nodes by identifier.
+  _Atomic(BITStringTableNode *) *nodes;
+  size_t maxCount;
+  _Atomic(size_t) count;
+  pthread_mutex_t insertLock;
+};
+
+static _Atomic(unsigned int) bit_nextCounterStripe;
+
+// The stripe of the current thread plus one, 0 until the thread looks up its first string.
+static _Thread_local unsigned int bit_currentCounterStripe;
+
+static BITStringTableCounters *bit_stringTableCounters(BITStringTable *table) {
+  unsigned int stripe = bit_currentCounterStripe;
+  if (stripe == 0) {
+    stripe = atomic_fetch_add_explicit(&bit_nextCounterStripe, 1, memory_order_relaxed) % BITStringTableCounterStripeCount + 1;
+    bit_currentCounterStripe = stripe;
+  }
+  return &table->counters[stripe - 1];
+}
+
+static size_t bit_stringTableSlot(const BITStringTable *table, CFHashCode hash) {
+
+  // Spreads hashes that only differ in their high bits over the slots.
+  return (size_t)(((uint64_t)hash * 0x9e3779b97f4a7c15ull) >> 32) & table->mask;
+}
+
+BITStringTable *bit_stringTableCreate(size_t maxCount) {
+  if (maxCount == 0 || maxCount > UINT32_MAX) {
+    return NULL;
+  }
+  void *memory = NULL;
+  if (posix_memalign(&memory, BIT_CACHE_LINE_SIZE, sizeof(BITStringTable)) != 0) {
+    return NULL;
+  }
+  BITStringTable *table = memory;
+  memset(table, 0, sizeof(BITStringTable));
+  size_t slotCount = 1;
+  while (slotCount < maxCount * 2) {
+    slotCount <<= 1;
+  }
+  table->slots = calloc(slotCount, sizeof(*table->slots));
+  table->nodes = calloc(maxCount, sizeof(*table->nodes));
+  if (!table->slots || !table->nodes) {
+    free(table->slots);
+    free(table->nodes);
+    free(table);
+    return NULL;
+  }
+  table->mask = slotCount - 1;
+  table->maxCount = maxCount;
+  for (size_t i = 0; i < BITStringTableCounterStripeCount; i++) {
+    atomic_init(&table->counters[i].hitCount, 0);
+    atomic_init(&table->counters[i].insertionCount, 0);
+    atomic_init(&table->counters[i].rejectionCount, 0);
+  }
+  atomic_init(&table->count, 0);
+  pthread_mutex_init(&table->insertLock, NULL);
+  return table;
+}
+
+void bit_stringTableDestroy(BITStringTable *table) {
+  if (!table) {
+    return;
+  }
+  size_t count = atomic_load_explicit(&table->count, memory_order_acquire);
+  for (size_t i = 0; i < count; i++) {
+    BITStringTableNode *node = atomic_load_explicit(&table->nodes[i], memory_order_relaxed);
+    CFRelease(node->string);
+    free(node);
+  }
+  free(table->slots);
+  free(table->nodes);
+  pthread_mutex_destroy(&table->insertLock);
+  free(table);
+}
+
+// Returns the node of the string or NULL and the free slot the string would be added to.
+static BITStringTableNode *_Nullable bit_stringTableFind(const BITStringTable *table, CFStringRef string, CFHashCode hash, size_t *freeSlot) {
+  size_t slot = bit_stringTableSlot(table, hash);
+  for (;;) {
+    BITStringTableNode *node = atomic_load_explicit(&table->slots[slot], memory_order_acquire);
+    if (!node) {
+      *freeSlot = slot;
+      return NULL;
+    }
+    if (node->string == string || (node->hash == hash && CFEqual(node->string, string))) {
+      return node;
+    }
+    slot = (slot + 1) & table->mask;
+  }
+}
+
+// Creates a node with the UTF-8 and the JSON representation of the string in one allocation.
+static BITStringTableNode *_Nullable bit_createStringTableNode(CFStringRef string, CFHashCode hash, BITStringTableIdentifier identifier) {
+  CFIndex length = CFStringGetLength(string);
+  CFIndex maxLength = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+  if (maxLength == kCFNotFound || maxLength > UINT32_MAX / 8) {
+    return NULL;
+  }
+  BITJSONWriter *writer = bit_jsonWriterCreate((size_t)maxLength + 2);
+  UInt8 *bytes = malloc((size_t)maxLength + 1);
+  if (!writer || !bytes) {
+    bit_jsonWriterDestroy(writer);
+    free(bytes);
+    return NULL;
+  }
+  // Unpaired surrogates are replaced like BITJSONWriter does, so they don't cut the string off.
+  CFIndex usedLength = 0;
+  CFIndex converted = CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, '?', false, bytes, maxLength, &usedLength);
+  if (converted != length) {
+    bit_jsonWriterDestroy(writer);
+    free(bytes);
+    return NULL;
+  }
+  bit_jsonWriterString(writer, (const char *)bytes, (size_t)usedLength);
+  size_t jsonLength = bit_jsonWriterLength(writer);
+
+  // Mutable strings are copied, so changing them later doesn't change the key.
+  BITStringTableNode *node = NULL;
+  if (!bit_jsonWriterHasFailed(writer)) {
+    node = malloc(sizeof(BITStringTableNode) + (size_t)usedLength + 1 + jsonLength + 1);
+  }
+  CFStringRef copy = node ? CFStringCreateCopy(kCFAllocatorDefault, string) : NULL;
+  if (node && !copy) {
+    free(node);
+    node = NULL;
+  }
+  if (node) {
+    char *nodeBytes = (char *)(node + 1);
+    char *nodeJSON = nodeBytes + usedLength + 1;
+    memcpy(nodeBytes, bytes, (size_t)usedLength);
+    nodeBytes[usedLength] = '\0';
+    memcpy(nodeJSON, bit_jsonWriterBytes(writer), jsonLength);
+    nodeJSON[jsonLength] = '\0';
+    node->entry = (BITStringTableEntry){
+      .identifier = identifier,
+      .length = (uint32_t)usedLength,
+      .jsonLength = (uint32_t)jsonLength,
+      .bytes = nodeBytes,
+      .json = nodeJSON
+    };
+    node->string = copy;
+    node->hash = hash;
+  }
+  bit_jsonWriterDestroy(writer);
+  free(bytes);
+  return node;
+}
+
+const BITStringTableEntry *bit_stringTableIntern(BITStringTable *table, CFStringRef string) {
+  BITStringTableCounters *counters = bit_stringTableCounters(table);
+  CFHashCode hash = CFHash(string);
+  size_t slot;
+  BITStringTableNode *node = bit_stringTableFind(table, string, hash, &slot);
+  if (node) {
+    atomic_fetch_add_explicit(&counters->hitCount, 1, memory_order_relaxed);
+    return &node->entry;
+  }
+
+  pthread_mutex_lock(&table->insertLock);
+
+  // Another thread may have added the string or taken the free slot in the meantime.
+  node = bit_stringTableFind(table, string, hash, &slot);
+  bool inserted = false;
+  size_t count = atomic_load_explicit(&table->count, memory_order_relaxed);
+  if (!node && count < table->maxCount) {
+    node = bit_createStringTableNode(string, hash, (BITStringTableIdentifier)count);
+    if (node) {
+
+      // The node is complete before it can be seen, readers load the slots with acquire.
+      atomic_store_explicit(&table->nodes[count], node, memory_order_release);
+      atomic_store_explicit(&table->slots[slot], node, memory_order_release);
+      atomic_store_explicit(&table->count, count + 1, memory_order_release);
+      inserted = true;
+    }
+  }
+  pthread_mutex_unlock(&table->insertLock);
+
+  if (inserted) {
+    atomic_fetch_add_explicit(&counters->insertionCount, 1, memory_order_relaxed);
+  } else if (node) {
+    atomic_fetch_add_explicit(&counters->hitCount, 1, memory_order_relaxed);
+  } else {
+    atomic_fetch_add_explicit(&counters->rejectionCount, 1, memory_order_relaxed);
+  }
+  return node ? &node->entry : NULL;
+}
+
+const BITStringTableEntry *bit_stringTableEntry(const BITStringTable *table, BITStringTableIdentifier identifier) {
+  if (identifier >= atomic_load_explicit(&table->count, memory_order_acquire)) {
+    return NULL;
+  }
+  BITStringTableNode *node = atomic_load_explicit(&table->nodes[identifier], memory_order_acquire);
+  return node ? &node->entry : NULL;
+}
+
+size_t bit_stringTableCount(const BITStringTable *table) {
+  return atomic_load_explicit(&table->count, memory_order_acquire);
+}
+
+BITStringTableStatistics bit_stringTableStatistics(const BITStringTable *table) {
+  BITStringTableStatistics statistics = {0};
+  for (size_t i = 0; i < BITStringTableCounterStripeCount; i++) {
+    statistics.hitCount += atomic_load_explicit(&table->counters[i].hitCount, memory_order_relaxed);
+    statistics.insertionCount += atomic_load_explicit(&table->counters[i].insertionCount, memory_order_relaxed);
+    statistics.rejectionCount += atomic_load_explicit(&table->counters[i].rejectionCount, memory_order_relaxed);
+  }
+  statistics.count = bit_stringTableCount(table);
+  return statistics;
+}
@@ -86,6 +86,18 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (NSDictionary *)contextDictionary;
 
+/**
+ *  The fields of contextDictionary, serialized as a JSON object. It's rebuilt whenever one of the context fields
+ *  changes, so it can be written into every envelope without serializing the same tags again. Setters rebuild it before
+ *  they return, so items tracked after a setter has been called carry the new value.
+ */
+@property (atomic, copy, readonly) NSData *tagsFragment;
+
+/**
+ *  The number of times tagsFragment has been built. Setters that don't change a value don't rebuild it.
+ */
+@property (atomic, assign, readonly) NSUInteger tagsFragmentBuildCount;
+
 ///-----------------------------------------------------------------------------
 /// @name Getter/Setter
 ///-----------------------------------------------------------------------------
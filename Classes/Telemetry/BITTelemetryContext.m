@@ -4,11 +4,24 @@
 #import "BITHockeyHelper.h"
 #import "BITPersistence.h"
 #import "BITPersistencePrivate.h"
+#import "BITJSONWriter.h"
 
 static NSString *const kBITUserMetaData = @"BITUserMetaData";
 
 static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQueue";
 
+// Setters that don't change a value leave the tags fragment alone instead of serializing all tags again.
+static BOOL bit_isSameContextValue(NSString *value, NSString *newValue) {
+  return value == newValue || [value isEqualToString:newValue];
+}
+
+@interface BITTelemetryContext ()
+
+@property (atomic, copy, readwrite) NSData *tagsFragment;
+@property (atomic, assign, readwrite) NSUInteger tagsFragmentBuildCount;
+
+@end
+
 @implementation BITTelemetryContext
 
 @synthesize appIdentifier = _appIdentifier;
@@ -60,6 +73,7 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
     _internal = internalContext;
     _session = sessionContext;
     _tags = [self tags];
+    [self updateTagsFragment];
   }
   return self;
 }
@@ -103,7 +117,7 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setAppIdentifier:(NSString *)appIdentifier {
   NSString* tmp = [appIdentifier copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
     self->_appIdentifier = tmp;
   });
 }
@@ -118,8 +132,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setScreenResolution:(NSString *)screenResolution {
   NSString* tmp = [screenResolution copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.screenResolution, tmp)) {
+      return;
+    }
     self.device.screenResolution = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -133,8 +152,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setAppVersion:(NSString *)appVersion {
   NSString* tmp = [appVersion copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.application.version, tmp)) {
+      return;
+    }
     self.application.version = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -148,8 +172,12 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setAnonymousUserId:(NSString *)userId {
   NSString* tmp = [userId copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.user.userId, tmp)) {
+      return;
+    }
     self.user.userId = tmp;
+    [self updateTagsFragment];
   });
 }
 
@@ -163,8 +191,12 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setAnonymousUserAquisitionDate:(NSString *)anonymousUserAquisitionDate {
   NSString* tmp = [anonymousUserAquisitionDate copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.user.anonUserAcquisitionDate, tmp)) {
+      return;
+    }
     self.user.anonUserAcquisitionDate = tmp;
+    [self updateTagsFragment];
   });
 }
 
@@ -178,8 +210,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setSdkVersion:(NSString *)sdkVersion {
   NSString* tmp = [sdkVersion copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.internal.sdkVersion, tmp)) {
+      return;
+    }
     self.internal.sdkVersion = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -193,8 +230,12 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setSessionId:(NSString *)sessionId {
   NSString* tmp = [sessionId copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.session.sessionId, tmp)) {
+      return;
+    }
     self.session.sessionId = tmp;
+    [self updateTagsFragment];
   });
 }
 
@@ -208,8 +249,12 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setIsFirstSession:(NSString *)isFirstSession {
   NSString* tmp = [isFirstSession copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.session.isFirst, tmp)) {
+      return;
+    }
     self.session.isFirst = tmp;
+    [self updateTagsFragment];
   });
 }
 
@@ -223,8 +268,12 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setIsNewSession:(NSString *)isNewSession {
   NSString* tmp = [isNewSession copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.session.isNew, tmp)) {
+      return;
+    }
     self.session.isNew = tmp;
+    [self updateTagsFragment];
   });
 }
 
@@ -238,8 +287,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setOsVersion:(NSString *)osVersion {
   NSString* tmp = [osVersion copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.osVersion, tmp)) {
+      return;
+    }
     self.device.osVersion = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -253,8 +307,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setOsName:(NSString *)osName {
   NSString* tmp = [osName copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.os, tmp)) {
+      return;
+    }
     self.device.os = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -268,8 +327,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setDeviceModel:(NSString *)deviceModel {
   NSString* tmp = [deviceModel copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.model, tmp)) {
+      return;
+    }
     self.device.model = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -283,8 +347,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setDeviceOemName:(NSString *)oemName {
   NSString* tmp = [oemName copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.oemName, tmp)) {
+      return;
+    }
     self.device.oemName = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -298,8 +367,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setOsLocale:(NSString *)osLocale {
   NSString* tmp = [osLocale copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.locale, tmp)) {
+      return;
+    }
     self.device.locale = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -313,8 +387,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setOsLanguage:(NSString *)osLanguage {
   NSString* tmp = [osLanguage copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.language, tmp)) {
+      return;
+    }
     self.device.language = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -328,8 +407,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setDeviceId:(NSString *)deviceId {
   NSString* tmp = [deviceId copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.deviceId, tmp)) {
+      return;
+    }
     self.device.deviceId = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -343,8 +427,13 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
 
 - (void)setDeviceType:(NSString *)deviceType {
   NSString* tmp = [deviceType copy];
-  dispatch_barrier_async(self.operationsQueue, ^{
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (bit_isSameContextValue(self.device.type, tmp)) {
+      return;
+    }
     self.device.type = tmp;
+    self->_tags = nil;
+    [self updateTagsFragment];
   });
 }
 
@@ -361,6 +450,17 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
   return tmp;
 }
 
+- (void)setTags:(NSDictionary *)tags {
+  NSDictionary *tmp = [tags copy];
+  dispatch_barrier_sync(self.operationsQueue, ^{
+    if (self->_tags == tmp || [self->_tags isEqualToDictionary:tmp]) {
+      return;
+    }
+    self->_tags = tmp;
+    [self updateTagsFragment];
+  });
+}
+
 - (NSDictionary *)tags {
   if(!_tags){
     NSMutableDictionary *tags = [self.application serializeToDictionary].mutableCopy;
@@ -372,4 +472,26 @@ static char *const BITContextOperationsQueue = "net.hockeyapp.telemetryContextQu
   return _tags;
 }
 
+/**
+ *  Serializes all context fields into tagsFragment. Must be called on the operationsQueue, either from a barrier block or
+ *  before the context is shared.
+ */
+- (void)updateTagsFragment {
+  NSMutableDictionary *fields = [NSMutableDictionary dictionaryWithDictionary:self.tags];
+  [fields addEntriesFromDictionary:[self.session serializeToDictionary]];
+  [fields addEntriesFromDictionary:[self.user serializeToDictionary]];
+
+  BITJSONWriter *writer = bit_jsonWriterCreate(1024);
+  if (!writer) {
+    return;
+  }
+  if (bit_jsonWriterObject(writer, fields)) {
+    self.tagsFragment = [NSData dataWithBytes:bit_jsonWriterBytes(writer) length:bit_jsonWriterLength(writer)];
+    self.tagsFragmentBuildCount += 1;
+  } else {
+    BITHockeyLogError(@"ERROR: Unable to serialize the telemetry context.");
+  }
+  bit_jsonWriterDestroy(writer);
+}
+
 @end
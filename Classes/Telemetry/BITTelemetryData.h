@@ -13,6 +13,12 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, copy) NSString *name;
 @property (nonatomic, nullable, strong) NSDictionary *properties;
 
+/**
+ *  The percentage of items of this kind that have been kept, the envelope of the item is stamped with it. An item stands
+ *  for 100 / sampleRate items. nil if the item hasn't been sampled.
+ */
+@property (nonatomic, nullable, copy) NSNumber *sampleRate;
+
 @end
 
 NS_ASSUME_NONNULL_END
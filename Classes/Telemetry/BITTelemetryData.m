@@ -11,6 +11,14 @@
   return dict;	
 }
 
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *)writer {
+  [super serializeMembersToJSONWriter:writer];
+  if (self.version != nil) {
+    bit_jsonWriterKey(writer, "ver");
+    bit_jsonWriterObject(writer, self.version);
+  }
+}
+
 #pragma mark - NSCoding
 
 - (instancetype)initWithCoder:(NSCoder *)coder {
@@ -19,6 +27,7 @@
     _version = [coder decodeObjectForKey:@"self.version"] ?: @"";
     _name = [coder decodeObjectForKey:@"self.name"] ?: @"";
     _properties = [coder decodeObjectForKey:@"self.properties"] ?: @"";
+    _sampleRate = [coder decodeObjectForKey:@"self.sampleRate"];
   }
   return self;
 }
@@ -28,6 +37,7 @@
   [coder encodeObject:self.version forKey:@"self.version"];
   [coder encodeObject:self.name forKey:@"self.name"];
   [coder encodeObject:self.properties forKey:@"self.properties"];
+  [coder encodeObject:self.sampleRate forKey:@"self.sampleRate"];
 }
 
 @end
@@ -1,4 +1,5 @@
 #import <Foundation/Foundation.h>
+#import "BITJSONWriter.h"
 
 
 @interface BITTelemetryObject : NSObject <NSCoding>
@@ -6,4 +7,19 @@
 - (NSDictionary *)serializeToDictionary;
 - (NSString *)serializeToString;
 
+/**
+ *  Writes this object as a JSON object, without creating the intermediate dictionary of serializeToDictionary.
+ *
+ *  @param writer the writer the object is written to
+ */
+- (void)serializeToJSONWriter:(BITJSONWriter *)writer;
+
+/**
+ *  Writes the members of this object to the JSON object that is currently open. Subclasses call super and add their
+ *  own members, the same way they do in serializeToDictionary.
+ *
+ *  @param writer the writer the members are written to
+ */
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *)writer;
+
 @end
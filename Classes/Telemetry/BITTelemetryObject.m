@@ -7,6 +7,16 @@
   return [NSDictionary dictionary];
 }
 
+- (void)serializeToJSONWriter:(BITJSONWriter *)writer {
+  bit_jsonWriterBeginObject(writer);
+  [self serializeMembersToJSONWriter:writer];
+  bit_jsonWriterEndObject(writer);
+}
+
+// empty implementation for the base class
+- (void)serializeMembersToJSONWriter:(BITJSONWriter *) __unused writer {
+}
+
 - (NSString *)serializeToString {
   NSDictionary *dict = [self serializeToDictionary];
   NSMutableString  *jsonString;
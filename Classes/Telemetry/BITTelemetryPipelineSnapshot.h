@@ -0,0 +1,67 @@
+#import <Foundation/Foundation.h>
+#import "HockeySDKNullability.h"
+#import "HockeySDKEnums.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  The counters and stage durations of the telemetry pipeline at the time the snapshot was taken. They cover all
+ *  telemetry tracked since the app was launched.
+ *
+ *  Durations are recorded in buckets whose bounds double, so percentiles are estimates that are at most twice the real
+ *  duration.
+ */
+@interface BITTelemetryPipelineSnapshot : NSObject
+
+/**
+ *  Takes a snapshot of the current counters and durations.
+ *
+ *  @return the snapshot
+ */
+- (instancetype)init NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Returns the value of a counter.
+ *
+ *  @param counter the counter
+ *
+ *  @return the value of the counter
+ */
+- (uint64_t)valueOfCounter:(BITTelemetryCounter)counter;
+
+/**
+ *  Returns how often the duration of a stage has been recorded.
+ *
+ *  @param stage the stage
+ *
+ *  @return the number of recorded durations
+ */
+- (uint64_t)countOfStage:(BITTelemetryStage)stage;
+
+/**
+ *  Returns the sum of the recorded durations of a stage.
+ *
+ *  @param stage the stage
+ *
+ *  @return the sum in seconds
+ */
+- (NSTimeInterval)totalDurationOfStage:(BITTelemetryStage)stage;
+
+/**
+ *  Estimates a percentile of the recorded durations of a stage.
+ *
+ *  @param stage the stage
+ *  @param percentile the percentile between 0 and 100, e.g. 99 for the duration 99% of the stages took at most
+ *
+ *  @return the estimated duration in seconds, 0 if none has been recorded
+ */
+- (NSTimeInterval)durationOfStage:(BITTelemetryStage)stage atPercentile:(double)percentile;
+
+/**
+ *  The counters and durations as measurements, e.g. `itemsEnqueued` or `request.p99`. Durations are in milliseconds.
+ */
+@property (nonatomic, copy, readonly) NSDictionary<NSString *, NSNumber *> *dictionaryRepresentation;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,77 @@
+#import "BITTelemetryPipelineSnapshot.h"
+#import "BITPipelineStatistics.h"
+
+static NSString *const BITCounterNames[BITTelemetryCounterCount] = {
+  @"itemsTracked",
+  @"eventsSampledOrAggregated",
+  @"itemsEnqueued",
+  @"itemsDroppedOnOverflow",
+  @"itemsDroppedWhileBlocked",
+  @"batchesFlushed",
+  @"batchesCompressed",
+  @"batchesPersisted",
+  @"bytesPersisted",
+  @"requestsSent",
+  @"bytesSent",
+  @"batchesRetried",
+  @"batchesDeleted"
+};
+
+static NSString *const BITStageNames[BITTelemetryStageCount] = {
+  @"serialization",
+  @"compression",
+  @"persistence",
+  @"request"
+};
+
+NS_ASSUME_NONNULL_BEGIN
+
+@implementation BITTelemetryPipelineSnapshot {
+  BITPipelineStatistics _statistics;
+}
+
+- (instancetype)init {
+  if ((self = [super init])) {
+    bit_pipelineStatisticsRead(&_statistics);
+  }
+  return self;
+}
+
+- (uint64_t)valueOfCounter:(BITTelemetryCounter)counter {
+  return counter < BITTelemetryCounterCount ? _statistics.counters[counter] : 0;
+}
+
+- (uint64_t)countOfStage:(BITTelemetryStage)stage {
+  return stage < BITTelemetryStageCount ? _statistics.histograms[stage].count : 0;
+}
+
+- (NSTimeInterval)totalDurationOfStage:(BITTelemetryStage)stage {
+  return stage < BITTelemetryStageCount ? (double)_statistics.histograms[stage].totalNanoseconds / NSEC_PER_SEC : 0;
+}
+
+- (NSTimeInterval)durationOfStage:(BITTelemetryStage)stage atPercentile:(double)percentile {
+  if (stage >= BITTelemetryStageCount) {
+    return 0;
+  }
+  return (double)bit_pipelineHistogramPercentile(&_statistics.histograms[stage], percentile) / NSEC_PER_SEC;
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)dictionaryRepresentation {
+  NSMutableDictionary<NSString *, NSNumber *> *dictionary = [NSMutableDictionary new];
+  for (NSUInteger counter = 0; counter < BITTelemetryCounterCount; counter++) {
+    dictionary[BITCounterNames[counter]] = @([self valueOfCounter:counter]);
+  }
+  for (NSUInteger stage = 0; stage < BITTelemetryStageCount; stage++) {
+    NSString *name = BITStageNames[stage];
+    uint64_t count = [self countOfStage:stage];
+    dictionary[[name stringByAppendingString:@".count"]] = @(count);
+    dictionary[[name stringByAppendingString:@".mean"]] = @(count > 0 ? [self totalDurationOfStage:stage] * 1000 / (double)count : 0);
+    dictionary[[name stringByAppendingString:@".p50"]] = @([self durationOfStage:stage atPercentile:50] * 1000);
+    dictionary[[name stringByAppendingString:@".p99"]] = @([self durationOfStage:stage atPercentile:99] * 1000);
+  }
+  return dictionary;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,88 @@
+#import <Foundation/Foundation.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Identifies a scheduled timeout, 0 never identifies one.
+ */
+typedef uint64_t BITTimeoutIdentifier;
+
+/**
+ *  Runs blocks once their deadline has passed, all driven by a single long-lived timer source.
+ *
+ *  Deadlines are rounded up to ticks of `tickInterval` seconds and kept in a hashed wheel of `slotCount` slots, a
+ *  deadline further away than a full turn of the wheel waits in its slot until its tick comes around. The timer is only
+ *  armed for the earliest tick with a deadline and disarmed while there is none, so an idle wheel never wakes up.
+ *  Deadlines are coarse on purpose: the timer gets a leeway of at least one tick, so the system can coalesce its wake ups
+ *  with others.
+ *
+ *  Scheduling and cancelling a timeout don't create timer sources, which makes them cheap enough for deadlines that are
+ *  set and reset all the time, like the flush deadline of every batch. All methods are thread-safe.
+ */
+@interface BITTimerWheel : NSObject
+
+/**
+ *  The wheel the channel and the sender share.
+ *
+ *  @return the shared wheel
+ */
++ (instancetype)sharedTimerWheel;
+
+/**
+ *  Initializes a wheel.
+ *
+ *  @param tickInterval the number of seconds deadlines are rounded up to
+ *  @param slotCount the number of slots of the wheel, deadlines within slotCount ticks are found without searching
+ *
+ *  @return the wheel
+ */
+- (instancetype)initWithTickInterval:(NSTimeInterval)tickInterval slotCount:(NSUInteger)slotCount NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Initializes a wheel with a tick interval of 0.5 seconds and 64 slots.
+ */
+- (instancetype)init;
+
+/**
+ *  The number of seconds deadlines are rounded up to.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval tickInterval;
+
+/**
+ *  The number of timer sources the wheel has created, which is 1 for its whole life time.
+ */
+@property (atomic, assign, readonly) uint64_t timerSourceCreationCount;
+
+/**
+ *  The number of timeouts that have been scheduled.
+ */
+@property (atomic, assign, readonly) uint64_t scheduledTimeoutCount;
+
+/**
+ *  The number of timeouts that have neither run nor been cancelled yet.
+ */
+@property (atomic, assign, readonly) NSUInteger pendingTimeoutCount;
+
+/**
+ *  Runs a block asynchronously on a queue once a delay has passed.
+ *
+ *  @param delay the number of seconds after which the block runs, it is rounded up to the next tick
+ *  @param queue the queue the block is run on
+ *  @param block the block
+ *
+ *  @return the identifier of the timeout, which cancels it
+ */
+- (BITTimeoutIdentifier)scheduleAfterDelay:(NSTimeInterval)delay queue:(dispatch_queue_t)queue block:(dispatch_block_t)block;
+
+/**
+ *  Cancels a timeout. A block that has already been dispatched to its queue still runs, callers that need to know
+ *  compare the identifier of the timeout they expect.
+ *
+ *  @param identifier the identifier of the timeout, 0 is ignored
+ */
+- (void)cancelTimeout:(BITTimeoutIdentifier)identifier;
+
+@end
+
+NS_ASSUME_NONNULL_END
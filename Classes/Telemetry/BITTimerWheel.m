@@ -0,0 +1,189 @@
+#import "BITTimerWheel.h"
+
+static NSTimeInterval const BITDefaultTickInterval = 0.5;
+static NSUInteger const BITDefaultSlotCount = 64;
+
+// Timers get at least one tick of leeway and this share of their delay, so long backoff delays can be coalesced more.
+static double const BITTimerLeewayRatio = 0.1;
+
+// Compensates the rounding of the uptime, a timer that fires right on a tick must not see the tick before.
+static double const BITTickEpsilon = 1e-6;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface BITTimeout : NSObject
+
+@property (nonatomic, assign) BITTimeoutIdentifier identifier;
+@property (nonatomic, assign) uint64_t tick;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, copy) dispatch_block_t block;
+
+@end
+
+@implementation BITTimeout
+@end
+
+@interface BITTimerWheel ()
+
+@property (nonatomic, strong) dispatch_queue_t timerQueue;
+@property (nonatomic, strong) dispatch_source_t timerSource;
+@property (nonatomic, copy) NSArray<NSMutableArray<BITTimeout *> *> *slots;
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, BITTimeout *> *timeouts;
+@property (nonatomic, assign) NSTimeInterval startTime;
+@property (nonatomic, assign) uint64_t currentTick;
+@property (nonatomic, assign) uint64_t armedTick;
+@property (nonatomic, assign) BITTimeoutIdentifier lastIdentifier;
+@property (atomic, assign) uint64_t timerSourceCreationCount;
+@property (atomic, assign) uint64_t scheduledTimeoutCount;
+@property (atomic, assign) NSUInteger pendingTimeoutCount;
+
+@end
+
+@implementation BITTimerWheel
+
++ (instancetype)sharedTimerWheel {
+  static BITTimerWheel *sharedTimerWheel;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedTimerWheel = [self new];
+  });
+  return sharedTimerWheel;
+}
+
+- (instancetype)init {
+  return [self initWithTickInterval:BITDefaultTickInterval slotCount:BITDefaultSlotCount];
+}
+
+- (instancetype)initWithTickInterval:(NSTimeInterval)tickInterval slotCount:(NSUInteger)slotCount {
+  if ((self = [super init])) {
+    _tickInterval = MAX(tickInterval, 0.001);
+    NSMutableArray *slots = [NSMutableArray arrayWithCapacity:MAX(slotCount, (NSUInteger)1)];
+    for (NSUInteger i = 0; i < MAX(slotCount, (NSUInteger)1); i++) {
+      [slots addObject:[NSMutableArray new]];
+    }
+    _slots = slots;
+    _timeouts = [NSMutableDictionary new];
+    _startTime = [NSProcessInfo processInfo].systemUptime;
+    _armedTick = UINT64_MAX;
+    _timerQueue = dispatch_queue_create("net.hockeyapp.timerWheelQueue", DISPATCH_QUEUE_SERIAL);
+
+    // The only timer source of the wheel, it stays disarmed until a timeout is scheduled.
+    _timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _timerQueue);
+    _timerSourceCreationCount = 1;
+    dispatch_source_set_timer(_timerSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(_timerSource, ^{
+      typeof(self) strongSelf = weakSelf;
+      [strongSelf advance];
+    });
+    dispatch_resume(_timerSource);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  dispatch_source_cancel(_timerSource);
+}
+
+#pragma mark - Scheduling
+
+- (BITTimeoutIdentifier)scheduleAfterDelay:(NSTimeInterval)delay queue:(dispatch_queue_t)queue block:(dispatch_block_t)block {
+  BITTimeout *timeout = [BITTimeout new];
+  timeout.queue = queue;
+  timeout.block = block;
+  @synchronized(self) {
+    NSTimeInterval deadline = [NSProcessInfo processInfo].systemUptime + MAX(delay, 0) - self.startTime;
+    timeout.tick = MAX((uint64_t)ceil(deadline / self.tickInterval - BITTickEpsilon), self.currentTick + 1);
+    timeout.identifier = ++self.lastIdentifier;
+    [self.slots[timeout.tick % self.slots.count] addObject:timeout];
+    self.timeouts[@(timeout.identifier)] = timeout;
+    self.scheduledTimeoutCount += 1;
+    self.pendingTimeoutCount = self.timeouts.count;
+    if (timeout.tick < self.armedTick) {
+      [self armForTick:timeout.tick];
+    }
+    return timeout.identifier;
+  }
+}
+
+- (void)cancelTimeout:(BITTimeoutIdentifier)identifier {
+  if (identifier == 0) {
+    return;
+  }
+  @synchronized(self) {
+    BITTimeout *timeout = self.timeouts[@(identifier)];
+    if (!timeout) {
+      return;
+    }
+    [self.timeouts removeObjectForKey:@(identifier)];
+    [self.slots[timeout.tick % self.slots.count] removeObjectIdenticalTo:timeout];
+    self.pendingTimeoutCount = self.timeouts.count;
+
+    // The timer stays armed, it finds nothing to run and is armed for the next deadline then.
+  }
+}
+
+#pragma mark - Ticking
+
+- (void)armForTick:(uint64_t)tick {
+  self.armedTick = tick;
+  if (tick == UINT64_MAX) {
+    dispatch_source_set_timer(self.timerSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    return;
+  }
+  NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+  NSTimeInterval delay = MAX(self.startTime + (double)tick * self.tickInterval - now, 0);
+  NSTimeInterval leeway = MAX(self.tickInterval, delay * BITTimerLeewayRatio);
+  dispatch_source_set_timer(self.timerSource,
+                            dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                            DISPATCH_TIME_FOREVER,
+                            (uint64_t)(leeway * NSEC_PER_SEC));
+}
+
+- (void)advance {
+  NSMutableArray<BITTimeout *> *expiredTimeouts = [NSMutableArray new];
+  @synchronized(self) {
+    NSTimeInterval elapsed = [NSProcessInfo processInfo].systemUptime - self.startTime;
+    uint64_t tick = (uint64_t)floor(elapsed / self.tickInterval + BITTickEpsilon);
+    if (tick > self.currentTick) {
+
+      // Every slot is visited at most once, after a full turn all of them have been looked at.
+      uint64_t slotCount = self.slots.count;
+      uint64_t firstTick = tick - self.currentTick > slotCount ? tick - slotCount + 1 : self.currentTick + 1;
+      for (uint64_t visitedTick = firstTick; visitedTick <= tick; visitedTick++) {
+        NSMutableArray<BITTimeout *> *slot = self.slots[visitedTick % slotCount];
+        NSIndexSet *expired = [slot indexesOfObjectsPassingTest:^BOOL(BITTimeout *timeout, NSUInteger __unused index, BOOL __unused *stop) {
+          return timeout.tick <= tick;
+        }];
+        if (expired.count > 0) {
+          [expiredTimeouts addObjectsFromArray:[slot objectsAtIndexes:expired]];
+          [slot removeObjectsAtIndexes:expired];
+        }
+      }
+      self.currentTick = tick;
+    }
+    for (BITTimeout *timeout in expiredTimeouts) {
+      [self.timeouts removeObjectForKey:@(timeout.identifier)];
+    }
+    self.pendingTimeoutCount = self.timeouts.count;
+
+    // Only a handful of deadlines are pending at any time, so the next one is simply searched for.
+    uint64_t nextTick = UINT64_MAX;
+    for (BITTimeout *timeout in self.timeouts.objectEnumerator) {
+      nextTick = MIN(nextTick, timeout.tick);
+    }
+    [self armForTick:nextTick];
+  }
+
+  // The blocks are dispatched without holding the lock, they may schedule timeouts themselves.
+  [expiredTimeouts sortUsingComparator:^NSComparisonResult(BITTimeout *lhs, BITTimeout *rhs) {
+    return lhs.tick < rhs.tick ? NSOrderedAscending : (lhs.tick > rhs.tick ? NSOrderedDescending : NSOrderedSame);
+  }];
+  for (BITTimeout *timeout in expiredTimeouts) {
+    dispatch_async(timeout.queue, timeout.block);
+  }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
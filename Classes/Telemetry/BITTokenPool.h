@@ -0,0 +1,89 @@
+#import <stdbool.h>
+#import <stddef.h>
+#import "HockeySDKNullability.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A counting semaphore that never blocks. A fixed number of tokens can be taken at a time, taking one fails instead of
+ *  waiting if none is left.
+ *
+ *  The number of tokens in use is a single atomic counter, so acquiring and releasing a token is a compare-and-swap
+ *  without locks or queues. A successful acquire has acquire semantics and a release has release semantics, so
+ *  everything written while holding a token is visible to the thread that takes it next.
+ *
+ *  All functions except bit_tokenPoolCreate and bit_tokenPoolDestroy are safe to call from multiple threads.
+ */
+typedef struct BITTokenPool BITTokenPool;
+
+/**
+ *  Creates a pool.
+ *
+ *  @param capacity the number of tokens that can be in use at a time
+ *
+ *  @return the pool or NULL if it could not be allocated
+ */
+BITTokenPool *_Nullable bit_tokenPoolCreate(size_t capacity);
+
+/**
+ *  Frees a pool. It must not be used afterwards.
+ *
+ *  @param pool the pool to free
+ */
+void bit_tokenPoolDestroy(BITTokenPool *_Nullable pool);
+
+/**
+ *  Takes a token.
+ *
+ *  @param pool the pool
+ *
+ *  @return true if a token has been taken, false if all tokens are in use
+ */
+bool bit_tokenPoolAcquire(BITTokenPool *pool);
+
+/**
+ *  Returns a token taken with bit_tokenPoolAcquire.
+ *
+ *  @param pool the pool
+ *
+ *  @return false if no token was in use, which means a token has been returned twice
+ */
+bool bit_tokenPoolRelease(BITTokenPool *pool);
+
+/**
+ *  Returns the number of tokens in use. The value may be outdated as soon as it has been read.
+ *
+ *  @param pool the pool
+ *
+ *  @return the number of tokens in use
+ */
+size_t bit_tokenPoolInUse(const BITTokenPool *pool);
+
+/**
+ *  Returns the largest number of tokens that have been in use at a time.
+ *
+ *  @param pool the pool
+ *
+ *  @return the high-water mark
+ */
+size_t bit_tokenPoolPeakInUse(const BITTokenPool *pool);
+
+/**
+ *  Returns the number of tokens that can be in use at a time.
+ *
+ *  @param pool the pool
+ *
+ *  @return the capacity
+ */
+size_t bit_tokenPoolCapacity(const BITTokenPool *pool);
+
+/**
+ *  Changes the number of tokens that can be in use at a time. Tokens in use are not revoked if the capacity shrinks
+ *  below their number, but no new ones are handed out until enough have been returned.
+ *
+ *  @param pool the pool
+ *  @param capacity the new capacity
+ */
+void bit_tokenPoolSetCapacity(BITTokenPool *pool, size_t capacity);
+
+NS_ASSUME_NONNULL_END
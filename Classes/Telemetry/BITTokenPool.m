@@ -0,0 +1,68 @@
+#import "BITTokenPool.h"
+#import <stdatomic.h>
+#import <stdlib.h>
+
+struct BITTokenPool {
+  _Atomic(size_t) inUse;
+  _Atomic(size_t) peakInUse;
+  _Atomic(size_t) capacity;
+};
+
+BITTokenPool *bit_tokenPoolCreate(size_t capacity) {
+  BITTokenPool *pool = malloc(sizeof(BITTokenPool));
+  if (!pool) {
+    return NULL;
+  }
+  atomic_init(&pool->inUse, 0);
+  atomic_init(&pool->peakInUse, 0);
+  atomic_init(&pool->capacity, capacity);
+  return pool;
+}
+
+void bit_tokenPoolDestroy(BITTokenPool *pool) {
+  free(pool);
+}
+
+bool bit_tokenPoolAcquire(BITTokenPool *pool) {
+  size_t inUse = atomic_load_explicit(&pool->inUse, memory_order_relaxed);
+  do {
+    if (inUse >= atomic_load_explicit(&pool->capacity, memory_order_relaxed)) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(&pool->inUse, &inUse, inUse + 1, memory_order_acquire, memory_order_relaxed));
+
+  // The high-water mark is only statistics, so it doesn't need to be ordered with anything else.
+  size_t peak = atomic_load_explicit(&pool->peakInUse, memory_order_relaxed);
+  while (inUse + 1 > peak &&
+         !atomic_compare_exchange_weak_explicit(&pool->peakInUse, &peak, inUse + 1, memory_order_relaxed, memory_order_relaxed)) {
+  }
+  return true;
+}
+
+bool bit_tokenPoolRelease(BITTokenPool *pool) {
+
+  // A plain decrement would wrap around on a double release and block the pool for good, so it's checked first.
+  size_t inUse = atomic_load_explicit(&pool->inUse, memory_order_relaxed);
+  do {
+    if (inUse == 0) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(&pool->inUse, &inUse, inUse - 1, memory_order_release, memory_order_relaxed));
+  return true;
+}
+
+size_t bit_tokenPoolInUse(const BITTokenPool *pool) {
+  return atomic_load_explicit(&pool->inUse, memory_order_acquire);
+}
+
+size_t bit_tokenPoolPeakInUse(const BITTokenPool *pool) {
+  return atomic_load_explicit(&pool->peakInUse, memory_order_relaxed);
+}
+
+size_t bit_tokenPoolCapacity(const BITTokenPool *pool) {
+  return atomic_load_explicit(&pool->capacity, memory_order_relaxed);
+}
+
+void bit_tokenPoolSetCapacity(BITTokenPool *pool, size_t capacity) {
+  atomic_store_explicit(&pool->capacity, capacity, memory_order_relaxed);
+}
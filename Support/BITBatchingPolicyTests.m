@@ -0,0 +1,259 @@
+//
+//  BITBatchingPolicyTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <zlib.h>
+#import "BITBatchingPolicy.h"
+#import "BITCompression.h"
+
+// A trace is a sequence of these, ordered by time. Traces recorded on a device can be replayed by setting the
+// BIT_BATCHING_TRACE environment variable to a file with one "seconds,bytes" line per event.
+typedef struct {
+  NSTimeInterval time;
+  NSUInteger length;
+} BITTraceEvent;
+
+typedef struct {
+  NSUInteger fileCount;
+  NSUInteger compressedLength;
+  NSTimeInterval totalLatency;
+  NSTimeInterval maximumLatency;
+} BITReplayResult;
+
+// A small deterministic generator, so traces are the same for every run.
+static uint64_t bit_nextRandom(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static double bit_uniformRandom(uint64_t *state) {
+  return (double)(bit_nextRandom(state) >> 11) / (double)(1ull << 53);
+}
+
+static NSTimeInterval bit_exponentialRandom(uint64_t *state, NSTimeInterval mean) {
+  return -mean * log(1 - bit_uniformRandom(state));
+}
+
+@interface BITBatchingPolicyTests : XCTestCase
+
+@end
+
+@implementation BITBatchingPolicyTests
+
+#pragma mark - Fixed policy
+
+- (void)testFixedPolicyPersistsAtMaxBatchSize {
+  BITFixedBatchingPolicy *policy = [[BITFixedBatchingPolicy alloc] initWithMaxBatchSize:3 batchInterval:10];
+  XCTAssertFalse([policy shouldPersistBatchWithItemCount:1 length:100000 addedAt:0]);
+  XCTAssertFalse([policy shouldPersistBatchWithItemCount:2 length:100 addedAt:0]);
+  XCTAssertTrue([policy shouldPersistBatchWithItemCount:3 length:100 addedAt:0]);
+  XCTAssertEqual([policy flushIntervalForBatchStartedAt:0], 10.0);
+  XCTAssertEqual([policy flushIntervalForBatchStartedAt:1000], 10.0);
+}
+
+- (void)testFixedPolicyDefaults {
+  BITFixedBatchingPolicy *policy = [BITFixedBatchingPolicy new];
+  XCTAssertEqual(policy.maxBatchSize, (NSUInteger)50);
+  XCTAssertEqual(policy.batchInterval, 15.0);
+
+  policy = [[BITFixedBatchingPolicy alloc] initWithMaxBatchSize:0 batchInterval:0];
+  XCTAssertEqual(policy.maxBatchSize, (NSUInteger)50);
+  XCTAssertEqual(policy.batchInterval, 15.0);
+}
+
+#pragma mark - Adaptive policy
+
+- (void)testAdaptivePolicyPersistsAtTargetLength {
+  BITAdaptiveBatchingPolicy *policy = [BITAdaptiveBatchingPolicy new];
+  policy.targetCompressedLength = 1000;
+
+  // Until a batch has been persisted, a compression ratio of 4 is assumed.
+  XCTAssertFalse([policy shouldPersistBatchWithItemCount:1 length:3000 addedAt:0]);
+  XCTAssertTrue([policy shouldPersistBatchWithItemCount:2 length:4000 addedAt:1]);
+
+  // Batches that compress better grow larger.
+  for (int i = 0; i < 20; i++) {
+    [policy didPersistBatchWithItemCount:10 length:10000 compressedLength:1000];
+  }
+  XCTAssertEqualWithAccuracy(policy.averageCompressionRatio, 10, 0.1);
+  XCTAssertFalse([policy shouldPersistBatchWithItemCount:1 length:4000 addedAt:2]);
+  XCTAssertFalse([policy shouldPersistBatchWithItemCount:2 length:8000 addedAt:3]);
+  XCTAssertTrue([policy shouldPersistBatchWithItemCount:3 length:10000 addedAt:4]);
+
+  // The maximum length applies regardless of the ratio.
+  policy.maximumLength = 5000;
+  XCTAssertTrue([policy shouldPersistBatchWithItemCount:1 length:5000 addedAt:5]);
+}
+
+- (void)testAdaptivePolicyAdaptsFlushIntervalToArrivalRate {
+  BITAdaptiveBatchingPolicy *policy = [BITAdaptiveBatchingPolicy new];
+  NSTimeInterval time = 0;
+
+  // Many items per second: batches fill up quickly, the shortest interval is used.
+  for (int i = 0; i < 200; i++) {
+    [policy shouldPersistBatchWithItemCount:1 length:500 addedAt:time];
+    time += 0.05;
+  }
+  XCTAssertEqualWithAccuracy(policy.averageArrivalInterval, 0.05, 0.01);
+  XCTAssertEqual([policy flushIntervalForBatchStartedAt:time], policy.minimumFlushInterval);
+
+  // One item every few minutes: the longest interval is used, but idle gaps are capped.
+  for (int i = 0; i < 200; i++) {
+    time += 3600;
+    [policy shouldPersistBatchWithItemCount:1 length:500 addedAt:time];
+  }
+  XCTAssertEqualWithAccuracy(policy.averageArrivalInterval, policy.maximumFlushInterval, 1);
+  XCTAssertEqual([policy flushIntervalForBatchStartedAt:time], policy.maximumFlushInterval);
+}
+
+#pragma mark - Trace replay
+
+- (NSData *)traceWithDuration:(NSTimeInterval)duration
+                         seed:(uint64_t)seed
+               arrivalInterval:(NSTimeInterval (^)(NSTimeInterval time, uint64_t *random))arrivalInterval
+                 eventLength:(NSUInteger (^)(uint64_t *random))eventLength {
+  NSMutableData *trace = [NSMutableData new];
+  uint64_t random = seed;
+  for (NSTimeInterval time = arrivalInterval(0, &random); time < duration; time += arrivalInterval(time, &random)) {
+    BITTraceEvent event = {.time = time, .length = eventLength(&random)};
+    [trace appendBytes:&event length:sizeof(event)];
+  }
+  return trace;
+}
+
+- (nullable NSData *)recordedTrace {
+  NSString *path = [NSProcessInfo processInfo].environment[@"BIT_BATCHING_TRACE"];
+  NSString *contents = path ? [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil] : nil;
+  if (!contents) {
+    return nil;
+  }
+  NSMutableData *trace = [NSMutableData new];
+  for (NSString *line in [contents componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+    NSArray *fields = [line componentsSeparatedByString:@","];
+    if (fields.count == 2) {
+      BITTraceEvent event = {.time = [fields[0] doubleValue], .length = (NSUInteger)[fields[1] integerValue]};
+      [trace appendBytes:&event length:sizeof(event)];
+    }
+  }
+  return trace;
+}
+
+- (NSDictionary<NSString *, NSData *> *)traces {
+  NSUInteger (^typicalLength)(uint64_t *) = ^NSUInteger(uint64_t *random) {
+    return 400 + (NSUInteger)(bit_uniformRandom(random) * 400);
+  };
+  NSMutableDictionary *traces = [NSMutableDictionary new];
+
+  // A menu bar app that tracks an event every one and a half minutes on average, for 8 hours.
+  traces[@"background"] = [self traceWithDuration:8 * 3600 seed:1 arrivalInterval:^NSTimeInterval(NSTimeInterval __unused time, uint64_t *random) {
+    return bit_exponentialRandom(random, 90);
+  } eventLength:typicalLength];
+
+  // An app used in 5 minute sessions with an event every 2 seconds, 20 minutes apart, for 8 hours.
+  traces[@"interactive"] = [self traceWithDuration:8 * 3600 seed:2 arrivalInterval:^NSTimeInterval(NSTimeInterval time, uint64_t *random) {
+    NSTimeInterval interval = bit_exponentialRandom(random, 2);
+    return fmod(time + interval, 25 * 60) < 5 * 60 ? interval : 20 * 60;
+  } eventLength:typicalLength];
+
+  // An app tracking 20 events per second with larger payloads, for 30 minutes.
+  traces[@"high rate"] = [self traceWithDuration:30 * 60 seed:3 arrivalInterval:^NSTimeInterval(NSTimeInterval __unused time, uint64_t *random) {
+    return bit_exponentialRandom(random, 0.05);
+  } eventLength:^NSUInteger(uint64_t *random) {
+    return 300 + (NSUInteger)(bit_uniformRandom(random) * 2700);
+  }];
+
+  NSData *recordedTrace = [self recordedTrace];
+  if (recordedTrace.length > 0) {
+    traces[@"recorded"] = recordedTrace;
+  }
+  return traces;
+}
+
+// Appends an envelope like line of the given length, so batches compress like real ones.
+- (void)appendEventOfLength:(NSUInteger)length index:(NSUInteger)index toBatch:(NSMutableData *)batch {
+  NSMutableString *line = [NSMutableString stringWithFormat:@"{\"ver\":1,\"name\":\"Microsoft.ApplicationInsights.Event\",\"time\":\"2017-01-01T00:%02lu:%02lu.000Z\","
+                                                            "\"iKey\":\"00000000-0000-0000-0000-000000000000\",\"data\":{\"baseData\":{\"name\":\"Event %lu\",\"properties\":{",
+                                                            (unsigned long)(index / 60 % 60), (unsigned long)(index % 60), (unsigned long)(index % 37)];
+  for (NSUInteger property = 0; line.length < length; property++) {
+    [line appendFormat:@"\"property%lu\":\"value %lu\",", (unsigned long)property, (unsigned long)((index * 31 + property) % 101)];
+  }
+  [batch appendData:(NSData *)[[line substringToIndex:length] dataUsingEncoding:NSUTF8StringEncoding]];
+  [batch appendBytes:"\n" length:1];
+}
+
+- (BITReplayResult)replayTrace:(NSData *)trace withPolicy:(id<BITBatchingPolicy>)policy {
+  const BITTraceEvent *events = trace.bytes;
+  NSUInteger eventCount = trace.length / sizeof(BITTraceEvent);
+  __block BITReplayResult result = {0};
+  NSMutableData *batch = [NSMutableData new];
+  NSMutableArray<NSNumber *> *batchTimes = [NSMutableArray new];
+  NSTimeInterval deadline = INFINITY;
+
+  void (^persist)(NSTimeInterval) = ^(NSTimeInterval time) {
+    NSData *compressed = bit_gzipData(batch, Z_DEFAULT_COMPRESSION);
+    if ([policy respondsToSelector:@selector(didPersistBatchWithItemCount:length:compressedLength:)]) {
+      [policy didPersistBatchWithItemCount:batchTimes.count length:batch.length compressedLength:compressed.length];
+    }
+    result.fileCount++;
+    result.compressedLength += compressed.length;
+    for (NSNumber *batchTime in batchTimes) {
+      NSTimeInterval latency = time - batchTime.doubleValue;
+      result.totalLatency += latency;
+      result.maximumLatency = MAX(result.maximumLatency, latency);
+    }
+    batch.length = 0;
+    [batchTimes removeAllObjects];
+  };
+
+  for (NSUInteger i = 0; i < eventCount; i++) {
+    BITTraceEvent event = events[i];
+
+    // The timer fires before the next event arrives.
+    if (batchTimes.count > 0 && event.time >= deadline) {
+      persist(deadline);
+    }
+    @autoreleasepool {
+      [self appendEventOfLength:event.length index:i toBatch:batch];
+    }
+    [batchTimes addObject:@(event.time)];
+    if ([policy shouldPersistBatchWithItemCount:batchTimes.count length:batch.length addedAt:event.time]) {
+      persist(event.time);
+    } else if (batchTimes.count == 1) {
+      deadline = event.time + [policy flushIntervalForBatchStartedAt:event.time];
+    }
+  }
+  if (batchTimes.count > 0) {
+    persist(deadline);
+  }
+  return result;
+}
+
+- (void)testReplayTracesWithFixedAndAdaptivePolicies {
+  NSDictionary<NSString *, NSData *> *traces = [self traces];
+  for (NSString *name in [traces.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+    NSData *trace = traces[name];
+    NSUInteger eventCount = trace.length / sizeof(BITTraceEvent);
+    const BITTraceEvent *events = trace.bytes;
+    double hours = MAX(events[eventCount - 1].time / 3600, 1.0 / 60);
+
+    BITReplayResult fixed = [self replayTrace:trace withPolicy:[BITFixedBatchingPolicy new]];
+    BITReplayResult adaptive = [self replayTrace:trace withPolicy:[BITAdaptiveBatchingPolicy new]];
+    for (NSString *policyName in @[@"fixed", @"adaptive"]) {
+      BITReplayResult result = [policyName isEqualToString:@"fixed"] ? fixed : adaptive;
+      NSLog(@"%@ trace (%lu events), %@ policy: %lu files (%.1f per hour), %.1f KB per file, latency mean %.1f s, max %.1f s",
+            name, (unsigned long)eventCount, policyName, (unsigned long)result.fileCount, (double)result.fileCount / hours,
+            (double)result.compressedLength / (double)result.fileCount / 1024, result.totalLatency / (double)eventCount, result.maximumLatency);
+    }
+
+    if (![name isEqualToString:@"recorded"]) {
+      XCTAssertLessThan(adaptive.fileCount, fixed.fileCount, @"%@", name);
+      XCTAssertLessThanOrEqual(adaptive.maximumLatency, [BITAdaptiveBatchingPolicy new].maximumFlushInterval + 0.001, @"%@", name);
+    }
+  }
+}
+
+@end
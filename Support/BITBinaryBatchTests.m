@@ -0,0 +1,305 @@
+//
+//  BITBinaryBatchTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITBinaryBatch.h"
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+#import "BITEventData.h"
+#import "BITEnvelope.h"
+#import "BITCompression.h"
+#import "BITGZIP.h"
+
+static NSUInteger const BITFuzzRoundCount = 200;
+static NSUInteger const BITFuzzMaxItemsPerBatch = 40;
+
+@interface BITBinaryBatchTests : XCTestCase
+
+@property (nonatomic, strong) BITChannel *channel;
+@property (nonatomic, strong) id persistenceMock;
+@property (nonatomic, assign) BITBinaryBatchWriter *sut;
+
+@end
+
+@implementation BITBinaryBatchTests
+
+- (void)setUp {
+  [super setUp];
+  self.persistenceMock = OCMClassMock([BITPersistence class]);
+  BITTelemetryContext *context = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123 \"quoted\"" persistence:self.persistenceMock];
+  self.channel = [[BITChannel alloc] initWithTelemetryContext:context persistence:self.persistenceMock];
+  self.sut = bit_binaryBatchWriterCreate(16);
+}
+
+- (void)tearDown {
+  bit_binaryBatchWriterDestroy(self.sut);
+  self.sut = NULL;
+  [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (NSString *)randomString {
+  static NSArray<NSString *> *pieces;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    pieces = @[@"a", @"Screen", @" ", @"\"", @"\\", @"/", @"\n", @"\t", @"\x01", @"\x1f", @"ä", @"✓", @"😀", @" ", @"0"];
+  });
+  NSMutableString *string = [NSMutableString new];
+  long length = lrand48() % 12;
+  for (long i = 0; i < length; i++) {
+    [string appendString:pieces[(NSUInteger)lrand48() % pieces.count]];
+  }
+  return string;
+}
+
+- (NSString *)randomKey {
+
+  // Keys repeat across events, so most of them end up in the string table of the batch.
+  return lrand48() % 4 ? [NSString stringWithFormat:@"key %ld", lrand48() % 20] : [self randomString];
+}
+
+- (double)randomMeasurement {
+  switch (lrand48() % 4) {
+    case 0:
+      return (double)(lrand48() % 1000);
+    case 1:
+      return drand48() * 1e6 - 5e5;
+    case 2:
+      return 1e300 * drand48();
+    default:
+      return -0.0;
+  }
+}
+
+- (BITEventRecord *)randomEventRecord {
+  BITEventRecord *record = bit_eventRecordPoolAcquire(self.channel.eventRecordPool);
+  NSString *name = lrand48() % 2 ? [NSString stringWithFormat:@"Event %ld", lrand48() % 10] : [self randomString];
+  XCTAssertTrue(bit_eventRecordSetName(record, (__bridge CFStringRef)name));
+  long propertyCount = lrand48() % 6;
+  for (long i = 0; i < propertyCount; i++) {
+    XCTAssertTrue(bit_eventRecordAddProperty(record, (__bridge CFStringRef)[self randomKey], (__bridge CFStringRef)[self randomString]));
+  }
+  long measurementCount = lrand48() % 4;
+  for (long i = 0; i < measurementCount; i++) {
+    XCTAssertTrue(bit_eventRecordAddMeasurement(record, (__bridge CFStringRef)[self randomKey], [self randomMeasurement]));
+  }
+
+  // Times before 1970 and fractions of milliseconds are rounded the same way in both formats.
+  record->timestamp = drand48() * 4e9 - 1e9;
+  record->sampleRate = lrand48() % 3 ? 0 : drand48() * 100;
+  return record;
+}
+
+- (NSData *)lineOfEventRecord:(const BITEventRecord *)record {
+  BITJSONWriter *writer = bit_jsonWriterCreate(256);
+  [self.channel serializeEventRecord:record toJSONWriter:writer];
+  NSMutableData *line = [NSMutableData dataWithBytes:bit_jsonWriterBytes(writer) length:bit_jsonWriterLength(writer)];
+  [line appendBytes:"\n" length:1];
+  bit_jsonWriterDestroy(writer);
+  return line;
+}
+
+- (BOOL)appendEventRecord:(const BITEventRecord *)record {
+  NSData *tags = self.channel.telemetryContext.tagsFragment;
+  return bit_binaryBatchWriterAppendEventRecord(self.sut, record, (__bridge CFStringRef)self.channel.telemetryContext.appIdentifier, tags.bytes, tags.length);
+}
+
+- (NSData *)batchOfEventCount:(NSUInteger)eventCount json:(NSMutableData *)json {
+  for (NSUInteger i = 0; i < eventCount; i++) {
+    BITEventRecord *record = [self randomEventRecord];
+    XCTAssertTrue([self appendEventRecord:record]);
+    [json appendData:[self lineOfEventRecord:record]];
+    bit_eventRecordPoolRelease(record);
+  }
+  return (NSData *)bit_binaryBatchWriterFinish(self.sut);
+}
+
+- (NSArray<NSData *> *)linesOfBatch:(NSData *)batch {
+  NSMutableArray<NSData *> *lines = [NSMutableArray new];
+  const char *bytes = batch.bytes;
+  NSUInteger start = 0;
+  for (NSUInteger i = 0; i < batch.length; i++) {
+    if (bytes[i] == '\n') {
+      [lines addObject:[batch subdataWithRange:NSMakeRange(start, i + 1 - start)]];
+      start = i + 1;
+    }
+  }
+  XCTAssertEqual(start, batch.length);
+  return lines;
+}
+
+#pragma mark - Round trip
+
+- (void)testRandomBatchesRenderToTheJSONOfTheirItems {
+  long seed = (long)time(NULL);
+  srand48(seed);
+  NSLog(@"Fuzzing binary batches with seed %ld", seed);
+
+  for (NSUInteger round = 0; round < BITFuzzRoundCount; round++) {
+    NSMutableArray *expectedLines = [NSMutableArray new];
+    NSMutableArray<NSDictionary *> *expectedEnvelopes = [NSMutableArray new];
+    NSUInteger itemCount = 1 + (NSUInteger)lrand48() % BITFuzzMaxItemsPerBatch;
+    for (NSUInteger i = 0; i < itemCount; i++) {
+      if (lrand48() % 4 == 0) {
+
+        // Items that are no event records are stored as the JSON of their envelope.
+        BITEventData *eventData = [BITEventData new];
+        eventData.name = [self randomString];
+        eventData.properties = @{[self randomKey] : [self randomString]};
+        NSDictionary *envelope = [[self.channel envelopeForTelemetryData:eventData] serializeToDictionary];
+        NSData *json = [NSJSONSerialization dataWithJSONObject:envelope options:(NSJSONWritingOptions)0 error:nil];
+        XCTAssertTrue(bit_binaryBatchWriterAppendJSON(self.sut, json.bytes, json.length));
+        [expectedLines addObject:[NSNull null]];
+        [expectedEnvelopes addObject:envelope];
+      } else {
+        BITEventRecord *record = [self randomEventRecord];
+        XCTAssertTrue([self appendEventRecord:record]);
+        NSData *line = [self lineOfEventRecord:record];
+        [expectedLines addObject:line];
+        [expectedEnvelopes addObject:[NSJSONSerialization JSONObjectWithData:line options:(NSJSONReadingOptions)0 error:nil]];
+        bit_eventRecordPoolRelease(record);
+      }
+    }
+    XCTAssertEqual(bit_binaryBatchWriterItemCount(self.sut), (uint32_t)itemCount);
+    size_t expectedLength = bit_binaryBatchWriterLength(self.sut);
+    NSData *batch = bit_binaryBatchWriterFinish(self.sut);
+    XCTAssertEqual(batch.length, expectedLength);
+    XCTAssertEqual(bit_binaryBatchWriterItemCount(self.sut), (uint32_t)0);
+
+    uint64_t trailerCount = 0;
+    XCTAssertTrue(bit_binaryBatchItemCount((NSData *)batch, &trailerCount));
+    XCTAssertEqual(trailerCount, (uint64_t)itemCount);
+
+    NSData *rendered = bit_renderBinaryBatch((NSData *)batch);
+    XCTAssertNotNil(rendered);
+    NSArray<NSData *> *lines = [self linesOfBatch:(NSData *)rendered];
+    XCTAssertEqual(lines.count, itemCount);
+    for (NSUInteger i = 0; i < MIN(lines.count, itemCount); i++) {
+
+      // Event records render to exactly the bytes the channel writes for them.
+      if ([expectedLines[i] isKindOfClass:[NSData class]]) {
+        XCTAssertEqualObjects(lines[i], expectedLines[i], @"Round %lu, item %lu", (unsigned long)round, (unsigned long)i);
+      }
+      NSDictionary *envelope = [NSJSONSerialization JSONObjectWithData:lines[i] options:(NSJSONReadingOptions)0 error:nil];
+      XCTAssertEqualObjects(envelope, expectedEnvelopes[i], @"Round %lu, item %lu", (unsigned long)round, (unsigned long)i);
+    }
+  }
+}
+
+- (void)testEmptyBatchesAreNotFinished {
+  XCTAssertNil(bit_binaryBatchWriterFinish(self.sut));
+}
+
+- (void)testBatchesAreRenderedFromMappedFiles {
+  NSMutableData *json = [NSMutableData new];
+  NSData *batch = [self batchOfEventCount:100 json:json];
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+  XCTAssertTrue([batch writeToFile:path atomically:YES]);
+
+  NSData *mapped = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:nil];
+  XCTAssertEqualObjects(bit_renderBinaryBatch((NSData *)mapped), json);
+  XCTAssertEqualObjects(bit_decompressData((NSData *)mapped), json);
+  XCTAssertEqualObjects([bit_gzippedDataForUpload((NSData *)mapped) bit_gunzippedData], json);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+#pragma mark - Damage
+
+- (void)testDamagedBatchesAreRejected {
+  srand48(1);
+  NSMutableData *json = [NSMutableData new];
+  NSData *batch = [self batchOfEventCount:10 json:json];
+  XCTAssertEqualObjects(bit_renderBinaryBatch(batch), json);
+
+  for (NSUInteger length = 0; length < batch.length; length++) {
+    XCTAssertNil(bit_renderBinaryBatch([batch subdataWithRange:NSMakeRange(0, length)]), @"Truncated to %lu bytes", (unsigned long)length);
+  }
+  for (NSUInteger i = 0; i < batch.length; i++) {
+    NSMutableData *damaged = [batch mutableCopy];
+    ((uint8_t *)damaged.mutableBytes)[i] ^= (uint8_t)(1 + lrand48() % 255);
+    XCTAssertNil(bit_renderBinaryBatch(damaged), @"Damaged at byte %lu", (unsigned long)i);
+  }
+}
+
+- (void)testOtherDataIsNoBinaryBatch {
+  NSData *json = [@"{\"ver\":1}\n" dataUsingEncoding:NSUTF8StringEncoding];
+  uint64_t itemCount = 0;
+  XCTAssertFalse(bit_isBinaryBatch(json.bytes, json.length));
+  XCTAssertFalse(bit_binaryBatchItemCount(json, &itemCount));
+  XCTAssertNil(bit_renderBinaryBatch(json));
+  XCTAssertEqualObjects(bit_decompressData([json bit_gzippedData]), json);
+}
+
+#pragma mark - Channel
+
+- (void)testChannelPersistsBinaryBatchesOfTheSameItems {
+  NSMutableArray<NSData *> *bundles = [NSMutableArray new];
+  OCMStub([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]).andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSData *bundle;
+    [invocation getArgument:&bundle atIndex:2];
+    [bundles addObject:bundle];
+  });
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = @"Telemetry item";
+
+  for (NSNumber *format in @[@(BITTelemetryBatchFormatJSON), @(BITTelemetryBatchFormatBinary)]) {
+    self.channel.batchFormat = (BITTelemetryBatchFormat)format.unsignedIntegerValue;
+    srand48(2);
+    for (NSUInteger i = 0; i < 50; i++) {
+      BITEventRecord *record = [self randomEventRecord];
+      record->timestamp = 1507801260.123;
+      [self.channel appendEventRecordToEventBuffer:record];
+      bit_eventRecordPoolRelease(record);
+    }
+    [self.channel appendTelemetryDataToEventBuffer:eventData];
+    XCTAssertEqual(self.channel.dataItemCount, (NSUInteger)51);
+    [self.channel persistDataItemQueue:self.channel.eventBuffer];
+  }
+
+  XCTAssertEqual(bundles.count, (NSUInteger)2);
+  XCTAssertTrue([bundles[0] bit_isGzippedData]);
+  XCTAssertTrue(bit_isBinaryBatch(bundles[1].bytes, bundles[1].length));
+  NSArray<NSData *> *jsonLines = [self linesOfBatch:(NSData *)bit_decompressData(bundles[0])];
+  NSArray<NSData *> *binaryLines = [self linesOfBatch:(NSData *)bit_decompressData(bundles[1])];
+  XCTAssertEqual(binaryLines.count, (NSUInteger)51);
+  XCTAssertEqualObjects([binaryLines subarrayWithRange:NSMakeRange(0, 50)], [jsonLines subarrayWithRange:NSMakeRange(0, 50)]);
+  XCTAssertTrue([[[NSString alloc] initWithData:binaryLines.lastObject encoding:NSUTF8StringEncoding] containsString:@"\"Telemetry item\""]);
+}
+
+- (void)testChangingTheFormatPersistsTheCurrentBatch {
+  __block NSData *persistedBundle = nil;
+  OCMStub([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]).andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSData *bundle;
+    [invocation getArgument:&bundle atIndex:2];
+    persistedBundle = bundle;
+  });
+  self.channel.batchFormat = BITTelemetryBatchFormatBinary;
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = @"Binary";
+  [self.channel appendTelemetryDataToEventBuffer:eventData];
+
+  self.channel.batchFormat = BITTelemetryBatchFormatJSON;
+  XCTAssertEqual(self.channel.dataItemCount, (NSUInteger)0);
+  XCTAssertTrue(bit_isBinaryBatch(persistedBundle.bytes, persistedBundle.length));
+  XCTAssertTrue([[[NSString alloc] initWithData:(NSData *)bit_decompressData(persistedBundle) encoding:NSUTF8StringEncoding] containsString:@"\"Binary\""]);
+}
+
+#pragma mark - Size
+
+- (void)testBinaryBatchesAreSmallerThanJSON {
+  srand48(3);
+  NSMutableData *json = [NSMutableData new];
+  NSData *batch = [self batchOfEventCount:1000 json:json];
+  NSData *gzipped = [json bit_gzippedData];
+  NSLog(@"1000 events: binary %lu bytes, JSON %lu bytes, gzipped JSON %lu bytes",
+        (unsigned long)batch.length, (unsigned long)json.length, (unsigned long)gzipped.length);
+  XCTAssertLessThan(batch.length, json.length / 2);
+}
+
+@end
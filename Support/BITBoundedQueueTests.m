@@ -0,0 +1,255 @@
+//
+//  BITBoundedQueueTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+#import "BITBoundedQueue.h"
+
+static NSUInteger const BITBenchmarkProducerCount = 16;
+static NSUInteger const BITBenchmarkEventCount = 1000000;
+
+static _Atomic(long) BITReleasedItemCount;
+
+static void bit_countReleasedItem(void * __unused item) {
+  atomic_fetch_add(&BITReleasedItemCount, 1);
+}
+
+static void *bit_itemWithValue(uintptr_t value) {
+  return (void *)value;
+}
+
+@interface BITBoundedQueueTests : XCTestCase
+
+@property (nonatomic, assign) BITBoundedQueue *sut;
+
+@end
+
+@implementation BITBoundedQueueTests
+
+- (void)setUp {
+  [super setUp];
+  atomic_store(&BITReleasedItemCount, 0);
+  self.sut = bit_boundedQueueCreate(3, bit_countReleasedItem);
+}
+
+- (void)tearDown {
+  bit_boundedQueueDestroy(self.sut);
+  self.sut = NULL;
+  [super tearDown];
+}
+
+- (void)testItemsArePoppedInOrder {
+  XCTAssertEqual(bit_boundedQueueCapacity(self.sut), (size_t)4);
+  for (uintptr_t i = 1; i <= 4; i++) {
+    XCTAssertTrue(bit_boundedQueuePush(self.sut, bit_itemWithValue(i), BITBoundedQueueOverflowDropNewest));
+  }
+  XCTAssertEqual(bit_boundedQueueCount(self.sut), (size_t)4);
+
+  void *item;
+  for (uintptr_t i = 1; i <= 4; i++) {
+    XCTAssertTrue(bit_boundedQueuePop(self.sut, &item));
+    XCTAssertEqual((uintptr_t)item, i);
+  }
+  XCTAssertFalse(bit_boundedQueuePop(self.sut, &item));
+  XCTAssertEqual(bit_boundedQueuePeakCount(self.sut), (size_t)4);
+  XCTAssertEqual(bit_boundedQueueDroppedCount(self.sut), (uint64_t)0);
+}
+
+- (void)testNewestItemIsDroppedWhenFull {
+  for (uintptr_t i = 1; i <= 4; i++) {
+    bit_boundedQueuePush(self.sut, bit_itemWithValue(i), BITBoundedQueueOverflowDropNewest);
+  }
+
+  XCTAssertFalse(bit_boundedQueuePush(self.sut, bit_itemWithValue(5), BITBoundedQueueOverflowDropNewest));
+  XCTAssertEqual(bit_boundedQueueDroppedCount(self.sut), (uint64_t)1);
+  XCTAssertEqual(atomic_load(&BITReleasedItemCount), 1L);
+
+  void *item;
+  XCTAssertTrue(bit_boundedQueuePop(self.sut, &item));
+  XCTAssertEqual((uintptr_t)item, (uintptr_t)1);
+}
+
+- (void)testOldestItemIsDroppedWhenFull {
+  for (uintptr_t i = 1; i <= 4; i++) {
+    bit_boundedQueuePush(self.sut, bit_itemWithValue(i), BITBoundedQueueOverflowDropOldest);
+  }
+
+  XCTAssertTrue(bit_boundedQueuePush(self.sut, bit_itemWithValue(5), BITBoundedQueueOverflowDropOldest));
+  XCTAssertEqual(bit_boundedQueueDroppedCount(self.sut), (uint64_t)1);
+  XCTAssertEqual(atomic_load(&BITReleasedItemCount), 1L);
+
+  void *item;
+  for (uintptr_t i = 2; i <= 5; i++) {
+    XCTAssertTrue(bit_boundedQueuePop(self.sut, &item));
+    XCTAssertEqual((uintptr_t)item, i);
+  }
+}
+
+- (void)testWaitingProducerContinuesOnceThereIsRoom {
+  for (uintptr_t i = 1; i <= 4; i++) {
+    bit_boundedQueuePush(self.sut, bit_itemWithValue(i), BITBoundedQueueOverflowWait);
+  }
+
+  BITBoundedQueue *queue = self.sut;
+  XCTestExpectation *expectation = [self expectationWithDescription:@"Item pushed"];
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+    bit_boundedQueuePush(queue, bit_itemWithValue(5), BITBoundedQueueOverflowWait);
+    [expectation fulfill];
+  });
+  [NSThread sleepForTimeInterval:0.1];
+  XCTAssertEqual(bit_boundedQueueCount(queue), (size_t)4);
+
+  void *item;
+  XCTAssertTrue(bit_boundedQueuePop(queue, &item));
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+  XCTAssertEqual(bit_boundedQueueCount(queue), (size_t)4);
+  XCTAssertEqual(bit_boundedQueueDroppedCount(queue), (uint64_t)0);
+}
+
+- (void)testConsumerIsOnlyScheduledWhileIdle {
+  XCTAssertTrue(bit_boundedQueueScheduleConsumer(self.sut));
+  XCTAssertFalse(bit_boundedQueueScheduleConsumer(self.sut));
+
+  // An item pushed while the consumer is scheduled keeps it going.
+  bit_boundedQueuePush(self.sut, bit_itemWithValue(1), BITBoundedQueueOverflowDropNewest);
+  XCTAssertFalse(bit_boundedQueueScheduleConsumer(self.sut));
+  XCTAssertTrue(bit_boundedQueueConsumerDidFinish(self.sut));
+
+  void *item;
+  XCTAssertTrue(bit_boundedQueuePop(self.sut, &item));
+  XCTAssertFalse(bit_boundedQueueConsumerDidFinish(self.sut));
+  XCTAssertTrue(bit_boundedQueueScheduleConsumer(self.sut));
+}
+
+- (void)testDestroyReleasesQueuedItems {
+  bit_boundedQueuePush(self.sut, bit_itemWithValue(1), BITBoundedQueueOverflowDropNewest);
+  bit_boundedQueuePush(self.sut, bit_itemWithValue(2), BITBoundedQueueOverflowDropNewest);
+  bit_boundedQueueDestroy(self.sut);
+  self.sut = NULL;
+  XCTAssertEqual(atomic_load(&BITReleasedItemCount), 2L);
+}
+
+#pragma mark - Benchmark
+
+typedef struct {
+  _Atomic(uint64_t) consumedCount;
+  uint64_t outOfOrderCount;
+  uintptr_t lastSequence[BITBenchmarkProducerCount];
+} BITBenchmarkConsumer;
+
+static void bit_consumeItem(BITBenchmarkConsumer *consumer, uintptr_t item) {
+  uintptr_t producer = item >> 32;
+  uintptr_t sequence = item & 0xffffffff;
+  if (sequence <= consumer->lastSequence[producer]) {
+    consumer->outOfOrderCount++;
+  }
+  consumer->lastSequence[producer] = sequence;
+  atomic_fetch_add_explicit(&consumer->consumedCount, 1, memory_order_release);
+}
+
+- (CFAbsoluteTime)drainEventsThroughBoundedQueueWithCapacity:(size_t)capacity overflow:(BITBoundedQueueOverflow)overflow consumer:(BITBenchmarkConsumer *)consumer droppedCount:(uint64_t *)droppedCount peakCount:(size_t *)peakCount {
+  BITBoundedQueue *queue = bit_boundedQueueCreate(capacity, NULL);
+  dispatch_queue_t drainQueue = dispatch_queue_create("net.hockeyapp.tests.drain", DISPATCH_QUEUE_SERIAL);
+  NSUInteger eventsPerProducer = BITBenchmarkEventCount / BITBenchmarkProducerCount;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(BITBenchmarkProducerCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t producer) {
+    for (uintptr_t i = 1; i <= eventsPerProducer; i++) {
+      bit_boundedQueuePush(queue, bit_itemWithValue((uintptr_t)producer << 32 | i), overflow);
+      if (bit_boundedQueueScheduleConsumer(queue)) {
+        dispatch_async(drainQueue, ^{
+          do {
+            void *item;
+            while (bit_boundedQueuePop(queue, &item)) {
+              bit_consumeItem(consumer, (uintptr_t)item);
+            }
+          } while (bit_boundedQueueConsumerDidFinish(queue));
+        });
+      }
+    }
+  });
+  dispatch_sync(drainQueue, ^{});
+  CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+
+  *droppedCount = bit_boundedQueueDroppedCount(queue);
+  *peakCount = bit_boundedQueuePeakCount(queue);
+  bit_boundedQueueDestroy(queue);
+  return duration;
+}
+
+- (void)testNoEventIsLostOrReorderedWhenProducersWait {
+  BITBenchmarkConsumer *consumer = calloc(1, sizeof(BITBenchmarkConsumer));
+  uint64_t droppedCount;
+  size_t peakCount;
+  [self drainEventsThroughBoundedQueueWithCapacity:1024 overflow:BITBoundedQueueOverflowWait consumer:consumer droppedCount:&droppedCount peakCount:&peakCount];
+
+  XCTAssertEqual(atomic_load(&consumer->consumedCount), (uint64_t)BITBenchmarkEventCount);
+  XCTAssertEqual(consumer->outOfOrderCount, (uint64_t)0);
+  XCTAssertEqual(droppedCount, (uint64_t)0);
+  XCTAssertLessThanOrEqual(peakCount, (size_t)1024);
+  free(consumer);
+}
+
+- (void)testEveryEventIsEitherConsumedOrCountedAsDropped {
+  for (NSNumber *overflow in @[@(BITBoundedQueueOverflowDropNewest), @(BITBoundedQueueOverflowDropOldest)]) {
+    BITBenchmarkConsumer *consumer = calloc(1, sizeof(BITBenchmarkConsumer));
+    uint64_t droppedCount;
+    size_t peakCount;
+    [self drainEventsThroughBoundedQueueWithCapacity:1024 overflow:(BITBoundedQueueOverflow)overflow.intValue consumer:consumer droppedCount:&droppedCount peakCount:&peakCount];
+
+    XCTAssertEqual(atomic_load(&consumer->consumedCount) + droppedCount, (uint64_t)BITBenchmarkEventCount);
+    XCTAssertEqual(consumer->outOfOrderCount, (uint64_t)0);
+    XCTAssertLessThanOrEqual(peakCount, (size_t)1024);
+    free(consumer);
+  }
+}
+
+- (void)testBoundedQueueComparedToDispatchingABlockPerEvent {
+  NSMutableString *report = [NSMutableString stringWithFormat:@"%lu events from %lu producers:", (unsigned long)BITBenchmarkEventCount, (unsigned long)BITBenchmarkProducerCount];
+  NSArray<NSString *> *names = @[@"drop newest", @"drop oldest", @"wait"];
+  for (BITBoundedQueueOverflow overflow = BITBoundedQueueOverflowDropNewest; overflow <= BITBoundedQueueOverflowWait; overflow++) {
+    BITBenchmarkConsumer *consumer = calloc(1, sizeof(BITBenchmarkConsumer));
+    uint64_t droppedCount;
+    size_t peakCount;
+    CFAbsoluteTime duration = [self drainEventsThroughBoundedQueueWithCapacity:8192 overflow:overflow consumer:consumer droppedCount:&droppedCount peakCount:&peakCount];
+    [report appendFormat:@"\n  bounded queue, %@: %.0f ms, %llu dropped, at most %lu queued", names[overflow], duration * 1000, droppedCount, (unsigned long)peakCount];
+    free(consumer);
+  }
+
+  // The path events took before: a block per event on a concurrent queue, which dispatches another block onto the
+  // serial queue of the channel. Nothing is dropped, but nothing limits the number of pending blocks either.
+  BITBenchmarkConsumer *consumer = calloc(1, sizeof(BITBenchmarkConsumer));
+  dispatch_queue_t eventQueue = dispatch_queue_create("net.hockeyapp.tests.events", DISPATCH_QUEUE_CONCURRENT);
+  dispatch_queue_t channelQueue = dispatch_queue_create("net.hockeyapp.tests.channel", DISPATCH_QUEUE_SERIAL);
+  NSUInteger eventsPerProducer = BITBenchmarkEventCount / BITBenchmarkProducerCount;
+  _Atomic(long) pending;
+  _Atomic(long) *pendingBlocks = &pending;
+  atomic_init(pendingBlocks, 0);
+  __block long peakPending = 0;
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(BITBenchmarkProducerCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t producer) {
+    for (uintptr_t i = 1; i <= eventsPerProducer; i++) {
+      uintptr_t item = (uintptr_t)producer << 32 | i;
+      atomic_fetch_add(pendingBlocks, 1);
+      dispatch_async(eventQueue, ^{
+        dispatch_async(channelQueue, ^{
+          long count = atomic_fetch_sub(pendingBlocks, 1);
+          peakPending = MAX(peakPending, count);
+          bit_consumeItem(consumer, item);
+        });
+      });
+    }
+  });
+  dispatch_barrier_sync(eventQueue, ^{});
+  dispatch_sync(channelQueue, ^{});
+  CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+  XCTAssertEqual(atomic_load(&consumer->consumedCount), (uint64_t)BITBenchmarkEventCount);
+  [report appendFormat:@"\n  block per event: %.0f ms, at most %ld pending", duration * 1000, peakPending];
+  free(consumer);
+
+  NSLog(@"%@", report);
+}
+
+@end
@@ -0,0 +1,342 @@
+//
+//  BITChannelTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
+#import "BITEventData.h"
+#import "BITSessionStateData.h"
+#import "BITMetricsManager.h"
+#import "BITMetricsManagerPrivate.h"
+#import "BITGZIP.h"
+#import "BITPipelineStatistics.h"
+
+static NSUInteger const BITStressThreadCount = 8;
+static NSUInteger const BITStressEventsPerThread = 10000;
+static NSUInteger const BITStressSessionStateInterval = 625;
+static NSUInteger const BITStressCriticalInterval = 160;
+
+// Items that are neither events nor session state, like the ones tracked around a crash.
+@interface BITCriticalTestData : BITTelemetryData
+@end
+
+@implementation BITCriticalTestData
+
+- (NSString *)envelopeTypeName {
+  return @"Microsoft.ApplicationInsights.CriticalTest";
+}
+
+- (NSString *)dataTypeName {
+  return @"CriticalTestData";
+}
+
+@end
+
+@interface BITChannelTests : XCTestCase
+
+@property (nonatomic, strong) BITChannel *sut;
+@property (nonatomic, strong) id persistenceMock;
+
+@end
+
+@implementation BITChannelTests
+
+- (void)setUp {
+  [super setUp];
+  self.persistenceMock = OCMClassMock([BITPersistence class]);
+  BITTelemetryContext *context = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123" persistence:self.persistenceMock];
+  self.sut = [[BITChannel alloc] initWithTelemetryContext:context persistence:self.persistenceMock];
+}
+
+- (BITEventData *)eventWithName:(NSString *)name {
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = name;
+  return eventData;
+}
+
+- (void)testBatchesArePersistedGzipped {
+  __block NSData *persistedBundle = nil;
+  OCMStub([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]).andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSData *bundle;
+    [invocation getArgument:&bundle atIndex:2];
+    persistedBundle = bundle;
+  });
+
+  for (int i = 0; i < 100; i++) {
+    [self.sut appendTelemetryDataToEventBuffer:[self eventWithName:[NSString stringWithFormat:@"Event %d", i]]];
+  }
+  [self.sut persistDataItemQueue:self.sut.eventBuffer];
+
+  XCTAssertTrue([persistedBundle bit_isGzippedData]);
+  NSString *batch = [[NSString alloc] initWithData:[persistedBundle bit_gunzippedData] encoding:NSUTF8StringEncoding];
+  NSArray *lines = [batch componentsSeparatedByString:@"\n"];
+  XCTAssertEqual(lines.count, (NSUInteger)101);
+  XCTAssertEqualObjects(lines.lastObject, @"");
+  for (int i = 0; i < 100; i++) {
+    NSDictionary *envelope = [NSJSONSerialization JSONObjectWithData:[lines[(NSUInteger)i] dataUsingEncoding:NSUTF8StringEncoding] options:(NSJSONReadingOptions)0 error:nil];
+    XCTAssertEqualObjects(envelope[@"data"][@"baseData"][@"name"], ([NSString stringWithFormat:@"Event %d", i]));
+  }
+  XCTAssertLessThan(persistedBundle.length, batch.length / 2);
+  XCTAssertEqual(self.sut.dataItemCount, (NSUInteger)0);
+
+  // The compression stream is reused for the next batch.
+  [self.sut appendTelemetryDataToEventBuffer:[self eventWithName:@"Next"]];
+  [self.sut persistDataItemQueue:self.sut.eventBuffer];
+  XCTAssertTrue([[[NSString alloc] initWithData:[persistedBundle bit_gunzippedData] encoding:NSUTF8StringEncoding] containsString:@"\"Next\""]);
+}
+
+- (void)testBatchesArePersistedWithStorageCodec {
+  __block NSData *persistedBundle = nil;
+  OCMStub([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]).andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSData *bundle;
+    [invocation getArgument:&bundle atIndex:2];
+    persistedBundle = bundle;
+  });
+
+  self.sut.storageCodec = BITCompressionCodecDeflateDictionary;
+  XCTAssertEqual(self.sut.storageCodec, BITCompressionCodecDeflateDictionary);
+  [self.sut appendTelemetryDataToEventBuffer:[self eventWithName:@"Event"]];
+  [self.sut persistDataItemQueue:self.sut.eventBuffer];
+
+  BITCompressionCodec codec = BITCompressionCodecGzip;
+  XCTAssertTrue(bit_compressionCodecOfData(persistedBundle, &codec));
+  XCTAssertEqual(codec, BITCompressionCodecDeflateDictionary);
+  NSString *batch = [[NSString alloc] initWithData:(NSData *)bit_decompressData(persistedBundle) encoding:NSUTF8StringEncoding];
+  XCTAssertTrue([batch containsString:@"\"Event\""]);
+}
+
+- (void)testBatchingPolicyDecidesWhenBatchesArePersisted {
+  OCMStub([self.persistenceMock isFreeSpaceAvailable]).andReturn(YES);
+  id policyMock = OCMProtocolMock(@protocol(BITBatchingPolicy));
+  OCMStub([policyMock shouldPersistBatchWithItemCount:0 length:0 addedAt:0]).ignoringNonObjectArgs().andDo(^(NSInvocation *invocation) {
+    NSUInteger itemCount;
+    [invocation getArgument:&itemCount atIndex:2];
+    BOOL shouldPersist = itemCount >= 2;
+    [invocation setReturnValue:&shouldPersist];
+  });
+  OCMStub([policyMock flushIntervalForBatchStartedAt:0]).ignoringNonObjectArgs().andReturn(60.0);
+  OCMExpect([policyMock didPersistBatchWithItemCount:2 length:0 compressedLength:0]).ignoringNonObjectArgs();
+  self.sut.batchingPolicy = policyMock;
+
+  [self.sut enqueueTelemetryItem:[self eventWithName:@"First"]];
+  dispatch_sync(self.sut.dataItemsOperations, ^{});
+  XCTAssertEqual(self.sut.dataItemCount, (NSUInteger)1);
+  XCTAssertNotEqual(self.sut.flushTimeout, (BITTimeoutIdentifier)0);
+
+  [self.sut enqueueTelemetryItem:[self eventWithName:@"Second"]];
+  dispatch_sync(self.sut.dataItemsOperations, ^{});
+  XCTAssertEqual(self.sut.dataItemCount, (NSUInteger)0);
+  XCTAssertEqual(self.sut.batchLength, (NSUInteger)0);
+  OCMVerify([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]);
+  XCTAssertEqual(self.sut.flushTimeout, (BITTimeoutIdentifier)0);
+  OCMVerifyAll(policyMock);
+
+  // Resetting the policy restores the default.
+  self.sut.batchingPolicy = nil;
+  XCTAssertTrue([self.sut.batchingPolicy isKindOfClass:[BITFixedBatchingPolicy class]]);
+}
+
+- (void)testItemsEnqueuedWhileTheItemQueueIsFullAreDroppedAndCounted {
+  OCMStub([self.persistenceMock isFreeSpaceAvailable]).andReturn(YES);
+  self.sut.overflowPolicy = BITTelemetryOverflowPolicyDropNewest;
+  size_t capacity = bit_boundedQueueCapacity([self.sut itemQueueForLane:BITChannelLaneEvents]);
+
+  // Nothing is taken out of the item queue while the channel's queue is suspended.
+  dispatch_suspend(self.sut.dataItemsOperations);
+  for (size_t i = 0; i < capacity + 10; i++) {
+    [self.sut enqueueTelemetryItem:[self eventWithName:@"Event"]];
+  }
+  XCTAssertEqual(self.sut.overflowedItemCount, (uint64_t)10);
+  XCTAssertEqual(bit_boundedQueueCount([self.sut itemQueueForLane:BITChannelLaneEvents]), capacity);
+
+  dispatch_resume(self.sut.dataItemsOperations);
+  dispatch_sync(self.sut.dataItemsOperations, ^{});
+  XCTAssertEqual(bit_boundedQueueCount([self.sut itemQueueForLane:BITChannelLaneEvents]), (size_t)0);
+}
+
+- (void)testItemsLeftWhenTheChannelGoesAwayAreNotCountedAsOverflow {
+  OCMStub([self.persistenceMock isFreeSpaceAvailable]).andReturn(YES);
+  dispatch_queue_t dataItemsOperations = self.sut.dataItemsOperations;
+  BITPipelineStatistics before;
+  bit_pipelineStatisticsRead(&before);
+
+  // The items are still queued when the channel is deallocated.
+  dispatch_suspend(dataItemsOperations);
+  @autoreleasepool {
+    for (int i = 0; i < 10; i++) {
+      [self.sut enqueueEventWithName:@"Event" properties:nil measurements:nil sampleRate:0];
+    }
+    self.sut = nil;
+  }
+  dispatch_resume(dataItemsOperations);
+  dispatch_sync(dataItemsOperations, ^{});
+
+  BITPipelineStatistics after;
+  bit_pipelineStatisticsRead(&after);
+  XCTAssertEqual(after.counters[BITTelemetryCounterItemsDroppedOnOverflow], before.counters[BITTelemetryCounterItemsDroppedOnOverflow]);
+}
+
+- (void)testBatchesWithSessionStateArePersistedWithHighPriority {
+  [self.sut appendTelemetryDataToEventBuffer:[self eventWithName:@"Event"]];
+  [self.sut appendTelemetryDataToEventBuffer:[BITSessionStateData new]];
+  [self.sut persistDataItemQueue:self.sut.eventBuffer];
+  OCMVerify([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityHigh]);
+
+  [self.sut appendTelemetryDataToEventBuffer:[self eventWithName:@"Event"]];
+  [self.sut persistDataItemQueue:self.sut.eventBuffer];
+  OCMVerify([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]);
+}
+
+- (void)testItemsTrackedRightAfterASessionStartCarryTheNewSession {
+  OCMStub([self.persistenceMock isFreeSpaceAvailable]).andReturn(YES);
+  NSMutableArray<NSData *> *bundles = [NSMutableArray new];
+  OCMStub([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]).ignoringNonObjectArgs().andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSData *bundle;
+    [invocation getArgument:&bundle atIndex:2];
+    [bundles addObject:bundle];
+  });
+  NSString *suiteName = [NSUUID UUID].UUIDString;
+  NSUserDefaults *userDefaults = [[NSUserDefaults alloc] initWithSuiteName:suiteName];
+  BITMetricsManager *manager = [[BITMetricsManager alloc] initWithChannel:self.sut telemetryContext:self.sut.telemetryContext persistence:self.persistenceMock userDefaults:userDefaults];
+
+  for (NSUInteger i = 0; i < 100; i++) {
+    [manager startNewSessionWithId:[NSString stringWithFormat:@"session %lu", (unsigned long)i]];
+    [manager trackEventWithName:[NSString stringWithFormat:@"session %lu", (unsigned long)i]];
+  }
+  dispatch_sync(self.sut.dataItemsOperations, ^{
+    [self.sut drainItemQueues];
+    [self.sut persistDataItemQueue:self.sut.eventBuffer];
+  });
+
+  // The session start carries the session it starts, the event after it carries the session it's named after.
+  NSUInteger sessionStartCount = 0;
+  NSUInteger eventCount = 0;
+  for (NSData *bundle in bundles) {
+    NSString *batch = [[NSString alloc] initWithData:[bundle bit_gunzippedData] encoding:NSUTF8StringEncoding];
+    for (NSString *line in [batch componentsSeparatedByString:@"\n"]) {
+      if (line.length == 0) {
+        continue;
+      }
+      NSDictionary *envelope = [NSJSONSerialization JSONObjectWithData:(NSData *)[line dataUsingEncoding:NSUTF8StringEncoding] options:(NSJSONReadingOptions)0 error:nil];
+      NSString *sessionId = envelope[@"tags"][@"ai.session.id"];
+      if ([envelope[@"data"][@"baseType"] isEqualToString:@"EventData"]) {
+        XCTAssertEqualObjects(sessionId, envelope[@"data"][@"baseData"][@"name"]);
+        eventCount++;
+      } else {
+        XCTAssertEqualObjects(sessionId, ([NSString stringWithFormat:@"session %lu", (unsigned long)sessionStartCount]));
+        XCTAssertEqualObjects(envelope[@"tags"][@"ai.session.isNew"], @"true");
+        sessionStartCount++;
+      }
+    }
+  }
+  XCTAssertEqual(sessionStartCount, (NSUInteger)100);
+  XCTAssertEqual(eventCount, (NSUInteger)100);
+  [userDefaults removePersistentDomainForName:suiteName];
+}
+
+- (void)testEmptyBufferIsNotPersisted {
+  [[self.persistenceMock reject] persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault];
+  [self.sut persistDataItemQueue:self.sut.eventBuffer];
+  OCMVerifyAll(self.persistenceMock);
+}
+
+- (void)testSessionStateIsDeliveredWhileEventsSaturateTheLanes {
+  __block BOOL storageFull = NO;
+  OCMStub([self.persistenceMock isFreeSpaceAvailable]).andDo(^(NSInvocation *invocation) {
+    BOOL available = !storageFull;
+    [invocation setReturnValue:&available];
+  });
+  NSMutableArray<NSData *> *bundles = [NSMutableArray new];
+  OCMStub([self.persistenceMock persistBundle:[OCMArg any] priority:BITPersistencePriorityDefault]).ignoringNonObjectArgs().andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSData *bundle;
+    [invocation getArgument:&bundle atIndex:2];
+    @synchronized(bundles) {
+      [bundles addObject:bundle];
+    }
+  });
+  self.sut.overflowPolicy = BITTelemetryOverflowPolicyDropOldest;
+
+  // All threads enqueue while the channel's queue is suspended, so the queues of the lanes overflow.
+  dispatch_suspend(self.sut.dataItemsOperations);
+  dispatch_apply(BITStressThreadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+    for (NSUInteger i = 0; i < BITStressEventsPerThread; i++) {
+      [self.sut enqueueEventWithName:@"Burst" properties:nil measurements:nil sampleRate:0];
+      if (i % BITStressSessionStateInterval == 0) {
+        [self.sut enqueueTelemetryItem:[BITSessionStateData new]];
+      }
+      if (i % BITStressCriticalInterval == 0) {
+        [self.sut enqueueTelemetryItem:[BITCriticalTestData new]];
+      }
+    }
+  });
+  dispatch_resume(self.sut.dataItemsOperations);
+  dispatch_sync(self.sut.dataItemsOperations, ^{
+    [self.sut persistDataItemQueue:self.sut.eventBuffer];
+  });
+
+  uint64_t eventCount = BITStressThreadCount * BITStressEventsPerThread;
+  uint64_t sessionStateCount = BITStressThreadCount * ((BITStressEventsPerThread + BITStressSessionStateInterval - 1) / BITStressSessionStateInterval);
+  uint64_t criticalCount = BITStressThreadCount * ((BITStressEventsPerThread + BITStressCriticalInterval - 1) / BITStressCriticalInterval);
+  BITChannelLaneStatistics sessionState = [self.sut statisticsForLane:BITChannelLaneSessionState];
+  BITChannelLaneStatistics critical = [self.sut statisticsForLane:BITChannelLaneCritical];
+  BITChannelLaneStatistics events = [self.sut statisticsForLane:BITChannelLaneEvents];
+  NSLog(@"Delivery ratios under saturation: session state %.3f, critical %.3f, events %.3f",
+        (double)sessionState.deliveredCount / (double)sessionStateCount, (double)critical.deliveredCount / (double)criticalCount,
+        (double)events.deliveredCount / (double)eventCount);
+  XCTAssertEqual(sessionState.deliveredCount, sessionStateCount);
+  XCTAssertEqual(sessionState.overflowedCount, (uint64_t)0);
+  XCTAssertEqual(critical.deliveredCount, criticalCount);
+  XCTAssertEqual(critical.overflowedCount, (uint64_t)0);
+  XCTAssertEqual(events.deliveredCount + events.overflowedCount, eventCount);
+  XCTAssertLessThanOrEqual(events.deliveredCount, (uint64_t)bit_boundedQueueCapacity([self.sut itemQueueForLane:BITChannelLaneEvents]));
+  XCTAssertGreaterThan(events.overflowedCount, (uint64_t)0);
+
+  // The weights let session state overtake the events that were enqueued before it.
+  NSUInteger index = 0;
+  NSUInteger lastSessionStateIndex = 0;
+  NSUInteger deliveredSessionStateCount = 0;
+  for (NSData *bundle in bundles) {
+    NSString *batch = [[NSString alloc] initWithData:[bundle bit_gunzippedData] encoding:NSUTF8StringEncoding];
+    for (NSString *line in [batch componentsSeparatedByString:@"\n"]) {
+      if (line.length == 0) {
+        continue;
+      }
+      if ([line containsString:@"\"SessionStateData\""]) {
+        lastSessionStateIndex = index;
+        deliveredSessionStateCount++;
+      }
+      index++;
+    }
+  }
+  XCTAssertEqual(deliveredSessionStateCount, (NSUInteger)sessionStateCount);
+  XCTAssertLessThan(lastSessionStateIndex, (NSUInteger)(2 * sessionStateCount));
+
+  // Once the storage is full, the lanes that may drop items do so while session state is still written.
+  storageFull = YES;
+  for (NSUInteger i = 0; i < 1000; i++) {
+    [self.sut enqueueEventWithName:@"Blocked" properties:nil measurements:nil sampleRate:0];
+    [self.sut enqueueTelemetryItem:[BITCriticalTestData new]];
+    if (i % 100 == 0) {
+      [self.sut enqueueTelemetryItem:[BITSessionStateData new]];
+    }
+  }
+  dispatch_sync(self.sut.dataItemsOperations, ^{});
+
+  BITChannelLaneStatistics blockedSessionState = [self.sut statisticsForLane:BITChannelLaneSessionState];
+  BITChannelLaneStatistics blockedCritical = [self.sut statisticsForLane:BITChannelLaneCritical];
+  BITChannelLaneStatistics blockedEvents = [self.sut statisticsForLane:BITChannelLaneEvents];
+  XCTAssertEqual(blockedSessionState.deliveredCount, sessionStateCount + 10);
+  XCTAssertEqual(blockedSessionState.blockedCount, (uint64_t)0);
+  XCTAssertEqual(blockedCritical.deliveredCount, criticalCount);
+  XCTAssertEqual(blockedCritical.blockedCount, (uint64_t)1000);
+  XCTAssertEqual(blockedEvents.deliveredCount, events.deliveredCount);
+  XCTAssertEqual(blockedEvents.blockedCount, (uint64_t)1000);
+}
+
+@end
@@ -0,0 +1,174 @@
+//
+//  BITCompressionTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import "BITCompression.h"
+#import "BITGZIP.h"
+#import <zlib.h>
+
+typedef struct {
+  const void *input;
+  size_t inputLength;
+  size_t inputOffset;
+  size_t maximumChunkLength;
+  void *output;
+  bool compressInOutput;
+} BITTestStreamContext;
+
+static long bit_testReadInput(void *_Nullable context, void *buffer, size_t capacity) {
+  BITTestStreamContext *stream = context;
+  size_t length = MIN(MIN(capacity, stream->maximumChunkLength), stream->inputLength - stream->inputOffset);
+  memcpy(buffer, (const char *)stream->input + stream->inputOffset, length);
+  stream->inputOffset += length;
+  return (long)length;
+}
+
+static bool bit_testWriteOutput(void *_Nullable context, const void *bytes, size_t length) {
+  BITTestStreamContext *stream = context;
+  [(__bridge NSMutableData *)stream->output appendBytes:bytes length:length];
+
+  // Compressing from within a callback must not disturb the stream that is running on the same thread.
+  return !stream->compressInOutput || [bit_gunzipData((NSData *)bit_gzipData([NSData dataWithBytes:bytes length:length], 1)) length] == length;
+}
+
+@interface BITCompressionTests : XCTestCase
+
+@end
+
+@implementation BITCompressionTests
+
+- (NSData *)batchWithItemCount:(NSUInteger)itemCount {
+  NSMutableString *batch = [NSMutableString new];
+  for (NSUInteger i = 0; i < itemCount; i++) {
+    [batch appendFormat:@"{\"ver\":1,\"name\":\"Microsoft.ApplicationInsights.Event\",\"time\":\"2017-01-01T00:00:%02lu.000Z\","
+                         "\"tags\":{\"ai.device.os\":\"OS X\"},\"data\":{\"baseType\":\"EventData\",\"baseData\":{\"ver\":2,\"name\":\"Event %lu\"}}}\n",
+                        (unsigned long)(i % 60), (unsigned long)i];
+  }
+  return [batch dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (NSArray<NSNumber *> *)availableCodecs {
+  NSMutableArray *codecs = [NSMutableArray new];
+  for (BITCompressionCodec codec = BITCompressionCodecGzip; codec <= BITCompressionCodecLZFSE; codec++) {
+    if (bit_compressionCodecIsAvailable(codec)) {
+      [codecs addObject:@(codec)];
+    }
+  }
+  return codecs;
+}
+
+- (void)testEveryCodecRoundTrips {
+  NSData *batch = [self batchWithItemCount:50];
+  for (NSNumber *codecNumber in [self availableCodecs]) {
+    BITCompressionCodec codec = (BITCompressionCodec)codecNumber.unsignedCharValue;
+    NSData *compressed = bit_compressData(batch, codec);
+    XCTAssertNotNil(compressed);
+    XCTAssertLessThan(compressed.length, batch.length / 4, @"Codec %u", codec);
+
+    BITCompressionCodec detectedCodec = BITCompressionCodecGzip;
+    XCTAssertTrue(bit_compressionCodecOfData((NSData *)compressed, &detectedCodec));
+    XCTAssertEqual(detectedCodec, codec);
+    XCTAssertEqualObjects(bit_decompressData((NSData *)compressed), batch, @"Codec %u", codec);
+  }
+}
+
+- (void)testCompressorIsReusedForChunkedInput {
+  NSData *batch = [self batchWithItemCount:500];
+  for (NSNumber *codecNumber in [self availableCodecs]) {
+    BITCompressor *compressor = bit_compressorCreate((BITCompressionCodec)codecNumber.unsignedCharValue);
+    XCTAssertTrue(compressor != NULL);
+    for (int stream = 0; stream < 3; stream++) {
+
+      // A too small expected length forces the output to grow.
+      NSMutableData *output = [NSMutableData new];
+      XCTAssertTrue(bit_compressorBegin(compressor, output, 16));
+      for (NSUInteger offset = 0; offset < batch.length; offset += 1000) {
+        XCTAssertTrue(bit_compressorWrite(compressor, (const char *)batch.bytes + offset, MIN((NSUInteger)1000, batch.length - offset)));
+      }
+      XCTAssertTrue(bit_compressorFinish(compressor));
+      XCTAssertEqualObjects(bit_decompressData(output), batch);
+    }
+    bit_compressorDestroy(compressor);
+  }
+}
+
+- (void)testPresetDictionaryImprovesSmallBatches {
+  NSData *batch = [self batchWithItemCount:1];
+  NSData *gzipped = bit_compressData(batch, BITCompressionCodecGzip);
+  NSData *dictionaryCompressed = bit_compressData(batch, BITCompressionCodecDeflateDictionary);
+  XCTAssertLessThan(dictionaryCompressed.length, gzipped.length);
+}
+
+- (void)testUncompressedDataIsNotDetected {
+  NSData *batch = [self batchWithItemCount:1];
+  XCTAssertFalse(bit_compressionCodecOfData(batch, NULL));
+  XCTAssertEqualObjects(bit_decompressData(batch), batch);
+}
+
+- (void)testDamagedDataIsNotDecompressed {
+  NSMutableData *compressed = [bit_compressData([self batchWithItemCount:50], BITCompressionCodecDeflateDictionary) mutableCopy];
+  compressed.length = compressed.length / 2;
+  XCTAssertNil(bit_decompressData(compressed));
+  XCTAssertNil(bit_gzippedDataForUpload(compressed));
+}
+
+- (void)testDataIsGzippedForUpload {
+  NSData *batch = [self batchWithItemCount:50];
+  NSData *gzipped = bit_compressData(batch, BITCompressionCodecGzip);
+  XCTAssertEqualObjects(bit_gzippedDataForUpload((NSData *)gzipped), gzipped);
+
+  for (NSData *stored in @[batch, (NSData *)bit_compressData(batch, BITCompressionCodecDeflateDictionary)]) {
+    NSData *uploaded = bit_gzippedDataForUpload(stored);
+    XCTAssertTrue([uploaded bit_isGzippedData]);
+    XCTAssertEqualObjects([uploaded bit_gunzippedData], batch);
+  }
+}
+
+- (NSData *)streamData:(NSData *)data gzip:(BOOL)gzip chunkLength:(size_t)chunkLength compressInOutput:(BOOL)compressInOutput {
+  NSMutableData *output = [NSMutableData new];
+  BITTestStreamContext context = {
+    .input = data.bytes,
+    .inputLength = data.length,
+    .maximumChunkLength = chunkLength,
+    .output = (__bridge void *)output,
+    .compressInOutput = compressInOutput
+  };
+  bool success = gzip ? bit_gzipStream(Z_DEFAULT_COMPRESSION, bit_testReadInput, bit_testWriteOutput, &context)
+                      : bit_gunzipStream(bit_testReadInput, bit_testWriteOutput, &context);
+  return success ? output : nil;
+}
+
+- (void)testStreamsRoundTripInChunks {
+  NSData *batch = [self batchWithItemCount:20000];
+  for (size_t chunkLength = 100; chunkLength <= 100000; chunkLength *= 10) {
+    NSData *gzipped = [self streamData:batch gzip:YES chunkLength:chunkLength compressInOutput:(chunkLength == 1000)];
+    XCTAssertTrue([gzipped bit_isGzippedData]);
+    XCTAssertEqualObjects([gzipped bit_gunzippedData], batch);
+    XCTAssertEqualObjects([self streamData:(NSData *)gzipped gzip:NO chunkLength:chunkLength compressInOutput:NO], batch);
+  }
+}
+
+- (void)testStreamFailsIfInputEndsEarly {
+  NSMutableData *gzipped = [bit_gzipData([self batchWithItemCount:500], Z_DEFAULT_COMPRESSION) mutableCopy];
+  gzipped.length -= 100;
+  XCTAssertNil([self streamData:gzipped gzip:NO chunkLength:1000 compressInOutput:NO]);
+
+  // The next stream on the thread starts from a clean state.
+  NSData *batch = [self batchWithItemCount:10];
+  XCTAssertEqualObjects(bit_gunzipData((NSData *)bit_gzipData(batch, Z_DEFAULT_COMPRESSION)), batch);
+}
+
+- (void)testGzipCategoryRoundTripsLargeData {
+  NSData *batch = [self batchWithItemCount:40000];
+  for (NSNumber *level in @[@(-1.0f), @0.0f, @0.5f, @1.0f]) {
+    NSData *gzipped = [batch bit_gzippedDataWithCompressionLevel:level.floatValue];
+    XCTAssertTrue([gzipped bit_isGzippedData]);
+    XCTAssertEqualObjects([gzipped bit_gunzippedData], batch);
+  }
+  XCTAssertNil([[NSData data] bit_gzippedData]);
+  XCTAssertNil([[NSData data] bit_gunzippedData]);
+}
+
+@end
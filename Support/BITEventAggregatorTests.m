@@ -0,0 +1,240 @@
+//
+//  BITEventAggregatorTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import "BITEventAggregator.h"
+#import "BITEventData.h"
+
+@interface BITEventAggregatorTests : XCTestCase
+
+@property (nonatomic, strong) BITEventAggregator *sut;
+@property (nonatomic, strong) NSMutableArray<BITEventData *> *trackedEvents;
+
+@end
+
+@implementation BITEventAggregatorTests
+
+- (void)setUp {
+  [super setUp];
+  NSMutableArray<BITEventData *> *trackedEvents = [NSMutableArray new];
+  self.trackedEvents = trackedEvents;
+  self.sut = [[BITEventAggregator alloc] initWithHandler:^(BITEventData *eventData) {
+    @synchronized(trackedEvents) {
+      [trackedEvents addObject:eventData];
+    }
+  }];
+}
+
+- (void)tearDown {
+  self.sut = nil;
+  [super tearDown];
+}
+
+- (void)testEventsAreTrackedRightAwayByDefault {
+  [self.sut addEventWithName:@"Click" properties:@{@"button" : @"ok"} measurements:@{@"duration" : @3}];
+
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)1);
+  BITEventData *eventData = self.trackedEvents.firstObject;
+  XCTAssertEqualObjects(eventData.name, @"Click");
+  XCTAssertEqualObjects(eventData.properties, @{@"button" : @"ok"});
+  XCTAssertEqualObjects(eventData.measurements, @{@"duration" : @3});
+  XCTAssertNil(eventData.sampleRate);
+  XCTAssertEqual(self.sut.aggregateCount, (NSUInteger)0);
+}
+
+- (void)testIdenticalEventsAreRolledUpIntoOneEvent {
+  [self.sut setAggregationEnabled:YES forEventWithName:@"Scroll"];
+  for (NSNumber *distance in @[@0.5, @5, @50, @50, @20000]) {
+    [self.sut addEventWithName:@"Scroll" properties:@{@"view" : @"list"} measurements:@{@"distance" : distance}];
+  }
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)0);
+  XCTAssertEqual(self.sut.aggregateCount, (NSUInteger)1);
+
+  [self.sut flush];
+
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)1);
+  BITEventData *eventData = self.trackedEvents.firstObject;
+  XCTAssertEqualObjects(eventData.name, @"Scroll");
+  XCTAssertEqualObjects(eventData.properties, @{@"view" : @"list"});
+  XCTAssertEqualWithAccuracy(eventData.sampleRate.doubleValue, 20.0, 1e-9);
+
+  NSDictionary<NSString *, NSNumber *> *measurements = eventData.measurements;
+  XCTAssertEqualObjects(measurements[@"aggregate.count"], @5);
+  XCTAssertEqualWithAccuracy(measurements[@"distance"].doubleValue, 20105.5 / 5, 1e-9);
+  XCTAssertEqualWithAccuracy(measurements[@"distance.sum"].doubleValue, 20105.5, 1e-9);
+  XCTAssertEqualObjects(measurements[@"distance.min"], @0.5);
+  XCTAssertEqualObjects(measurements[@"distance.max"], @20000);
+  XCTAssertEqualObjects(measurements[@"distance.le.1"], @1);
+  XCTAssertEqualObjects(measurements[@"distance.le.10"], @1);
+  XCTAssertEqualObjects(measurements[@"distance.le.100"], @2);
+  XCTAssertEqualObjects(measurements[@"distance.le.1000"], @0);
+  XCTAssertEqualObjects(measurements[@"distance.le.10000"], @0);
+  XCTAssertEqualObjects(measurements[@"distance.gt.10000"], @1);
+  XCTAssertEqual(self.sut.aggregateCount, (NSUInteger)0);
+}
+
+- (void)testMeasurementsMissingFromSomeEventsStillExtrapolateToTheirSum {
+  [self.sut setAggregationEnabled:YES forEventWithName:@"Load"];
+  [self.sut addEventWithName:@"Load" properties:nil measurements:@{@"duration" : @6, @"size" : @100}];
+  [self.sut addEventWithName:@"Load" properties:nil measurements:@{@"duration" : @3}];
+  [self.sut addEventWithName:@"Load" properties:nil measurements:@{@"duration" : @3}];
+  [self.sut addEventWithName:@"Load" properties:nil measurements:nil];
+  [self.sut flush];
+
+  BITEventData *eventData = self.trackedEvents.firstObject;
+  NSDictionary<NSString *, NSNumber *> *measurements = eventData.measurements;
+  double extrapolation = 100 / eventData.sampleRate.doubleValue;
+  XCTAssertEqualWithAccuracy(measurements[@"duration"].doubleValue * extrapolation, 12, 1e-9);
+  XCTAssertEqualWithAccuracy(measurements[@"size"].doubleValue * extrapolation, 100, 1e-9);
+  XCTAssertEqualObjects(measurements[@"duration.count"], @3);
+  XCTAssertEqualObjects(measurements[@"size.count"], @1);
+  XCTAssertEqualObjects(measurements[@"size.sum"], @100);
+}
+
+- (void)testEventsWithDifferentPropertiesAreAggregatedSeparately {
+  [self.sut setAggregationEnabled:YES forEventWithName:@"Scroll"];
+  [self.sut addEventWithName:@"Scroll" properties:@{@"view" : @"list", @"mode" : @"dark"} measurements:nil];
+  [self.sut addEventWithName:@"Scroll" properties:@{@"mode" : @"dark", @"view" : @"list"} measurements:nil];
+  [self.sut addEventWithName:@"Scroll" properties:@{@"view" : @"grid"} measurements:nil];
+  [self.sut addEventWithName:@"Scroll" properties:nil measurements:nil];
+  XCTAssertEqual(self.sut.aggregateCount, (NSUInteger)3);
+
+  [self.sut flush];
+
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)3);
+  NSMutableDictionary<NSDictionary *, NSNumber *> *counts = [NSMutableDictionary new];
+  for (BITEventData *eventData in self.trackedEvents) {
+    counts[eventData.properties] = eventData.measurements[@"aggregate.count"];
+  }
+  XCTAssertEqualObjects(counts, (@{@{@"view" : @"list", @"mode" : @"dark"} : @2, @{@"view" : @"grid"} : @1, @{} : @1}));
+}
+
+- (void)testDisablingAggregationTracksCollectedAggregates {
+  [self.sut setAggregationEnabled:YES forEventWithName:@"Scroll"];
+  [self.sut addEventWithName:@"Scroll" properties:nil measurements:nil];
+  XCTAssertTrue([self.sut isAggregationEnabledForEventWithName:@"Scroll"]);
+
+  [self.sut setAggregationEnabled:NO forEventWithName:@"Scroll"];
+  XCTAssertFalse([self.sut isAggregationEnabledForEventWithName:@"Scroll"]);
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)1);
+
+  [self.sut addEventWithName:@"Scroll" properties:nil measurements:nil];
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)2);
+  XCTAssertNil(self.trackedEvents.lastObject.sampleRate);
+}
+
+- (void)testSamplingNothingOrEverything {
+  [self.sut setSamplingPercentage:0 forEventWithName:@"Dropped"];
+  [self.sut setSamplingPercentage:250 forEventWithName:@"Kept"];
+  XCTAssertEqual([self.sut samplingPercentageForEventWithName:@"Kept"], 100.0);
+  XCTAssertEqual([self.sut samplingPercentageForEventWithName:@"Other"], 100.0);
+
+  for (int i = 0; i < 1000; i++) {
+    [self.sut addEventWithName:@"Dropped" properties:nil measurements:nil];
+    [self.sut addEventWithName:@"Kept" properties:nil measurements:nil];
+  }
+
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)1000);
+  for (BITEventData *eventData in self.trackedEvents) {
+    XCTAssertEqualObjects(eventData.name, @"Kept");
+    XCTAssertNil(eventData.sampleRate);
+  }
+}
+
+- (void)testSampledEventsCarryTheirSampleRate {
+  [self.sut setSamplingPercentage:25 forEventWithName:@"Tick"];
+  NSUInteger eventCount = 100000;
+  for (NSUInteger i = 0; i < eventCount; i++) {
+    [self.sut addEventWithName:@"Tick" properties:nil measurements:nil];
+  }
+
+  // The expected 25000 events have a standard deviation of about 137, this is more than 7 of them.
+  XCTAssertEqualWithAccuracy((double)self.trackedEvents.count, 25000.0, 1000.0);
+  for (BITEventData *eventData in self.trackedEvents) {
+    XCTAssertEqualObjects(eventData.sampleRate, @25);
+  }
+}
+
+- (void)testSampledEventsAreWeightedInAggregates {
+  [self.sut setSamplingPercentage:10 forEventWithName:@"Tick"];
+  [self.sut setAggregationEnabled:YES forEventWithName:@"Tick"];
+  NSUInteger eventCount = 100000;
+  for (NSUInteger i = 0; i < eventCount; i++) {
+    [self.sut addEventWithName:@"Tick" properties:nil measurements:@{@"value" : @2}];
+  }
+  [self.sut flush];
+
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)1);
+  NSDictionary<NSString *, NSNumber *> *measurements = self.trackedEvents.firstObject.measurements;
+  double count = measurements[@"aggregate.count"].doubleValue;
+  XCTAssertEqualWithAccuracy(count, (double)eventCount, 0.1 * (double)eventCount);
+  XCTAssertEqualWithAccuracy(fmod(count, 10), 0, 1e-6);
+  XCTAssertEqualWithAccuracy(self.trackedEvents.firstObject.sampleRate.doubleValue, 100 / count, 1e-12);
+  XCTAssertEqualWithAccuracy(measurements[@"value"].doubleValue, 2, 1e-9);
+  XCTAssertEqualWithAccuracy(measurements[@"value.sum"].doubleValue, 2 * count, 1e-6);
+  XCTAssertEqualWithAccuracy(measurements[@"value.le.10"].doubleValue, count, 1e-6);
+}
+
+- (void)testAggregatesAreTrackedOnceTheIntervalHasPassed {
+  NSMutableArray<BITEventData *> *trackedEvents = [NSMutableArray new];
+  XCTestExpectation *expectation = [self expectationWithDescription:@"Aggregate tracked"];
+  BITEventAggregator *sut = [[BITEventAggregator alloc] initWithHandler:^(BITEventData *eventData) {
+    [trackedEvents addObject:eventData];
+    [expectation fulfill];
+  }];
+  sut.interval = 0.2;
+  [sut setAggregationEnabled:YES forEventWithName:@"Scroll"];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [sut addEventWithName:@"Scroll" properties:nil measurements:nil];
+  [sut addEventWithName:@"Scroll" properties:nil measurements:nil];
+
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+
+  XCTAssertGreaterThanOrEqual(CFAbsoluteTimeGetCurrent() - start, 0.15);
+  XCTAssertEqualObjects(trackedEvents.firstObject.measurements[@"aggregate.count"], @2);
+  XCTAssertEqual(sut.aggregateCount, (NSUInteger)0);
+}
+
+- (void)testExceedingTheMaxAggregateCountTracksAllAggregates {
+  self.sut.maxAggregateCount = 10;
+  [self.sut setAggregationEnabled:YES forEventWithName:@"Open"];
+  for (int i = 0; i < 10; i++) {
+    [self.sut addEventWithName:@"Open" properties:@{@"file" : @(i).stringValue} measurements:nil];
+  }
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)0);
+
+  [self.sut addEventWithName:@"Open" properties:@{@"file" : @"10"} measurements:nil];
+
+  XCTAssertEqual(self.trackedEvents.count, (NSUInteger)11);
+  XCTAssertEqual(self.sut.aggregateCount, (NSUInteger)0);
+}
+
+- (void)testAggregationReducesTheNumberOfTrackedEvents {
+  [self.sut setAggregationEnabled:YES forEventWithName:@"MouseMoved"];
+  NSArray<NSString *> *views = @[@"sidebar", @"list", @"detail", @"toolbar"];
+  NSUInteger eventCount = 100000;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(8, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+    for (NSUInteger i = 0; i < eventCount / 8; i++) {
+      [self.sut addEventWithName:@"MouseMoved"
+                      properties:@{@"view" : views[(thread + i) % views.count]}
+                    measurements:@{@"distance" : @(i % 200)}];
+    }
+  });
+  [self.sut flush];
+  CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+
+  XCTAssertEqual(self.trackedEvents.count, views.count);
+  double count = 0;
+  for (BITEventData *eventData in self.trackedEvents) {
+    count += eventData.measurements[@"aggregate.count"].doubleValue;
+  }
+  XCTAssertEqual(count, (double)eventCount);
+  NSLog(@"Aggregated %lu events into %lu in %.1f ms (%.0f ns per event)", (unsigned long)eventCount,
+        (unsigned long)self.trackedEvents.count, duration * 1000, duration / (double)eventCount * 1e9);
+}
+
+@end
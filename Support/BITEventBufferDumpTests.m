@@ -0,0 +1,226 @@
+//
+//  BITEventBufferDumpTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITEventBufferDump.h"
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITCompression.h"
+#import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
+#import "BITCrashManager.h"
+#import "BITCrashManagerPrivate.h"
+#import <signal.h>
+#import <sys/resource.h>
+#import <sys/wait.h>
+
+// The callbacks of the crash manager, which the crash reporter would call once it has written its report.
+static PLCrashReporterCallbacks *bit_crashReporterCallbacks;
+
+/**
+ *  Does what the post-crash callback of the crash reporter does, or calls it if there is one, then lets the signal
+ *  terminate the process.
+ */
+static void bit_dumpEventBufferAndReraise(int signalNumber, siginfo_t *info, void *uap) {
+  if (bit_crashReporterCallbacks) {
+    bit_crashReporterCallbacks->handleSignal(info, (ucontext_t *)uap, bit_crashReporterCallbacks->context);
+  } else {
+    bit_eventBufferDumpWrite();
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = SIG_DFL;
+  sigemptyset(&action.sa_mask);
+  sigaction(signalNumber, &action, NULL);
+  raise(signalNumber);
+}
+
+/**
+ *  A post-crash callback of the app, it kills the process so the test can tell that it has been called.
+ */
+static void bit_killProcess(void * __unused context) {
+  kill(getpid(), SIGKILL);
+}
+
+@interface BITEventBufferDumpTests : XCTestCase
+
+@property (nonatomic, assign) BITRingBuffer *eventBuffer;
+@property (nonatomic, assign) BITRingBuffer *previousEventBuffer;
+@property (nonatomic, strong) BITPersistence *persistence;
+
+@end
+
+@implementation BITEventBufferDumpTests
+
+- (void)setUp {
+  [super setUp];
+  self.eventBuffer = bit_ringBufferCreate(64 * 1024);
+  self.previousEventBuffer = BITTelemetryEventBuffer;
+  BITTelemetryEventBuffer = self.eventBuffer;
+
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id persistenceMock = OCMPartialMock(persistence);
+  OCMStub([persistenceMock bundleIdentifier]).andReturn(bundleIdentifier);
+  self.persistence = [persistence init];
+}
+
+- (void)tearDown {
+  bit_crashReporterCallbacks = NULL;
+  bit_eventBufferDumpClose();
+  BITTelemetryEventBuffer = self.previousEventBuffer;
+  bit_ringBufferDestroy(self.eventBuffer);
+  [[NSFileManager defaultManager] removeItemAtPath:[self.persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent error:nil];
+  [super tearDown];
+}
+
+/**
+ *  Crashes a child process with the given signal. The child inherits the event buffer and the dump file, like the app
+ *  would if it crashed for real.
+ *
+ *  @param invalidAccess raises the signal by accessing invalid memory instead of calling raise(3)
+ *
+ *  @return the signal the child has been terminated with, 0 if it wasn't terminated by a signal
+ */
+- (int)crashChildProcessWithSignal:(int)signalNumber invalidAccess:(BOOL)invalidAccess {
+  pid_t pid = fork();
+  if (pid == 0) {
+
+    // Only async-signal-safe functions from here on, the child has a single thread and all locks in the state they were
+    // in when the parent forked.
+    struct rlimit noCoreDumps = {0, 0};
+    setrlimit(RLIMIT_CORE, &noCoreDumps);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = bit_dumpEventBufferAndReraise;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(signalNumber, &action, NULL);
+
+    // An invalid access may be reported as either signal.
+    sigaction(SIGBUS, &action, NULL);
+    sigaction(SIGSEGV, &action, NULL);
+    if (invalidAccess) {
+      volatile int *invalidAddress = NULL;
+      *invalidAddress = 1;
+    } else {
+      raise(signalNumber);
+    }
+    _exit(0);
+  }
+  XCTAssertGreaterThan(pid, 0);
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  return WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+}
+
+- (NSString *)dumpContent {
+  NSData *dump = [NSData dataWithContentsOfFile:[self.persistence eventBufferDumpPath]];
+  return [[NSString alloc] initWithData:dump ?: [NSData data] encoding:NSUTF8StringEncoding];
+}
+
+- (void)testBufferedItemsAreDumpedWhenTheProcessIsKilledBySignal {
+  bit_appendStringToEventBuffer(@"{\"name\":\"first\"}", self.eventBuffer);
+  bit_appendStringToEventBuffer(@"{\"name\":\"second\"}", self.eventBuffer);
+
+  int signals[] = {SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV, SIGTRAP};
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+    XCTAssertTrue(bit_eventBufferDumpOpen([self.persistence eventBufferDumpPath].fileSystemRepresentation));
+    XCTAssertEqual([self crashChildProcessWithSignal:signals[i] invalidAccess:NO], signals[i]);
+    XCTAssertEqualObjects([self dumpContent], @"{\"name\":\"first\"}\n{\"name\":\"second\"}\n", @"signal %d", signals[i]);
+  }
+}
+
+- (void)testBufferedItemsAreDumpedOnInvalidMemoryAccess {
+  bit_appendStringToEventBuffer(@"{\"name\":\"crash\"}", self.eventBuffer);
+  XCTAssertTrue(bit_eventBufferDumpOpen([self.persistence eventBufferDumpPath].fileSystemRepresentation));
+
+  int signalNumber = [self crashChildProcessWithSignal:SIGSEGV invalidAccess:YES];
+
+  XCTAssertTrue(signalNumber == SIGSEGV || signalNumber == SIGBUS);
+  XCTAssertEqualObjects([self dumpContent], @"{\"name\":\"crash\"}\n");
+}
+
+- (void)testCrashManagerCallbacksDumpBufferedItems {
+  BITCrashManager *crashManager = [[BITCrashManager alloc] initWithAppIdentifier:@"123" hockeyAppClient:nil];
+  bit_crashReporterCallbacks = crashManager.crashCallBacks;
+  bit_appendStringToEventBuffer(@"{\"name\":\"crash\"}", self.eventBuffer);
+  XCTAssertTrue(bit_eventBufferDumpOpen([self.persistence eventBufferDumpPath].fileSystemRepresentation));
+
+  // The callbacks are handed to the crash reporter even if the app doesn't set any of its own.
+  XCTAssertEqual([self crashChildProcessWithSignal:SIGABRT invalidAccess:NO], SIGABRT);
+
+  XCTAssertEqualObjects([self dumpContent], @"{\"name\":\"crash\"}\n");
+}
+
+- (void)testCrashManagerCallbacksDumpBufferedItemsBeforeCallingTheAppCallback {
+  BITCrashManager *crashManager = [[BITCrashManager alloc] initWithAppIdentifier:@"123" hockeyAppClient:nil];
+  BITCrashManagerCallbacks callbacks = {.context = NULL, .handleSignal = bit_killProcess};
+  [crashManager setCrashCallbacks:&callbacks];
+  bit_crashReporterCallbacks = crashManager.crashCallBacks;
+  bit_appendStringToEventBuffer(@"{\"name\":\"crash\"}", self.eventBuffer);
+  XCTAssertTrue(bit_eventBufferDumpOpen([self.persistence eventBufferDumpPath].fileSystemRepresentation));
+
+  XCTAssertEqual([self crashChildProcessWithSignal:SIGABRT invalidAccess:NO], SIGKILL);
+
+  XCTAssertEqualObjects([self dumpContent], @"{\"name\":\"crash\"}\n");
+
+  // The callbacks of the app are process wide.
+  BITCrashManagerCallbacks noCallbacks = {.context = NULL, .handleSignal = NULL};
+  [crashManager setCrashCallbacks:&noCallbacks];
+}
+
+- (void)testPersistedItemsAreNotDumped {
+  bit_appendStringToEventBuffer(@"{\"name\":\"persisted\"}", self.eventBuffer);
+  bit_resetEventBuffer(self.eventBuffer);
+  bit_appendStringToEventBuffer(@"{\"name\":\"pending\"}", self.eventBuffer);
+  XCTAssertTrue(bit_eventBufferDumpOpen([self.persistence eventBufferDumpPath].fileSystemRepresentation));
+
+  XCTAssertEqual([self crashChildProcessWithSignal:SIGABRT invalidAccess:NO], SIGABRT);
+
+  XCTAssertEqualObjects([self dumpContent], @"{\"name\":\"pending\"}\n");
+}
+
+- (void)testNothingIsWrittenWithoutDumpFile {
+  bit_appendStringToEventBuffer(@"{\"name\":\"lost\"}", self.eventBuffer);
+  bit_eventBufferDumpClose();
+
+  XCTAssertEqual(bit_eventBufferDumpWrite(), 0);
+}
+
+- (void)testDumpIsRecoveredAsBundleOnNextLaunch {
+  [self.persistence recoverEventBufferDump];
+  dispatch_sync(self.persistence.persistenceQueue, ^{});
+  XCTAssertEqualObjects([self dumpContent], @"");
+  bit_appendStringToEventBuffer(@"{\"name\":\"first\"}", self.eventBuffer);
+  bit_appendStringToEventBuffer(@"{\"name\":\"second\"}", self.eventBuffer);
+  XCTAssertEqual([self crashChildProcessWithSignal:SIGSEGV invalidAccess:NO], SIGSEGV);
+
+  // The crash cut off the last item in the middle.
+  NSFileHandle *dump = [NSFileHandle fileHandleForWritingAtPath:[self.persistence eventBufferDumpPath]];
+  [dump seekToEndOfFile];
+  [dump writeData:(NSData *)[@"{\"name\":\"thi" dataUsingEncoding:NSUTF8StringEncoding]];
+  [dump closeFile];
+
+  // The next launch.
+  [self.persistence recoverEventBufferDump];
+  dispatch_sync(self.persistence.persistenceQueue, ^{});
+
+  XCTAssertEqual(self.persistence.persistedBundleCount, (NSUInteger)1);
+  NSString *filePath = [self.persistence requestNextFilePath];
+  NSData *bundle = bit_decompressData((NSData *)[self.persistence dataAtFilePath:(NSString *)filePath]);
+  XCTAssertEqualObjects([[NSString alloc] initWithData:(NSData *)bundle encoding:NSUTF8StringEncoding], @"{\"name\":\"first\"}\n{\"name\":\"second\"}\n");
+  XCTAssertEqualObjects([self dumpContent], @"");
+
+  // Recovering again doesn't persist the items twice.
+  [self.persistence recoverEventBufferDump];
+  dispatch_sync(self.persistence.persistenceQueue, ^{});
+  XCTAssertEqual(self.persistence.persistedBundleCount, (NSUInteger)1);
+}
+
+@end
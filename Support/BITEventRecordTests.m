@@ -0,0 +1,294 @@
+//
+//  BITEventRecordTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITEventRecord.h"
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+#import "BITEventData.h"
+#import "BITEnvelope.h"
+
+// The hook malloc calls for every allocation while stack logging is enabled, it is exported by libmalloc.
+typedef void (BITMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfHotFramesToSkip);
+extern BITMallocLogger *malloc_logger;
+
+static uint32_t const BITMallocLogTypeAllocate = 2;
+
+static _Thread_local BOOL BITCountsAllocations;
+static _Thread_local uint64_t BITAllocationCount;
+
+static void bit_countAllocation(uint32_t type, uintptr_t __unused arg1, uintptr_t __unused arg2, uintptr_t __unused arg3, uintptr_t __unused result, uint32_t __unused numberOfHotFramesToSkip) {
+  if (BITCountsAllocations && (type & BITMallocLogTypeAllocate)) {
+    BITAllocationCount++;
+  }
+}
+
+static NSUInteger const BITAllocationRoundCount = 20;
+static NSUInteger const BITAllocationEventsPerRound = 500;
+
+/**
+ *  Stands in for the persistence without going through a mock for every call, which would allocate.
+ */
+@interface BITAllocationFreePersistence : NSObject
+@end
+
+@implementation BITAllocationFreePersistence
+
+- (BOOL)isFreeSpaceAvailable {
+  return YES;
+}
+
+- (void)countDroppedEvents:(NSUInteger) __unused count {
+}
+
+- (void)persistBundle:(NSData *) __unused bundle priority:(BITPersistencePriority) __unused priority {
+}
+
+@end
+
+@interface BITEventRecordTests : XCTestCase
+
+@property (nonatomic, assign) BITEventRecordPool *sut;
+
+@end
+
+@implementation BITEventRecordTests
+
+- (void)setUp {
+  [super setUp];
+  self.sut = bit_eventRecordPoolCreate(4);
+}
+
+- (void)tearDown {
+  bit_eventRecordPoolDestroy(self.sut);
+  self.sut = NULL;
+  [super tearDown];
+}
+
+- (NSString *)stringOfRecord:(BITEventRecord *)record string:(BITEventRecordString)string {
+  return [[NSString alloc] initWithBytes:bit_eventRecordStringBytes(record, string) length:string.length encoding:NSUTF8StringEncoding];
+}
+
+- (void)testRecordsAreReused {
+  BITEventRecord *record = bit_eventRecordPoolAcquire(self.sut);
+  bit_eventRecordSetName(record, CFSTR("Event"));
+  bit_eventRecordAddProperty(record, CFSTR("key"), CFSTR("value"));
+  bit_eventRecordAddMeasurement(record, CFSTR("duration"), 1.5);
+  record->object = CFBridgingRetain([BITEventData new]);
+  bit_eventRecordPoolRelease(record);
+
+  BITEventRecord *reused = bit_eventRecordPoolAcquire(self.sut);
+  XCTAssertEqual(reused, record);
+  XCTAssertEqual(reused->propertyCount, (uint32_t)0);
+  XCTAssertEqual(reused->measurementCount, (uint32_t)0);
+  XCTAssertEqual(reused->byteCount, (size_t)0);
+  XCTAssertTrue(reused->object == NULL);
+  XCTAssertEqual(bit_eventRecordPoolAllocatedCount(self.sut), (size_t)1);
+
+  // Records returned to a full pool are freed.
+  BITEventRecord *records[6];
+  for (int i = 0; i < 6; i++) {
+    records[i] = i == 0 ? reused : bit_eventRecordPoolAcquire(self.sut);
+  }
+  for (int i = 0; i < 6; i++) {
+    bit_eventRecordPoolRelease(records[i]);
+  }
+  XCTAssertEqual(bit_eventRecordPoolAllocatedCount(self.sut), (size_t)6);
+}
+
+- (void)testNamesAndKeysAreInternedButValuesAreNot {
+  BITEventRecord *first = bit_eventRecordPoolAcquire(self.sut);
+  BITEventRecord *second = bit_eventRecordPoolAcquire(self.sut);
+  for (int i = 0; i < 2; i++) {
+    BITEventRecord *record = i == 0 ? first : second;
+    bit_eventRecordSetName(record, (__bridge CFStringRef)[NSMutableString stringWithString:@"Événement 🎉"]);
+    bit_eventRecordAddProperty(record, CFSTR("key"), CFSTR("value \"quoted\""));
+    bit_eventRecordAddMeasurement(record, CFSTR("duration"), 1.5);
+  }
+
+  XCTAssertTrue(first->name.entry != NULL);
+  XCTAssertEqual(first->name.entry, second->name.entry);
+  XCTAssertEqual(first->properties[0].key.entry, second->properties[0].key.entry);
+  XCTAssertEqual(first->measurements[0].key.entry, second->measurements[0].key.entry);
+  XCTAssertTrue(first->properties[0].value.entry == NULL);
+  XCTAssertEqual(bit_eventRecordPoolInternedCount(self.sut), (size_t)3);
+
+  XCTAssertEqualObjects([self stringOfRecord:first string:first->name], @"Événement 🎉");
+  XCTAssertEqualObjects([self stringOfRecord:second string:second->properties[0].value], @"value \"quoted\"");
+  XCTAssertEqual(second->measurements[0].value, 1.5);
+  bit_eventRecordPoolRelease(first);
+  bit_eventRecordPoolRelease(second);
+}
+
+- (void)testUnpairedSurrogatesAreReplacedInsteadOfCuttingValuesOff {
+  unichar characters[] = {'a', 0xd800, 'b'};
+  NSString *value = [NSString stringWithCharacters:characters length:3];
+  BITEventRecord *record = bit_eventRecordPoolAcquire(self.sut);
+  bit_eventRecordAddProperty(record, CFSTR("key"), (__bridge CFStringRef)value);
+
+  // The same replacement BITJSONWriter makes for objects.
+  XCTAssertEqualObjects([self stringOfRecord:record string:record->properties[0].value], @"a?b");
+  bit_eventRecordPoolRelease(record);
+}
+
+- (void)testStringsAreStoredInTheRecordOnceTheInternTableIsFull {
+  BITEventRecord *record = bit_eventRecordPoolAcquire(self.sut);
+  for (int i = 0; i < 4096; i++) {
+    bit_eventRecordSetName(record, (__bridge CFStringRef)[NSString stringWithFormat:@"Event %d", i]);
+  }
+  XCTAssertEqual(bit_eventRecordPoolInternedCount(self.sut), (size_t)4096);
+
+  bit_eventRecordSetName(record, CFSTR("One too many"));
+  XCTAssertTrue(record->name.entry == NULL);
+  XCTAssertEqualObjects([self stringOfRecord:record string:record->name], @"One too many");
+  XCTAssertEqual(bit_eventRecordPoolInternedCount(self.sut), (size_t)4096);
+  bit_eventRecordPoolRelease(record);
+}
+
+- (void)testTimestampIsFormattedLikeEnvelopeTimes {
+  BITEventRecord *record = bit_eventRecordPoolAcquire(self.sut);
+  char time[32];
+  record->timestamp = 1507801260.123;
+  XCTAssertEqual(bit_eventRecordFormatTimestamp(record, time, sizeof(time)), (size_t)24);
+  XCTAssertEqualObjects(@(time), @"2017-10-12T09:41:00.123Z");
+
+  record->timestamp = 1507801260.9996;
+  bit_eventRecordFormatTimestamp(record, time, sizeof(time));
+  XCTAssertEqualObjects(@(time), @"2017-10-12T09:41:01.000Z");
+  XCTAssertEqual(bit_eventRecordFormatTimestamp(record, time, 24), (size_t)0);
+  bit_eventRecordPoolRelease(record);
+}
+
+#pragma mark - Channel
+
+- (BITChannel *)channelWithPersistence:(BITPersistence *)persistence {
+  BITTelemetryContext *context = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123" persistence:OCMClassMock([BITPersistence class])];
+  return [[BITChannel alloc] initWithTelemetryContext:context persistence:persistence];
+}
+
+- (NSDictionary *)envelopeOfRecordEnqueuedInChannel:(BITChannel *)channel {
+  __block NSDictionary *envelope;
+  dispatch_sync(channel.dataItemsOperations, ^{
+    void *item;
+    XCTAssertTrue(bit_boundedQueuePop([channel itemQueueForLane:BITChannelLaneEvents], &item));
+    BITEventRecord *record = item;
+    BITJSONWriter *writer = bit_jsonWriterCreate(256);
+    if (record->object) {
+      [[channel envelopeForTelemetryData:(__bridge BITTelemetryData *)record->object] serializeToJSONWriter:writer];
+    } else {
+      [channel serializeEventRecord:record toJSONWriter:writer];
+    }
+    NSData *json = [NSData dataWithBytes:bit_jsonWriterBytes(writer) length:bit_jsonWriterLength(writer)];
+    envelope = [NSJSONSerialization JSONObjectWithData:json options:(NSJSONReadingOptions)0 error:nil];
+    bit_jsonWriterDestroy(writer);
+    bit_eventRecordPoolRelease(record);
+  });
+  return envelope;
+}
+
+- (void)testEventRecordsAreSerializedLikeEventData {
+  BITChannel *channel = [self channelWithPersistence:OCMClassMock([BITPersistence class])];
+  NSDictionary *properties = @{@"screen" : @"Main \"Window\"", @"emoji" : @"🎉", @"control" : @"\n\t"};
+  NSDictionary *measurements = @{@"duration" : @1.25, @"count" : @3, @"large" : @1e300};
+
+  // Keep the drain from taking the records out of the queue.
+  dispatch_suspend(channel.dataItemsOperations);
+  [channel enqueueEventWithName:@"Tapped ✓" properties:properties measurements:measurements sampleRate:25];
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = @"Tapped ✓";
+  eventData.properties = properties;
+  eventData.measurements = measurements;
+  eventData.sampleRate = @25;
+  [channel enqueueTelemetryItem:eventData];
+  dispatch_resume(channel.dataItemsOperations);
+
+  NSMutableDictionary *recordEnvelope = [[self envelopeOfRecordEnqueuedInChannel:channel] mutableCopy];
+  NSMutableDictionary *eventDataEnvelope = [[self envelopeOfRecordEnqueuedInChannel:channel] mutableCopy];
+  XCTAssertNotNil(recordEnvelope[@"time"]);
+  XCTAssertNotNil(eventDataEnvelope[@"time"]);
+  [recordEnvelope removeObjectForKey:@"time"];
+  [eventDataEnvelope removeObjectForKey:@"time"];
+  XCTAssertEqualObjects(recordEnvelope, eventDataEnvelope);
+  XCTAssertEqualObjects(recordEnvelope[@"sampleRate"], @25);
+  XCTAssertEqualObjects(recordEnvelope[@"data"][@"baseData"][@"properties"], properties);
+}
+
+- (void)testEventsARecordCantHoldAreEnqueuedAsEventData {
+  BITChannel *channel = [self channelWithPersistence:OCMClassMock([BITPersistence class])];
+  dispatch_suspend(channel.dataItemsOperations);
+  [channel enqueueEventWithName:@"Toggled" properties:nil measurements:@{@"enabled" : @YES} sampleRate:0];
+  [channel enqueueEventWithName:@"Counted" properties:nil measurements:@{@"count" : @(ULLONG_MAX)} sampleRate:0];
+  dispatch_resume(channel.dataItemsOperations);
+
+  XCTAssertEqualObjects([self envelopeOfRecordEnqueuedInChannel:channel][@"data"][@"baseData"][@"measurements"], @{@"enabled" : @YES});
+  XCTAssertEqualObjects([self envelopeOfRecordEnqueuedInChannel:channel][@"data"][@"baseData"][@"measurements"], @{@"count" : @(ULLONG_MAX)});
+}
+
+#pragma mark - Allocations
+
+- (double)allocationsPerEventInChannel:(BITChannel *)channel enqueueingEvent:(void (^)(NSUInteger index))enqueueEvent {
+  __block uint64_t allocationCount = 0;
+
+  // Everything happens on the channel's queue, so the allocations of serializing the events are counted too. The first
+  // round warms up the pool, the intern table and the buffers.
+  dispatch_sync(channel.dataItemsOperations, ^{
+    for (NSUInteger round = 0; round <= BITAllocationRoundCount; round++) {
+      BITAllocationCount = 0;
+      BITCountsAllocations = YES;
+      for (NSUInteger i = 0; i < BITAllocationEventsPerRound; i++) {
+        enqueueEvent(i);
+      }
+      [channel drainItemQueues];
+      BITCountsAllocations = NO;
+      if (round > 0) {
+        allocationCount += BITAllocationCount;
+      }
+      bit_resetEventBuffer(channel.eventBuffer);
+      channel.dataItemCount = 0;
+      channel.batchLength = 0;
+    }
+  });
+  return (double)allocationCount / (double)(BITAllocationRoundCount * BITAllocationEventsPerRound);
+}
+
+- (void)testAllocationsPerEvent {
+  BITMallocLogger *previousLogger = malloc_logger;
+  malloc_logger = bit_countAllocation;
+
+  // Make sure allocations are reported at all.
+  BITAllocationCount = 0;
+  BITCountsAllocations = YES;
+  free(malloc(16));
+  BITCountsAllocations = NO;
+  XCTAssertEqual(BITAllocationCount, (uint64_t)1);
+
+  BITChannel *channel = [self channelWithPersistence:(BITPersistence *)[BITAllocationFreePersistence new]];
+  channel.batchingPolicy = [[BITFixedBatchingPolicy alloc] initWithMaxBatchSize:NSUIntegerMax batchInterval:3600];
+  NSArray<NSString *> *screens = @[@"Main", @"Settings", @"Detail", @"Search"];
+  NSDictionary *measurements = @{@"duration" : @12.5};
+
+  double eventDataAllocations = [self allocationsPerEventInChannel:channel enqueueingEvent:^(NSUInteger index) {
+    BITEventData *eventData = [BITEventData new];
+    eventData.name = @"Screen viewed";
+    eventData.properties = @{@"screen" : screens[index % screens.count]};
+    eventData.measurements = measurements;
+    [channel enqueueTelemetryItem:eventData];
+  }];
+  double recordAllocations = [self allocationsPerEventInChannel:channel enqueueingEvent:^(NSUInteger index) {
+    NSDictionary *properties = @{@"screen" : screens[index % screens.count]};
+    [channel enqueueEventWithName:@"Screen viewed" properties:properties measurements:measurements sampleRate:0];
+  }];
+  malloc_logger = previousLogger;
+
+  // Both include the properties dictionary, which is created by the caller.
+  NSLog(@"Allocations per event: %.2f as BITEventData, %.2f as event record", eventDataAllocations, recordAllocations);
+  XCTAssertLessThan(recordAllocations, 2.0);
+  XCTAssertLessThan(recordAllocations * 4, eventDataAllocations);
+}
+
+@end
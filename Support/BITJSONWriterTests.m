@@ -0,0 +1,186 @@
+//
+//  BITJSONWriterTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITJSONWriter.h"
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+#import "BITEnvelope.h"
+#import "BITData.h"
+#import "BITEventData.h"
+#import "BITSessionStateData.h"
+
+@interface BITJSONWriterTests : XCTestCase
+
+@property (nonatomic, assign) BITJSONWriter *sut;
+
+@end
+
+@implementation BITJSONWriterTests
+
+- (void)setUp {
+  [super setUp];
+  self.sut = bit_jsonWriterCreate(16);
+}
+
+- (void)tearDown {
+  bit_jsonWriterDestroy(self.sut);
+  self.sut = NULL;
+  [super tearDown];
+}
+
+- (NSString *)output {
+  return [[NSString alloc] initWithBytes:bit_jsonWriterBytes(self.sut) length:bit_jsonWriterLength(self.sut) encoding:NSUTF8StringEncoding];
+}
+
+- (id)parsedOutput {
+  NSData *data = [NSData dataWithBytes:bit_jsonWriterBytes(self.sut) length:bit_jsonWriterLength(self.sut)];
+  return [NSJSONSerialization JSONObjectWithData:data options:(NSJSONReadingOptions)0 error:nil];
+}
+
+- (void)testSeparatorsAreInsertedBetweenMembers {
+  bit_jsonWriterBeginObject(self.sut);
+  bit_jsonWriterKey(self.sut, "a");
+  bit_jsonWriterInteger(self.sut, -1);
+  bit_jsonWriterKey(self.sut, "b");
+  bit_jsonWriterBeginArray(self.sut);
+  bit_jsonWriterBool(self.sut, true);
+  bit_jsonWriterNull(self.sut);
+  bit_jsonWriterBeginObject(self.sut);
+  bit_jsonWriterEndObject(self.sut);
+  bit_jsonWriterEndArray(self.sut);
+  bit_jsonWriterKey(self.sut, "c");
+  bit_jsonWriterDouble(self.sut, 0.1);
+  bit_jsonWriterEndObject(self.sut);
+
+  XCTAssertFalse(bit_jsonWriterHasFailed(self.sut));
+  XCTAssertEqualObjects([self output], @"{\"a\":-1,\"b\":[true,null,{}],\"c\":0.1}");
+}
+
+- (void)testRawKeysAreFollowedByTheirValue {
+  bit_jsonWriterBeginObject(self.sut);
+  bit_jsonWriterRawKey(self.sut, "\"a\"", 3);
+  bit_jsonWriterRaw(self.sut, "\"b\"", 3);
+  bit_jsonWriterRawKey(self.sut, "\"c\"", 3);
+  bit_jsonWriterInteger(self.sut, 1);
+  bit_jsonWriterEndObject(self.sut);
+
+  XCTAssertEqualObjects([self output], @"{\"a\":\"b\",\"c\":1}");
+}
+
+- (void)testStringsAreEscaped {
+  NSString *string = @"quote\" backslash\\ newline\n tab\t control\x01 emoji😀 umlaut ä";
+  bit_jsonWriterBeginArray(self.sut);
+  bit_jsonWriterNSString(self.sut, string);
+  bit_jsonWriterEndArray(self.sut);
+
+  XCTAssertTrue([[self output] containsString:@"\\u0001"]);
+  XCTAssertEqualObjects([self parsedOutput], @[string]);
+}
+
+- (void)testNullCharactersAreEscaped {
+  unichar asciiCharacters[] = {'a', 0, 'b'};
+  unichar nonASCIICharacters[] = {0xe4, 0, 'b'};
+  NSString *ascii = [NSString stringWithCharacters:asciiCharacters length:3];
+  NSString *nonASCII = [NSString stringWithCharacters:nonASCIICharacters length:3];
+  bit_jsonWriterBeginArray(self.sut);
+  bit_jsonWriterNSString(self.sut, ascii);
+  bit_jsonWriterNSString(self.sut, nonASCII);
+  bit_jsonWriterEndArray(self.sut);
+
+  XCTAssertEqualObjects([self output], @"[\"a\\u0000b\",\"ä\\u0000b\"]");
+  XCTAssertEqualObjects([self parsedOutput], (@[ascii, nonASCII]));
+}
+
+- (void)testLongNonASCIIStringsAreWrittenCompletely {
+  NSMutableString *string = [NSMutableString new];
+  for (int i = 0; i < 500; i++) {
+    [string appendString:@"ö😀"];
+  }
+  bit_jsonWriterBeginArray(self.sut);
+  bit_jsonWriterNSString(self.sut, string);
+  bit_jsonWriterEndArray(self.sut);
+
+  XCTAssertEqualObjects([self parsedOutput], @[string]);
+}
+
+- (void)testUnsupportedValuesFailAndCanBeRestored {
+  bit_jsonWriterBeginObject(self.sut);
+  bit_jsonWriterKey(self.sut, "valid");
+  bit_jsonWriterInteger(self.sut, 1);
+
+  BITJSONWriterCheckpoint checkpoint = bit_jsonWriterCheckpoint(self.sut);
+  bit_jsonWriterKey(self.sut, "invalid");
+  XCTAssertFalse(bit_jsonWriterObject(self.sut, @(NAN)));
+  XCTAssertTrue(bit_jsonWriterHasFailed(self.sut));
+
+  bit_jsonWriterRestore(self.sut, checkpoint);
+  XCTAssertFalse(bit_jsonWriterObject(self.sut, [NSDate date]));
+  bit_jsonWriterRestore(self.sut, checkpoint);
+  bit_jsonWriterEndObject(self.sut);
+
+  XCTAssertFalse(bit_jsonWriterHasFailed(self.sut));
+  XCTAssertEqualObjects([self output], @"{\"valid\":1}");
+}
+
+- (void)testFoundationObjectsMatchJSONSerialization {
+  NSDictionary *object = @{@"string" : @"value",
+                           @"integer" : @42,
+                           @"negative" : @(-7),
+                           @"double" : @(3.14159),
+                           @"bool" : @YES,
+                           @"null" : [NSNull null],
+                           @"array" : @[@1, @"two", @{@"three" : @3}]};
+  XCTAssertTrue(bit_jsonWriterObject(self.sut, object));
+  XCTAssertEqualObjects([self parsedOutput], object);
+}
+
+- (void)testEnvelopeMatchesDictionarySerialization {
+  id persistenceMock = OCMClassMock([BITPersistence class]);
+  BITTelemetryContext *context = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123" persistence:persistenceMock];
+  BITChannel *channel = [[BITChannel alloc] initWithTelemetryContext:context persistence:persistenceMock];
+
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = @"Event \"with\" quotes";
+  eventData.properties = @{@"key" : @"välue"};
+  eventData.measurements = @{@"duration" : @1.5};
+  BITSessionStateData *sessionStateData = [BITSessionStateData new];
+  sessionStateData.state = BITSessionState_end;
+
+  for (BITTelemetryData *telemetryData in @[eventData, sessionStateData]) {
+    BITEnvelope *envelope = [channel envelopeForTelemetryData:telemetryData];
+    bit_jsonWriterReset(self.sut);
+    [envelope serializeToJSONWriter:self.sut];
+    XCTAssertFalse(bit_jsonWriterHasFailed(self.sut));
+
+    // The writer uses the context's tags fragment, the dictionary the merged context fields.
+    envelope.tags = context.contextDictionary;
+    XCTAssertEqualObjects([self parsedOutput], [envelope serializeToDictionary]);
+  }
+}
+
+- (void)testInvalidBaseDataIsOmitted {
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = @"Event";
+  eventData.measurements = @{@"invalid" : @(INFINITY)};
+  BITData *data = [BITData new];
+  data.baseType = eventData.dataTypeName;
+  data.baseData = eventData;
+  BITEnvelope *envelope = [BITEnvelope new];
+  envelope.name = eventData.envelopeTypeName;
+  envelope.data = data;
+
+  [envelope serializeToJSONWriter:self.sut];
+
+  XCTAssertFalse(bit_jsonWriterHasFailed(self.sut));
+  NSDictionary *parsed = [self parsedOutput];
+  XCTAssertEqualObjects(parsed[@"name"], @"Microsoft.ApplicationInsights.Event");
+  XCTAssertEqualObjects(parsed[@"data"], @{@"baseType" : @"EventData"});
+}
+
+@end
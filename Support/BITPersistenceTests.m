@@ -40,4 +40,235 @@
     XCTAssertEqualObjects(path, validPath);
 }
 
+- (BITPersistence *)persistenceWithBundleFiles:(NSUInteger)fileCount {
+    NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+    BITPersistence *persistence = [BITPersistence alloc];
+    id mock = OCMPartialMock(persistence);
+    OCMStub([mock bundleIdentifier]).andReturn(bundleIdentifier);
+    
+    // Files are created newest first, so the file names don't match the order they have been persisted in.
+    NSString *directoryPath = [persistence folderPathForType:BITPersistenceTypeTelemetry];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+    for (NSUInteger i = 0; i < fileCount; i++) {
+        NSString *filePath = [directoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@"hockey-app-bundle-%lu", (unsigned long)i]];
+        [[NSData dataWithBytes:&i length:sizeof(i)] writeToFile:filePath atomically:NO];
+        NSDate *creationDate = [NSDate dateWithTimeIntervalSinceNow:-60.0 * (i + 1)];
+        [[NSFileManager defaultManager] setAttributes:@{NSFileCreationDate : creationDate} ofItemAtPath:filePath error:nil];
+    }
+    return [persistence init];
+}
+
+- (void)removeDirectoryOfPersistence:(BITPersistence *)persistence {
+    [[NSFileManager defaultManager] removeItemAtPath:[persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent error:nil];
+}
+
+- (void)testBundlesOnDiskAreHandedOutOldestFirst {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:3];
+    XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)3);
+    
+    XCTAssertEqualObjects([persistence requestNextFilePath].lastPathComponent, @"hockey-app-bundle-2");
+    XCTAssertEqualObjects([persistence requestNextFilePath].lastPathComponent, @"hockey-app-bundle-1");
+    XCTAssertEqualObjects([persistence requestNextFilePath].lastPathComponent, @"hockey-app-bundle-0");
+    XCTAssertNil([persistence requestNextFilePath]);
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
+- (void)testIndexIsUpdatedWithoutReadingTheDirectory {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:1];
+    persistence.maxFileCount = 2;
+    persistence.evictionPolicy = BITTelemetryEvictionPolicyNone;
+    XCTAssertTrue([persistence isFreeSpaceAvailable]);
+    
+    [persistence persistBundle:[@"{}" dataUsingEncoding:NSUTF8StringEncoding]];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)2);
+    XCTAssertFalse([persistence isFreeSpaceAvailable]);
+    
+    // Requested bundles are skipped until they are given back.
+    NSString *oldestPath = [persistence requestNextFilePath];
+    NSString *newestPath = [persistence requestNextFilePath];
+    XCTAssertEqualObjects(oldestPath.lastPathComponent, @"hockey-app-bundle-0");
+    XCTAssertNotNil(newestPath);
+    XCTAssertNil([persistence requestNextFilePath]);
+    [persistence giveBackRequestedFilePath:(NSString *)oldestPath];
+    XCTAssertEqualObjects([persistence requestNextFilePath], oldestPath);
+    
+    [persistence deleteFileAtPath:(NSString *)oldestPath];
+    XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)1);
+    XCTAssertTrue([persistence isFreeSpaceAvailable]);
+    
+    // A bundle that vanished from disk is dropped from the index as soon as it is read.
+    [[NSFileManager defaultManager] removeItemAtPath:(NSString *)newestPath error:nil];
+    XCTAssertNil([persistence dataAtFilePath:(NSString *)newestPath]);
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)0);
+    XCTAssertEqual(persistence.requestedBundlePaths.count, (NSUInteger)0);
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
+- (void)testOldestBundlesAreEvictedOnceTheByteBudgetIsUsedUp {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:0];
+    NSData *bundle = [@"{\"event\":1}\n{\"event\":2}\n" dataUsingEncoding:NSUTF8StringEncoding];
+    persistence.maxBytes = bundle.length * 3;
+    
+    for (int i = 0; i < 3; i++) {
+        [persistence persistBundle:bundle];
+    }
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertEqual(persistence.bytesStored, (uint64_t)(bundle.length * 3));
+    
+    // The oldest bundle is being sent, so the next one has to make room.
+    NSString *sentPath = [persistence requestNextFilePath];
+    NSString *evictedPath = persistence.persistedBundlePaths[1];
+    XCTAssertTrue([persistence isFreeSpaceAvailable]);
+    [persistence persistBundle:bundle];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    
+    XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)3);
+    XCTAssertEqual(persistence.bytesStored, (uint64_t)(bundle.length * 3));
+    XCTAssertEqual(persistence.bytesEvicted, (uint64_t)bundle.length);
+    XCTAssertEqual(persistence.eventsDropped, (uint64_t)2);
+    XCTAssertTrue([persistence.persistedBundlePaths containsObject:(NSString *)sentPath]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:evictedPath]);
+    
+    // Bundles that can never fit are dropped right away.
+    [persistence persistBundle:[NSMutableData dataWithLength:bundle.length * 4]];
+    [persistence countDroppedEvents:3];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertEqual(persistence.bytesEvicted, (uint64_t)bundle.length);
+    XCTAssertEqual(persistence.eventsDropped, (uint64_t)5);
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
+- (void)testLowPriorityBundlesAreEvictedFirst {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:0];
+    persistence.evictionPolicy = BITTelemetryEvictionPolicyLowestPriorityFirst;
+    persistence.maxFileCount = 2;
+    NSData *bundle = [@"{}\n" dataUsingEncoding:NSUTF8StringEncoding];
+    
+    [persistence persistBundle:bundle priority:BITPersistencePriorityHigh];
+    [persistence persistBundle:bundle priority:BITPersistencePriorityDefault];
+    [persistence persistBundle:bundle priority:BITPersistencePriorityHigh];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    
+    // The default priority bundle has been evicted although it is newer.
+    NSString *oldestPath = persistence.persistedBundlePaths.firstObject;
+    XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)2);
+    XCTAssertTrue([persistence.persistedBundlePaths.lastObject hasSuffix:@"-high"]);
+    XCTAssertTrue([oldestPath hasSuffix:@"-high"]);
+    
+    // Default priority bundles don't replace high priority ones.
+    [persistence persistBundle:bundle priority:BITPersistencePriorityDefault];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertEqualObjects(persistence.persistedBundlePaths.firstObject, oldestPath);
+    XCTAssertEqual(persistence.eventsDropped, (uint64_t)2);
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
+- (void)testStorageIsFullOnceNothingCanBeEvicted {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:0];
+    persistence.maxFileCount = 2;
+    NSData *bundle = [@"{}\n" dataUsingEncoding:NSUTF8StringEncoding];
+    [persistence persistBundle:bundle];
+    [persistence persistBundle:bundle];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertTrue([persistence isFreeSpaceAvailable]);
+    
+    // Both bundles are being sent, so the next one can't be stored.
+    NSString *sentPath = [persistence requestNextFilePath];
+    [persistence requestNextFilePath];
+    [persistence persistBundle:bundle];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertTrue(persistence.evictionFailed);
+    XCTAssertFalse([persistence isFreeSpaceAvailable]);
+    
+    // Sending a bundle makes room again.
+    [persistence deleteFileAtPath:(NSString *)sentPath];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertTrue([persistence isFreeSpaceAvailable]);
+    [persistence persistBundle:bundle];
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    XCTAssertFalse(persistence.evictionFailed);
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
+- (void)testSessionStateSurvivesBurstsOfEventsUnderTheDefaultPolicy {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:0];
+    XCTAssertEqual(persistence.evictionPolicy, BITTelemetryEvictionPolicyOldestFirst);
+    persistence.maxFileCount = 20;
+    NSData *sessionState = [@"{\"data\":{\"baseType\":\"SessionStateData\"}}\n" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *events = [@"{\"event\":1}\n{\"event\":2}\n" dataUsingEncoding:NSUTF8StringEncoding];
+    
+    // Every thread stores a session start at the beginning and the middle of a burst of events.
+    dispatch_apply(4, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t __unused thread) {
+        for (NSUInteger i = 0; i < 200; i++) {
+            if (i % 100 == 0) {
+                [persistence persistBundle:sessionState priority:BITPersistencePriorityHigh];
+            }
+            [persistence persistBundle:events priority:BITPersistencePriorityDefault];
+        }
+    });
+    dispatch_sync(persistence.persistenceQueue, ^{});
+    
+    NSUInteger highPriorityCount = 0;
+    for (NSString *path in persistence.persistedBundlePaths) {
+        highPriorityCount += [path hasSuffix:@"-high"] ? 1 : 0;
+    }
+    XCTAssertEqual(highPriorityCount, (NSUInteger)8);
+    XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)20);
+    XCTAssertEqual(persistence.eventsDropped, (uint64_t)((800 - 12) * 2));
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
+- (void)testNoEvictionBlocksOnceTheByteBudgetIsUsedUp {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:2];
+    persistence.evictionPolicy = BITTelemetryEvictionPolicyNone;
+    XCTAssertEqual(persistence.bytesStored, (uint64_t)(2 * sizeof(NSUInteger)));
+    XCTAssertTrue([persistence isFreeSpaceAvailable]);
+    XCTAssertFalse([persistence isStorageUnderPressure]);
+    
+    persistence.maxBytes = 2 * sizeof(NSUInteger);
+    XCTAssertFalse([persistence isFreeSpaceAvailable]);
+    XCTAssertTrue([persistence isStorageUnderPressure]);
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
+- (void)testFailedSendAttemptsArePersistedWithTheBundle {
+    BITPersistence *persistence = [self persistenceWithBundleFiles:2];
+    NSString *deferredPath = (NSString *)[persistence requestNextFilePath];
+    NSUInteger attempts = [persistence recordFailedSendAttemptForFilePath:deferredPath retryDate:[NSDate dateWithTimeIntervalSinceNow:3600]];
+    [persistence giveBackRequestedFilePath:deferredPath];
+    XCTAssertEqual(attempts, (NSUInteger)1);
+    
+    // The deferred bundle is skipped although it is the oldest one.
+    NSString *nextPath = [persistence requestNextFilePath];
+    XCTAssertNotNil(nextPath);
+    XCTAssertNotEqualObjects(nextPath, deferredPath);
+    XCTAssertNil([persistence requestNextFilePath]);
+    XCTAssertEqualWithAccuracy([persistence nextRetryDate].timeIntervalSinceNow, 3600.0, 5.0);
+    
+    // After a relaunch, the attempts and the retry date are read from the bundle file.
+    NSString *bundleIdentifier = [persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent.lastPathComponent;
+    BITPersistence *relaunchedPersistence = [BITPersistence alloc];
+    id mock = OCMPartialMock(relaunchedPersistence);
+    OCMStub([mock bundleIdentifier]).andReturn(bundleIdentifier);
+    relaunchedPersistence = [relaunchedPersistence init];
+    XCTAssertEqual([relaunchedPersistence failedSendAttemptsForFilePath:deferredPath], (NSUInteger)1);
+    XCTAssertEqualObjects([relaunchedPersistence requestNextFilePath], nextPath);
+    XCTAssertNil([relaunchedPersistence requestNextFilePath]);
+    
+    [relaunchedPersistence deleteFileAtPath:deferredPath];
+    XCTAssertEqual([relaunchedPersistence failedSendAttemptsForFilePath:deferredPath], (NSUInteger)0);
+    XCTAssertNil([relaunchedPersistence nextRetryDate]);
+    
+    [self removeDirectoryOfPersistence:persistence];
+}
+
 @end
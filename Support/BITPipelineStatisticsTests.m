@@ -0,0 +1,111 @@
+//
+//  BITPipelineStatisticsTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+#import "BITPipelineStatistics.h"
+#import "BITTelemetryPipelineSnapshot.h"
+
+static NSUInteger const BITIncrementsPerThread = 100000;
+static NSUInteger const BITBenchmarkIncrementCount = 4800000;
+
+// The baseline: a single counter all threads increment.
+static _Atomic(uint64_t) bit_sharedCounter;
+
+@interface BITPipelineStatisticsTests : XCTestCase
+
+@end
+
+@implementation BITPipelineStatisticsTests
+
+- (void)testCountersAreSummedUpAcrossThreads {
+  BITTelemetryPipelineSnapshot *before = [BITTelemetryPipelineSnapshot new];
+  dispatch_apply(16, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t __unused thread) {
+    for (NSUInteger i = 0; i < BITIncrementsPerThread; i++) {
+      bit_pipelineCount(BITTelemetryCounterBatchesDeleted, 1);
+    }
+    bit_pipelineCount(BITTelemetryCounterBatchesDeleted, 10);
+  });
+  BITTelemetryPipelineSnapshot *after = [BITTelemetryPipelineSnapshot new];
+
+  uint64_t delta = [after valueOfCounter:BITTelemetryCounterBatchesDeleted] - [before valueOfCounter:BITTelemetryCounterBatchesDeleted];
+  XCTAssertEqual(delta, (uint64_t)(16 * (BITIncrementsPerThread + 10)));
+  XCTAssertEqual([after valueOfCounter:(BITTelemetryCounter)BITTelemetryCounterCount], (uint64_t)0);
+}
+
+- (void)testPercentilesAreTheUpperBoundsOfTheirBuckets {
+  BITPipelineHistogram histogram = {0};
+  XCTAssertEqual(bit_pipelineHistogramPercentile(&histogram, 50), (uint64_t)0);
+
+  // 90 durations between 512 and 1023 ns, 9 between 8 and 16 us and a single one of 1 ms.
+  histogram.buckets[10] = 90;
+  histogram.buckets[14] = 9;
+  histogram.buckets[20] = 1;
+  XCTAssertEqual(bit_pipelineHistogramPercentile(&histogram, 0), (uint64_t)1024);
+  XCTAssertEqual(bit_pipelineHistogramPercentile(&histogram, 50), (uint64_t)1024);
+  XCTAssertEqual(bit_pipelineHistogramPercentile(&histogram, 90), (uint64_t)1024);
+  XCTAssertEqual(bit_pipelineHistogramPercentile(&histogram, 99), (uint64_t)16384);
+  XCTAssertEqual(bit_pipelineHistogramPercentile(&histogram, 100), (uint64_t)1048576);
+}
+
+- (void)testDurationsAreRecordedPerStage {
+  BITTelemetryPipelineSnapshot *before = [BITTelemetryPipelineSnapshot new];
+  bit_pipelineRecordNanoseconds(BITTelemetryStageCompression, 3000);
+  bit_pipelineRecordNanoseconds(BITTelemetryStageCompression, 0);
+  bit_pipelineRecordNanoseconds(BITTelemetryStageCompression, 1ull << 45);
+  uint64_t start = bit_pipelineTimestamp();
+  [NSThread sleepForTimeInterval:0.01];
+  bit_pipelineRecordDuration(BITTelemetryStageCompression, start);
+  BITTelemetryPipelineSnapshot *after = [BITTelemetryPipelineSnapshot new];
+
+  XCTAssertEqual([after countOfStage:BITTelemetryStageCompression] - [before countOfStage:BITTelemetryStageCompression], (uint64_t)4);
+  XCTAssertGreaterThanOrEqual([after totalDurationOfStage:BITTelemetryStageCompression] - [before totalDurationOfStage:BITTelemetryStageCompression], 0.01);
+  XCTAssertGreaterThan([after durationOfStage:BITTelemetryStageCompression atPercentile:100], 0.01);
+}
+
+- (void)testDictionaryRepresentation {
+  bit_pipelineCount(BITTelemetryCounterItemsTracked, 1);
+  bit_pipelineRecordNanoseconds(BITTelemetryStageRequest, 2000000);
+  NSDictionary<NSString *, NSNumber *> *dictionary = [BITTelemetryPipelineSnapshot new].dictionaryRepresentation;
+
+  XCTAssertEqual(dictionary.count, (NSUInteger)(BITTelemetryCounterCount + 4 * BITTelemetryStageCount));
+  XCTAssertGreaterThanOrEqual(dictionary[@"itemsTracked"].unsignedLongLongValue, (uint64_t)1);
+  XCTAssertGreaterThanOrEqual(dictionary[@"request.count"].unsignedLongLongValue, (uint64_t)1);
+  XCTAssertGreaterThan(dictionary[@"request.p99"].doubleValue, 0);
+  XCTAssertNotNil(dictionary[@"serialization.p50"]);
+  XCTAssertNotNil(dictionary[@"batchesDeleted"]);
+}
+
+#pragma mark - Overhead
+
+// Runs the increments on the given number of threads and returns the nanoseconds per increment.
+- (double)nanosecondsPerIncrementOnThreads:(NSUInteger)threadCount increment:(void (^)(void))increment {
+  NSUInteger incrementsPerThread = BITBenchmarkIncrementCount / threadCount;
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t __unused thread) {
+    for (NSUInteger i = 0; i < incrementsPerThread; i++) {
+      increment();
+    }
+  });
+
+  // Threads run in parallel, so this is the cost a single thread sees per increment.
+  return (CFAbsoluteTimeGetCurrent() - start) / (double)incrementsPerThread * 1e9;
+}
+
+- (void)testIncrementOverhead {
+  for (NSNumber *threads in @[@1, @4, @16]) {
+    NSUInteger threadCount = threads.unsignedIntegerValue;
+    double shardedTime = [self nanosecondsPerIncrementOnThreads:threadCount increment:^{
+      bit_pipelineCount(BITTelemetryCounterItemsEnqueued, 1);
+    }];
+    double sharedTime = [self nanosecondsPerIncrementOnThreads:threadCount increment:^{
+      atomic_fetch_add_explicit(&bit_sharedCounter, 1, memory_order_relaxed);
+    }];
+    NSLog(@"Counting on %lu threads: per-thread shards %.1f ns, a single shared atomic %.1f ns",
+          (unsigned long)threadCount, shardedTime, sharedTime);
+  }
+}
+
+@end
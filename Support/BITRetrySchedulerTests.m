@@ -0,0 +1,99 @@
+//
+//  BITRetrySchedulerTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import "BITRetryScheduler.h"
+
+@interface BITRetrySchedulerTests : XCTestCase
+
+@property (nonatomic, strong) BITRetryScheduler *sut;
+
+@end
+
+@implementation BITRetrySchedulerTests
+
+- (void)setUp {
+  [super setUp];
+  self.sut = [BITRetryScheduler new];
+  self.sut.baseDelay = 1;
+  self.sut.maximumDelay = 16;
+  self.sut.maximumRetryAfter = 60;
+  self.sut.failureThreshold = 3;
+}
+
+- (void)testDelayGrowsExponentiallyWithJitterUpToTheMaximum {
+  XCTAssertEqual([self.sut delayForAttempt:0], 0.0);
+  for (NSUInteger attempt = 1; attempt <= 8; attempt++) {
+    NSTimeInterval fullDelay = MIN(exp2((double)(attempt - 1)), 16.0);
+    for (int i = 0; i < 100; i++) {
+      NSTimeInterval delay = [self.sut delayForAttempt:attempt];
+      XCTAssertGreaterThanOrEqual(delay, fullDelay / 2);
+      XCTAssertLessThanOrEqual(delay, fullDelay);
+    }
+  }
+  XCTAssertLessThanOrEqual([self.sut delayForAttempt:NSUIntegerMax], 16.0);
+}
+
+- (void)testFailuresDelayTheNextRequest {
+  XCTAssertEqual([self.sut acquireRequestAt:100], 0.0);
+
+  NSTimeInterval delay = [self.sut recordFailureAt:100 retryAfter:0];
+  XCTAssertGreaterThanOrEqual(delay, 0.5);
+  XCTAssertLessThanOrEqual(delay, 1.0);
+  XCTAssertEqualWithAccuracy([self.sut acquireRequestAt:100], delay, 0.001);
+  XCTAssertEqual([self.sut acquireRequestAt:100 + delay], 0.0);
+  XCTAssertEqual(self.sut.state, BITCircuitStateClosed);
+
+  [self.sut recordSuccess];
+  XCTAssertEqual(self.sut.consecutiveFailures, (NSUInteger)0);
+  XCTAssertEqual([self.sut acquireRequestAt:100], 0.0);
+}
+
+- (void)testRetryAfterIsHonoredUpToTheMaximum {
+  XCTAssertEqual([self.sut recordFailureAt:0 retryAfter:30], 30.0);
+  XCTAssertEqual([self.sut acquireRequestAt:10], 20.0);
+
+  [self.sut recordSuccess];
+  XCTAssertEqual([self.sut recordFailureAt:0 retryAfter:3600], 60.0);
+}
+
+- (void)testCircuitOpensAfterTooManyFailuresAndLetsOneProbeThrough {
+  NSTimeInterval time = 0;
+  for (NSUInteger i = 0; i < 3; i++) {
+    time += [self.sut recordFailureAt:time retryAfter:0];
+  }
+  XCTAssertEqual(self.sut.state, BITCircuitStateOpen);
+
+  // Once the delay has passed, a single probe is let through.
+  XCTAssertEqual([self.sut acquireRequestAt:time], 0.0);
+  XCTAssertEqual(self.sut.state, BITCircuitStateHalfOpen);
+  XCTAssertGreaterThan([self.sut acquireRequestAt:time], 0.0);
+
+  // A failed probe opens the circuit again with a longer delay.
+  NSTimeInterval delay = [self.sut recordFailureAt:time retryAfter:0];
+  XCTAssertEqual(self.sut.state, BITCircuitStateOpen);
+  XCTAssertGreaterThanOrEqual(delay, 4.0);
+  XCTAssertGreaterThan([self.sut acquireRequestAt:time], 0.0);
+
+  // A successful probe closes it.
+  time += delay;
+  XCTAssertEqual([self.sut acquireRequestAt:time], 0.0);
+  [self.sut recordSuccess];
+  XCTAssertEqual(self.sut.state, BITCircuitStateClosed);
+  XCTAssertEqual([self.sut acquireRequestAt:time], 0.0);
+  XCTAssertEqual([self.sut acquireRequestAt:time], 0.0);
+}
+
+- (void)testCancelledProbeCanBeTakenAgain {
+  self.sut.failureThreshold = 1;
+  NSTimeInterval time = [self.sut recordFailureAt:0 retryAfter:0];
+  XCTAssertEqual([self.sut acquireRequestAt:time], 0.0);
+  XCTAssertGreaterThan([self.sut acquireRequestAt:time], 0.0);
+
+  [self.sut cancelRequest];
+  XCTAssertEqual([self.sut acquireRequestAt:time], 0.0);
+}
+
+@end
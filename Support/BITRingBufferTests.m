@@ -0,0 +1,133 @@
+//
+//  BITRingBufferTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import "BITRingBuffer.h"
+
+@interface BITRingBufferTests : XCTestCase
+
+@property (nonatomic, assign) BITRingBuffer *sut;
+
+@end
+
+static void bit_collectRecord(void *context, const char *bytes, size_t length) {
+  NSMutableArray *records = (__bridge NSMutableArray *)context;
+  [records addObject:[[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding]];
+}
+
+@implementation BITRingBufferTests
+
+- (void)setUp {
+  [super setUp];
+  self.sut = bit_ringBufferCreate(4096);
+}
+
+- (void)tearDown {
+  bit_ringBufferDestroy(self.sut);
+  self.sut = NULL;
+  [super tearDown];
+}
+
+- (void)testCapacityIsRoundedUpToPowerOfTwo {
+  BITRingBuffer *buffer = bit_ringBufferCreate(5000);
+  XCTAssertEqual(bit_ringBufferCapacity(buffer), (size_t)8192);
+  bit_ringBufferDestroy(buffer);
+}
+
+- (void)testRecordsAreConsumedInOrder {
+  XCTAssertTrue(bit_ringBufferAppend(self.sut, "first\n", 6));
+  XCTAssertTrue(bit_ringBufferAppend(self.sut, "second\n", 7));
+
+  NSMutableArray *records = [NSMutableArray new];
+  size_t count = bit_ringBufferConsume(self.sut, bit_collectRecord, (__bridge void *)records);
+
+  XCTAssertEqual(count, (size_t)2);
+  XCTAssertEqualObjects(records, (@[@"first\n", @"second\n"]));
+  XCTAssertEqual(bit_ringBufferUsedBytes(self.sut), (size_t)0);
+}
+
+- (void)testAppendFailsIfBufferIsFull {
+  char record[1000];
+  memset(record, 'a', sizeof(record));
+  NSUInteger appended = 0;
+  while (bit_ringBufferAppend(self.sut, record, sizeof(record))) {
+    appended++;
+  }
+  XCTAssertEqual(appended, (NSUInteger)4);
+
+  // Consuming frees the space again.
+  bit_ringBufferDiscard(self.sut);
+  XCTAssertTrue(bit_ringBufferAppend(self.sut, record, sizeof(record)));
+}
+
+- (void)testRecordsWrapAround {
+  char record[700];
+  NSMutableArray *records = [NSMutableArray new];
+  for (int i = 0; i < 100; i++) {
+    memset(record, 'a' + (i % 26), sizeof(record));
+    XCTAssertTrue(bit_ringBufferAppend(self.sut, record, sizeof(record)));
+    bit_ringBufferConsume(self.sut, bit_collectRecord, (__bridge void *)records);
+  }
+  XCTAssertEqual(records.count, (NSUInteger)100);
+  for (NSUInteger i = 0; i < records.count; i++) {
+    NSString *record = records[i];
+    XCTAssertEqual(record.length, (NSUInteger)700);
+    XCTAssertEqual([record characterAtIndex:699], (unichar)('a' + (i % 26)));
+  }
+}
+
+- (void)testConcurrentProducers {
+  NSUInteger const producerCount = 8;
+  NSUInteger const recordsPerProducer = 5000;
+  BITRingBuffer *buffer = bit_ringBufferCreate(64 * 1024);
+  NSMutableArray *records = [NSMutableArray new];
+
+  dispatch_group_t group = dispatch_group_create();
+  for (NSUInteger producer = 0; producer < producerCount; producer++) {
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+      for (NSUInteger i = 0; i < recordsPerProducer; i++) {
+        char line[32];
+        int length = snprintf(line, sizeof(line), "%lu:%lu\n", (unsigned long)producer, (unsigned long)i);
+        while (!bit_ringBufferAppend(buffer, line, (size_t)length)) {
+          sched_yield();
+        }
+      }
+    });
+  }
+  while (dispatch_group_wait(group, DISPATCH_TIME_NOW) != 0) {
+    bit_ringBufferConsume(buffer, bit_collectRecord, (__bridge void *)records);
+  }
+  bit_ringBufferConsume(buffer, bit_collectRecord, (__bridge void *)records);
+
+  XCTAssertEqual(records.count, producerCount * recordsPerProducer);
+
+  // Records of a single producer keep their order.
+  NSMutableDictionary<NSString *, NSNumber *> *lastIndex = [NSMutableDictionary new];
+  for (NSString *record in records) {
+    NSArray *components = [[record stringByTrimmingCharactersInSet:[NSCharacterSet newlineCharacterSet]] componentsSeparatedByString:@":"];
+    NSInteger index = [components[1] integerValue];
+    NSNumber *previous = lastIndex[components[0]];
+    XCTAssertEqual(index, previous ? previous.integerValue + 1 : 0);
+    lastIndex[components[0]] = @(index);
+  }
+  bit_ringBufferDestroy(buffer);
+}
+
+- (void)testWriteToFileDescriptorDoesNotConsume {
+  bit_ringBufferAppend(self.sut, "{\"a\":1}\n", 8);
+  bit_ringBufferAppend(self.sut, "{\"b\":2}\n", 8);
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+  int fd = open(path.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  XCTAssertEqual(bit_ringBufferWriteToFileDescriptor(self.sut, fd), (ssize_t)16);
+  close(fd);
+
+  NSString *content = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil];
+  XCTAssertEqualObjects(content, @"{\"a\":1}\n{\"b\":2}\n");
+  XCTAssertGreaterThan(bit_ringBufferUsedBytes(self.sut), (size_t)0);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+@end
@@ -0,0 +1,252 @@
+//
+//  BITSegmentedLogTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import <signal.h>
+#import <sys/wait.h>
+#import "BITSegmentedLog.h"
+#import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
+
+static size_t const BITTestSegmentSize = 16 * 1024;
+
+// Fills the buffer with a record whose length and content are derived from its sequence number.
+static size_t bit_fillRecord(char *buffer, uint64_t sequence) {
+  size_t length = 8 + (size_t)((sequence * 7919) % 3000);
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = (char)((sequence + i) & 0xff);
+  }
+  memcpy(buffer, &sequence, sizeof(sequence));
+  return length;
+}
+
+@interface BITSegmentedLogTests : XCTestCase
+
+@property (nonatomic, copy) NSString *directoryPath;
+
+@end
+
+@implementation BITSegmentedLogTests
+
+- (void)setUp {
+  [super setUp];
+  self.directoryPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+  [[NSFileManager defaultManager] createDirectoryAtPath:self.directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeItemAtPath:self.directoryPath error:nil];
+  [super tearDown];
+}
+
+- (BITSegmentedLog *)openLog {
+  return bit_segmentedLogOpen(self.directoryPath.fileSystemRepresentation, BITTestSegmentSize);
+}
+
+- (NSArray *)segmentFiles {
+  return [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.directoryPath error:nil];
+}
+
+- (NSData *)readRecord:(BITSegmentedLogRecordID)recordID fromLog:(BITSegmentedLog *)log {
+  long long length = bit_segmentedLogRecordLength(log, recordID);
+  if (length <= 0) {
+    return nil;
+  }
+  NSMutableData *data = [NSMutableData dataWithLength:(NSUInteger)length];
+  return bit_segmentedLogRead(log, recordID, data.mutableBytes) ? data : nil;
+}
+
+// Reads all available records and checks that they are an uninterrupted sequence starting at firstSequence.
+- (uint64_t)verifyRecordsOfLog:(BITSegmentedLog *)log startingAt:(uint64_t)firstSequence {
+  char expected[4096];
+  uint64_t sequence = firstSequence;
+  BITSegmentedLogRecordID recordID;
+  while (bit_segmentedLogAcquireNext(log, &recordID)) {
+    NSData *record = [self readRecord:recordID fromLog:log];
+    size_t length = bit_fillRecord(expected, sequence);
+    XCTAssertEqualObjects(record, [NSData dataWithBytes:expected length:length], @"Record %llu is damaged", sequence);
+    sequence++;
+  }
+  return sequence;
+}
+
+#pragma mark - Tests
+
+- (void)testRecordsAreHandedOutOldestFirst {
+  BITSegmentedLog *log = [self openLog];
+  BITSegmentedLogRecordID first, second, acquired;
+  XCTAssertTrue(bit_segmentedLogAppend(log, "first", 5, &first));
+  XCTAssertTrue(bit_segmentedLogAppend(log, "second", 6, &second));
+  XCTAssertEqual(bit_segmentedLogRecordCount(log), (size_t)2);
+
+  XCTAssertTrue(bit_segmentedLogAcquireNext(log, &acquired));
+  XCTAssertEqual(acquired, first);
+  XCTAssertTrue(bit_segmentedLogAcquireNext(log, &acquired));
+  XCTAssertEqual(acquired, second);
+  XCTAssertFalse(bit_segmentedLogAcquireNext(log, &acquired));
+
+  // A released record is handed out again.
+  bit_segmentedLogRelease(log, first);
+  XCTAssertTrue(bit_segmentedLogAcquireNext(log, &acquired));
+  XCTAssertEqual(acquired, first);
+  XCTAssertEqualObjects([self readRecord:first fromLog:log], [@"first" dataUsingEncoding:NSUTF8StringEncoding]);
+
+  XCTAssertTrue(bit_segmentedLogRemove(log, first));
+  XCTAssertFalse(bit_segmentedLogRemove(log, first));
+  XCTAssertEqual(bit_segmentedLogRecordCount(log), (size_t)1);
+  XCTAssertEqual(bit_segmentedLogUsedBytes(log), (uint64_t)(16 + 6));
+  bit_segmentedLogClose(log);
+}
+
+- (void)testRemovedRecordsStayRemovedAfterReopening {
+  BITSegmentedLog *log = [self openLog];
+  BITSegmentedLogRecordID recordID;
+  char buffer[4096];
+  for (uint64_t sequence = 0; sequence < 10; sequence++) {
+    size_t length = bit_fillRecord(buffer, sequence);
+    bit_segmentedLogAppend(log, buffer, length, NULL);
+  }
+  for (int i = 0; i < 4; i++) {
+    bit_segmentedLogAcquireNext(log, &recordID);
+    bit_segmentedLogRemove(log, recordID);
+  }
+  bit_segmentedLogClose(log);
+
+  log = [self openLog];
+  XCTAssertEqual(bit_segmentedLogRecordCount(log), (size_t)6);
+  XCTAssertEqual([self verifyRecordsOfLog:log startingAt:4], (uint64_t)10);
+  bit_segmentedLogClose(log);
+}
+
+- (void)testSegmentsAreDeletedOnceAllRecordsAreRemoved {
+  BITSegmentedLog *log = [self openLog];
+  char buffer[4096];
+  for (uint64_t sequence = 0; sequence < 100; sequence++) {
+    size_t length = bit_fillRecord(buffer, sequence);
+    XCTAssertTrue(bit_segmentedLogAppend(log, buffer, length, NULL));
+  }
+  XCTAssertGreaterThan([self segmentFiles].count, (NSUInteger)5);
+
+  BITSegmentedLogRecordID recordID;
+  while (bit_segmentedLogAcquireNext(log, &recordID)) {
+    XCTAssertTrue(bit_segmentedLogRemove(log, recordID));
+  }
+  XCTAssertEqual(bit_segmentedLogRecordCount(log), (size_t)0);
+  XCTAssertEqual(bit_segmentedLogUsedBytes(log), (uint64_t)0);
+
+  // Only the segment new records are appended to is kept.
+  XCTAssertEqual([self segmentFiles].count, (NSUInteger)1);
+  bit_segmentedLogClose(log);
+}
+
+- (void)testRecoveryTruncatesDamagedTail {
+  BITSegmentedLog *log = [self openLog];
+  char buffer[4096];
+  for (uint64_t sequence = 0; sequence < 5; sequence++) {
+    size_t length = bit_fillRecord(buffer, sequence);
+    bit_segmentedLogAppend(log, buffer, length, NULL);
+  }
+  bit_segmentedLogClose(log);
+
+  // Simulate a crash in the middle of the last append, followed by garbage.
+  NSString *segmentPath = [self.directoryPath stringByAppendingPathComponent:[self segmentFiles].firstObject];
+  NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:segmentPath error:nil];
+  unsigned long long size = attributes.fileSize;
+  NSFileHandle *handle = [NSFileHandle fileHandleForUpdatingAtPath:segmentPath];
+  [handle truncateFileAtOffset:size - 10];
+  [handle writeData:[@"garbage" dataUsingEncoding:NSUTF8StringEncoding]];
+  [handle closeFile];
+
+  log = [self openLog];
+  XCTAssertEqual(bit_segmentedLogRecordCount(log), (size_t)4);
+  XCTAssertEqual([self verifyRecordsOfLog:log startingAt:0], (uint64_t)4);
+
+  // New records are appended right behind the last intact one.
+  size_t length = bit_fillRecord(buffer, 4);
+  XCTAssertTrue(bit_segmentedLogAppend(log, buffer, length, NULL));
+  bit_segmentedLogClose(log);
+
+  log = [self openLog];
+  XCTAssertEqual([self verifyRecordsOfLog:log startingAt:0], (uint64_t)5);
+  bit_segmentedLogClose(log);
+}
+
+- (void)testRecoveryAfterWritersAreKilledAtRandomPoints {
+  const char *directoryPath = self.directoryPath.fileSystemRepresentation;
+  uint64_t nextSequence = 0;
+  uint64_t firstSequence = 0;
+  srandom(42);
+
+  for (int round = 0; round < 50; round++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+
+      // The child only appends until it gets killed, somewhere in the middle of a record.
+      char buffer[4096];
+      BITSegmentedLog *log = bit_segmentedLogOpen(directoryPath, BITTestSegmentSize);
+      for (uint64_t sequence = nextSequence;; sequence++) {
+        size_t length = bit_fillRecord(buffer, sequence);
+        if (!log || !bit_segmentedLogAppend(log, buffer, length, NULL)) {
+          _exit(1);
+        }
+      }
+    }
+    XCTAssertGreaterThan(pid, 0);
+    usleep((useconds_t)(random() % 5000));
+    kill(pid, SIGKILL);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    XCTAssertTrue(WIFSIGNALED(status), @"Writer exited on its own in round %d", round);
+
+    // Everything that has been appended completely must be recovered, in order and without gaps.
+    BITSegmentedLog *log = bit_segmentedLogOpen(directoryPath, BITTestSegmentSize);
+    XCTAssertTrue(log != NULL);
+    nextSequence = [self verifyRecordsOfLog:log startingAt:firstSequence];
+    XCTAssertEqual(bit_segmentedLogRecordCount(log), (size_t)(nextSequence - firstSequence));
+    bit_segmentedLogClose(log);
+
+    // Remove some of the oldest records, like the sender does after a successful upload.
+    log = bit_segmentedLogOpen(directoryPath, BITTestSegmentSize);
+    uint64_t removeCount = (nextSequence - firstSequence) / 2;
+    BITSegmentedLogRecordID recordID;
+    for (uint64_t i = 0; i < removeCount && bit_segmentedLogAcquireNext(log, &recordID); i++) {
+      bit_segmentedLogRemove(log, recordID);
+    }
+    firstSequence += removeCount;
+    bit_segmentedLogClose(log);
+  }
+  XCTAssertGreaterThan(nextSequence, (uint64_t)0);
+}
+
+- (void)testPersistenceStoresBundlesInSegmentedLog {
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id mock = OCMPartialMock(persistence);
+  OCMStub([mock bundleIdentifier]).andReturn(bundleIdentifier);
+  persistence = [persistence initWithStorageFormat:BITPersistenceStorageFormatSegmentedLog];
+
+  NSData *bundle = [@"{\"name\":\"event\"}\n" dataUsingEncoding:NSUTF8StringEncoding];
+  [persistence persistBundle:bundle];
+  dispatch_sync(persistence.persistenceQueue, ^{});
+  XCTAssertEqual(persistence.segmentedLogRecordCount, (NSUInteger)1);
+
+  NSString *path = [persistence requestNextFilePath];
+  XCTAssertNotNil(path);
+  XCTAssertNil([persistence requestNextFilePath]);
+  XCTAssertEqualObjects([persistence dataAtFilePath:(NSString *)path], bundle);
+
+  [persistence giveBackRequestedFilePath:(NSString *)path];
+  path = [persistence requestNextFilePath];
+  XCTAssertNotNil(path);
+  [persistence deleteFileAtPath:(NSString *)path];
+  XCTAssertEqual(persistence.segmentedLogRecordCount, (NSUInteger)0);
+  XCTAssertNil([persistence requestNextFilePath]);
+
+  [[NSFileManager defaultManager] removeItemAtPath:[persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent error:nil];
+  [mock stopMocking];
+}
+
+@end
@@ -0,0 +1,650 @@
+//
+//  BITSenderTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITSender.h"
+#import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
+#import "BITGZIP.h"
+#import "BITCompression.h"
+#import "BITTestHTTPServer.h"
+#import "BITRetryScheduler.h"
+#import <zlib.h>
+#import <stdatomic.h>
+#import <mach/mach.h>
+
+@interface BITSenderTests : XCTestCase
+
+@property (nonatomic, strong) BITSender *sut;
+@property (nonatomic, strong) id persistenceMock;
+
+@end
+
+// Hands out a fixed number of batches from memory, so the sender can be stressed without touching the disk.
+static _Atomic(long) BITStressBatchesLeft;
+static _Atomic(long) BITStressRequestsSent;
+static _Atomic(long) BITStressRequestsRunning;
+static _Atomic(long) BITStressOversubscriptions;
+static NSUInteger const BITStressRequestLimit = 4;
+
+@interface BITStressPersistence : BITPersistence
+@end
+
+@implementation BITStressPersistence
+
+- (NSString *)requestNextFilePath {
+  return atomic_fetch_sub(&BITStressBatchesLeft, 1) > 0 ? @"hockey-app-bundle-stress" : nil;
+}
+
+- (NSData *)dataAtFilePath:(NSString *)filePath {
+  return filePath ? [@"{\"name\":\"stress\"}\n" dataUsingEncoding:NSUTF8StringEncoding] : nil;
+}
+
+- (NSURL *)uploadableFileURLForFilePath:(NSString * __unused)filePath uncompressedLength:(NSUInteger * __unused)uncompressedLength {
+  return nil;
+}
+
+- (void)deleteFileAtPath:(NSString * __unused)path {
+}
+
+- (void)giveBackRequestedFilePath:(NSString * __unused)filePath {
+}
+
+- (NSUInteger)failedSendAttemptsForFilePath:(NSString * __unused)filePath {
+  return 0;
+}
+
+- (NSDate *)nextRetryDate {
+  return nil;
+}
+
+@end
+
+// Answers every request on another thread after a short delay instead of sending it.
+@interface BITStressSender : BITSender
+@end
+
+@implementation BITStressSender
+
+- (void)sendRequest:(NSURLRequest * __unused)request filePath:(NSString *)path {
+  if (atomic_fetch_add(&BITStressRequestsRunning, 1) >= (long)BITStressRequestLimit) {
+    atomic_fetch_add(&BITStressOversubscriptions, 1);
+  }
+  atomic_fetch_add(&BITStressRequestsSent, 1);
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(50 * NSEC_PER_USEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+    atomic_fetch_sub(&BITStressRequestsRunning, 1);
+    NSData *responseData = [@"{\"itemsReceived\":1,\"itemsAccepted\":1,\"errors\":[]}" dataUsingEncoding:NSUTF8StringEncoding];
+    [self handleResponseWithStatusCode:200 responseData:(NSData *)responseData retryAfter:0 filePaths:@[path] itemCounts:nil error:nil];
+  });
+}
+
+@end
+
+@implementation BITSenderTests
+
+- (void)setUp {
+  [super setUp];
+  self.persistenceMock = OCMClassMock([BITPersistence class]);
+  self.sut = [[BITSender alloc] initWithPersistence:self.persistenceMock serverURL:(NSURL *)[NSURL URLWithString:@"https://example.com/v2/track"]];
+}
+
+- (NSData *)sentBodyForData:(NSData *)data {
+  __block NSData *body = nil;
+  id senderMock = OCMPartialMock(self.sut);
+  OCMStub([senderMock sendRequest:[OCMArg any] filePath:[OCMArg any]]).andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSURLRequest *request;
+    [invocation getArgument:&request atIndex:2];
+    body = request.HTTPBody;
+  });
+  [senderMock sendData:data withFilePath:@"hockey-app-bundle-test"];
+  [senderMock stopMocking];
+  return body;
+}
+
+- (void)testStoredGzipIsSentAsIs {
+  NSData *batch = [@"{\"name\":\"event\"}\n" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *gzippedBatch = [batch bit_gzippedData];
+
+  XCTAssertEqualObjects([self sentBodyForData:gzippedBatch], gzippedBatch);
+}
+
+- (void)testUncompressedBatchesAreGzipped {
+  NSData *batch = [@"{\"name\":\"event\"}\n" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *body = [self sentBodyForData:batch];
+
+  XCTAssertTrue([body bit_isGzippedData]);
+  XCTAssertEqualObjects([body bit_gunzippedData], batch);
+}
+
+- (void)testBatchesStoredWithOtherCodecsAreSentGzipped {
+  NSData *batch = [@"{\"name\":\"event\"}\n" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *body = [self sentBodyForData:(NSData *)bit_compressData(batch, BITCompressionCodecDeflateDictionary)];
+
+  XCTAssertTrue([body bit_isGzippedData]);
+  XCTAssertEqualObjects([body bit_gunzippedData], batch);
+}
+
+#pragma mark - Coalescing
+
+- (NSData *)batchWithItemCount:(NSUInteger)itemCount name:(NSString *)name {
+  NSMutableString *batch = [NSMutableString new];
+  for (NSUInteger i = 0; i < itemCount; i++) {
+    [batch appendFormat:@"{\"name\":\"%@\",\"time\":\"2016-11-18T12:00:%02lu.000Z\",\"iKey\":\"00000000-0000-0000-0000-000000000000\","
+                        @"\"tags\":{\"ai.device.os\":\"OS X\",\"ai.device.osVersion\":\"10.12.1\",\"ai.session.id\":\"%@\"},"
+                        @"\"data\":{\"baseType\":\"EventData\",\"baseData\":{\"ver\":2,\"name\":\"event-%lu\"}}}\n",
+                        name, (unsigned long)(i % 60), name, (unsigned long)i];
+  }
+  return (NSData *)[batch dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void)testBatchesAreCoalescedUpToTheLengthLimit {
+  NSData *first = [self batchWithItemCount:2 name:@"first"];
+  NSData *second = [self batchWithItemCount:1 name:@"second"];
+  NSData *third = [self batchWithItemCount:3 name:@"third"];
+  OCMExpect([self.persistenceMock requestNextFilePath]).andReturn(@"first");
+  OCMExpect([self.persistenceMock requestNextFilePath]).andReturn(@"second");
+  OCMExpect([self.persistenceMock requestNextFilePath]).andReturn(@"third");
+  OCMStub([self.persistenceMock dataAtFilePath:@"first"]).andReturn(bit_gzipData(first, Z_DEFAULT_COMPRESSION));
+  OCMStub([self.persistenceMock dataAtFilePath:@"second"]).andReturn(bit_compressData(second, BITCompressionCodecDeflateDictionary));
+  OCMStub([self.persistenceMock dataAtFilePath:@"third"]).andReturn(third);
+  OCMExpect([self.persistenceMock giveBackRequestedFilePath:@"third"]);
+
+  __block NSData *body = nil;
+  __block NSArray *sentFilePaths = nil;
+  __block NSArray *sentItemCounts = nil;
+  id senderMock = OCMPartialMock(self.sut);
+  OCMStub([senderMock sendRequestBodyAtURL:[OCMArg any] filePaths:[OCMArg any] itemCounts:[OCMArg any]]).andDo(^(NSInvocation *invocation) {
+    __unsafe_unretained NSURL *bodyURL;
+    __unsafe_unretained NSArray *filePaths;
+    __unsafe_unretained NSArray *itemCounts;
+    [invocation getArgument:&bodyURL atIndex:2];
+    [invocation getArgument:&filePaths atIndex:3];
+    [invocation getArgument:&itemCounts atIndex:4];
+    body = [NSData dataWithContentsOfURL:bodyURL];
+    [[NSFileManager defaultManager] removeItemAtURL:bodyURL error:nil];
+    sentFilePaths = filePaths;
+    sentItemCounts = itemCounts;
+  });
+  self.sut.maxRequestLength = first.length + second.length;
+
+  [senderMock sendSavedData];
+
+  OCMVerifyAll(self.persistenceMock);
+  NSMutableData *expectedBody = [first mutableCopy];
+  [expectedBody appendData:second];
+  XCTAssertEqualObjects(bit_gunzipData(body), expectedBody);
+  XCTAssertEqualObjects(sentFilePaths, (@[@"first", @"second"]));
+  XCTAssertEqualObjects(sentItemCounts, (@[@2, @1]));
+  [senderMock stopMocking];
+}
+
+- (void)testOnlyAcknowledgedBatchesAreDeleted {
+  NSDictionary *response = @{@"itemsReceived" : @5, @"itemsAccepted" : @3,
+                             @"errors" : @[@{@"index" : @2, @"statusCode" : @429}, @{@"index" : @4, @"statusCode" : @400}]};
+  NSData *responseData = [NSJSONSerialization dataWithJSONObject:response options:0 error:NULL];
+  OCMExpect([self.persistenceMock deleteFileAtPath:@"first"]);
+  OCMExpect([self.persistenceMock giveBackRequestedFilePath:@"second"]);
+  OCMExpect([self.persistenceMock deleteFileAtPath:@"third"]);
+  [[self.persistenceMock reject] deleteFileAtPath:@"second"];
+  [self.sut acquireRequestToken];
+
+  [self.sut handleResponseWithStatusCode:206 responseData:responseData retryAfter:0 filePaths:@[@"first", @"second", @"third"] itemCounts:@[@2, @2, @1] error:nil];
+
+  OCMVerifyAll(self.persistenceMock);
+}
+
+- (void)testRecoverableStatusCodeGivesBackAllBatches {
+  OCMExpect([self.persistenceMock giveBackRequestedFilePath:@"first"]);
+  OCMExpect([self.persistenceMock giveBackRequestedFilePath:@"second"]);
+  [[self.persistenceMock reject] deleteFileAtPath:[OCMArg any]];
+  [self.sut acquireRequestToken];
+
+  [self.sut handleResponseWithStatusCode:503 responseData:[NSData data] retryAfter:0 filePaths:@[@"first", @"second"] itemCounts:@[@1, @1] error:nil];
+
+  OCMVerifyAll(self.persistenceMock);
+  XCTAssertEqual(self.sut.runningRequestsCount, (NSUInteger)0);
+}
+
+- (void)testRetryableItemIndexesAreParsedFromTheResponse {
+  NSDictionary *response = @{@"errors" : @[@{@"index" : @1, @"statusCode" : @500}, @{@"index" : @3, @"statusCode" : @400}, @"garbage"]};
+  NSData *responseData = [NSJSONSerialization dataWithJSONObject:response options:0 error:NULL];
+
+  XCTAssertEqualObjects([self.sut retryableItemIndexesInResponseData:responseData], [NSIndexSet indexSetWithIndex:1]);
+  XCTAssertEqual([self.sut retryableItemIndexesInResponseData:[@"not json" dataUsingEncoding:NSUTF8StringEncoding]].count, (NSUInteger)0);
+}
+
+#pragma mark - Loopback server
+
+static NSUInteger const BITBacklogBatchCount = 100;
+static NSUInteger const BITBacklogBatchSize = 50;
+
+/**
+ *  Persists a backlog of 5000 events in 100 batches, sends it to a server on the loopback interface and measures the
+ *  time it takes until every batch has been deleted.
+ */
+- (NSTimeInterval)drainBacklogWithMaxBatchesPerRequest:(NSUInteger)maxBatchesPerRequest rejectFirstItem:(BOOL)rejectFirstItem requestCount:(NSUInteger *)requestCount {
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id persistenceMock = OCMPartialMock(persistence);
+  OCMStub([persistenceMock bundleIdentifier]).andReturn(bundleIdentifier);
+  persistence = [persistence init];
+  persistence.maxFileCount = BITBacklogBatchCount * 2;
+  for (NSUInteger i = 0; i < BITBacklogBatchCount; i++) {
+    [persistence persistBundle:(NSData *)bit_gzipData([self batchWithItemCount:BITBacklogBatchSize name:[NSString stringWithFormat:@"batch-%lu", (unsigned long)i]], Z_DEFAULT_COMPRESSION)];
+  }
+  dispatch_sync(persistence.persistenceQueue, ^{});
+  XCTAssertEqual(persistence.persistedBundleCount, BITBacklogBatchCount);
+
+  __block NSUInteger acceptedCount = 0;
+  __block BOOL rejected = !rejectFirstItem;
+  BITTestHTTPServer *server = [[BITTestHTTPServer alloc] initWithHandler:^BITTestHTTPResponse *(BITTestHTTPRequest *request) {
+    NSIndexSet *rejectedItems = nil;
+    @synchronized(self) {
+      if (!rejected) {
+        rejected = YES;
+        rejectedItems = [NSIndexSet indexSetWithIndex:0];
+      }
+      acceptedCount += request.lines.count - rejectedItems.count;
+    }
+    return [BITTestHTTPResponse telemetryResponseForRequest:request rejectingItems:rejectedItems statusCode:503];
+  }];
+  XCTAssertNotNil(server);
+
+  // Every request takes a simulated round trip, which is what coalescing saves.
+  server.responseDelay = 0.02;
+  BITSender *sender = [[BITSender alloc] initWithPersistence:persistence serverURL:server.URL];
+  sender.maxRequestCount = 1;
+  sender.maxBatchesPerRequest = maxBatchesPerRequest;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [sender sendSavedData];
+  while ((persistence.persistedBundleCount > 0 || sender.runningRequestsCount > 0) && CFAbsoluteTimeGetCurrent() - start < 60) {
+    [NSThread sleepForTimeInterval:0.005];
+  }
+  NSTimeInterval duration = CFAbsoluteTimeGetCurrent() - start;
+
+  XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)0);
+  @synchronized(self) {
+    XCTAssertEqual(acceptedCount, BITBacklogBatchCount * BITBacklogBatchSize);
+  }
+  *requestCount = server.requestCount;
+  [server stop];
+  [[NSFileManager defaultManager] removeItemAtPath:[persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent error:nil];
+  return duration;
+}
+
+- (void)testBacklogIsDrainedWithFewerRequestsWhenBatchesAreCoalesced {
+  NSUInteger singleRequestCount = 0;
+  NSUInteger coalescedRequestCount = 0;
+  NSTimeInterval single = [self drainBacklogWithMaxBatchesPerRequest:1 rejectFirstItem:NO requestCount:&singleRequestCount];
+  NSTimeInterval coalesced = [self drainBacklogWithMaxBatchesPerRequest:20 rejectFirstItem:NO requestCount:&coalescedRequestCount];
+
+  NSLog(@"Draining %lu events: %lu requests in %.3fs one batch per request, %lu requests in %.3fs coalesced",
+        (unsigned long)(BITBacklogBatchCount * BITBacklogBatchSize),
+        (unsigned long)singleRequestCount, single, (unsigned long)coalescedRequestCount, coalesced);
+  XCTAssertEqual(singleRequestCount, BITBacklogBatchCount);
+  XCTAssertEqual(coalescedRequestCount, BITBacklogBatchCount / 20);
+}
+
+- (void)testRejectedBatchIsSentAgainWhenBatchesAreCoalesced {
+  NSUInteger requestCount = 0;
+  [self drainBacklogWithMaxBatchesPerRequest:20 rejectFirstItem:YES requestCount:&requestCount];
+
+  // The batch with the rejected item is sent again in the next request, all other batches have been acknowledged.
+  XCTAssertEqual(requestCount, BITBacklogBatchCount / 20 + 1);
+}
+
+#pragma mark - Uploading from file
+
+static NSUInteger const BITLargeBacklogBatchCount = 20;
+static NSUInteger const BITLargeBacklogBatchLength = 10 * 1024 * 1024;
+
+static uint64_t bit_residentSize(void) {
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+    return 0;
+  }
+  return info.resident_size;
+}
+
+/**
+ *  A batch of events with random payloads, which gzip can only compress to about half of its length.
+ */
+- (NSData *)incompressibleBatchOfLength:(NSUInteger)length {
+  static const char hexDigits[] = "0123456789abcdef";
+  NSMutableData *batch = [NSMutableData dataWithCapacity:length];
+  uint8_t random[256];
+  char line[sizeof(random) * 2 + 32];
+  while (batch.length < length) {
+    arc4random_buf(random, sizeof(random));
+    size_t lineLength = (size_t)snprintf(line, sizeof(line), "{\"name\":\"payload\",\"data\":\"");
+    for (size_t i = 0; i < sizeof(random); i++) {
+      line[lineLength++] = hexDigits[random[i] >> 4];
+      line[lineLength++] = hexDigits[random[i] & 0x0f];
+    }
+    line[lineLength++] = '"';
+    line[lineLength++] = '}';
+    line[lineLength++] = '\n';
+    [batch appendBytes:line length:lineLength];
+  }
+  return batch;
+}
+
+- (void)testBatchStoredAsGzipFileIsUploadedFromItsFile {
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id persistenceMock = OCMPartialMock(persistence);
+  OCMStub([persistenceMock bundleIdentifier]).andReturn(bundleIdentifier);
+  persistence = [persistence init];
+  NSData *batch = [self batchWithItemCount:10 name:@"file"];
+  [persistence persistBundle:(NSData *)bit_gzipData(batch, Z_DEFAULT_COMPRESSION)];
+  [persistence persistBundle:(NSData *)bit_compressData(batch, BITCompressionCodecDeflateDictionary)];
+  dispatch_sync(persistence.persistenceQueue, ^{});
+
+  // Only the gzip file can be uploaded as it is.
+  NSArray<NSString *> *paths = persistence.persistedBundlePaths.array;
+  NSUInteger uncompressedLength = 0;
+  XCTAssertNotNil([persistence uploadableFileURLForFilePath:paths[0] uncompressedLength:&uncompressedLength]);
+  XCTAssertEqual(uncompressedLength, batch.length);
+  XCTAssertNil([persistence uploadableFileURLForFilePath:paths[1] uncompressedLength:NULL]);
+
+  NSMutableArray<NSData *> *bodies = [NSMutableArray new];
+  BITTestHTTPServer *server = [[BITTestHTTPServer alloc] initWithHandler:^BITTestHTTPResponse *(BITTestHTTPRequest *request) {
+    @synchronized(bodies) {
+      [bodies addObject:request.decodedBody];
+    }
+    return [BITTestHTTPResponse telemetryResponseForRequest:request rejectingItems:nil statusCode:0];
+  }];
+  BITSender *sender = [[BITSender alloc] initWithPersistence:persistence serverURL:server.URL];
+  sender.maxBatchesPerRequest = 1;
+  sender.maxRequestCount = 1;
+  id senderMock = OCMPartialMock(sender);
+  OCMExpect([senderMock sendFileAtURL:[OCMArg any] withFilePath:paths[0]]).andForwardToRealObject();
+
+  [senderMock sendSavedData];
+  [self waitForSender:sender untilDrainedOrTimeout:10];
+
+  OCMVerifyAll(senderMock);
+  XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)0);
+  XCTAssertEqualObjects(bodies, (@[batch, batch]));
+  [server stop];
+  [self removeDirectoryOfSender:sender];
+}
+
+/**
+ *  Drains a backlog of about 100 MB of gzipped batches to a server on the loopback interface and samples the resident
+ *  size of the process meanwhile.
+ *
+ *  @return how far the resident size grew above what it was before sending
+ */
+- (uint64_t)peakMemoryGrowthWhileDrainingLargeBacklogUploadingFromFile:(BOOL)uploadsFromFile duration:(NSTimeInterval *)duration {
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id persistenceMock = OCMPartialMock(persistence);
+  OCMStub([persistenceMock bundleIdentifier]).andReturn(bundleIdentifier);
+  persistence = [persistence init];
+  persistence.maxFileCount = BITLargeBacklogBatchCount * 2;
+  persistence.maxBytes = BITLargeBacklogBatchCount * BITLargeBacklogBatchLength * 2;
+  NSUInteger gzippedLength = 0;
+  @autoreleasepool {
+    NSData *gzippedBatch = bit_gzipData([self incompressibleBatchOfLength:BITLargeBacklogBatchLength], 1);
+    gzippedLength = gzippedBatch.length;
+    for (NSUInteger i = 0; i < BITLargeBacklogBatchCount; i++) {
+      [persistence persistBundle:(NSData *)gzippedBatch];
+    }
+    dispatch_sync(persistence.persistenceQueue, ^{});
+  }
+  XCTAssertEqual(persistence.persistedBundleCount, BITLargeBacklogBatchCount);
+
+  BITTestHTTPServer *server = [[BITTestHTTPServer alloc] initWithHandler:^BITTestHTTPResponse *(BITTestHTTPRequest * __unused request) {
+    return [BITTestHTTPResponse responseWithStatusCode:200
+                                               headers:@{@"Content-Type" : @"application/json"}
+                                                  body:[@"{\"errors\":[]}" dataUsingEncoding:NSUTF8StringEncoding]];
+  }];
+  server.discardsBodies = YES;
+  BITSender *sender = [[BITSender alloc] initWithPersistence:persistence serverURL:server.URL];
+  sender.maxBatchesPerRequest = 1;
+  sender.uploadsFromFile = uploadsFromFile;
+
+  uint64_t baseline = bit_residentSize();
+  __block uint64_t peak = baseline;
+  dispatch_semaphore_t drained = dispatch_semaphore_create(0);
+  dispatch_semaphore_t samplingFinished = dispatch_semaphore_create(0);
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+    while (dispatch_semaphore_wait(drained, dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_MSEC)) != 0) {
+      peak = MAX(peak, bit_residentSize());
+    }
+    dispatch_semaphore_signal(samplingFinished);
+  });
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  @autoreleasepool {
+    [sender sendSavedData];
+    while ((persistence.persistedBundleCount > 0 || sender.runningRequestsCount > 0) && CFAbsoluteTimeGetCurrent() - start < 120) {
+      [NSThread sleepForTimeInterval:0.01];
+    }
+  }
+  *duration = CFAbsoluteTimeGetCurrent() - start;
+  dispatch_semaphore_signal(drained);
+  dispatch_semaphore_wait(samplingFinished, DISPATCH_TIME_FOREVER);
+
+  XCTAssertEqual(persistence.persistedBundleCount, (NSUInteger)0);
+  XCTAssertEqual(server.receivedBodyLength, (unsigned long long)(gzippedLength * BITLargeBacklogBatchCount));
+  [server stop];
+  [self removeDirectoryOfSender:sender];
+  return peak - baseline;
+}
+
+- (void)testPeakMemoryWhileDrainingLargeBacklogDoesntDependOnBatchSize {
+  NSTimeInterval inMemoryDuration = 0;
+  NSTimeInterval fromFileDuration = 0;
+  uint64_t inMemory = [self peakMemoryGrowthWhileDrainingLargeBacklogUploadingFromFile:NO duration:&inMemoryDuration];
+  uint64_t fromFile = [self peakMemoryGrowthWhileDrainingLargeBacklogUploadingFromFile:YES duration:&fromFileDuration];
+
+  NSLog(@"Draining %lu batches of %lu MB: peak resident size +%.1f MB in %.2fs read into memory, +%.1f MB in %.2fs uploaded from file",
+        (unsigned long)BITLargeBacklogBatchCount, (unsigned long)(BITLargeBacklogBatchLength / 1024 / 1024),
+        (double)inMemory / 1024 / 1024, inMemoryDuration, (double)fromFile / 1024 / 1024, fromFileDuration);
+
+  // Every running request holds a whole batch in memory on the old path, on the new one only the buffers of the
+  // session do.
+  XCTAssertLessThan(fromFile, inMemory / 2);
+}
+
+#pragma mark - Retrying
+
+- (void)testRetryAfterHeaderIsParsed {
+  NSURL *url = (NSURL *)[NSURL URLWithString:@"https://example.com/v2/track"];
+  NSHTTPURLResponse *seconds = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:429 HTTPVersion:@"HTTP/1.1" headerFields:@{@"retry-after" : @"120"}];
+  XCTAssertEqual([self.sut retryAfterIntervalOfResponse:seconds], 120.0);
+
+  NSDateFormatter *formatter = [NSDateFormatter new];
+  formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+  formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+  formatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss 'GMT'";
+  NSString *httpDate = [formatter stringFromDate:[NSDate dateWithTimeIntervalSinceNow:300]];
+  NSHTTPURLResponse *date = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:503 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Retry-After" : httpDate}];
+  XCTAssertEqualWithAccuracy([self.sut retryAfterIntervalOfResponse:date], 300.0, 2.0);
+
+  NSHTTPURLResponse *invalid = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:503 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Retry-After" : @"soon"}];
+  XCTAssertEqual([self.sut retryAfterIntervalOfResponse:invalid], 0.0);
+  XCTAssertEqual([self.sut retryAfterIntervalOfResponse:nil], 0.0);
+}
+
+- (void)testFailedBatchesAreDeferredWithTheirAttempts {
+  OCMStub([self.persistenceMock failedSendAttemptsForFilePath:@"first"]).andReturn(2);
+  OCMExpect([self.persistenceMock recordFailedSendAttemptForFilePath:@"first" retryDate:[OCMArg checkWithBlock:^BOOL(NSDate *retryDate) {
+    return retryDate.timeIntervalSinceNow > 25;
+  }]]);
+  OCMExpect([self.persistenceMock giveBackRequestedFilePath:@"first"]);
+  [self.sut acquireRequestToken];
+
+  [self.sut handleResponseWithStatusCode:429 responseData:[NSData data] retryAfter:30 filePaths:@[@"first"] itemCounts:nil error:nil];
+
+  OCMVerifyAll(self.persistenceMock);
+  XCTAssertEqual(self.sut.retryScheduler.consecutiveFailures, (NSUInteger)1);
+  XCTAssertGreaterThan([self.sut.retryScheduler acquireRequestAt:[NSProcessInfo processInfo].systemUptime], 25.0);
+}
+
+- (void)testBatchesAreDroppedOnceTheirAttemptsAreUsedUp {
+  self.sut.maxSendAttempts = 3;
+  OCMStub([self.persistenceMock failedSendAttemptsForFilePath:@"first"]).andReturn(2);
+  OCMExpect([self.persistenceMock dropFileAtPath:@"first"]);
+  [[self.persistenceMock reject] giveBackRequestedFilePath:@"first"];
+  [self.sut acquireRequestToken];
+
+  [self.sut handleResponseWithStatusCode:500 responseData:[NSData data] retryAfter:0 filePaths:@[@"first"] itemCounts:nil error:nil];
+
+  OCMVerifyAll(self.persistenceMock);
+}
+
+- (void)testFailuresWithoutResponseDontUseUpAttempts {
+  OCMExpect([self.persistenceMock giveBackRequestedFilePath:@"first"]);
+  [[self.persistenceMock reject] recordFailedSendAttemptForFilePath:[OCMArg any] retryDate:[OCMArg any]];
+  [self.sut acquireRequestToken];
+
+  NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNotConnectedToInternet userInfo:nil];
+  [self.sut handleResponseWithStatusCode:0 responseData:nil retryAfter:0 filePaths:@[@"first"] itemCounts:nil error:error];
+
+  OCMVerifyAll(self.persistenceMock);
+  XCTAssertEqual(self.sut.retryScheduler.consecutiveFailures, (NSUInteger)1);
+}
+
+#pragma mark - Scripted endpoint
+
+/**
+ *  Creates a sender for a persistence with the given number of batches and a server that answers with the given status
+ *  codes in turn, repeating the last one. The Retry-After header is only sent with the first response.
+ */
+- (BITSender *)senderWithBatchCount:(NSUInteger)batchCount server:(BITTestHTTPServer *__autoreleasing *)server statusCodes:(NSArray<NSNumber *> *)statusCodes retryAfter:(NSString *)retryAfter {
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id persistenceMock = OCMPartialMock(persistence);
+  OCMStub([persistenceMock bundleIdentifier]).andReturn(bundleIdentifier);
+  persistence = [persistence init];
+  for (NSUInteger i = 0; i < batchCount; i++) {
+    [persistence persistBundle:(NSData *)bit_gzipData([self batchWithItemCount:5 name:@"retry"], Z_DEFAULT_COMPRESSION)];
+  }
+  dispatch_sync(persistence.persistenceQueue, ^{});
+
+  __block NSUInteger responseIndex = 0;
+  *server = [[BITTestHTTPServer alloc] initWithHandler:^BITTestHTTPResponse *(BITTestHTTPRequest *request) {
+    NSUInteger index;
+    @synchronized(statusCodes) {
+      index = responseIndex++;
+    }
+    NSInteger statusCode = statusCodes[MIN(index, statusCodes.count - 1)].integerValue;
+    if (statusCode == 200) {
+      return [BITTestHTTPResponse telemetryResponseForRequest:request rejectingItems:nil statusCode:0];
+    }
+    NSDictionary *headers = index == 0 && retryAfter ? @{@"Retry-After" : retryAfter} : nil;
+    return [BITTestHTTPResponse responseWithStatusCode:statusCode headers:headers body:nil];
+  }];
+
+  BITSender *sender = [[BITSender alloc] initWithPersistence:persistence serverURL:(*server).URL];
+  sender.maxBatchesPerRequest = 1;
+  sender.maxRequestCount = 1;
+  return sender;
+}
+
+- (void)waitForSender:(BITSender *)sender untilDrainedOrTimeout:(NSTimeInterval)timeout {
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  while ((sender.persistence.persistedBundleCount > 0 || sender.runningRequestsCount > 0) && CFAbsoluteTimeGetCurrent() - start < timeout) {
+
+    // Simulates telemetry being persisted all the time, which used to trigger a retry every time.
+    [sender sendSavedDataAsync];
+    [NSThread sleepForTimeInterval:0.01];
+  }
+}
+
+- (void)removeDirectoryOfSender:(BITSender *)sender {
+  [[NSFileManager defaultManager] removeItemAtPath:[sender.persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent error:nil];
+}
+
+- (void)testRetryAfterIsHonoredByTheSender {
+  BITTestHTTPServer *server = nil;
+  BITSender *sender = [self senderWithBatchCount:1 server:&server statusCodes:@[@503, @200] retryAfter:@"1"];
+  sender.retryScheduler.baseDelay = 0.01;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [sender sendSavedData];
+  [self waitForSender:sender untilDrainedOrTimeout:10];
+  CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+
+  XCTAssertEqual(sender.persistence.persistedBundleCount, (NSUInteger)0);
+  XCTAssertEqual(server.requestCount, (NSUInteger)2);
+  XCTAssertGreaterThanOrEqual(duration, 1.0);
+  XCTAssertEqual(sender.retryScheduler.state, BITCircuitStateClosed);
+  [server stop];
+  [self removeDirectoryOfSender:sender];
+}
+
+- (void)testCircuitBreakerLimitsRequestsDuringAnOutage {
+  BITTestHTTPServer *server = nil;
+  BITSender *sender = [self senderWithBatchCount:5 server:&server statusCodes:@[@500] retryAfter:nil];
+  sender.retryScheduler.baseDelay = 0.05;
+  sender.retryScheduler.maximumDelay = 0.4;
+  sender.retryScheduler.failureThreshold = 3;
+
+  [sender sendSavedData];
+  [self waitForSender:sender untilDrainedOrTimeout:2];
+
+  // Without backing off, every trigger would have been a request, about 200 of them.
+  NSUInteger requestCount = server.requestCount;
+  NSLog(@"%lu requests during a 2 second outage", (unsigned long)requestCount);
+  XCTAssertGreaterThanOrEqual(requestCount, (NSUInteger)3);
+  XCTAssertLessThanOrEqual(requestCount, (NSUInteger)15);
+  XCTAssertEqual(sender.persistence.persistedBundleCount, (NSUInteger)5);
+  XCTAssertNotEqual(sender.retryScheduler.state, BITCircuitStateClosed);
+  [server stop];
+  [self removeDirectoryOfSender:sender];
+}
+
+#pragma mark - Request tokens
+
+- (void)testRequestTokensNeitherLeakNorOversubscribeWhenSendingFromManyThreads {
+  NSUInteger threadCount = 16;
+  NSUInteger triggersPerThread = 2000;
+  long batchCount = 20000;
+  atomic_store(&BITStressBatchesLeft, batchCount);
+  atomic_store(&BITStressRequestsSent, 0);
+  atomic_store(&BITStressRequestsRunning, 0);
+  atomic_store(&BITStressOversubscriptions, 0);
+
+  // The persistence is never initialized, the stubbed methods don't need any state.
+  BITStressPersistence *persistence = [BITStressPersistence alloc];
+  BITStressSender *sender = [[BITStressSender alloc] initWithPersistence:persistence serverURL:(NSURL *)[NSURL URLWithString:@"https://example.com/v2/track"]];
+  sender.maxRequestCount = BITStressRequestLimit;
+  sender.maxBatchesPerRequest = 1;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t __unused thread) {
+    for (NSUInteger i = 0; i < triggersPerThread; i++) {
+      [sender sendSavedDataAsync];
+    }
+  });
+  CFAbsoluteTime dispatchDuration = CFAbsoluteTimeGetCurrent() - start;
+
+  // Every response sends the next batch, so the backlog drains even after the triggers have stopped.
+  while ((atomic_load(&BITStressBatchesLeft) > 0 || sender.runningRequestsCount > 0) && CFAbsoluteTimeGetCurrent() - start < 60) {
+    [NSThread sleepForTimeInterval:0.001];
+  }
+  dispatch_barrier_sync(sender.senderTasksQueue, ^{});
+  CFAbsoluteTime drainDuration = CFAbsoluteTimeGetCurrent() - start;
+
+  NSLog(@"%lu triggers from %lu threads dispatched in %.1f ms (%.0f ns each), %ld requests sent in %.1f ms, peak %lu running",
+        (unsigned long)(threadCount * triggersPerThread), (unsigned long)threadCount, dispatchDuration * 1000,
+        dispatchDuration / (double)(threadCount * triggersPerThread) * 1e9, atomic_load(&BITStressRequestsSent),
+        drainDuration * 1000, (unsigned long)sender.peakRunningRequestsCount);
+  XCTAssertEqual(atomic_load(&BITStressRequestsSent), batchCount);
+  XCTAssertEqual(atomic_load(&BITStressOversubscriptions), 0L);
+  XCTAssertEqual(sender.runningRequestsCount, (NSUInteger)0);
+  XCTAssertLessThanOrEqual(sender.peakRunningRequestsCount, BITStressRequestLimit);
+  XCTAssertTrue([sender acquireRequestToken]);
+  [sender releaseRequestToken];
+}
+
+@end
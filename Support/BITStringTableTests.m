@@ -0,0 +1,195 @@
+//
+//  BITStringTableTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <pthread.h>
+#import "BITStringTable.h"
+#import "BITJSONWriter.h"
+
+static NSUInteger const BITBenchmarkStringCount = 300;
+static NSUInteger const BITBenchmarkLookupCount = 1000000;
+
+@interface BITStringTableTests : XCTestCase
+
+@property (nonatomic, assign) BITStringTable *sut;
+
+@end
+
+@implementation BITStringTableTests
+
+- (void)setUp {
+  [super setUp];
+  self.sut = bit_stringTableCreate(4);
+}
+
+- (void)tearDown {
+  bit_stringTableDestroy(self.sut);
+  self.sut = NULL;
+  [super tearDown];
+}
+
+- (void)testEqualStringsShareAnEntry {
+  NSString *name = @"Screen viewed";
+  const BITStringTableEntry *entry = bit_stringTableIntern(self.sut, (__bridge CFStringRef)name);
+  const BITStringTableEntry *other = bit_stringTableIntern(self.sut, (__bridge CFStringRef)[NSMutableString stringWithString:name]);
+  const BITStringTableEntry *key = bit_stringTableIntern(self.sut, CFSTR("screen"));
+
+  XCTAssertTrue(entry != NULL);
+  XCTAssertEqual(entry, other);
+  XCTAssertEqual(entry->identifier, (BITStringTableIdentifier)0);
+  XCTAssertEqual(key->identifier, (BITStringTableIdentifier)1);
+  XCTAssertEqual(bit_stringTableEntry(self.sut, 1), key);
+  XCTAssertTrue(bit_stringTableEntry(self.sut, 2) == NULL);
+  XCTAssertEqual(bit_stringTableCount(self.sut), (size_t)2);
+}
+
+- (void)testEntriesHoldTheUTF8AndJSONRepresentation {
+  NSString *string = @"quote\" newline\n control\x01 emoji😀 umlaut ä";
+  const BITStringTableEntry *entry = bit_stringTableIntern(self.sut, (__bridge CFStringRef)string);
+
+  XCTAssertEqualObjects(@(entry->bytes), string);
+  XCTAssertEqual(entry->length, (uint32_t)strlen(entry->bytes));
+  XCTAssertEqual(entry->jsonLength, (uint32_t)strlen(entry->json));
+  NSString *json = [NSString stringWithFormat:@"[%s]", entry->json];
+  NSArray *parsed = [NSJSONSerialization JSONObjectWithData:[json dataUsingEncoding:NSUTF8StringEncoding] options:(NSJSONReadingOptions)0 error:nil];
+  XCTAssertEqualObjects(parsed, @[string]);
+}
+
+- (void)testUnpairedSurrogatesAreReplacedInsteadOfCuttingEntriesOff {
+  unichar characters[] = {'a', 0xdc00, 'b'};
+  const BITStringTableEntry *entry = bit_stringTableIntern(self.sut, (__bridge CFStringRef)[NSString stringWithCharacters:characters length:3]);
+
+  XCTAssertEqualObjects(@(entry->bytes), @"a?b");
+  XCTAssertEqual(entry->length, (uint32_t)3);
+  XCTAssertEqualObjects(@(entry->json), @"\"a?b\"");
+}
+
+- (void)testChangingAMutableStringDoesNotChangeItsEntry {
+  NSMutableString *string = [NSMutableString stringWithString:@"before"];
+  const BITStringTableEntry *entry = bit_stringTableIntern(self.sut, (__bridge CFStringRef)string);
+  [string setString:@"after"];
+
+  XCTAssertEqualObjects(@(entry->bytes), @"before");
+  XCTAssertEqual(bit_stringTableIntern(self.sut, CFSTR("before")), entry);
+  XCTAssertNotEqual(bit_stringTableIntern(self.sut, (__bridge CFStringRef)string), entry);
+}
+
+- (void)testStringsAreRejectedOnceTheTableIsFull {
+  for (int i = 0; i < 4; i++) {
+    XCTAssertTrue(bit_stringTableIntern(self.sut, (__bridge CFStringRef)[NSString stringWithFormat:@"key %d", i]) != NULL);
+  }
+  XCTAssertTrue(bit_stringTableIntern(self.sut, CFSTR("key 4")) == NULL);
+  XCTAssertTrue(bit_stringTableIntern(self.sut, CFSTR("key 0")) != NULL);
+
+  BITStringTableStatistics statistics = bit_stringTableStatistics(self.sut);
+  XCTAssertEqual(statistics.insertionCount, (uint64_t)4);
+  XCTAssertEqual(statistics.rejectionCount, (uint64_t)1);
+  XCTAssertEqual(statistics.hitCount, (uint64_t)1);
+  XCTAssertEqual(statistics.count, (size_t)4);
+}
+
+- (void)testConcurrentThreadsGetTheSameEntries {
+  BITStringTable *table = bit_stringTableCreate(BITBenchmarkStringCount);
+  NSArray<NSString *> *strings = [self benchmarkStrings];
+  const BITStringTableEntry **entries = calloc(16 * BITBenchmarkStringCount, sizeof(BITStringTableEntry *));
+
+  dispatch_apply(16, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+
+    // Every thread walks the strings in a different order, so they race for adding them.
+    for (NSUInteger i = 0; i < BITBenchmarkStringCount; i++) {
+      NSUInteger index = (i + thread * 37) % BITBenchmarkStringCount;
+      NSString *copy = [NSMutableString stringWithString:strings[index]];
+      entries[thread * BITBenchmarkStringCount + index] = bit_stringTableIntern(table, (__bridge CFStringRef)copy);
+    }
+  });
+
+  for (NSUInteger i = 0; i < BITBenchmarkStringCount; i++) {
+    const BITStringTableEntry *entry = entries[i];
+    XCTAssertTrue(entry != NULL);
+    XCTAssertEqualObjects(@(entry->bytes), strings[i]);
+    XCTAssertEqual(bit_stringTableEntry(table, entry->identifier), entry);
+    for (NSUInteger thread = 1; thread < 16; thread++) {
+      XCTAssertEqual(entries[thread * BITBenchmarkStringCount + i], entry);
+    }
+  }
+  BITStringTableStatistics statistics = bit_stringTableStatistics(table);
+  XCTAssertEqual(statistics.count, (size_t)BITBenchmarkStringCount);
+  XCTAssertEqual(statistics.insertionCount, (uint64_t)BITBenchmarkStringCount);
+  XCTAssertEqual(statistics.hitCount, (uint64_t)(15 * BITBenchmarkStringCount));
+  free(entries);
+  bit_stringTableDestroy(table);
+}
+
+#pragma mark - Benchmark
+
+- (NSArray<NSString *> *)benchmarkStrings {
+  NSMutableArray<NSString *> *strings = [NSMutableArray new];
+  for (NSUInteger i = 0; i < BITBenchmarkStringCount; i++) {
+    [strings addObject:[NSString stringWithFormat:@"%@.%@ %lu", i % 2 ? @"Property" : @"Event", i % 3 ? @"key" : @"näme", (unsigned long)i]];
+  }
+  return strings;
+}
+
+// Runs the lookups on the given number of threads and returns the nanoseconds per lookup.
+- (double)nanosecondsPerLookupOnThreads:(NSUInteger)threadCount strings:(NSArray<NSString *> *)strings lookup:(void (^)(CFStringRef string, BITJSONWriter *writer))lookup {
+  NSUInteger lookupsPerThread = BITBenchmarkLookupCount / threadCount;
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+    BITJSONWriter *writer = bit_jsonWriterCreate(4096);
+    for (NSUInteger i = 0; i < lookupsPerThread; i++) {
+      if (i % 64 == 0) {
+        bit_jsonWriterReset(writer);
+      }
+      lookup((__bridge CFStringRef)strings[(i * 7 + thread) % strings.count], writer);
+    }
+    bit_jsonWriterDestroy(writer);
+  });
+  return (CFAbsoluteTimeGetCurrent() - start) / (double)(lookupsPerThread * threadCount) * 1e9;
+}
+
+- (void)testReadMostlyLookupsAcrossCores {
+  NSArray<NSString *> *strings = [self benchmarkStrings];
+  BITStringTable *table = bit_stringTableCreate(4096);
+
+  // The previous approach: a dictionary guarded by a lock, whose values still have to be escaped when written.
+  CFMutableDictionaryRef dictionary = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+  pthread_mutex_t *lock = malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(lock, NULL);
+  for (NSString *string in strings) {
+    CFDictionarySetValue(dictionary, (__bridge CFStringRef)string, (__bridge CFStringRef)string);
+  }
+
+  for (NSNumber *threads in @[@1, @4, @16]) {
+    NSUInteger threadCount = threads.unsignedIntegerValue;
+    double tableTime = [self nanosecondsPerLookupOnThreads:threadCount strings:strings lookup:^(CFStringRef string, BITJSONWriter *writer) {
+      const BITStringTableEntry *entry = bit_stringTableIntern(table, string);
+      bit_jsonWriterRawKey(writer, entry->json, entry->jsonLength);
+    }];
+    double lockedTime = [self nanosecondsPerLookupOnThreads:threadCount strings:strings lookup:^(CFStringRef string, BITJSONWriter *writer) {
+      pthread_mutex_lock(lock);
+      CFStringRef value = CFDictionaryGetValue(dictionary, string);
+      pthread_mutex_unlock(lock);
+      bit_jsonWriterNSStringKey(writer, (__bridge NSString *)value);
+    }];
+    double escapedTime = [self nanosecondsPerLookupOnThreads:threadCount strings:strings lookup:^(CFStringRef string, BITJSONWriter *writer) {
+      bit_jsonWriterNSStringKey(writer, (__bridge NSString *)string);
+    }];
+    NSLog(@"Writing a key on %lu threads: string table %.1f ns, locked dictionary %.1f ns, escaping every time %.1f ns",
+          (unsigned long)threadCount, tableTime, lockedTime, escapedTime);
+  }
+
+  BITStringTableStatistics statistics = bit_stringTableStatistics(table);
+  double hitRate = (double)statistics.hitCount / (double)(statistics.hitCount + statistics.insertionCount + statistics.rejectionCount);
+  NSLog(@"String table hit rate %.4f%% with %zu strings", hitRate * 100, statistics.count);
+  XCTAssertEqual(statistics.count, (size_t)BITBenchmarkStringCount);
+  XCTAssertGreaterThan(hitRate, 0.999);
+
+  pthread_mutex_destroy(lock);
+  free(lock);
+  CFRelease(dictionary);
+  bit_stringTableDestroy(table);
+}
+
+@end
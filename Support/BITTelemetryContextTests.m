@@ -0,0 +1,90 @@
+//
+//  BITTelemetryContextTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+
+@interface BITTelemetryContext (Testing)
+
+- (void)setAppVersion:(NSString *)appVersion;
+- (void)setOsLanguage:(NSString *)osLanguage;
+
+@end
+
+@interface BITTelemetryContextTests : XCTestCase
+
+@property (nonatomic, strong) BITTelemetryContext *sut;
+
+@end
+
+@implementation BITTelemetryContextTests
+
+- (void)setUp {
+  [super setUp];
+  id persistenceMock = OCMClassMock([BITPersistence class]);
+  self.sut = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123" persistence:persistenceMock];
+}
+
+- (NSDictionary *)parsedTagsFragment {
+  return [NSJSONSerialization JSONObjectWithData:self.sut.tagsFragment options:(NSJSONReadingOptions)0 error:nil];
+}
+
+- (void)waitForPendingUpdates {
+
+  // A synchronous block on the concurrent queue only runs after all previously submitted barrier blocks.
+  dispatch_sync(self.sut.operationsQueue, ^{});
+}
+
+- (void)testTagsFragmentContainsContextDictionary {
+  XCTAssertNotNil(self.sut.tagsFragment);
+  XCTAssertEqualObjects([self parsedTagsFragment], self.sut.contextDictionary);
+}
+
+- (void)testSettersRebuildTagsFragment {
+  NSUInteger buildCount = self.sut.tagsFragmentBuildCount;
+
+  [self.sut setSessionId:@"session"];
+  [self waitForPendingUpdates];
+
+  XCTAssertEqual(self.sut.tagsFragmentBuildCount, buildCount + 1);
+  XCTAssertEqualObjects([self parsedTagsFragment][@"ai.session.id"], @"session");
+}
+
+- (void)testDeviceAndApplicationSettersRebuildTagsFragment {
+  [self.sut setAppVersion:@"4.2"];
+  [self.sut setOsLanguage:@"de"];
+  [self waitForPendingUpdates];
+
+  NSDictionary *tags = [self parsedTagsFragment];
+  XCTAssertEqualObjects(tags[@"ai.application.ver"], @"4.2");
+  XCTAssertEqualObjects(tags[@"ai.device.language"], @"de");
+  XCTAssertEqualObjects(tags, self.sut.contextDictionary);
+}
+
+- (void)testTagsFragmentIsOnlyRebuiltOnChanges {
+  [self.sut setSessionId:@"session"];
+  [self.sut setAppVersion:@"4.2"];
+  [self waitForPendingUpdates];
+  NSData *fragment = self.sut.tagsFragment;
+  NSUInteger buildCount = self.sut.tagsFragmentBuildCount;
+
+  [self.sut setSessionId:@"session"];
+  [self.sut setAppVersion:@"4.2"];
+  [self.sut setIsNewSession:self.sut.isNewSession];
+  [self waitForPendingUpdates];
+
+  XCTAssertEqual(self.sut.tagsFragment, fragment);
+  XCTAssertEqual(self.sut.tagsFragmentBuildCount, buildCount);
+
+  [self.sut setSessionId:@"other session"];
+  [self waitForPendingUpdates];
+
+  XCTAssertNotEqual(self.sut.tagsFragment, fragment);
+  XCTAssertEqual(self.sut.tagsFragmentBuildCount, buildCount + 1);
+}
+
+@end
@@ -0,0 +1,309 @@
+//
+//  BITTelemetryEndToEndBenchmarkTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#import "BITMetricsManager.h"
+#import "BITMetricsManagerPrivate.h"
+#import "BITHockeyBaseManagerPrivate.h"
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
+#import "BITSender.h"
+#import "BITRetryScheduler.h"
+#import "BITTelemetryPipelineSnapshot.h"
+#import "BITTestHTTPServer.h"
+
+// The path the results are written to can be set in the environment of the test run, so a CI job can keep them.
+static NSString *const BITBenchmarkResultsPathVariable = @"BIT_BENCHMARK_RESULTS_PATH";
+static NSString *const BITBenchmarkResultsFileName = @"HockeySDKTelemetryBenchmark.json";
+static NSUInteger const BITBenchmarkResultsVersion = 1;
+
+static NSString *const BITBenchmarkEventName = @"Benchmark.screenViewed";
+static NSUInteger const BITBenchmarkEventsPerScenario = 8000;
+static double const BITBenchmarkSteadyEventsPerSecond = 4000;
+static NSUInteger const BITBenchmarkBurstThreadCount = 4;
+static NSTimeInterval const BITBenchmarkOfflineDuration = 1;
+static NSUInteger const BITBenchmarkRejectedRequestCount = 40;
+static NSTimeInterval const BITBenchmarkTimeout = 60;
+
+typedef BITTestHTTPResponse *_Nonnull (^BITBenchmarkResponder)(BITTestHTTPRequest *request, NSUInteger requestIndex);
+
+static uint64_t bit_residentSize(void) {
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+    return 0;
+  }
+  return info.resident_size;
+}
+
+static int bit_compareLatencies(const void *lhs, const void *rhs) {
+  uint64_t left = *(const uint64_t *)lhs;
+  uint64_t right = *(const uint64_t *)rhs;
+  return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+static NSMutableArray<NSDictionary *> *BITBenchmarkResults;
+
+/**
+ *  Drives the whole pipeline, from BITMetricsManager through the channel and the persistence to the sender, against a
+ *  server on the loopback interface. Every scenario tracks the same events with the same payloads, only the rate they
+ *  are tracked at and the way the server answers differ.
+ *
+ *  The results of all scenarios are written as JSON once the tests of this class have run.
+ */
+@interface BITTelemetryEndToEndBenchmarkTests : XCTestCase
+
+@end
+
+@implementation BITTelemetryEndToEndBenchmarkTests
+
++ (void)setUp {
+  [super setUp];
+  BITBenchmarkResults = [NSMutableArray new];
+}
+
++ (void)tearDown {
+  NSString *path = [NSProcessInfo processInfo].environment[BITBenchmarkResultsPathVariable] ?:
+                   [NSTemporaryDirectory() stringByAppendingPathComponent:BITBenchmarkResultsFileName];
+  NSDictionary *report = @{@"suite" : @"telemetry-end-to-end",
+                           @"version" : @(BITBenchmarkResultsVersion),
+                           @"date" : @((uint64_t)[NSDate date].timeIntervalSince1970),
+                           @"scenarios" : BITBenchmarkResults};
+  NSData *json = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:NULL];
+  [json writeToFile:path atomically:YES];
+  NSLog(@"Telemetry benchmark results written to %@:\n%@", path, [[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding]);
+  [super tearDown];
+}
+
+#pragma mark - Scenarios
+
+- (void)testSteadyRate {
+  [self runScenarioNamed:@"steady"
+             threadCount:1
+         eventsPerSecond:BITBenchmarkSteadyEventsPerSecond
+         offlineDuration:0
+               responder:^BITTestHTTPResponse *(BITTestHTTPRequest *request, NSUInteger __unused requestIndex) {
+                 return [BITTestHTTPResponse telemetryResponseForRequest:request rejectingItems:nil statusCode:0];
+               }];
+}
+
+- (void)testBurst {
+  [self runScenarioNamed:@"burst"
+             threadCount:BITBenchmarkBurstThreadCount
+         eventsPerSecond:0
+         offlineDuration:0
+               responder:^BITTestHTTPResponse *(BITTestHTTPRequest *request, NSUInteger __unused requestIndex) {
+                 return [BITTestHTTPResponse telemetryResponseForRequest:request rejectingItems:nil statusCode:0];
+               }];
+}
+
+- (void)testOfflineThenReconnect {
+  [self runScenarioNamed:@"offline-then-reconnect"
+             threadCount:1
+         eventsPerSecond:0
+         offlineDuration:BITBenchmarkOfflineDuration
+               responder:^BITTestHTTPResponse *(BITTestHTTPRequest *request, NSUInteger __unused requestIndex) {
+                 return [BITTestHTTPResponse telemetryResponseForRequest:request rejectingItems:nil statusCode:0];
+               }];
+}
+
+- (void)testServerThrottling {
+  [self runScenarioNamed:@"429-storm"
+             threadCount:1
+         eventsPerSecond:0
+         offlineDuration:0
+               responder:^BITTestHTTPResponse *(BITTestHTTPRequest *request, NSUInteger requestIndex) {
+                 if (requestIndex < BITBenchmarkRejectedRequestCount) {
+                   return [BITTestHTTPResponse responseWithStatusCode:429 headers:nil body:nil];
+                 }
+                 return [BITTestHTTPResponse telemetryResponseForRequest:request rejectingItems:nil statusCode:0];
+               }];
+}
+
+#pragma mark - Running a scenario
+
+/**
+ *  Tracks BITBenchmarkEventsPerScenario events and waits until the server has accepted all of them that haven't been
+ *  dropped.
+ *
+ *  @param name the name of the scenario in the results
+ *  @param threadCount the number of threads the events are tracked on, each tracks an equal share
+ *  @param eventsPerSecond the rate every thread tracks events at, 0 to track them as fast as possible
+ *  @param offlineDuration the number of seconds the server is unreachable for, starting with the first event
+ *  @param responder answers the requests that reach the server
+ */
+- (void)runScenarioNamed:(NSString *)name
+             threadCount:(NSUInteger)threadCount
+         eventsPerSecond:(double)eventsPerSecond
+         offlineDuration:(NSTimeInterval)offlineDuration
+               responder:(BITBenchmarkResponder)responder {
+  NSObject *counterLock = [NSObject new];
+  __block NSUInteger answeredCount = 0;
+  __block uint64_t deliveredCount = 0;
+  BITTestHTTPServer *server = [[BITTestHTTPServer alloc] initWithHandler:^BITTestHTTPResponse *(BITTestHTTPRequest *request) {
+    NSUInteger requestIndex;
+    @synchronized(counterLock) {
+      requestIndex = answeredCount++;
+    }
+    BITTestHTTPResponse *response = responder(request, requestIndex);
+    if (response.statusCode == 200) {
+      uint64_t events = 0;
+      for (NSString *line in request.lines) {
+        if ([line containsString:BITBenchmarkEventName]) {
+          events++;
+        }
+      }
+      @synchronized(counterLock) {
+        deliveredCount += events;
+      }
+    }
+    return response;
+  }];
+  XCTAssertNotNil(server);
+  server.offline = offlineDuration > 0;
+
+  // Every scenario stores its batches in a directory of its own.
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id persistenceMock = OCMPartialMock(persistence);
+  OCMStub([persistenceMock bundleIdentifier]).andReturn(bundleIdentifier);
+  persistence = [persistence init];
+  persistence.maxBytes = 64 * 1024 * 1024;
+  NSUserDefaults *userDefaults = [[NSUserDefaults alloc] initWithSuiteName:bundleIdentifier];
+  BITTelemetryContext *context = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123" persistence:persistence];
+  BITChannel *channel = [[BITChannel alloc] initWithTelemetryContext:context persistence:persistence];
+  BITMetricsManager *manager = [[BITMetricsManager alloc] initWithChannel:channel telemetryContext:context persistence:persistence userDefaults:userDefaults];
+  manager.serverURL = server.URL.absoluteString;
+  [manager startManager];
+  manager.sender.maxSendAttempts = NSUIntegerMax;
+  manager.sender.retryScheduler.baseDelay = 0.05;
+  manager.sender.retryScheduler.maximumDelay = 0.5;
+
+  // The peaks are sampled on a thread of their own while the scenario runs.
+  __block uint64_t peakResidentSize = bit_residentSize();
+  __block uint64_t peakBytesOnDisk = 0;
+  dispatch_semaphore_t finished = dispatch_semaphore_create(0);
+  dispatch_semaphore_t samplingFinished = dispatch_semaphore_create(0);
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+    do {
+      peakResidentSize = MAX(peakResidentSize, bit_residentSize());
+      peakBytesOnDisk = MAX(peakBytesOnDisk, persistence.bytesStored);
+    } while (dispatch_semaphore_wait(finished, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_MSEC)) != 0);
+    dispatch_semaphore_signal(samplingFinished);
+  });
+
+  BITTelemetryPipelineSnapshot *before = [BITTelemetryPipelineSnapshot new];
+  NSArray<NSString *> *screens = @[@"Home", @"Settings", @"Details", @"Search"];
+  NSUInteger eventsPerThread = BITBenchmarkEventsPerScenario / threadCount;
+  NSUInteger eventCount = eventsPerThread * threadCount;
+  uint64_t *latencies = malloc(eventCount * sizeof(uint64_t));
+  NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+  dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+    uint64_t *threadLatencies = latencies + thread * eventsPerThread;
+    for (NSUInteger i = 0; i < eventsPerThread; i++) {
+      if (eventsPerSecond > 0 && i % 100 == 0) {
+        NSTimeInterval due = start + (double)i / eventsPerSecond;
+        NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+        if (due > now) {
+          [NSThread sleepForTimeInterval:due - now];
+        }
+      }
+      @autoreleasepool {
+        NSDictionary *properties = @{@"screen" : screens[i % screens.count]};
+        NSDictionary *measurements = @{@"duration" : @(i % 100)};
+        uint64_t trackStart = mach_absolute_time();
+        [manager trackEventWithName:BITBenchmarkEventName properties:properties measurements:measurements];
+        threadLatencies[i] = mach_absolute_time() - trackStart;
+      }
+    }
+  });
+  NSTimeInterval trackingDuration = [NSProcessInfo processInfo].systemUptime - start;
+
+  // Whatever is left in the current batch is stored right away instead of waiting for the batch interval.
+  [channel performOnDataItemsOperations:^{
+    [channel drainItemQueues];
+    [channel persistDataItemQueue:channel.eventBuffer];
+  }];
+
+  NSTimeInterval reconnectTime = start;
+  if (offlineDuration > 0) {
+    NSTimeInterval remaining = start + offlineDuration - [NSProcessInfo processInfo].systemUptime;
+    if (remaining > 0) {
+      [NSThread sleepForTimeInterval:remaining];
+    }
+    reconnectTime = [NSProcessInfo processInfo].systemUptime;
+    server.offline = NO;
+  }
+
+  uint64_t delivered = 0;
+  while ([NSProcessInfo processInfo].systemUptime - start < BITBenchmarkTimeout) {
+    @synchronized(counterLock) {
+      delivered = deliveredCount;
+    }
+    if (delivered + manager.telemetryEventsDropped >= eventCount) {
+      break;
+    }
+    [NSThread sleepForTimeInterval:0.01];
+  }
+  NSTimeInterval end = [NSProcessInfo processInfo].systemUptime;
+  dispatch_semaphore_signal(finished);
+  dispatch_semaphore_wait(samplingFinished, DISPATCH_TIME_FOREVER);
+  BITTelemetryPipelineSnapshot *after = [BITTelemetryPipelineSnapshot new];
+
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+  qsort(latencies, eventCount, sizeof(uint64_t), bit_compareLatencies);
+  double scale = (double)timebase.numer / (double)timebase.denom;
+  double p50Latency = (double)latencies[eventCount / 2] * scale;
+  double p99Latency = (double)latencies[eventCount * 99 / 100] * scale;
+  free(latencies);
+
+  uint64_t dropped = manager.telemetryEventsDropped;
+  NSMutableDictionary *result = [NSMutableDictionary new];
+  result[@"scenario"] = name;
+  result[@"events"] = @(eventCount);
+  result[@"threads"] = @(threadCount);
+  result[@"eventsDelivered"] = @(delivered);
+  result[@"eventsDropped"] = @(dropped);
+  result[@"durationSeconds"] = @(end - start);
+  result[@"trackingSeconds"] = @(trackingDuration);
+  result[@"eventsPerSecond"] = @((double)delivered / (end - start));
+  result[@"p50EnqueueLatencyNanoseconds"] = @(p50Latency);
+  result[@"p99EnqueueLatencyNanoseconds"] = @(p99Latency);
+  result[@"peakResidentBytes"] = @(peakResidentSize);
+  result[@"peakBytesOnDisk"] = @(peakBytesOnDisk);
+  result[@"bytesPersisted"] = @([after valueOfCounter:BITTelemetryCounterBytesPersisted] - [before valueOfCounter:BITTelemetryCounterBytesPersisted]);
+  result[@"bytesSent"] = @([after valueOfCounter:BITTelemetryCounterBytesSent] - [before valueOfCounter:BITTelemetryCounterBytesSent]);
+  result[@"bytesOnWire"] = @(server.receivedBodyLength);
+  @synchronized(counterLock) {
+    result[@"requestsAnswered"] = @(answeredCount);
+  }
+  result[@"batchesRetried"] = @([after valueOfCounter:BITTelemetryCounterBatchesRetried] - [before valueOfCounter:BITTelemetryCounterBatchesRetried]);
+  if (offlineDuration > 0) {
+    result[@"secondsToDrainAfterReconnect"] = @(end - reconnectTime);
+  }
+  @synchronized(BITBenchmarkResults) {
+    [BITBenchmarkResults addObject:result];
+  }
+  NSLog(@"%@: %.0f events/s, p99 enqueue %.0f ns, peak RSS %llu bytes, peak on disk %llu bytes, %llu bytes on the wire",
+        name, [result[@"eventsPerSecond"] doubleValue], p99Latency, peakResidentSize, peakBytesOnDisk, server.receivedBodyLength);
+
+  XCTAssertEqual(delivered + dropped, (uint64_t)eventCount);
+  XCTAssertGreaterThan(delivered, (uint64_t)0);
+  XCTAssertGreaterThan(server.receivedBodyLength, 0ull);
+
+  [manager unregisterObservers];
+  [server stop];
+  [userDefaults removePersistentDomainForName:bundleIdentifier];
+  [[NSFileManager defaultManager] removeItemAtPath:[persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent error:nil];
+}
+
+@end
@@ -0,0 +1,682 @@
+//
+//  BITTelemetryPerformanceTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import <mach/mach_time.h>
+#import <stdatomic.h>
+#import "BITRingBuffer.h"
+#import "BITJSONWriter.h"
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
+#import "BITEnvelope.h"
+#import "BITEventData.h"
+#import "BITCompression.h"
+#import <zlib.h>
+
+static NSUInteger const BITBenchmarkEventCount = 10000;
+static NSUInteger const BITBenchmarkBatchSize = 50;
+static NSUInteger const BITBenchmarkEnqueueCount = 96000;
+
+#pragma mark - Baseline implementations
+
+// The event buffer as it was implemented before BITRingBuffer: every append copies the whole buffer.
+typedef _Atomic(char *) bit_legacy_atomic_charptr;
+
+static void bit_legacyResetEventBuffer(char **eventBuffer) {
+  char *newEmptyString = NULL;
+  char *prevString = NULL;
+  do {
+    prevString = *eventBuffer;
+    newEmptyString = strdup("");
+    if (atomic_compare_exchange_strong((bit_legacy_atomic_charptr *)eventBuffer, &prevString, newEmptyString)) {
+      free(prevString);
+      return;
+    }
+    free(newEmptyString);
+  } while (true);
+}
+
+static void bit_legacyAppendStringToEventBuffer(const char *string, char **eventBuffer) {
+  do {
+    char *newBuffer = NULL;
+    char *previousBuffer = *eventBuffer;
+    asprintf(&newBuffer, "%s%s\n", previousBuffer, string);
+    if (atomic_compare_exchange_strong((bit_legacy_atomic_charptr *)eventBuffer, &previousBuffer, newBuffer)) {
+      free(previousBuffer);
+      return;
+    }
+    free(newBuffer);
+  } while (true);
+}
+
+// isFreeSpaceAvailable and nextURLOfType: as they were implemented before the bundle index: both list the directory.
+static NSArray<NSURL *> *bit_legacyPersistedFiles(NSString *directoryPath) {
+  return [[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:directoryPath]
+                                       includingPropertiesForKeys:@[NSURLNameKey]
+                                                          options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                            error:nil];
+}
+
+static BOOL bit_legacyIsFreeSpaceAvailable(NSString *directoryPath, NSUInteger maxFileCount) {
+  return bit_legacyPersistedFiles(directoryPath).count < maxFileCount;
+}
+
+static NSString *bit_legacyNextPath(NSString *directoryPath, NSArray *requestedBundlePaths) {
+  for (NSURL *fileURL in bit_legacyPersistedFiles(directoryPath)) {
+    NSString *absolutePath = fileURL.path;
+    if (![requestedBundlePaths containsObject:absolutePath]) {
+      return absolutePath;
+    }
+  }
+  return nil;
+}
+
+// NSData (BITGZIP) as it was implemented before BITCompression: the gzip output grows by 16 KB per deflate round and
+// the gunzip output by half the input length per inflate round.
+static NSUInteger const BITLegacyGzipChunkSize = 16384;
+
+static NSData *bit_legacyGzippedData(NSData *data) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  stream.avail_in = (uInt)data.length;
+  stream.next_in = (Bytef *)(uintptr_t)data.bytes;
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return nil;
+  }
+  NSMutableData *output = [NSMutableData dataWithLength:BITLegacyGzipChunkSize];
+  while (stream.avail_out == 0) {
+    if (stream.total_out >= output.length) {
+      output.length += BITLegacyGzipChunkSize;
+    }
+    stream.next_out = (uint8_t *)output.mutableBytes + stream.total_out;
+    stream.avail_out = (uInt)(output.length - stream.total_out);
+    deflate(&stream, Z_FINISH);
+  }
+  deflateEnd(&stream);
+  output.length = stream.total_out;
+  return output;
+}
+
+static NSData *bit_legacyGunzippedData(NSData *data) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  stream.avail_in = (uInt)data.length;
+  stream.next_in = (Bytef *)(uintptr_t)data.bytes;
+  NSMutableData *output = [NSMutableData dataWithLength:(NSUInteger)(data.length * 1.5)];
+  if (inflateInit2(&stream, 47) != Z_OK) {
+    return nil;
+  }
+  int status = Z_OK;
+  while (status == Z_OK) {
+    if (stream.total_out >= output.length) {
+      output.length += data.length / 2;
+    }
+    stream.next_out = (uint8_t *)output.mutableBytes + stream.total_out;
+    stream.avail_out = (uInt)(output.length - stream.total_out);
+    status = inflate(&stream, Z_SYNC_FLUSH);
+  }
+  inflateEnd(&stream);
+  output.length = stream.total_out;
+  return status == Z_STREAM_END ? output : nil;
+}
+
+typedef struct {
+  const uint8_t *input;
+  size_t inputLength;
+  size_t inputOffset;
+  size_t outputLength;
+} BITBenchmarkStreamContext;
+
+static long bit_benchmarkReadInput(void *_Nullable context, void *buffer, size_t capacity) {
+  BITBenchmarkStreamContext *stream = context;
+  size_t length = MIN(capacity, stream->inputLength - stream->inputOffset);
+  memcpy(buffer, stream->input + stream->inputOffset, length);
+  stream->inputOffset += length;
+  return (long)length;
+}
+
+static bool bit_benchmarkDiscardOutput(void *_Nullable context, const void *__unused bytes, size_t length) {
+  ((BITBenchmarkStreamContext *)context)->outputLength += length;
+  return true;
+}
+
+static double bit_megabytesPerSecond(NSUInteger length, NSUInteger iterations, void (^block)(void)) {
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < iterations; i++) {
+    @autoreleasepool {
+      block();
+    }
+  }
+  double seconds = (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+  return (double)length * iterations / (1024 * 1024) / seconds;
+}
+
+static void bit_discardRecord(void *__unused context, const char *__unused bytes, size_t __unused length) {
+}
+
+// Enqueueing as it was implemented before the item queues: a block per item on the serial queue, which appends the
+// item under the channel's monitor, taken recursively by the append and the persisting it triggers.
+static void bit_legacyEnqueue(dispatch_queue_t queue, id monitor, BITRingBuffer *buffer, NSData *line) {
+  dispatch_async(queue, ^{
+    @synchronized(monitor) {
+      @synchronized(monitor) {
+        if (!bit_ringBufferAppend(buffer, line.bytes, line.length)) {
+          bit_ringBufferConsume(buffer, bit_discardRecord, NULL);
+          bit_ringBufferAppend(buffer, line.bytes, line.length);
+        }
+      }
+    }
+  });
+}
+
+#pragma mark - Latencies
+
+typedef struct {
+  double p50;
+  double p99;
+} BITLatencyPercentiles;
+
+static int bit_compareLatencies(const void *lhs, const void *rhs) {
+  uint64_t left = *(const uint64_t *)lhs;
+  uint64_t right = *(const uint64_t *)rhs;
+  return (left > right) - (left < right);
+}
+
+// Calls the block from the given number of threads at once and returns the percentiles of the nanoseconds a call took.
+static BITLatencyPercentiles bit_latencies(NSUInteger threadCount, void (^block)(void)) {
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+  NSUInteger callsPerThread = BITBenchmarkEnqueueCount / threadCount;
+  NSUInteger count = callsPerThread * threadCount;
+  uint64_t *latencies = malloc(count * sizeof(uint64_t));
+  dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+    uint64_t *threadLatencies = latencies + thread * callsPerThread;
+    for (NSUInteger i = 0; i < callsPerThread; i++) {
+      @autoreleasepool {
+        uint64_t start = mach_absolute_time();
+        block();
+        threadLatencies[i] = mach_absolute_time() - start;
+      }
+    }
+  });
+  qsort(latencies, count, sizeof(uint64_t), bit_compareLatencies);
+  double scale = (double)timebase.numer / (double)timebase.denom;
+  BITLatencyPercentiles percentiles = {
+    .p50 = (double)latencies[count / 2] * scale,
+    .p99 = (double)latencies[count * 99 / 100] * scale
+  };
+  free(latencies);
+  return percentiles;
+}
+
+#pragma mark - Allocation counting
+
+// libmalloc reports every allocation to this hook, it's what Instruments uses to record allocations.
+typedef void (bit_malloc_logger_t)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip);
+extern bit_malloc_logger_t *malloc_logger;
+
+static uint32_t const BITMallocLogTypeAllocate = 2;
+static uint32_t const BITMallocLogTypeDeallocate = 4;
+
+static _Atomic(uint64_t) BITAllocatedBytes;
+static _Atomic(uint64_t) BITAllocationCount;
+
+static void bit_countingMallocLogger(uint32_t type, uintptr_t __unused arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t __unused result, uint32_t __unused numHotFramesToSkip) {
+  if (!(type & BITMallocLogTypeAllocate)) {
+    return;
+  }
+
+  // For realloc the new size is passed in arg3, for everything else in arg2.
+  uintptr_t size = (type & BITMallocLogTypeDeallocate) ? arg3 : arg2;
+  atomic_fetch_add_explicit(&BITAllocatedBytes, size, memory_order_relaxed);
+  atomic_fetch_add_explicit(&BITAllocationCount, 1, memory_order_relaxed);
+}
+
+typedef struct {
+  double nanosecondsPerEvent;
+  double bytesPerEvent;
+  double allocationsPerEvent;
+} BITBenchmarkResult;
+
+static BITBenchmarkResult bit_benchmark(NSUInteger iterations, void (^block)(void)) {
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+
+  // Warm up caches and buffers that are only allocated once.
+  block();
+
+  atomic_store(&BITAllocatedBytes, 0);
+  atomic_store(&BITAllocationCount, 0);
+  bit_malloc_logger_t *previousLogger = malloc_logger;
+  malloc_logger = bit_countingMallocLogger;
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < iterations; i++) {
+    @autoreleasepool {
+      block();
+    }
+  }
+  uint64_t elapsed = mach_absolute_time() - start;
+  malloc_logger = previousLogger;
+
+  BITBenchmarkResult result = {
+    .nanosecondsPerEvent = (double)elapsed * timebase.numer / timebase.denom / iterations,
+    .bytesPerEvent = (double)atomic_load(&BITAllocatedBytes) / iterations,
+    .allocationsPerEvent = (double)atomic_load(&BITAllocationCount) / iterations
+  };
+  return result;
+}
+
+@interface BITTelemetryPerformanceTests : XCTestCase
+
+@property (nonatomic, copy) NSData *eventJSON;
+@property (nonatomic, strong) BITChannel *channel;
+@property (nonatomic, strong) BITEventData *eventData;
+
+@end
+
+@implementation BITTelemetryPerformanceTests
+
+- (void)setUp {
+  [super setUp];
+  NSDictionary *event = @{@"ver" : @1,
+                          @"name" : @"Microsoft.ApplicationInsights.Event",
+                          @"time" : @"2016-05-24T12:00:00.000Z",
+                          @"iKey" : @"00000000-0000-0000-0000-000000000000",
+                          @"tags" : @{@"ai.device.os" : @"OS X", @"ai.device.osVersion" : @"10.12.1 (16B2555)", @"ai.session.id" : [NSUUID UUID].UUIDString},
+                          @"data" : @{@"baseType" : @"EventData", @"baseData" : @{@"ver" : @2, @"name" : @"Button tapped"}}};
+  self.eventJSON = [NSJSONSerialization dataWithJSONObject:event options:(NSJSONWritingOptions)0 error:nil];
+
+  id persistenceMock = OCMClassMock([BITPersistence class]);
+  BITTelemetryContext *context = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123" persistence:persistenceMock];
+  self.channel = [[BITChannel alloc] initWithTelemetryContext:context persistence:persistenceMock];
+
+  NSMutableDictionary *properties = [NSMutableDictionary new];
+  NSMutableDictionary *measurements = [NSMutableDictionary new];
+  for (int i = 0; i < 10; i++) {
+    properties[[NSString stringWithFormat:@"property%d", i]] = [NSString stringWithFormat:@"Value of property \"%d\"", i];
+    measurements[[NSString stringWithFormat:@"measurement%d", i]] = @(i * 1.25);
+  }
+  BITEventData *eventData = [BITEventData new];
+  eventData.name = @"Benchmark event";
+  eventData.properties = properties;
+  eventData.measurements = measurements;
+  self.eventData = eventData;
+}
+
+#pragma mark - Event buffer
+
+- (void)testPerformanceLegacyEventBufferAppend {
+  NSString *line = [[NSString alloc] initWithData:self.eventJSON encoding:NSUTF8StringEncoding];
+  const char *bytes = line.UTF8String;
+  [self measureBlock:^{
+    char *buffer = strdup("");
+    for (NSUInteger i = 0; i < BITBenchmarkEventCount; i++) {
+      bit_legacyAppendStringToEventBuffer(bytes, &buffer);
+      if ((i + 1) % BITBenchmarkBatchSize == 0) {
+        bit_legacyResetEventBuffer(&buffer);
+      }
+    }
+    free(buffer);
+  }];
+}
+
+- (void)testPerformanceRingBufferAppend {
+  NSData *line = self.eventJSON;
+  BITRingBuffer *buffer = bit_ringBufferCreate(1024 * 1024);
+  char const separator = '\n';
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < BITBenchmarkEventCount; i++) {
+      struct iovec iov[2] = {{(void *)(uintptr_t)line.bytes, line.length}, {(void *)(uintptr_t)&separator, 1}};
+      bit_ringBufferAppendv(buffer, iov, 2);
+      if ((i + 1) % BITBenchmarkBatchSize == 0) {
+        bit_ringBufferConsume(buffer, bit_discardRecord, NULL);
+      }
+    }
+  }];
+  bit_ringBufferDestroy(buffer);
+}
+
+- (void)testPerformanceRingBufferConcurrentAppend {
+  NSData *line = self.eventJSON;
+  BITRingBuffer *buffer = bit_ringBufferCreate(1024 * 1024);
+  dispatch_queue_t consumerQueue = dispatch_queue_create("net.hockeyapp.test.consumer", DISPATCH_QUEUE_SERIAL);
+  [self measureBlock:^{
+    dispatch_apply(4, dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^(size_t __unused iteration) {
+      for (NSUInteger i = 0; i < BITBenchmarkEventCount / 4; i++) {
+        while (!bit_ringBufferAppend(buffer, line.bytes, line.length)) {
+          dispatch_sync(consumerQueue, ^{
+            bit_ringBufferConsume(buffer, bit_discardRecord, NULL);
+          });
+        }
+      }
+    });
+    bit_ringBufferConsume(buffer, bit_discardRecord, NULL);
+  }];
+  bit_ringBufferDestroy(buffer);
+}
+
+#pragma mark - Enqueueing
+
+- (void)testEnqueueLatencyUnderContention {
+  BITChannel *channel = self.channel;
+  OCMStub([(id)channel.persistence isFreeSpaceAvailable]).andReturn(YES);
+  NSDictionary *properties = @{@"screen" : @"Main"};
+  NSData *line = self.eventJSON;
+  dispatch_queue_t legacyQueue = dispatch_queue_create("net.hockeyapp.test.legacySenderQueue", DISPATCH_QUEUE_SERIAL);
+  BITRingBuffer *legacyBuffer = bit_ringBufferCreate(1024 * 1024);
+  NSObject *legacyMonitor = [NSObject new];
+
+  uint64_t enqueuedCount = 0;
+  for (NSNumber *threads in @[@1, @4, @16]) {
+    NSUInteger threadCount = threads.unsignedIntegerValue;
+    BITLatencyPercentiles itemQueues = bit_latencies(threadCount, ^{
+      [channel enqueueEventWithName:@"Button tapped" properties:properties measurements:nil sampleRate:0];
+    });
+    dispatch_sync(channel.dataItemsOperations, ^{});
+    enqueuedCount += BITBenchmarkEnqueueCount / threadCount * threadCount;
+
+    BITLatencyPercentiles legacy = bit_latencies(threadCount, ^{
+      bit_legacyEnqueue(legacyQueue, legacyMonitor, legacyBuffer, line);
+    });
+    dispatch_sync(legacyQueue, ^{});
+    NSLog(@"Enqueueing on %lu threads: item queues p50 %.0f ns p99 %.0f ns, block per item under a monitor p50 %.0f ns p99 %.0f ns",
+          (unsigned long)threadCount, itemQueues.p50, itemQueues.p99, legacy.p50, legacy.p99);
+    XCTAssertLessThanOrEqual(itemQueues.p50, itemQueues.p99);
+  }
+
+  // Every event is either processed or dropped by its lane's queue, none is lost in the handoff.
+  BITChannelLaneStatistics events = [channel statisticsForLane:BITChannelLaneEvents];
+  XCTAssertEqual(events.deliveredCount + events.overflowedCount, enqueuedCount);
+  bit_ringBufferDestroy(legacyBuffer);
+}
+
+#pragma mark - Serialization
+
+- (void)testSerializationAllocationsAndTimePerEvent {
+  BITChannel *channel = self.channel;
+  BITEventData *eventData = self.eventData;
+  BITJSONWriter *writer = bit_jsonWriterCreate(4096);
+  NSUInteger const iterations = 10000;
+
+  // The previous path: envelope -> nested dictionaries -> NSJSONSerialization.
+  BITBenchmarkResult dictionaryResult = bit_benchmark(iterations, ^{
+    NSDictionary *dictionary = [channel dictionaryForTelemetryData:eventData];
+    NSData *data = [NSJSONSerialization dataWithJSONObject:dictionary options:(NSJSONWritingOptions)0 error:nil];
+    (void)data;
+  });
+
+  // The streaming path used by the channel.
+  BITBenchmarkResult writerResult = bit_benchmark(iterations, ^{
+    bit_jsonWriterReset(writer);
+    [[channel envelopeForTelemetryData:eventData] serializeToJSONWriter:writer];
+  });
+  bit_jsonWriterDestroy(writer);
+
+  NSLog(@"EventData (10 properties, 10 measurements) via NSJSONSerialization: %.0f ns/event, %.0f bytes/event, %.1f allocations/event",
+        dictionaryResult.nanosecondsPerEvent, dictionaryResult.bytesPerEvent, dictionaryResult.allocationsPerEvent);
+  NSLog(@"EventData (10 properties, 10 measurements) via BITJSONWriter: %.0f ns/event, %.0f bytes/event, %.1f allocations/event",
+        writerResult.nanosecondsPerEvent, writerResult.bytesPerEvent, writerResult.allocationsPerEvent);
+
+  XCTAssertLessThan(writerResult.bytesPerEvent, dictionaryResult.bytesPerEvent);
+  XCTAssertLessThan(writerResult.allocationsPerEvent, dictionaryResult.allocationsPerEvent);
+}
+
+- (void)testTagsFragmentAllocationsAndTimePerEvent {
+  BITChannel *channel = self.channel;
+  BITEventData *eventData = self.eventData;
+  BITJSONWriter *writer = bit_jsonWriterCreate(4096);
+  NSUInteger const iterations = 10000;
+
+  // Tags merged into a new dictionary and serialized for every item.
+  BITBenchmarkResult dictionaryResult = bit_benchmark(iterations, ^{
+    BITEnvelope *envelope = [channel envelopeForTelemetryData:eventData];
+    envelope.tagsFragment = nil;
+    envelope.tags = channel.telemetryContext.contextDictionary;
+    bit_jsonWriterReset(writer);
+    [envelope serializeToJSONWriter:writer];
+  });
+
+  // Tags copied from the context's cached fragment.
+  BITBenchmarkResult fragmentResult = bit_benchmark(iterations, ^{
+    bit_jsonWriterReset(writer);
+    [[channel envelopeForTelemetryData:eventData] serializeToJSONWriter:writer];
+  });
+  bit_jsonWriterDestroy(writer);
+
+  NSLog(@"Tags from contextDictionary: %.0f ns/event, %.0f bytes/event, %.1f allocations/event",
+        dictionaryResult.nanosecondsPerEvent, dictionaryResult.bytesPerEvent, dictionaryResult.allocationsPerEvent);
+  NSLog(@"Tags from cached fragment: %.0f ns/event, %.0f bytes/event, %.1f allocations/event",
+        fragmentResult.nanosecondsPerEvent, fragmentResult.bytesPerEvent, fragmentResult.allocationsPerEvent);
+
+  XCTAssertLessThan(fragmentResult.allocationsPerEvent, dictionaryResult.allocationsPerEvent);
+}
+
+#pragma mark - Persistence
+
+- (void)benchmarkPersistenceLookupsWithFileCount:(NSUInteger)fileCount {
+  NSString *bundleIdentifier = [NSString stringWithFormat:@"com.testapp.benchmark.%@", [NSUUID UUID].UUIDString];
+  BITPersistence *persistence = [BITPersistence alloc];
+  id mock = OCMPartialMock(persistence);
+  OCMStub([mock bundleIdentifier]).andReturn(bundleIdentifier);
+  NSString *directoryPath = [persistence folderPathForType:BITPersistenceTypeTelemetry];
+  [[NSFileManager defaultManager] createDirectoryAtPath:directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+  for (NSUInteger i = 0; i < fileCount; i++) {
+    [self.eventJSON writeToFile:[persistence fileURLForType:BITPersistenceTypeTelemetry] atomically:NO];
+  }
+  persistence = [persistence initWithStorageFormat:BITPersistenceStorageFormatFiles];
+  persistence.maxFileCount = NSUIntegerMax;
+  persistence.evictionPolicy = BITTelemetryEvictionPolicyNone;
+  XCTAssertEqual(persistence.persistedBundleCount, fileCount);
+
+  // Keep a few bundles in flight, like the sender does while requests are running.
+  NSMutableArray *requestedPaths = [NSMutableArray new];
+  for (int i = 0; i < 4; i++) {
+    [requestedPaths addObject:(NSString *)[persistence requestNextFilePath]];
+  }
+  NSUInteger const legacyIterations = fileCount > 500 ? 20 : 200;
+  NSUInteger const iterations = 10000;
+
+  BITBenchmarkResult legacyEnqueueResult = bit_benchmark(legacyIterations, ^{
+    (void)bit_legacyIsFreeSpaceAvailable(directoryPath, NSUIntegerMax);
+  });
+  BITBenchmarkResult enqueueResult = bit_benchmark(iterations, ^{
+    (void)[persistence isFreeSpaceAvailable];
+  });
+  BITBenchmarkResult legacyNextResult = bit_benchmark(legacyIterations, ^{
+    (void)bit_legacyNextPath(directoryPath, requestedPaths);
+  });
+  BITBenchmarkResult nextResult = bit_benchmark(iterations, ^{
+    NSString *path = [persistence requestNextFilePath];
+    dispatch_sync(persistence.persistenceQueue, ^{
+      [persistence.requestedBundlePaths removeObject:(NSString *)path];
+    });
+  });
+
+  NSLog(@"%lu files, isFreeSpaceAvailable per enqueue: directory listing %.0f ns (%.1f allocations), index %.0f ns (%.1f allocations)",
+        (unsigned long)fileCount, legacyEnqueueResult.nanosecondsPerEvent, legacyEnqueueResult.allocationsPerEvent,
+        enqueueResult.nanosecondsPerEvent, enqueueResult.allocationsPerEvent);
+  NSLog(@"%lu files, next file lookup: directory listing %.0f ns (%.1f allocations), index %.0f ns (%.1f allocations)",
+        (unsigned long)fileCount, legacyNextResult.nanosecondsPerEvent, legacyNextResult.allocationsPerEvent,
+        nextResult.nanosecondsPerEvent, nextResult.allocationsPerEvent);
+
+  XCTAssertLessThan(enqueueResult.nanosecondsPerEvent, legacyEnqueueResult.nanosecondsPerEvent);
+  XCTAssertLessThan(nextResult.nanosecondsPerEvent, legacyNextResult.nanosecondsPerEvent);
+
+  [[NSFileManager defaultManager] removeItemAtPath:[persistence appHockeySDKDirectoryPath].stringByDeletingLastPathComponent error:nil];
+  [mock stopMocking];
+}
+
+- (void)testPersistenceLookupsWith50Files {
+  [self benchmarkPersistenceLookupsWithFileCount:50];
+}
+
+- (void)testPersistenceLookupsWith500Files {
+  [self benchmarkPersistenceLookupsWithFileCount:500];
+}
+
+- (void)testPersistenceLookupsWith5000Files {
+  [self benchmarkPersistenceLookupsWithFileCount:5000];
+}
+
+#pragma mark - Compression
+
+// A corpus of batches like the channel produces them, with event names and properties varying between events.
+- (NSArray<NSData *> *)compressionCorpusWithBatchCount:(NSUInteger)batchCount {
+  BITJSONWriter *writer = bit_jsonWriterCreate(4096);
+  NSMutableArray *corpus = [NSMutableArray new];
+  for (NSUInteger batchIndex = 0; batchIndex < batchCount; batchIndex++) {
+    NSMutableData *batch = [NSMutableData new];
+    for (NSUInteger i = 0; i < BITBenchmarkBatchSize; i++) {
+      BITEventData *eventData = [BITEventData new];
+      eventData.name = [NSString stringWithFormat:@"Screen %lu viewed", (unsigned long)((batchIndex * 7 + i) % 23)];
+      eventData.properties = @{@"source" : (i % 2 ? @"menu" : @"toolbar"), @"item" : [NSString stringWithFormat:@"%lu", (unsigned long)i]};
+      eventData.measurements = @{@"duration" : @(i * 0.37)};
+      bit_jsonWriterReset(writer);
+      [[self.channel envelopeForTelemetryData:eventData] serializeToJSONWriter:writer];
+      [batch appendBytes:bit_jsonWriterBytes(writer) length:bit_jsonWriterLength(writer)];
+      [batch appendBytes:"\n" length:1];
+    }
+    [corpus addObject:batch];
+  }
+  bit_jsonWriterDestroy(writer);
+  return corpus;
+}
+
+- (void)testCompressionCodecRatioAndThroughput {
+  NSArray<NSData *> *corpus = [self compressionCorpusWithBatchCount:200];
+  NSUInteger uncompressedLength = 0;
+  for (NSData *batch in corpus) {
+    uncompressedLength += batch.length;
+  }
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+  NSArray *codecNames = @[@"gzip", @"deflate + dictionary", @"lzfse"];
+
+  for (BITCompressionCodec codec = BITCompressionCodecGzip; codec <= BITCompressionCodecLZFSE; codec++) {
+    if (!bit_compressionCodecIsAvailable(codec)) {
+      NSLog(@"%@: not available", codecNames[codec]);
+      continue;
+    }
+
+    // Batches are compressed one by one with a reused compressor, like the channel does.
+    BITCompressor *compressor = bit_compressorCreate(codec);
+    NSMutableArray<NSData *> *compressedCorpus = [NSMutableArray new];
+    NSUInteger compressedLength = 0;
+    uint64_t start = mach_absolute_time();
+    for (NSData *batch in corpus) {
+      NSMutableData *output = [NSMutableData new];
+      bit_compressorBegin(compressor, output, batch.length);
+      bit_compressorWrite(compressor, batch.bytes, batch.length);
+      XCTAssertTrue(bit_compressorFinish(compressor));
+      compressedLength += output.length;
+      [compressedCorpus addObject:output];
+    }
+    uint64_t compressionTime = mach_absolute_time() - start;
+    bit_compressorDestroy(compressor);
+
+    start = mach_absolute_time();
+    for (NSData *compressed in compressedCorpus) {
+      XCTAssertNotNil(bit_decompressData(compressed));
+    }
+    uint64_t decompressionTime = mach_absolute_time() - start;
+
+    double megabytes = (double)uncompressedLength / (1024 * 1024);
+    double compressionSeconds = (double)compressionTime * timebase.numer / timebase.denom / NSEC_PER_SEC;
+    double decompressionSeconds = (double)decompressionTime * timebase.numer / timebase.denom / NSEC_PER_SEC;
+    NSLog(@"%@: %lu batches of %lu events, ratio %.2f, compression %.1f MB/s, decompression %.1f MB/s",
+          codecNames[codec], (unsigned long)corpus.count, (unsigned long)BITBenchmarkBatchSize,
+          (double)uncompressedLength / compressedLength, megabytes / compressionSeconds, megabytes / decompressionSeconds);
+  }
+}
+
+- (void)benchmarkGzipWithPayloadLength:(NSUInteger)length {
+
+  // A crash log like payload: mostly repetitive text with some noise.
+  NSMutableData *payload = [NSMutableData dataWithCapacity:length];
+  for (NSUInteger line = 0; payload.length < length; line++) {
+    NSString *text = [NSString stringWithFormat:@"%-4lu com.example.app  0x%016llx -[BITExampleController handleEvent:] + %lu\n",
+                                                (unsigned long)(line % 64), (unsigned long long)(line * 2654435761u), (unsigned long)(line % 997)];
+    [payload appendData:(NSData *)[text dataUsingEncoding:NSUTF8StringEncoding]];
+  }
+  payload.length = length;
+  NSUInteger iterations = MAX((NSUInteger)1, (NSUInteger)(64 * 1024 * 1024) / length);
+  NSData *gzipped = bit_gzipData(payload, Z_DEFAULT_COMPRESSION);
+  XCTAssertEqualObjects(bit_legacyGunzippedData((NSData *)gzipped), payload);
+
+  double legacyGzip = bit_megabytesPerSecond(length, iterations, ^{
+    bit_legacyGzippedData(payload);
+  });
+  double gzip = bit_megabytesPerSecond(length, iterations, ^{
+    bit_gzipData(payload, Z_DEFAULT_COMPRESSION);
+  });
+  double gzipStream = bit_megabytesPerSecond(length, iterations, ^{
+    BITBenchmarkStreamContext context = {.input = payload.bytes, .inputLength = payload.length};
+    bit_gzipStream(Z_DEFAULT_COMPRESSION, bit_benchmarkReadInput, bit_benchmarkDiscardOutput, &context);
+  });
+  double legacyGunzip = bit_megabytesPerSecond(length, iterations, ^{
+    bit_legacyGunzippedData((NSData *)gzipped);
+  });
+  double gunzip = bit_megabytesPerSecond(length, iterations, ^{
+    bit_gunzipData((NSData *)gzipped);
+  });
+  double gunzipStream = bit_megabytesPerSecond(length, iterations, ^{
+    BITBenchmarkStreamContext context = {.input = gzipped.bytes, .inputLength = gzipped.length};
+    bit_gunzipStream(bit_benchmarkReadInput, bit_benchmarkDiscardOutput, &context);
+  });
+
+  NSLog(@"%lu KB gzip: legacy %.1f MB/s, in memory %.1f MB/s, streaming %.1f MB/s",
+        (unsigned long)(length / 1024), legacyGzip, gzip, gzipStream);
+  NSLog(@"%lu KB gunzip: legacy %.1f MB/s, in memory %.1f MB/s, streaming %.1f MB/s",
+        (unsigned long)(length / 1024), legacyGunzip, gunzip, gunzipStream);
+}
+
+- (void)testGzipThroughputWith64KB {
+  [self benchmarkGzipWithPayloadLength:64 * 1024];
+}
+
+- (void)testGzipThroughputWith1MB {
+  [self benchmarkGzipWithPayloadLength:1024 * 1024];
+}
+
+- (void)testGzipThroughputWith32MB {
+  [self benchmarkGzipWithPayloadLength:32 * 1024 * 1024];
+}
+
+- (void)testPerformanceDictionarySerialization {
+  BITChannel *channel = self.channel;
+  BITEventData *eventData = self.eventData;
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 1000; i++) {
+      @autoreleasepool {
+        NSDictionary *dictionary = [channel dictionaryForTelemetryData:eventData];
+        NSData *data = [NSJSONSerialization dataWithJSONObject:dictionary options:(NSJSONWritingOptions)0 error:nil];
+        (void)data;
+      }
+    }
+  }];
+}
+
+- (void)testPerformanceJSONWriterSerialization {
+  BITChannel *channel = self.channel;
+  BITEventData *eventData = self.eventData;
+  BITJSONWriter *writer = bit_jsonWriterCreate(4096);
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 1000; i++) {
+      @autoreleasepool {
+        bit_jsonWriterReset(writer);
+        [[channel envelopeForTelemetryData:eventData] serializeToJSONWriter:writer];
+      }
+    }
+  }];
+  bit_jsonWriterDestroy(writer);
+}
+
+@end
@@ -0,0 +1,115 @@
+//
+//  BITTestHTTPServer.h
+//  HockeySDK
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A request received by BITTestHTTPServer.
+ */
+@interface BITTestHTTPRequest : NSObject
+
+@property (nonatomic, copy) NSString *method;
+@property (nonatomic, copy) NSString *path;
+
+/**
+ *  Header names are lowercased.
+ */
+@property (nonatomic, copy) NSDictionary<NSString *, NSString *> *headers;
+
+/**
+ *  The body as it was received, with a chunked transfer encoding removed.
+ */
+@property (nonatomic, copy) NSData *body;
+
+/**
+ *  The body, inflated if it was sent gzipped.
+ */
+@property (nonatomic, copy, readonly) NSData *decodedBody;
+
+/**
+ *  The lines of an x-json-stream body.
+ */
+@property (nonatomic, copy, readonly) NSArray<NSString *> *lines;
+
+@end
+
+/**
+ *  A response returned by the handler of BITTestHTTPServer.
+ */
+@interface BITTestHTTPResponse : NSObject
+
++ (instancetype)responseWithStatusCode:(NSInteger)statusCode headers:(nullable NSDictionary<NSString *, NSString *> *)headers body:(nullable NSData *)body;
+
+/**
+ *  A telemetry ingestion response accepting all items except the given ones, which are rejected with the given status
+ *  code. The status code is 206 if any item is rejected and 200 otherwise.
+ */
++ (instancetype)telemetryResponseForRequest:(BITTestHTTPRequest *)request rejectingItems:(nullable NSIndexSet *)rejectedItems statusCode:(NSInteger)itemStatusCode;
+
+@property (nonatomic, assign) NSInteger statusCode;
+@property (nonatomic, copy) NSDictionary<NSString *, NSString *> *headers;
+@property (nonatomic, copy) NSData *body;
+
+@end
+
+typedef BITTestHTTPResponse *_Nonnull (^BITTestHTTPHandler)(BITTestHTTPRequest *request);
+
+/**
+ *  A minimal HTTP/1.1 server listening on the loopback interface, to test the sender against a real network stack.
+ *  Connections are kept alive and served concurrently, the handler may be called on any thread.
+ */
+@interface BITTestHTTPServer : NSObject
+
+/**
+ *  Starts a server on a free port.
+ *
+ *  @param handler creates the response for every request
+ *
+ *  @return the server or nil if it could not be started
+ */
+- (nullable instancetype)initWithHandler:(BITTestHTTPHandler)handler;
+
+/**
+ *  The URL of the path every request is accepted at.
+ */
+@property (nonatomic, strong, readonly) NSURL *URL;
+
+/**
+ *  Simulated round trip time, the response to every request is delayed by this many seconds.
+ */
+@property (atomic, assign) NSTimeInterval responseDelay;
+
+/**
+ *  The number of requests that have been answered.
+ */
+@property (atomic, assign, readonly) NSUInteger requestCount;
+
+/**
+ *  If set, request bodies are counted while they are received but not kept, so the server doesn't hold large uploads
+ *  in memory. The body of every request passed to the handler is empty then.
+ */
+@property (atomic, assign) BOOL discardsBodies;
+
+/**
+ *  If set, connections are closed once a request has been received, without a response, like a network that went away
+ *  while the request was sent. The handler isn't called for these requests.
+ */
+@property (atomic, assign) BOOL offline;
+
+/**
+ *  The total length of all request bodies that have been received.
+ */
+@property (atomic, assign, readonly) unsigned long long receivedBodyLength;
+
+/**
+ *  Closes the listening socket and all connections.
+ */
+- (void)stop;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,306 @@
+//
+//  BITTestHTTPServer.m
+//  HockeySDK
+//
+
+#import "BITTestHTTPServer.h"
+#import "BITCompression.h"
+
+#import <arpa/inet.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+#import <unistd.h>
+
+static NSUInteger const BITTestHTTPMaximumHeaderLength = 64 * 1024;
+
+@implementation BITTestHTTPRequest
+
+- (NSData *)decodedBody {
+  if ([[self.headers[@"content-encoding"] lowercaseString] isEqualToString:@"gzip"]) {
+    return bit_gunzipData(self.body) ?: [NSData data];
+  }
+  return self.body;
+}
+
+- (NSArray<NSString *> *)lines {
+  NSString *string = [[NSString alloc] initWithData:self.decodedBody encoding:NSUTF8StringEncoding];
+  NSMutableArray<NSString *> *lines = [NSMutableArray new];
+  [string enumerateLinesUsingBlock:^(NSString *line, BOOL * __unused stop) {
+    if (line.length > 0) {
+      [lines addObject:line];
+    }
+  }];
+  return lines;
+}
+
+@end
+
+@implementation BITTestHTTPResponse
+
++ (instancetype)responseWithStatusCode:(NSInteger)statusCode headers:(NSDictionary<NSString *, NSString *> *)headers body:(NSData *)body {
+  BITTestHTTPResponse *response = [self new];
+  response.statusCode = statusCode;
+  response.headers = headers ?: @{};
+  response.body = body ?: [NSData data];
+  return response;
+}
+
++ (instancetype)telemetryResponseForRequest:(BITTestHTTPRequest *)request rejectingItems:(NSIndexSet *)rejectedItems statusCode:(NSInteger)itemStatusCode {
+  NSUInteger itemCount = request.lines.count;
+  NSMutableArray *errors = [NSMutableArray new];
+  [rejectedItems enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL * __unused stop) {
+    if (idx < itemCount) {
+      [errors addObject:@{@"index" : @(idx), @"statusCode" : @(itemStatusCode), @"message" : @"Rejected by test server"}];
+    }
+  }];
+  NSDictionary *json = @{@"itemsReceived" : @(itemCount), @"itemsAccepted" : @(itemCount - errors.count), @"errors" : errors};
+  NSData *body = [NSJSONSerialization dataWithJSONObject:json options:0 error:NULL];
+  return [self responseWithStatusCode:errors.count > 0 ? 206 : 200 headers:@{@"Content-Type" : @"application/json"} body:body];
+}
+
+@end
+
+@interface BITTestHTTPServer ()
+
+@property (nonatomic, copy) BITTestHTTPHandler handler;
+@property (nonatomic, strong) NSURL *URL;
+@property (atomic, assign) NSUInteger requestCount;
+@property (atomic, assign) unsigned long long receivedBodyLength;
+@property (nonatomic, strong) dispatch_queue_t connectionQueue;
+@property (nonatomic, strong) NSMutableSet<NSNumber *> *connections;
+@property (atomic, assign) int listeningSocket;
+
+@end
+
+@implementation BITTestHTTPServer
+
+- (instancetype)initWithHandler:(BITTestHTTPHandler)handler {
+  if ((self = [super init])) {
+    _handler = [handler copy];
+    _connections = [NSMutableSet new];
+    _connectionQueue = dispatch_queue_create("net.hockeyapp.testHTTPServer.connections", DISPATCH_QUEUE_CONCURRENT);
+
+    int listeningSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listeningSocket < 0) {
+      return nil;
+    }
+    int reuse = 1;
+    setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {0};
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (bind(listeningSocket, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listeningSocket, 64) != 0 ||
+        getsockname(listeningSocket, (struct sockaddr *)&address, &addressLength) != 0) {
+      close(listeningSocket);
+      return nil;
+    }
+    _listeningSocket = listeningSocket;
+    _URL = [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%u/v2/track", ntohs(address.sin_port)]];
+
+    NSThread *acceptThread = [[NSThread alloc] initWithTarget:self selector:@selector(acceptConnections) object:nil];
+    acceptThread.name = @"net.hockeyapp.testHTTPServer.accept";
+    [acceptThread start];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stop];
+}
+
+- (void)stop {
+  int listeningSocket = self.listeningSocket;
+  self.listeningSocket = -1;
+  if (listeningSocket >= 0) {
+    shutdown(listeningSocket, SHUT_RDWR);
+    close(listeningSocket);
+  }
+  @synchronized(self.connections) {
+    for (NSNumber *connection in self.connections) {
+      shutdown(connection.intValue, SHUT_RDWR);
+    }
+  }
+}
+
+#pragma mark - Connections
+
+- (void)acceptConnections {
+  while (YES) {
+    int listeningSocket = self.listeningSocket;
+    if (listeningSocket < 0) {
+      return;
+    }
+    int connection = accept(listeningSocket, NULL, NULL);
+    if (connection < 0) {
+      return;
+    }
+    int noSigPipe = 1;
+    setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+    @synchronized(self.connections) {
+      [self.connections addObject:@(connection)];
+    }
+    dispatch_async(self.connectionQueue, ^{
+      [self serveConnection:connection];
+      @synchronized(self.connections) {
+        [self.connections removeObject:@(connection)];
+      }
+      close(connection);
+    });
+  }
+}
+
+- (void)serveConnection:(int)connection {
+  NSMutableData *buffer = [NSMutableData new];
+  while (YES) {
+    BITTestHTTPRequest *request = [self readRequestFromConnection:connection buffer:buffer];
+    if (!request || self.offline) {
+      return;
+    }
+    BITTestHTTPResponse *response = self.handler(request);
+    NSTimeInterval delay = self.responseDelay;
+    if (delay > 0) {
+      [NSThread sleepForTimeInterval:delay];
+    }
+    self.requestCount += 1;
+    if (![self writeResponse:response toConnection:connection]) {
+      return;
+    }
+  }
+}
+
+- (BITTestHTTPRequest *)readRequestFromConnection:(int)connection buffer:(NSMutableData *)buffer {
+  NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+  NSRange headerEnd;
+  while ((headerEnd = [buffer rangeOfData:separator options:0 range:NSMakeRange(0, buffer.length)]).location == NSNotFound) {
+    if (buffer.length > BITTestHTTPMaximumHeaderLength || ![self readFromConnection:connection intoBuffer:buffer]) {
+      return nil;
+    }
+  }
+
+  NSString *head = [[NSString alloc] initWithData:[buffer subdataWithRange:NSMakeRange(0, headerEnd.location)] encoding:NSUTF8StringEncoding];
+  NSArray<NSString *> *headLines = [head componentsSeparatedByString:@"\r\n"];
+  NSArray<NSString *> *requestLine = [headLines.firstObject componentsSeparatedByString:@" "];
+  if (requestLine.count < 2) {
+    return nil;
+  }
+  NSMutableDictionary<NSString *, NSString *> *headers = [NSMutableDictionary new];
+  for (NSString *line in [headLines subarrayWithRange:NSMakeRange(1, headLines.count - 1)]) {
+    NSRange colon = [line rangeOfString:@":"];
+    if (colon.location != NSNotFound) {
+      NSString *name = [[line substringToIndex:colon.location] lowercaseString];
+      headers[name] = [[line substringFromIndex:colon.location + 1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    }
+  }
+
+  [buffer replaceBytesInRange:NSMakeRange(0, NSMaxRange(headerEnd)) withBytes:NULL length:0];
+
+  // Upload tasks from files or streams may send the body in chunks instead of declaring its length.
+  NSMutableData *body = self.discardsBodies ? nil : [NSMutableData new];
+  if ([[headers[@"transfer-encoding"] lowercaseString] containsString:@"chunked"]) {
+    while (YES) {
+      NSString *sizeLine = [self readLineFromConnection:connection buffer:buffer];
+      if (!sizeLine) {
+        return nil;
+      }
+      unsigned long long chunkLength = strtoull(sizeLine.UTF8String, NULL, 16);
+      if (chunkLength == 0) {
+        break;
+      }
+      if (![self readBodyOfLength:chunkLength fromConnection:connection buffer:buffer intoBody:body] ||
+          ![self readLineFromConnection:connection buffer:buffer]) {
+        return nil;
+      }
+    }
+
+    // Skips the trailer, which ends with an empty line.
+    NSString *line;
+    do {
+      line = [self readLineFromConnection:connection buffer:buffer];
+    } while (line.length > 0);
+    if (!line) {
+      return nil;
+    }
+  } else if (![self readBodyOfLength:strtoull([headers[@"content-length"] UTF8String] ?: "0", NULL, 10) fromConnection:connection buffer:buffer intoBody:body]) {
+    return nil;
+  }
+
+  BITTestHTTPRequest *request = [BITTestHTTPRequest new];
+  request.method = requestLine[0];
+  request.path = requestLine[1];
+  request.headers = headers;
+  request.body = body ?: [NSData data];
+  return request;
+}
+
+- (NSString *)readLineFromConnection:(int)connection buffer:(NSMutableData *)buffer {
+  NSData *separator = [@"\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+  NSRange lineEnd;
+  while ((lineEnd = [buffer rangeOfData:separator options:0 range:NSMakeRange(0, buffer.length)]).location == NSNotFound) {
+    if (buffer.length > BITTestHTTPMaximumHeaderLength || ![self readFromConnection:connection intoBuffer:buffer]) {
+      return nil;
+    }
+  }
+  NSString *line = [[NSString alloc] initWithData:[buffer subdataWithRange:NSMakeRange(0, lineEnd.location)] encoding:NSUTF8StringEncoding];
+  [buffer replaceBytesInRange:NSMakeRange(0, NSMaxRange(lineEnd)) withBytes:NULL length:0];
+  return line ?: @"";
+}
+
+/**
+ *  Moves the given number of bytes from the buffer to the body, reading from the connection as long as the buffer holds
+ *  less. The body may be nil to discard the bytes.
+ */
+- (BOOL)readBodyOfLength:(unsigned long long)length fromConnection:(int)connection buffer:(NSMutableData *)buffer intoBody:(NSMutableData *)body {
+  while (length > 0) {
+    if (buffer.length == 0 && ![self readFromConnection:connection intoBuffer:buffer]) {
+      return NO;
+    }
+    NSUInteger available = (NSUInteger)MIN((unsigned long long)buffer.length, length);
+    [body appendBytes:buffer.bytes length:available];
+    [buffer replaceBytesInRange:NSMakeRange(0, available) withBytes:NULL length:0];
+    length -= available;
+    @synchronized(self) {
+      self.receivedBodyLength += available;
+    }
+  }
+  return YES;
+}
+
+- (BOOL)readFromConnection:(int)connection intoBuffer:(NSMutableData *)buffer {
+  uint8_t chunk[16 * 1024];
+  ssize_t length = recv(connection, chunk, sizeof(chunk), 0);
+  if (length <= 0) {
+    return NO;
+  }
+  [buffer appendBytes:chunk length:(NSUInteger)length];
+  return YES;
+}
+
+- (BOOL)writeResponse:(BITTestHTTPResponse *)response toConnection:(int)connection {
+  NSMutableString *head = [NSMutableString stringWithFormat:@"HTTP/1.1 %ld %@\r\n", (long)response.statusCode,
+                                                            [NSHTTPURLResponse localizedStringForStatusCode:response.statusCode]];
+  [head appendFormat:@"Content-Length: %lu\r\nConnection: keep-alive\r\n", (unsigned long)response.body.length];
+  [response.headers enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL * __unused stop) {
+    [head appendFormat:@"%@: %@\r\n", name, value];
+  }];
+  [head appendString:@"\r\n"];
+
+  NSMutableData *data = [[head dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+  [data appendData:response.body];
+  const uint8_t *bytes = data.bytes;
+  NSUInteger written = 0;
+  while (written < data.length) {
+    ssize_t length = send(connection, bytes + written, data.length - written, 0);
+    if (length <= 0) {
+      return NO;
+    }
+    written += (NSUInteger)length;
+  }
+  return YES;
+}
+
+@end
@@ -0,0 +1,118 @@
+//
+//  BITTimerWheelTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <OCMock/OCMock.h>
+#import "BITTimerWheel.h"
+#import "BITChannel.h"
+#import "BITChannelPrivate.h"
+#import "BITTelemetryContext.h"
+#import "BITPersistence.h"
+#import "BITPersistencePrivate.h"
+
+static NSUInteger const BITTimerBenchmarkEventCount = 10000;
+static NSUInteger const BITTimerBenchmarkBatchSize = 50;
+
+@interface BITTimerWheelTests : XCTestCase
+
+@property (nonatomic, strong) BITTimerWheel *sut;
+@property (nonatomic, strong) dispatch_queue_t queue;
+
+@end
+
+@implementation BITTimerWheelTests
+
+- (void)setUp {
+  [super setUp];
+  self.sut = [[BITTimerWheel alloc] initWithTickInterval:0.01 slotCount:4];
+  self.queue = dispatch_queue_create("net.hockeyapp.test.timerWheel", DISPATCH_QUEUE_SERIAL);
+}
+
+- (void)testTimeoutsRunOnTheirQueueOnceTheirDelayHasPassed {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"Timeout ran"];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  __block CFAbsoluteTime end = 0;
+  dispatch_queue_set_specific(self.queue, (__bridge void *)self, (__bridge void *)self, NULL);
+  BITTimeoutIdentifier identifier = [self.sut scheduleAfterDelay:0.05 queue:self.queue block:^{
+    XCTAssertTrue(dispatch_get_specific((__bridge void *)self) == (__bridge void *)self);
+    end = CFAbsoluteTimeGetCurrent();
+    [expectation fulfill];
+  }];
+
+  XCTAssertNotEqual(identifier, (BITTimeoutIdentifier)0);
+  XCTAssertEqual(self.sut.pendingTimeoutCount, (NSUInteger)1);
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+  XCTAssertGreaterThanOrEqual(end - start, 0.05);
+  XCTAssertEqual(self.sut.pendingTimeoutCount, (NSUInteger)0);
+}
+
+- (void)testDeadlinesBeyondATurnOfTheWheelRunInOrder {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"Timeouts ran"];
+  expectation.expectedFulfillmentCount = 3;
+  NSMutableArray<NSNumber *> *order = [NSMutableArray new];
+
+  // The wheel turns every 40 ms, so the longest deadline stays in its slot for several turns.
+  for (NSNumber *delay in @[@0.15, @0.03, @0.01]) {
+    [self.sut scheduleAfterDelay:delay.doubleValue queue:self.queue block:^{
+      [order addObject:delay];
+      [expectation fulfill];
+    }];
+  }
+
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+  XCTAssertEqualObjects(order, (@[@0.01, @0.03, @0.15]));
+  XCTAssertEqual(self.sut.scheduledTimeoutCount, (uint64_t)3);
+  XCTAssertEqual(self.sut.timerSourceCreationCount, (uint64_t)1);
+}
+
+- (void)testCancelledTimeoutsDontRun {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"Later timeout ran"];
+  __block BOOL cancelledTimeoutRan = NO;
+  BITTimeoutIdentifier identifier = [self.sut scheduleAfterDelay:0.02 queue:self.queue block:^{
+    cancelledTimeoutRan = YES;
+  }];
+  [self.sut scheduleAfterDelay:0.06 queue:self.queue block:^{
+    [expectation fulfill];
+  }];
+  [self.sut cancelTimeout:identifier];
+  [self.sut cancelTimeout:identifier];
+  [self.sut cancelTimeout:0];
+
+  XCTAssertEqual(self.sut.pendingTimeoutCount, (NSUInteger)1);
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+  XCTAssertFalse(cancelledTimeoutRan);
+}
+
+- (void)testTimerSourcesPerTenThousandEvents {
+  id persistenceMock = OCMClassMock([BITPersistence class]);
+  OCMStub([persistenceMock isFreeSpaceAvailable]).andReturn(YES);
+  BITTelemetryContext *context = [[BITTelemetryContext alloc] initWithAppIdentifier:@"123" persistence:persistenceMock];
+  BITChannel *channel = [[BITChannel alloc] initWithTelemetryContext:context persistence:persistenceMock];
+  BITTimerWheel *wheel = [BITTimerWheel new];
+  channel.timerWheel = wheel;
+  channel.batchingPolicy = [[BITFixedBatchingPolicy alloc] initWithMaxBatchSize:BITTimerBenchmarkBatchSize batchInterval:15];
+
+  // The events are processed in chunks that fit into the item queue, so none of them is dropped.
+  dispatch_sync(channel.dataItemsOperations, ^{
+    for (NSUInteger i = 0; i < BITTimerBenchmarkEventCount; i++) {
+      [channel enqueueEventWithName:@"Screen viewed" properties:nil measurements:nil sampleRate:0];
+      if ((i + 1) % 1000 == 0) {
+        [channel drainItemQueues];
+      }
+    }
+  });
+
+  // Before the wheel, every flush deadline created and cancelled a timer source of its own.
+  uint64_t timerSourcesBefore = wheel.scheduledTimeoutCount;
+  uint64_t timerSourcesAfter = wheel.timerSourceCreationCount;
+  NSLog(@"Timer sources created for %lu events: %llu per batch deadline, %llu with the timer wheel",
+        (unsigned long)BITTimerBenchmarkEventCount, timerSourcesBefore, timerSourcesAfter);
+  XCTAssertEqual(timerSourcesBefore, (uint64_t)(BITTimerBenchmarkEventCount / BITTimerBenchmarkBatchSize));
+  XCTAssertEqual(timerSourcesAfter, (uint64_t)1);
+  XCTAssertEqual(wheel.pendingTimeoutCount, (NSUInteger)0);
+  XCTAssertEqual(channel.flushTimeout, (BITTimeoutIdentifier)0);
+}
+
+@end
@@ -0,0 +1,138 @@
+//
+//  BITTokenPoolTests.m
+//  HockeySDK
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+#import "BITTokenPool.h"
+
+static NSUInteger const BITStressThreadCount = 16;
+static NSUInteger const BITStressIterations = 100000;
+
+@interface BITTokenPoolTests : XCTestCase
+
+@property (nonatomic, assign) BITTokenPool *sut;
+
+@end
+
+@implementation BITTokenPoolTests
+
+- (void)setUp {
+  [super setUp];
+  self.sut = bit_tokenPoolCreate(2);
+}
+
+- (void)tearDown {
+  bit_tokenPoolDestroy(self.sut);
+  self.sut = NULL;
+  [super tearDown];
+}
+
+- (void)testTokensAreLimitedToTheCapacity {
+  XCTAssertTrue(bit_tokenPoolAcquire(self.sut));
+  XCTAssertTrue(bit_tokenPoolAcquire(self.sut));
+  XCTAssertFalse(bit_tokenPoolAcquire(self.sut));
+  XCTAssertEqual(bit_tokenPoolInUse(self.sut), (size_t)2);
+
+  XCTAssertTrue(bit_tokenPoolRelease(self.sut));
+  XCTAssertTrue(bit_tokenPoolAcquire(self.sut));
+  XCTAssertTrue(bit_tokenPoolRelease(self.sut));
+  XCTAssertTrue(bit_tokenPoolRelease(self.sut));
+  XCTAssertEqual(bit_tokenPoolInUse(self.sut), (size_t)0);
+  XCTAssertEqual(bit_tokenPoolPeakInUse(self.sut), (size_t)2);
+}
+
+- (void)testDoubleReleaseIsRejected {
+  XCTAssertTrue(bit_tokenPoolAcquire(self.sut));
+  XCTAssertTrue(bit_tokenPoolRelease(self.sut));
+  XCTAssertFalse(bit_tokenPoolRelease(self.sut));
+  XCTAssertEqual(bit_tokenPoolInUse(self.sut), (size_t)0);
+}
+
+- (void)testShrinkingTheCapacityKeepsTokensInUse {
+  XCTAssertTrue(bit_tokenPoolAcquire(self.sut));
+  XCTAssertTrue(bit_tokenPoolAcquire(self.sut));
+  bit_tokenPoolSetCapacity(self.sut, 1);
+  XCTAssertEqual(bit_tokenPoolCapacity(self.sut), (size_t)1);
+
+  XCTAssertTrue(bit_tokenPoolRelease(self.sut));
+  XCTAssertFalse(bit_tokenPoolAcquire(self.sut));
+  XCTAssertTrue(bit_tokenPoolRelease(self.sut));
+  XCTAssertTrue(bit_tokenPoolAcquire(self.sut));
+}
+
+- (void)testTokensAreNeverOversubscribedUnderContention {
+  bit_tokenPoolSetCapacity(self.sut, 4);
+  BITTokenPool *pool = self.sut;
+
+  // dispatch_apply returns once all threads are done, so the blocks can use the counters on the stack.
+  _Atomic(long) counters[3];
+  _Atomic(long) *holders = &counters[0];
+  _Atomic(long) *oversubscriptions = &counters[1];
+  _Atomic(long) *acquisitions = &counters[2];
+  for (int i = 0; i < 3; i++) {
+    atomic_init(&counters[i], 0);
+  }
+
+  dispatch_apply(BITStressThreadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t __unused thread) {
+    for (NSUInteger i = 0; i < BITStressIterations; i++) {
+      if (bit_tokenPoolAcquire(pool)) {
+        if (atomic_fetch_add(holders, 1) >= 4) {
+          atomic_fetch_add(oversubscriptions, 1);
+        }
+        atomic_fetch_add(acquisitions, 1);
+        atomic_fetch_sub(holders, 1);
+        bit_tokenPoolRelease(pool);
+      }
+    }
+  });
+
+  XCTAssertEqual(atomic_load(oversubscriptions), 0L);
+  XCTAssertGreaterThan(atomic_load(acquisitions), 0L);
+  XCTAssertEqual(bit_tokenPoolInUse(pool), (size_t)0);
+  XCTAssertLessThanOrEqual(bit_tokenPoolPeakInUse(pool), (size_t)4);
+}
+
+- (void)testAcquireReleaseOverheadComparedToQueueGuardedCounter {
+  BITTokenPool *pool = bit_tokenPoolCreate(BITStressThreadCount);
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(BITStressThreadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t __unused thread) {
+    for (NSUInteger i = 0; i < BITStressIterations; i++) {
+      if (bit_tokenPoolAcquire(pool)) {
+        bit_tokenPoolRelease(pool);
+      }
+    }
+  });
+  CFAbsoluteTime poolDuration = CFAbsoluteTimeGetCurrent() - start;
+  bit_tokenPoolDestroy(pool);
+
+  // The counter the sender used before: every read and write is a dispatch_sync onto a concurrent queue, the check and
+  // the increment are two separate blocks.
+  dispatch_queue_t queue = dispatch_queue_create("net.hockeyapp.tests.requestsCount", DISPATCH_QUEUE_CONCURRENT);
+  __block NSUInteger count = 0;
+  start = CFAbsoluteTimeGetCurrent();
+  dispatch_apply(BITStressThreadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t __unused thread) {
+    for (NSUInteger i = 0; i < BITStressIterations; i++) {
+      __block NSUInteger current;
+      dispatch_sync(queue, ^{
+        current = count;
+      });
+      if (current < BITStressThreadCount) {
+        dispatch_sync(queue, ^{
+          count = current + 1;
+        });
+        dispatch_sync(queue, ^{
+          count -= 1;
+        });
+      }
+    }
+  });
+  CFAbsoluteTime queueDuration = CFAbsoluteTimeGetCurrent() - start;
+
+  double operations = (double)(BITStressThreadCount * BITStressIterations);
+  NSLog(@"Acquire and release on %lu threads: token pool %.1f ns, queue guarded counter %.1f ns per pair",
+        (unsigned long)BITStressThreadCount, poolDuration / operations * 1e9, queueDuration / operations * 1e9);
+}
+
+@end